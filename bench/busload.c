@@ -0,0 +1,173 @@
+/**
+ * Cost of the exact wire bit count per frame, table driven against bit by
+ * bit, and of the bus load accounting in the RX path
+ *
+ * Synthetic frames of standard and extended IDs with payloads rich in runs
+ * of equal bits are counted directly, so the benchmark needs no adapter. The
+ * cost is related to a fully loaded 1 Mbit/s bus on both channels
+ */
+#include <ocii_busload.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdio.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define FRAMES 4096
+#define ROUNDS 500
+
+static ocii_busload_t load;
+static ocii_message_t frames[FRAMES];
+
+static uint32_t rng_state = 0x12345678U;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * Reference count, one bit at a time through the CRC and the stuffing
+ */
+static uint32_t bitwise(const ocii_message_t *message) {
+    static uint8_t bits[160];
+    int length = 0, bytes = message->remote          ? 0
+                            : message->data_len < 8 ? message->data_len
+                                                    : 8,
+        last = -1, run = 0;
+    uint32_t stuffed = 0;
+    uint16_t crc = 0;
+
+#define PUT(value, count)                                                      \
+    for (int i = (count) - 1; i >= 0; i--)                                     \
+    bits[length++] = (uint8_t)((value) >> i & 1)
+
+    PUT(0U, 1);
+    if (!message->extended) {
+        PUT(message->can_id, 11);
+        PUT(message->remote, 1);
+        PUT(0U, 2);
+    } else {
+        PUT(message->can_id >> 18, 11);
+        PUT(3U, 2);
+        PUT(message->can_id, 18);
+        PUT(message->remote, 1);
+        PUT(0U, 2);
+    }
+    PUT(message->data_len, 4);
+    for (int j = 0; j < bytes; j++)
+        PUT(message->data[j], 8);
+    for (int i = 0; i < length; i++)
+        crc = (uint16_t)(((crc << 1) ^ ((bits[i] ^ (crc >> 14)) & 1 ? 0x4599
+                                                                    : 0)) &
+                         0x7FFF);
+    PUT(crc, 15);
+#undef PUT
+
+    for (int i = 0; i < length; i++) {
+        if (bits[i] == last)
+            run++;
+        else {
+            last = bits[i];
+            run = 1;
+        }
+        if (run == 5) {
+            stuffed++;
+            last = !last;
+            run = 1;
+        }
+    }
+
+    return (uint32_t)length + stuffed + 13;
+}
+
+int main(void) {
+    ocii_packet_t init = {.timing = {OCIIBR1000000[0], OCIIBR1000000[1]}};
+    uint64_t start, table_us, bitwise_us, hook_us, bits = 0, stuffing = 0;
+    uint32_t checksum = 0, reference = 0, stuff, fewest = UINT32_MAX, most = 0;
+    double mean, share;
+    int error_code;
+
+    for (int i = 0; i < FRAMES; i++) {
+        ocii_message_t *message = &frames[i];
+
+        message->extended = (uint8_t)(rng() % 4 == 0);
+        message->can_id = rng() & (message->extended ? 0x1FFFFFFFU : 0x7FFU);
+        message->data_len = (uint8_t)(rng() % 9);
+        for (int j = 0; j < 8; j++) {
+            uint32_t value = rng();
+
+            message->data[j] = value % 3 == 0   ? 0x00
+                               : value % 3 == 1 ? 0xFF
+                                                : (uint8_t)(value >> 8);
+        }
+
+        bits += ocii_busload_frame_bits(message, &stuff);
+        stuffing += stuff;
+        fewest = stuff < fewest ? stuff : fewest;
+        most = stuff > most ? stuff : most;
+    }
+    mean = (double)bits / FRAMES;
+
+    start = ocii_time_us();
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = 0; i < FRAMES; i++)
+            checksum += ocii_busload_frame_bits(&frames[i], NULL);
+    table_us = ocii_time_us() - start;
+
+    start = ocii_time_us();
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = 0; i < FRAMES; i++)
+            reference += bitwise(&frames[i]);
+    bitwise_us = ocii_time_us() - start;
+
+    if ((error_code = ocii_busload_init(&load)) != OCII_ERROR_NO_ERROR ||
+        (error_code = ocii_busload_set_timing(&load, ocii_channel0, &init)) !=
+            OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(error_code));
+        return -1;
+    }
+    start = ocii_time_us();
+    for (int r = 0; r < ROUNDS; r++)
+        for (int i = 0; i < FRAMES; i++)
+            (void)ocii_busload_rx_hook(&load, ocii_channel0, &frames[i]);
+    hook_us = ocii_time_us() - start;
+
+    /**
+     * A second of back to back frames ends one bucket before now
+     */
+    start = ocii_time_us() / OCII_BUSLOAD_BUCKET_US * OCII_BUSLOAD_BUCKET_US -
+            1000000U - OCII_BUSLOAD_BUCKET_US;
+    for (uint64_t at = 0; at < 1000000U;)
+        for (int i = 0; i < FRAMES && at < 1000000U; i++) {
+            (void)ocii_busload_add(&load, ocii_channel1, &frames[i],
+                                   start + at);
+            at += ocii_busload_frame_bits(&frames[i], NULL);
+        }
+    (void)ocii_busload_set_timing(&load, ocii_channel1, &init);
+    (void)ocii_busload_get(&load, ocii_channel1, 1000000U, ocii_time_us(),
+                           &share);
+
+    (void)fprintf(stdout,
+                  "%d frames: %.1f wire bits on average, %.2f stuff bits on "
+                  "average, %u to %u\n",
+                  FRAMES, mean, (double)stuffing / FRAMES, fewest, most);
+    (void)fprintf(stdout,
+                  "table driven: %.1f ns per frame\nbit by bit:   %.1f ns per "
+                  "frame\n",
+                  (double)table_us * 1000.0 / (ROUNDS * FRAMES),
+                  (double)bitwise_us * 1000.0 / (ROUNDS * FRAMES));
+    (void)fprintf(stdout,
+                  "RX hook: %.1f ns per frame, %.3f%% of a core at full load "
+                  "on both channels\n",
+                  (double)hook_us * 1000.0 / (ROUNDS * FRAMES),
+                  (double)hook_us * 1000.0 / (ROUNDS * FRAMES) * 2 * 1e6 /
+                      mean / 1e7);
+    (void)fprintf(stdout, "back to back frames for 1 s: load %.3f\n", share);
+
+    (void)ocii_busload_deinit(&load);
+
+    return checksum != reference;
+}
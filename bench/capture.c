@@ -0,0 +1,117 @@
+/**
+ * Cost of the trigger capture in the RX path while it is armed, and the
+ * captures it takes
+ *
+ * Synthetic traffic of standard IDs is fed to the RX hook directly, so the
+ * benchmark needs no adapter. Eight predicates are armed on ID and payload,
+ * one of them on a rare value of a signal. The sink only checks the captures,
+ * as the writing happens on a thread of its own either way
+ */
+#include <ocii_capture.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define IDS 64
+#define MESSAGES 10000000
+#define PRE 1000
+#define POST 200
+#define FULL_LOAD 7400 /* 8 byte frames per second at 1 Mbit/s */
+
+static ocii_capture_t capture;
+static ocii_message_t traffic[IDS];
+static uint64_t complete, wrong;
+
+static uint32_t rng_state = 0x12345678U;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * The trigger frame must be 0x123 with 0xA5 in its first byte
+ */
+static int sink(void *user, const ocii_capture_event_t *event) {
+    const ocii_message_t *trigger = &event->frames[event->pre].message;
+
+    (void)user;
+    if (event->pre == PRE && event->count == PRE + 1 + POST)
+        complete++;
+    if (trigger->can_id != 0x123 || trigger->data[0] != 0xA5)
+        wrong++;
+
+    return 0;
+}
+
+static double run(int armed) {
+    ocii_capture_config_t config[ocii_channel_sizeof] = {0};
+    uint64_t start;
+
+    config[ocii_channel0] = (ocii_capture_config_t){
+        .pre = PRE, .post = POST, .matches = armed ? OCII_CAPTURE_TRIGGERS : 0};
+    config[ocii_channel0].gap_us = armed ? 0 : 1000000U;
+    for (int i = 0; i < OCII_CAPTURE_TRIGGERS; i++) {
+        ocii_match_t *match = &config[ocii_channel0].match[i];
+
+        /**
+         * Only the first predicate can fire, the others name IDs that are
+         * never sent
+         */
+        match->can_id = i == 0 ? 0x123 : 0x700U + (uint32_t)i;
+        match->id_mask = 0x7FF;
+        match->data[0] = 0xA5;
+        match->data_mask[0] = 0xFF;
+    }
+
+    if (ocii_capture_init(&capture, config, sink, NULL) != OCII_ERROR_NO_ERROR)
+        return -1.0;
+
+    start = ocii_time_us();
+    for (int i = 0; i < MESSAGES; i++) {
+        ocii_message_t *message = &traffic[rng() % IDS];
+
+        /**
+         * The byte takes 0xA5 on about one message of 0x123 in 2000
+         */
+        message->data[0] = rng() % 2000 == 0 ? 0xA5 : (uint8_t)(rng() % 0xA5);
+        (void)ocii_capture_rx_hook(&capture, ocii_channel0, message);
+    }
+    start = ocii_time_us() - start;
+
+    (void)ocii_capture_deinit(&capture);
+
+    return (double)start * 1000.0 / MESSAGES;
+}
+
+int main(void) {
+    double ns;
+
+    for (int i = 0; i < IDS; i++)
+        traffic[i] = (ocii_message_t){.can_id = 0x100U + (uint32_t)i * 7U,
+                                      .data_len = 8};
+    traffic[5].can_id = 0x123;
+
+    ns = run(0);
+    (void)fprintf(stdout, "recording only: %.1f ns per message\n", ns);
+
+    ns = run(1);
+    (void)fprintf(stdout,
+                  "%d predicates armed: %.1f ns per message, %.3f%% of a "
+                  "core at full load on both channels\n",
+                  OCII_CAPTURE_TRIGGERS, ns, ns * 2 * FULL_LOAD / 1e7);
+    (void)fprintf(stdout,
+                  "%llu captures of %d + 1 + %d frames, %llu complete, %llu "
+                  "missed, %llu with a wrong trigger frame\n",
+                  (unsigned long long)capture.captures, PRE, POST,
+                  (unsigned long long)complete,
+                  (unsigned long long)capture.missed,
+                  (unsigned long long)wrong);
+
+    return wrong != 0 || complete == 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * Stream reduction and cost of change-only delivery
+ *
+ * A minute of synthetic bus traffic with device time stamps is fed to the RX
+ * hook directly, so the benchmark needs no adapter. Most IDs repeat their
+ * payload, some carry slowly moving signals and a few a rolling counter
+ */
+#include <ocii_change.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define IDS 200        /* Those past the static and slow ones carry a counter */
+#define STATIC_IDS 140 /* Same payload all the time */
+#define SLOW_IDS 50    /* A signal that changes every SLOW_EVERY messages */
+#define SLOW_EVERY 100
+#define SECONDS 60
+#define STREAM 400000
+
+static uint32_t rng_state = 0x12345678U;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static ocii_message_t stream[STREAM];
+static int streamed;
+
+/**
+ * Lays out the traffic in arrival order
+ */
+static void generate(void) {
+    static ocii_message_t message[IDS];
+    uint32_t period[IDS], next[IDS], sent[IDS] = {0};
+
+    /**
+     * Periods of 10 to 100 ms, in the 100 us units of the device clock
+     */
+    for (int i = 0; i < IDS; i++) {
+        message[i] = (ocii_message_t){
+            .can_id = i % 4 ? 0x100U + (uint32_t)i : 0x18FF0000U + (uint32_t)i,
+            .extended = i % 4 ? 0 : 1,
+            .time_flag = 1,
+            .data_len = 8};
+        for (int j = 0; j < 8; j++)
+            message[i].data[j] = (uint8_t)rng();
+        period[i] = 100U * (1 + rng() % 10);
+        next[i] = rng() % period[i];
+    }
+
+    for (uint32_t now = 0; now < SECONDS * 10000U; now++)
+        for (int i = 0; i < IDS && streamed < STREAM; i++) {
+            if (next[i] != now)
+                continue;
+            next[i] += period[i];
+
+            message[i].time_stamp = now;
+            if (i >= STATIC_IDS && i < STATIC_IDS + SLOW_IDS &&
+                ++sent[i] % SLOW_EVERY == 0)
+                message[i].data[0]++;
+            else if (i >= STATIC_IDS + SLOW_IDS)
+                message[i].data[7]++;
+            stream[streamed++] = message[i];
+        }
+}
+
+static int run(uint32_t refresh_ms) {
+    static ocii_change_t change;
+    uint64_t out = 0, start;
+    int error_code;
+
+    if ((error_code = ocii_change_init(&change, refresh_ms)) !=
+        OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(error_code));
+        return -1;
+    }
+
+    start = ocii_time_us();
+    for (int i = 0; i < streamed; i++)
+        if (ocii_change_rx_hook(&change, ocii_channel0, &stream[i]) == 0)
+            out++;
+    start = ocii_time_us() - start;
+
+    (void)fprintf(stdout,
+                  "refresh %4u ms: %6d in, %6llu out, %5.1fx smaller, %6llu "
+                  "refreshes, %.1f ns per message\n",
+                  refresh_ms, streamed, (unsigned long long)out,
+                  (double)streamed / (double)out,
+                  (unsigned long long)change.refreshed[ocii_channel0],
+                  (double)start * 1000.0 / (double)streamed);
+
+    return ocii_change_deinit(&change);
+}
+
+int main(void) {
+    int ret;
+
+    generate();
+    (void)fprintf(stdout,
+                  "%d IDs over %d s: %d static, %d changing every %d "
+                  "messages, %d with a counter\n",
+                  IDS, SECONDS, STATIC_IDS, SLOW_IDS, SLOW_EVERY,
+                  IDS - STATIC_IDS - SLOW_IDS);
+
+    ret = run(0);
+    ret |= run(1000);
+    ret |= run(100);
+
+    return ret;
+}
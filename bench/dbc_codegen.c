@@ -0,0 +1,229 @@
+/**
+ * Decoders generated by ocii_dbcgen against hand-written ones and the runtime
+ * DBC engine
+ *
+ * The generated header is made from bench/dbc_codegen.dbc by the Makefile.
+ * The hand-written decoders are what one would write for the same database:
+ * byte loads, shifts and casts per signal. Both decode the same random frames
+ * into the same structs and their results are compared
+ */
+#include <dbc_codegen.h>
+#include <ocii_dbc.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
+
+#define FRAMES 1000000
+#define BATCH 1024
+#define ROUNDS 5
+
+typedef union {
+    sample_engine_data_t engine_data;
+    sample_wheel_speeds_t wheel_speeds;
+    sample_steering_t steering;
+    sample_battery_t battery;
+    sample_imu_t imu;
+    sample_diagnostics_t diagnostics;
+} decoded_t;
+
+decoded_t decoded[BATCH];
+
+static uint32_t rng_state = 0x12345678U;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void hand_engine_data(const uint8_t *d, sample_engine_data_t *o) {
+    o->engine_speed = (double)(d[0] | d[1] << 8) * 0.125;
+    o->coolant_temp = (double)d[2] - 40.0;
+    o->throttle_pos = (double)d[3] * 0.4;
+    o->gear = d[4] & 0x0F;
+    o->torque_request =
+        (double)((int16_t)((d[4] >> 4 | d[5] << 4) << 4) >> 4) * 0.5;
+    o->counter = d[6] & 0x0F;
+    o->checksum = d[7];
+}
+
+static void hand_wheel_speeds(const uint8_t *d, sample_wheel_speeds_t *o) {
+    o->wheel_fl = (double)(d[0] << 8 | d[1]) * 0.01;
+    o->wheel_fr = (double)(d[2] << 8 | d[3]) * 0.01;
+    o->wheel_rl = (double)(d[4] << 8 | d[5]) * 0.01;
+    o->wheel_rr = (double)(d[6] << 8 | d[7]) * 0.01;
+}
+
+static void hand_steering(const uint8_t *d, sample_steering_t *o) {
+    o->angle = (double)(int16_t)(d[0] << 8 | d[1]) * 0.1;
+    o->rate = (uint16_t)(d[2] << 4 | d[3] >> 4);
+    o->counter = d[3] & 0x0F;
+    o->checksum = d[4];
+}
+
+static void hand_battery(const uint8_t *d, sample_battery_t *o) {
+    o->voltage = (double)(d[0] | d[1] << 8) * 0.05;
+    o->current = (double)(int16_t)(d[2] | d[3] << 8) * 0.1;
+    o->state_of_charge = (double)d[4] * 0.5;
+    o->temperature = (int8_t)d[5];
+    o->flags = (uint16_t)(d[6] | d[7] << 8);
+}
+
+static void hand_imu(const uint8_t *d, sample_imu_t *o) {
+    memcpy(&o->yaw_rate, &d[0], sizeof(o->yaw_rate));
+    memcpy(&o->lateral_accel, &d[4], sizeof(o->lateral_accel));
+}
+
+static void hand_diagnostics(const uint8_t *d, sample_diagnostics_t *o) {
+    uint32_t word = (uint32_t)d[1] | (uint32_t)d[2] << 8 |
+                    (uint32_t)d[3] << 16 | (uint32_t)d[4] << 24;
+
+    o->page = d[0];
+    if (d[0] == 0) {
+        o->odometer_km = (double)word * 0.1;
+        o->fuel_level = (double)d[5] * 0.4;
+    } else if (d[0] == 1) {
+        o->operating_hours = word;
+        o->oil_pressure = (double)(int16_t)(d[5] | d[6] << 8) * 0.01;
+    }
+}
+
+static int hand_decode(const ocii_message_t *frame, decoded_t *out) {
+    switch (frame->extended ? frame->can_id | 0x80000000U : frame->can_id) {
+    case 0x100:
+        hand_engine_data(frame->data, &out->engine_data);
+        return sample_engine_data_index;
+    case 0x1A0:
+        hand_wheel_speeds(frame->data, &out->wheel_speeds);
+        return sample_wheel_speeds_index;
+    case 0x250:
+        hand_steering(frame->data, &out->steering);
+        return sample_steering_index;
+    case 0x98FF50E5U:
+        hand_battery(frame->data, &out->battery);
+        return sample_battery_index;
+    case 0x200:
+        hand_imu(frame->data, &out->imu);
+        return sample_imu_index;
+    case 0x300:
+        hand_diagnostics(frame->data, &out->diagnostics);
+        return sample_diagnostics_index;
+    default:
+        return -1;
+    }
+}
+
+static int generated_decode(const ocii_message_t *frame, decoded_t *out) {
+    int index = sample_find(frame->can_id, frame->extended);
+
+    switch (index) {
+    case sample_engine_data_index:
+        sample_engine_data_unpack(frame, &out->engine_data);
+        break;
+    case sample_wheel_speeds_index:
+        sample_wheel_speeds_unpack(frame, &out->wheel_speeds);
+        break;
+    case sample_steering_index:
+        sample_steering_unpack(frame, &out->steering);
+        break;
+    case sample_battery_index:
+        sample_battery_unpack(frame, &out->battery);
+        break;
+    case sample_imu_index:
+        sample_imu_unpack(frame, &out->imu);
+        break;
+    case sample_diagnostics_index:
+        sample_diagnostics_unpack(frame, &out->diagnostics);
+        break;
+    }
+
+    return index;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct {
+        uint32_t can_id;
+        uint8_t extended;
+    } ids[] = {{SAMPLE_ENGINE_DATA_ID, SAMPLE_ENGINE_DATA_EXTENDED},
+               {SAMPLE_WHEEL_SPEEDS_ID, SAMPLE_WHEEL_SPEEDS_EXTENDED},
+               {SAMPLE_STEERING_ID, SAMPLE_STEERING_EXTENDED},
+               {SAMPLE_BATTERY_ID, SAMPLE_BATTERY_EXTENDED},
+               {SAMPLE_IMU_ID, SAMPLE_IMU_EXTENDED},
+               {SAMPLE_DIAGNOSTICS_ID, SAMPLE_DIAGNOSTICS_EXTENDED}};
+    static ocii_message_t frames[FRAMES];
+    static double values[16];
+    const char *path = argc > 1 ? argv[1] : "bench/dbc_codegen.dbc";
+    uint64_t mismatches = 0, start, generated_us, hand_us, engine_us = 0;
+    ocii_dbc_t *db = NULL;
+    int ret;
+
+    for (int f = 0; f < FRAMES; f++) {
+        uint32_t which = rng() % sizeof_arr(ids);
+
+        frames[f] = (ocii_message_t){.can_id = ids[which].can_id,
+                                     .extended = ids[which].extended,
+                                     .data_len = 8};
+        for (int b = 0; b < 8; b++)
+            frames[f].data[b] = (uint8_t)rng();
+        if (which == sample_diagnostics_index)
+            frames[f].data[0] &= 0x01;
+    }
+
+    for (int f = 0; f < FRAMES; f += 7) {
+        decoded_t a, b;
+
+        memset(&a, 0, sizeof(a));
+        memset(&b, 0, sizeof(b));
+        if (generated_decode(&frames[f], &a) != hand_decode(&frames[f], &b) ||
+            memcmp(&a, &b, sizeof(a)) != 0)
+            mismatches++;
+    }
+
+    start = ocii_time_us();
+    for (int round = 0; round < ROUNDS; round++)
+        for (int f = 0; f < FRAMES; f++)
+            (void)generated_decode(&frames[f], &decoded[f % BATCH]);
+    generated_us = ocii_time_us() - start;
+
+    start = ocii_time_us();
+    for (int round = 0; round < ROUNDS; round++)
+        for (int f = 0; f < FRAMES; f++)
+            (void)hand_decode(&frames[f], &decoded[f % BATCH]);
+    hand_us = ocii_time_us() - start;
+
+    /**
+     * The runtime engine for reference, only if the DBC file is at hand
+     */
+    if ((ret = ocii_dbc_load(path, &db, NULL)) == OCII_ERROR_NO_ERROR) {
+        start = ocii_time_us();
+        for (int round = 0; round < ROUNDS; round++)
+            for (int f = 0; f < FRAMES; f++)
+                (void)ocii_dbc_decode_frame(db, &frames[f], values);
+        engine_us = ocii_time_us() - start;
+        ocii_dbc_free(db);
+    } else
+        (void)fprintf(stderr, "%s: %s\n", path,
+                      ocii_error_code_to_string(ret));
+
+    (void)fprintf(stdout, "generated:    %10.0f frames/s\n",
+                  (double)FRAMES * ROUNDS * 1e6 / (double)generated_us);
+    (void)fprintf(stdout, "hand-written: %10.0f frames/s\n",
+                  (double)FRAMES * ROUNDS * 1e6 / (double)hand_us);
+    if (engine_us != 0)
+        (void)fprintf(stdout, "DBC engine:   %10.0f frames/s\n",
+                      (double)FRAMES * ROUNDS * 1e6 / (double)engine_us);
+    (void)fprintf(stdout,
+                  "generated/hand-written %.2f, mismatches %llu\n"
+                  "acceptance filter: code 0x%08X mask 0x%08X\n",
+                  (double)hand_us / (double)generated_us,
+                  (unsigned long long)mismatches, SAMPLE_ACC_CODE,
+                  SAMPLE_ACC_MASK);
+
+    return mismatches == 0 ? 0 : -1;
+}
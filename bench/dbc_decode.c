@@ -0,0 +1,183 @@
+/**
+ * Decode throughput of the DBC engine against a generic bit walking decoder
+ *
+ * A synthetic database with a mix of Intel, Motorola, signed and byte aligned
+ * signals is generated in memory, so the benchmark needs no input files.
+ * Both decoders run over the same frames and their results are compared
+ */
+#include <math.h>
+#include <ocii_dbc.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define MESSAGES 200
+#define FRAMES 1000000
+#define BATCH 1000
+#define ROUNDS 5
+
+static uint32_t rng_state = 0x12345678U;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+/**
+ * Appends one message with signals packed back to back, Motorola signals are
+ * laid out in the sawtooth bit order they use on the wire
+ */
+static size_t generate_message(char *text, size_t size, uint32_t id) {
+    size_t used = (size_t)snprintf(text, size, "BO_ %u MSG_%u: 8 ECU\n", id, id);
+    int motorola = rng() % 2, position = 0, index = 0;
+
+    while (position < 64) {
+        int length = (int)(rng() % 16) + 1, start;
+
+        if (rng() % 4 == 0 && position % 8 == 0 && position + 16 <= 64)
+            length = (rng() % 2 + 1) * 8; /* Byte aligned */
+        if (position + length > 64)
+            length = 64 - position;
+
+        /**
+         * Position counts big endian bits for Motorola, turn it into the
+         * DBC start bit of the MSB
+         */
+        start = motorola ? (position / 8) * 8 + 7 - position % 8 : position;
+
+        used += (size_t)snprintf(
+            text + used, size - used,
+            " SG_ SIG_%u_%d : %d|%d@%d%c (%g,%g) [0|0] \"\" ECU\n", id,
+            index++, start, length, motorola ? 0 : 1, rng() % 3 ? '+' : '-',
+            (double)(rng() % 100 + 1) / 10.0, (double)(rng() % 50));
+        position += length;
+    }
+
+    return used;
+}
+
+/**
+ * The kind of decoder the engine replaces: one bit at a time
+ */
+static double walk_signal(const ocii_dbc_signal_t *signal,
+                          const uint8_t *data) {
+    uint64_t raw = 0;
+    int position = signal->start;
+
+    for (int i = 0; i < signal->length; i++) {
+        uint64_t bit = data[position / 8] >> (position % 8) & 1U;
+
+        if (signal->intel) {
+            raw |= bit << i;
+            position++;
+        } else {
+            raw = raw << 1 | bit;
+            position = position % 8 == 0 ? position + 15 : position - 1;
+        }
+    }
+
+    if (signal->is_signed && signal->length < 64 &&
+        (raw >> (signal->length - 1) & 1U))
+        raw |= UINT64_MAX << signal->length;
+
+    return (signal->is_signed ? (double)(int64_t)raw : (double)raw) *
+               signal->factor +
+           signal->offset;
+}
+
+int main(void) {
+    static char text[MESSAGES * 2048];
+    static ocii_message_t frames[FRAMES];
+    static double expected[64], values[64];
+    ocii_dbc_buffer_t buffer;
+    ocii_dbc_t *db;
+    size_t used = 0;
+    uint64_t signals = 0, mismatches = 0, start, plan_us, walk_us;
+    double sink = 0;
+    int ret;
+
+    for (uint32_t m = 0; m < MESSAGES; m++)
+        used += generate_message(text + used, sizeof(text) - used,
+                                 m % 2 ? 0x100 + m * 3
+                                       : 0x80000000U | (0x18F00000U + m * 7));
+
+    if ((ret = ocii_dbc_parse(text, used, &db, NULL)) != OCII_ERROR_NO_ERROR)
+        goto ocii_leave;
+
+    for (int f = 0; f < FRAMES; f++) {
+        const ocii_dbc_message_t *message = &db->message[rng() % MESSAGES];
+
+        frames[f] = (ocii_message_t){.can_id = message->can_id,
+                                     .extended = message->extended,
+                                     .data_len = 8,
+                                     .time_stamp = (uint32_t)f};
+        for (int b = 0; b < 8; b++)
+            frames[f].data[b] = (uint8_t)rng();
+        signals += message->count;
+    }
+
+    for (int f = 0; f < FRAMES; f += 97) {
+        int index = ocii_dbc_decode_frame(db, &frames[f], values);
+        const ocii_dbc_message_t *message = &db->message[index];
+
+        for (uint32_t s = 0; s < message->count; s++) {
+            expected[s] =
+                walk_signal(&db->signal[message->first + s], frames[f].data);
+            if (fabs(expected[s] - values[s]) > 1e-9 * fabs(expected[s]))
+                mismatches++;
+        }
+    }
+
+    if ((ret = ocii_dbc_buffer_init(db, &buffer, BATCH)) !=
+        OCII_ERROR_NO_ERROR)
+        goto ocii_free;
+
+    start = ocii_time_us();
+    for (int round = 0; round < ROUNDS; round++)
+        for (int f = 0; f < FRAMES; f += BATCH) {
+            ocii_dbc_buffer_reset(db, &buffer);
+            (void)ocii_dbc_decode(db, &frames[f], BATCH, &buffer);
+        }
+    plan_us = ocii_time_us() - start;
+
+    start = ocii_time_us();
+    for (int round = 0; round < ROUNDS; round++)
+        for (int f = 0; f < FRAMES; f++) {
+            const ocii_dbc_message_t *message =
+                &db->message[ocii_dbc_find(db, frames[f].can_id,
+                                           frames[f].extended)];
+
+            for (uint32_t s = 0; s < message->count; s++)
+                sink += walk_signal(&db->signal[message->first + s],
+                                    frames[f].data);
+        }
+    walk_us = ocii_time_us() - start;
+
+    (void)fprintf(stdout, "messages %u, signals %u, %.1f signals per frame\n",
+                  db->messages, db->signals, (double)signals / FRAMES);
+    (void)fprintf(stdout, "plan:     %10.0f frames/s %12.0f signals/s\n",
+                  (double)FRAMES * ROUNDS * 1e6 / (double)plan_us,
+                  (double)signals * ROUNDS * 1e6 / (double)plan_us);
+    (void)fprintf(stdout, "bit walk: %10.0f frames/s %12.0f signals/s\n",
+                  (double)FRAMES * ROUNDS * 1e6 / (double)walk_us,
+                  (double)signals * ROUNDS * 1e6 / (double)walk_us);
+    (void)fprintf(stdout, "speedup %.1fx, mismatches %llu%s\n",
+                  (double)walk_us / (double)plan_us,
+                  (unsigned long long)mismatches, sink == 0.5 ? " " : "");
+
+    ocii_dbc_buffer_free(&buffer);
+    ocii_dbc_free(db);
+
+    return mismatches == 0 ? 0 : -1;
+ocii_free:
+    ocii_dbc_free(db);
+ocii_leave:
+    printf("%s\n", ocii_error_code_to_string(ret));
+    return -1;
+}
@@ -0,0 +1,164 @@
+/**
+ * Channel-to-channel forwarding: ocii_gateway against a hand-written read and
+ * write loop
+ *
+ * No adapter is needed, it runs against the emulated device of sim_device.h.
+ * Every USB transfer costs USB_US and channel 0 receives 0x100 every
+ * PERIOD_US. Both loops remap it to 0x200 on channel 1. The latency is taken
+ * at the emulated device, from the time the message arrived on channel 0 to
+ * the time it was written to channel 1
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ocii_gateway.h>
+#include <opencanalystii.h>
+#include <sim_device.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define USB_US 40
+#define PERIOD_US 500
+#define RUN_US 1000000U
+
+static uint64_t start;
+static uint64_t latency[OCII_GATEWAY_HISTOGRAM];
+static uint64_t received, max_latency;
+
+/**
+ * Records messages arriving on channel 1, the data of the background message
+ * carries its sequence number
+ */
+static void bus(int channel, const ocii_message_t *message, uint64_t now) {
+    uint32_t sequence;
+    uint64_t delay;
+    int bucket = 0;
+
+    if (channel != ocii_channel1 || message->can_id != 0x200)
+        return;
+    memcpy(&sequence, message->data, sizeof(sequence));
+    delay = now - (start + (uint64_t)sequence * PERIOD_US);
+    while (bucket < OCII_GATEWAY_HISTOGRAM - 1 && delay >> bucket != 0)
+        bucket++;
+    latency[bucket]++;
+    if (delay > max_latency)
+        max_latency = delay;
+    received++;
+}
+
+/**
+ * Restarts the traffic with an empty device queue and clean counters
+ */
+static void restart(void) {
+    (void)pthread_mutex_lock(&sim.lock);
+    sim.channel[ocii_channel0].tail = sim.channel[ocii_channel0].head;
+    sim.channel[ocii_channel0].sequence = 0;
+    sim.channel[ocii_channel1].sent = 0;
+    memset(latency, 0, sizeof(latency));
+    received = max_latency = 0;
+    (void)pthread_mutex_unlock(&sim.lock);
+    start = ocii_time_us();
+    sim_background(ocii_channel0, 0x100, PERIOD_US);
+}
+
+static void report(const char *name, uint64_t packets) {
+    uint64_t sum = 0;
+
+    (void)fprintf(stdout,
+                  "%-24s %6llu forwarded in %6llu packets (%.2f per packet), "
+                  "max %llu us\n",
+                  name, (unsigned long long)received,
+                  (unsigned long long)packets,
+                  packets != 0 ? (double)received / (double)packets : 0.0,
+                  (unsigned long long)max_latency);
+    for (int i = 0; i < OCII_GATEWAY_HISTOGRAM; i++) {
+        if (latency[i] == 0)
+            continue;
+        sum += latency[i];
+        (void)fprintf(stdout, "%24s < %6llu us %6llu  %5.1f%%\n", "",
+                      1ULL << i, (unsigned long long)latency[i],
+                      100.0 * (double)sum / (double)received);
+    }
+}
+
+/**
+ * What callers write today: every packet read is written back out
+ */
+static void hand_written(void) {
+    ocii_packet_t packet;
+    uint64_t packets = 0;
+
+    restart();
+    while (ocii_time_us() - start < RUN_US) {
+        if (ocii_read(ocii_channel0, &packet) != OCII_ERROR_NO_ERROR)
+            continue;
+        for (int i = 0; i < packet.count; i++)
+            if (packet.message[i].can_id == 0x100)
+                packet.message[i].can_id = 0x200;
+        if (ocii_write(ocii_channel1, &packet) == OCII_ERROR_NO_ERROR)
+            packets++;
+    }
+    report("ocii_read + ocii_write", packets);
+}
+
+static int gateway(const char *name, uint32_t flush_us, uint32_t rate) {
+    static ocii_gateway_t gw;
+    ocii_gateway_rule_t rule = {.can_id = 0x100,
+                                .from = ocii_channel0,
+                                .action = OCII_GATEWAY_REMAP,
+                                .remap_id = 0x200,
+                                .rate = rate,
+                                .burst = rate != 0 ? 10 : 0};
+    ocii_packet_t packets[16];
+    int error_code;
+
+    if ((error_code = ocii_gateway_init(&gw, OCII_GATEWAY_DROP)) !=
+            OCII_ERROR_NO_ERROR ||
+        (error_code = ocii_gateway_add_rule(&gw, &rule)) < 0) {
+        (void)fprintf(stderr, "%s: %s\n", name,
+                      ocii_error_code_to_string(error_code));
+        return -1;
+    }
+    gw.flush_us = flush_us;
+
+    restart();
+    while (ocii_time_us() - start < RUN_US) {
+        (void)ocii_read_many(ocii_channel0, packets, 16);
+        (void)ocii_gateway_poll(&gw);
+    }
+    report(name, gw.stats.packets);
+    if (rate != 0)
+        (void)fprintf(stdout, "%24s %llu limited\n", "",
+                      (unsigned long long)gw.stats.limited);
+
+    return ocii_gateway_deinit(&gw);
+}
+
+int main(void) {
+    int ret;
+
+    sim_usb_us = USB_US;
+    sim_tx_handler = bus;
+    if ((ret = ocii_open_device()) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(ret));
+        return -1;
+    }
+    (void)ocii_start(ocii_channel0);
+    (void)ocii_start(ocii_channel1);
+
+    (void)fprintf(stdout,
+                  "emulated device: %d us per transfer, a message every %d "
+                  "us\n",
+                  USB_US, PERIOD_US);
+
+    hand_written();
+    ret = gateway("gateway", 0, 0);
+    ret |= gateway("gateway, flush 1 ms", 1000, 0);
+    ret |= gateway("gateway, limit 500/s", 1000, 500);
+
+    (void)ocii_close_device();
+
+    return ret;
+}
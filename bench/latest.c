@@ -0,0 +1,143 @@
+/**
+ * Latest-value lookups from several threads while the RX path keeps writing:
+ * the sequence-locked table against a map behind one mutex
+ *
+ * The RX hook is fed with synthetic traffic directly, so the benchmark needs
+ * no adapter. Every byte of a payload is the low byte of the message count of
+ * its ID, so readers can tell a torn copy
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ocii_latest.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define IDS 200
+#define RUN_US 1000000U
+#define READERS_MAX 4
+
+static ocii_latest_t latest;
+static atomic_int running;
+static atomic_long reads, torn;
+static int locked;
+
+/**
+ * What consumers use today, one map behind one mutex
+ */
+static struct {
+    pthread_mutex_t lock;
+    ocii_latest_entry_t entry[ocii_channel_sizeof][2048];
+} mutex_map = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void mutex_map_put(int channel, const ocii_message_t *message) {
+    ocii_latest_entry_t *entry = &mutex_map.entry[channel][message->can_id];
+
+    (void)pthread_mutex_lock(&mutex_map.lock);
+    entry->message = *message;
+    entry->channel = (uint8_t)channel;
+    entry->time_us = ocii_time_us();
+    entry->count++;
+    (void)pthread_mutex_unlock(&mutex_map.lock);
+}
+
+static int mutex_map_get(int channel, uint32_t can_id,
+                         ocii_latest_entry_t *entry) {
+    (void)pthread_mutex_lock(&mutex_map.lock);
+    *entry = mutex_map.entry[channel][can_id];
+    (void)pthread_mutex_unlock(&mutex_map.lock);
+
+    return entry->count != 0 ? OCII_ERROR_NO_ERROR : OCII_ERROR_BUFFER_EMPTY;
+}
+
+static void *reader(void *arg) {
+    ocii_latest_entry_t entry;
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+    long count = 0;
+
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        int channel;
+
+        id = (id * 1103515245U + 12345U) % IDS;
+        channel = (int)(id & 1);
+        if ((locked ? mutex_map_get(channel, 0x100 + id, &entry)
+                    : ocii_latest_get(&latest, channel, 0x100 + id, 0,
+                                      &entry)) != OCII_ERROR_NO_ERROR)
+            continue;
+        if (entry.message.data[0] != entry.message.data[7] ||
+            entry.message.data[0] != (uint8_t)entry.count)
+            atomic_fetch_add(&torn, 1);
+        count++;
+    }
+    atomic_fetch_add(&reads, count);
+
+    return NULL;
+}
+
+static void run(int mutex, int readers) {
+    static ocii_message_t message[IDS];
+    static uint64_t rounds[2]; /* Per table, the count of every ID */
+    pthread_t thread[READERS_MAX];
+    uint64_t start, written = 0;
+
+    locked = mutex;
+    atomic_store(&reads, 0);
+    atomic_store(&running, 1);
+    for (int i = 0; i < IDS; i++)
+        message[i] = (ocii_message_t){.can_id = 0x100U + (uint32_t)i,
+                                      .data_len = 8};
+    for (int i = 0; i < readers; i++)
+        (void)pthread_create(&thread[i], NULL, reader,
+                             (void *)(uintptr_t)(i + 1));
+
+    start = ocii_time_us();
+    while (ocii_time_us() - start < RUN_US) {
+        rounds[mutex]++;
+        for (int i = 0; i < IDS; i++, written++) {
+            int channel = i & 1;
+
+            memset(message[i].data, (uint8_t)rounds[mutex],
+                   sizeof(message[i].data));
+            if (mutex)
+                mutex_map_put(channel, &message[i]);
+            else
+                (void)ocii_latest_rx_hook(&latest, (ocii_channel_t)channel,
+                                          &message[i]);
+        }
+    }
+
+    atomic_store(&running, 0);
+    for (int i = 0; i < readers; i++)
+        (void)pthread_join(thread[i], NULL);
+
+    (void)fprintf(stdout,
+                  "%-9s %d readers: %6.2f M writes/s, %6.2f M reads/s\n",
+                  mutex ? "mutex map" : "seqlock", readers,
+                  (double)written / RUN_US, (double)atomic_load(&reads) / RUN_US);
+}
+
+int main(void) {
+    ocii_latest_entry_t entries[IDS];
+    int error_code;
+
+    if ((error_code = ocii_latest_init(&latest)) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(error_code));
+        return -1;
+    }
+
+    for (int readers = 1; readers <= READERS_MAX; readers *= 2) {
+        run(1, readers);
+        run(0, readers);
+    }
+
+    (void)fprintf(stdout, "%ld torn reads, snapshot of %d IDs\n",
+                  atomic_load(&torn),
+                  ocii_latest_snapshot(&latest, entries, IDS));
+
+    return ocii_latest_deinit(&latest);
+}
@@ -0,0 +1,166 @@
+/**
+ * Status monitor of the I/O thread: RX latency with status polls interleaved
+ * at different rates, and how soon a degrading channel is reported
+ *
+ * No adapter is needed, it runs against the emulated device of sim_device.h.
+ * Every USB transfer costs USB_US and channel 0 receives 0x100 every
+ * PERIOD_US. The transmit error counter of channel 1 rises by STEP every
+ * STEP_US, through warning and error passive to bus-off, and drops back to 0
+ * after that. RX latency is taken from the time the device received a
+ * message to the time ocii_read_wait returned it. Detection latency is taken
+ * from a change of the emulated state to the event of the monitor
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ocii_monitor.h>
+#include <opencanalystii.h>
+#include <sim_device.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define USB_US 40
+#define PERIOD_US 500
+#define RUN_US 1000000U
+#define STEP 16
+#define STEP_US 25000U
+
+static uint64_t latency[RUN_US / PERIOD_US + 16];
+static atomic_uint_least64_t changed; /* When the emulated state changed */
+static uint64_t detected, detection_us;
+static int received;
+
+static void event(void *user, const ocii_monitor_event_t *event) {
+    (void)user;
+    if (!(event->changes & OCII_MONITOR_STATE))
+        return;
+    detected++;
+    detection_us += event->current.time_us - atomic_load(&changed);
+}
+
+static int compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Emulated transceiver fault on channel 1, one counter step per call
+ */
+static void degrade(uint32_t *te) {
+    ocii_packet_t status = {0};
+    ocii_monitor_state_t before, after;
+
+    (void)pthread_mutex_lock(&sim.lock);
+    status = sim.channel[ocii_channel1].status;
+    before = ocii_monitor_classify(&status);
+    *te = *te >= 256 ? 0 : *te + STEP;
+    status.reg_te_counter = *te < 256 ? *te : 127;
+    status.reg_status = *te >= 256 ? OCII_MONITOR_STATUS_BUS_OFF : 0;
+    after = ocii_monitor_classify(&status);
+    sim.channel[ocii_channel1].status = status;
+    if (before != after)
+        atomic_store(&changed, ocii_time_us());
+    (void)pthread_mutex_unlock(&sim.lock);
+}
+
+static int run(const char *name, uint32_t period_ms) {
+    static ocii_monitor_t monitor;
+    ocii_monitor_summary_t summary;
+    ocii_packet_t packet;
+    uint64_t start, next_step;
+    uint32_t te = 0;
+    int error_code;
+
+    if ((error_code = ocii_monitor_init(&monitor, event, NULL)) !=
+        OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(error_code));
+        return -1;
+    }
+    (void)ocii_set_status_period(period_ms);
+
+    (void)pthread_mutex_lock(&sim.lock);
+    sim.channel[ocii_channel0].tail = sim.channel[ocii_channel0].head;
+    sim.channel[ocii_channel0].sequence = 0;
+    memset(&sim.channel[ocii_channel1].status, 0,
+           sizeof(sim.channel[ocii_channel1].status));
+    (void)pthread_mutex_unlock(&sim.lock);
+    while (ocii_read(ocii_channel0, &packet) == OCII_ERROR_NO_ERROR)
+        ;
+    received = 0;
+    detected = detection_us = 0;
+
+    start = ocii_time_us();
+    next_step = start + STEP_US;
+    sim_background(ocii_channel0, 0x100, PERIOD_US);
+
+    while (ocii_time_us() - start < RUN_US) {
+        if (ocii_time_us() >= next_step) {
+            degrade(&te);
+            next_step += STEP_US;
+        }
+        if (ocii_read_wait(ocii_channel0, &packet, ocii_time_us() + 2000U) !=
+            OCII_ERROR_NO_ERROR)
+            continue;
+        for (int i = 0; i < packet.count; i++) {
+            uint32_t sequence;
+
+            if (received == (int)(sizeof(latency) / sizeof(latency[0])))
+                break;
+            memcpy(&sequence, packet.message[i].data, sizeof(sequence));
+            latency[received++] = ocii_time_us() - start -
+                                  (uint64_t)sequence * PERIOD_US;
+        }
+    }
+    sim_background(ocii_channel0, 0x100, 0);
+    (void)ocii_set_status_period(0);
+
+    (void)ocii_monitor_summary(&monitor, ocii_channel1, &summary);
+    qsort(latency, (size_t)received, sizeof(latency[0]), compare);
+    (void)fprintf(stdout,
+                  "%-18s rx p50 %4llu us  p99 %4llu us  max %5llu us  "
+                  "%5llu polls  %2llu state changes",
+                  name, (unsigned long long)latency[received / 2],
+                  (unsigned long long)latency[received * 99 / 100],
+                  (unsigned long long)latency[received - 1],
+                  (unsigned long long)summary.polls,
+                  (unsigned long long)detected);
+    if (detected != 0)
+        (void)fprintf(stdout, ", detected after %llu us on average",
+                      (unsigned long long)(detection_us / detected));
+    (void)fprintf(stdout, "\n");
+
+    return ocii_monitor_deinit(&monitor);
+}
+
+int main(void) {
+    int ret;
+
+    sim_usb_us = USB_US;
+    if ((ret = ocii_open_device()) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(ret));
+        return -1;
+    }
+    (void)ocii_start(ocii_channel0);
+    (void)ocii_start(ocii_channel1);
+    (void)ocii_start_io_thread();
+
+    (void)fprintf(stdout,
+                  "emulated device: %d us per transfer, a message every %d "
+                  "us, a counter step every %u ms\n",
+                  USB_US, PERIOD_US, STEP_US / 1000U);
+
+    ret = run("no status polls", 0);
+    ret |= run("polls every 100 ms", 100);
+    ret |= run("polls every 10 ms", 10);
+    ret |= run("polls every 1 ms", 1);
+
+    (void)ocii_stop_io_thread();
+    (void)ocii_close_device();
+
+    return ret;
+}
@@ -0,0 +1,89 @@
+/**
+ * Open and reopen latency of the device with a fresh libusb context every
+ * time and with a held one, by vendor and product ID and by port path
+ *
+ * No adapter is needed, it runs against the emulated device of sim_device.h.
+ * libusb_init scans the buses, which costs ENUMERATE_US, about what a real
+ * scan takes on a desktop machine, and every USB transfer costs USB_US. Each
+ * open is followed by ocii_close_device
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <opencanalystii.h>
+#include <sim_device.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define USB_US 40
+#define ENUMERATE_US 100
+#define OPENS 200
+
+static const uint8_t ports[] = {4}; /* The emulated adapter is on 1-4 */
+
+static uint64_t took[OPENS];
+
+static int compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int open_any(void) { return ocii_open_device(); }
+
+static int open_path(void) {
+    return ocii_open_device_path(1, ports, sizeof(ports));
+}
+
+static int run(const char *name, int (*open)(void)) {
+    uint64_t total = 0;
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    for (int i = 0; i < OPENS && error_code == OCII_ERROR_NO_ERROR; i++) {
+        uint64_t start = ocii_time_us();
+
+        if ((error_code = open()) == OCII_ERROR_NO_ERROR)
+            (void)ocii_close_device();
+        took[i] = ocii_time_us() - start;
+        total += took[i];
+    }
+
+    if (error_code != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s: %s\n", name,
+                      ocii_error_code_to_string(error_code));
+        return -1;
+    }
+
+    qsort(took, OPENS, sizeof(took[0]), compare);
+    (void)fprintf(stdout,
+                  "%-26s mean %7.1f us  p50 %5llu us  max %5llu us\n", name,
+                  (double)total / OPENS, (unsigned long long)took[OPENS / 2],
+                  (unsigned long long)took[OPENS - 1]);
+
+    return 0;
+}
+
+int main(void) {
+    int ret;
+
+    sim_usb_us = USB_US;
+    sim_enumerate_us = ENUMERATE_US;
+
+    (void)fprintf(stdout,
+                  "emulated device: %d us per bus scan, %d us per transfer, "
+                  "%d opens each\n",
+                  ENUMERATE_US, USB_US, OPENS);
+
+    ret = run("fresh context", open_any);
+    ret |= run("fresh context, by path", open_path);
+
+    if (ocii_hold_context() != OCII_ERROR_NO_ERROR)
+        return -1;
+    ret |= run("held context", open_any);
+    ret |= run("held context, by path", open_path);
+
+    return ocii_release_context() != OCII_ERROR_NO_ERROR ? -1 : ret;
+}
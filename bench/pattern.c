@@ -0,0 +1,164 @@
+/**
+ * Frames per second through 1000 payload rules, compiled into per-ID groups
+ * against a linear scan of the rule list after each read
+ *
+ * Synthetic traffic of 400 IDs is matched directly, so the benchmark needs no
+ * adapter. 100 of the IDs carry rules: 90 IDs have 5 rules each on single
+ * bytes, 10 fault code IDs have 55 rules each on a 3-byte code
+ */
+#include <ocii_pattern.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define IDS 400
+#define RULES 1000
+#define FAULT_IDS 10
+#define FAULT_RULES 55
+#define MESSAGES 4000000
+
+static ocii_pattern_rule_t rules[RULES];
+static ocii_message_t traffic[IDS];
+static uint64_t fired;
+
+static uint32_t rng_state = 0x12345678U;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void callback(void *user, int rule, ocii_channel_t channel,
+                     const ocii_message_t *message) {
+    (void)user;
+    (void)rule;
+    (void)channel;
+    (void)message;
+    fired++;
+}
+
+/**
+ * How the application matched before, every rule for every frame
+ */
+static int scan(const ocii_message_t *message) {
+    int matched = 0;
+
+    for (int r = 0; r < RULES; r++) {
+        const ocii_pattern_rule_t *rule = &rules[r];
+        int match = rule->can_id == message->can_id &&
+                    rule->extended == message->extended;
+
+        for (int i = 0; i < 8 && match; i++)
+            match = ((message->data[i] ^ rule->data[i]) &
+                     rule->data_mask[i]) == 0;
+        if (match) {
+            callback(rule->user, r, ocii_channel0, message);
+            matched++;
+        }
+    }
+
+    return matched;
+}
+
+static void generate(void) {
+    int r = 0;
+
+    for (int i = 0; i < IDS; i++)
+        traffic[i] = (ocii_message_t){
+            .can_id = i % 2 ? 0x18FEF000U + (uint32_t)i : 0x100U + (uint32_t)i,
+            .extended = i % 2 ? 1 : 0,
+            .data_len = 8};
+
+    for (int i = 0; i < FAULT_IDS; i++)
+        for (int j = 0; j < FAULT_RULES; j++, r++) {
+            rules[r] = (ocii_pattern_rule_t){.can_id = traffic[i].can_id,
+                                             .extended = traffic[i].extended,
+                                             .callback = callback};
+            rules[r].data[2] = (uint8_t)j;
+            rules[r].data[3] = (uint8_t)(j * 7);
+            rules[r].data[4] = 0x1F;
+            memset(&rules[r].data_mask[2], 0xFF, 3);
+        }
+
+    for (int i = FAULT_IDS; r < RULES; i++)
+        for (int j = 0; j < 5 && r < RULES; j++, r++) {
+            rules[r] = (ocii_pattern_rule_t){.can_id = traffic[i].can_id,
+                                             .extended = traffic[i].extended,
+                                             .callback = callback};
+            rules[r].data[j] = 0xFF;
+            rules[r].data_mask[j] = 0xFF;
+        }
+}
+
+/**
+ * Fault code IDs carry one of their codes on one frame in four, the other
+ * IDs hit a rule byte on one frame in 64
+ */
+static void next_frame(ocii_message_t *message, int id) {
+    uint32_t value = rng();
+
+    memset(message->data, (uint8_t)(value & 0x7F), sizeof(message->data));
+    if (id < FAULT_IDS && value >> 30 == 0) {
+        int j = (int)((value >> 8) % FAULT_RULES);
+
+        message->data[2] = (uint8_t)j;
+        message->data[3] = (uint8_t)(j * 7);
+        message->data[4] = 0x1F;
+    } else if (value >> 26 == 0)
+        message->data[(value >> 8) % 8] = 0xFF;
+}
+
+int main(void) {
+    ocii_pattern_t *pattern;
+    uint64_t start, scanned_us, matched_us, scanned, matched = 0;
+    int error_code;
+
+    generate();
+    if ((error_code = ocii_pattern_compile(rules, RULES, &pattern)) !=
+        OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(error_code));
+        return -1;
+    }
+
+    start = ocii_time_us();
+    for (int i = 0; i < MESSAGES; i++) {
+        int id = (int)(rng() % IDS);
+
+        next_frame(&traffic[id], id);
+        (void)scan(&traffic[id]);
+    }
+    scanned_us = ocii_time_us() - start;
+    scanned = fired;
+
+    rng_state = 0x12345678U;
+    fired = 0;
+    start = ocii_time_us();
+    for (int i = 0; i < MESSAGES; i++) {
+        int id = (int)(rng() % IDS);
+
+        next_frame(&traffic[id], id);
+        matched += (uint64_t)ocii_pattern_match(pattern, ocii_channel0,
+                                                &traffic[id]);
+    }
+    matched_us = ocii_time_us() - start;
+
+    (void)fprintf(stdout,
+                  "%d rules in %u ID groups, %d frames of %d IDs\n"
+                  "linear scan: %10.0f frames/s, %llu matches\n"
+                  "compiled:    %10.0f frames/s, %llu matches, %.0fx\n",
+                  RULES, pattern->groups, MESSAGES, IDS,
+                  MESSAGES * 1e6 / (double)scanned_us,
+                  (unsigned long long)scanned,
+                  MESSAGES * 1e6 / (double)matched_us,
+                  (unsigned long long)matched,
+                  (double)scanned_us / (double)matched_us);
+
+    ocii_pattern_free(pattern);
+
+    return matched != scanned || fired != matched;
+}
@@ -0,0 +1,156 @@
+/**
+ * Hot-unplug and reconnection: how soon a removed adapter is noticed, how
+ * long the channel replay takes once it is back, and what happens to the
+ * messages sent in the meantime
+ *
+ * No adapter is needed, it runs against the emulated device of sim_device.h.
+ * Every USB transfer costs USB_US and channel 0 receives a numbered message
+ * every PERIOD_US. The adapter is pulled for OUTAGE_US every CYCLE_US and
+ * comes back with its channels stopped. Channel 1 writes through write
+ * combining every WRITE_US all along. Outage is taken from the replug to the
+ * first message read after it
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <sim_device.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define USB_US 40
+#define PERIOD_US 500
+#define CYCLE_US 300000U
+#define OUTAGE_US 100000U
+#define WRITE_US 20000U
+#define CYCLES 10
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static ocii_reconnect_event_t removed, resumed;
+static int removals, resumes;
+
+static void hook(void *user, const ocii_reconnect_event_t *event) {
+    (void)user;
+    (void)pthread_mutex_lock(&lock);
+    if (event->event == OCII_RECONNECT_REMOVED) {
+        removed = *event;
+        removals++;
+    } else {
+        resumed = *event;
+        resumes++;
+    }
+    (void)pthread_mutex_unlock(&lock);
+}
+
+int main(void) {
+    ocii_packet_t init = {.acc_code = 0x00,
+                          .acc_mask = 0xFFFFFFFF,
+                          .filter = 0x01,
+                          .timing = {[0] = OCIIBR500000[0],
+                                     [1] = OCIIBR500000[1]},
+                          .mode = 0x00};
+    uint64_t noticed = 0, found = 0, replay = 0, outage = 0, outage_max = 0;
+    uint64_t accepted = 0, rejected = 0, sent = 0;
+    int ret;
+
+    sim_usb_us = USB_US;
+    if ((ret = ocii_open_device()) != OCII_ERROR_NO_ERROR ||
+        (ret = ocii_init(ocii_channel0, &init)) != OCII_ERROR_NO_ERROR ||
+        (ret = ocii_init(ocii_channel1, &init)) != OCII_ERROR_NO_ERROR ||
+        (ret = ocii_start(ocii_channel0)) != OCII_ERROR_NO_ERROR ||
+        (ret = ocii_start(ocii_channel1)) != OCII_ERROR_NO_ERROR ||
+        (ret = ocii_set_write_combining(ocii_channel1, 5000U)) !=
+            OCII_ERROR_NO_ERROR ||
+        (ret = ocii_start_io_thread()) != OCII_ERROR_NO_ERROR ||
+        (ret = ocii_start_reconnect(hook, NULL)) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(ret));
+        return -1;
+    }
+
+    (void)fprintf(stdout,
+                  "emulated device: %d us per transfer, a message every %d "
+                  "us, pulled for %u ms every %u ms\n",
+                  USB_US, PERIOD_US, OUTAGE_US / 1000U, CYCLE_US / 1000U);
+
+    sim_background(ocii_channel0, 0x100, PERIOD_US);
+
+    for (int cycle = 0; cycle < CYCLES; cycle++) {
+        uint64_t start = ocii_time_us(), pulled = 0, plugged = 0, next_write;
+        ocii_packet_t packet;
+        int waiting = 0;
+
+        next_write = start;
+        while (ocii_time_us() - start < CYCLE_US) {
+            uint64_t now = ocii_time_us();
+
+            if (now >= next_write) {
+                ocii_packet_t tx = {.count = 1};
+
+                tx.message[0] = (ocii_message_t){.can_id = 0x200,
+                                                 .data_len = 8};
+                if (ocii_write(ocii_channel1, &tx) == OCII_ERROR_NO_ERROR)
+                    accepted++;
+                else
+                    rejected++;
+                next_write += WRITE_US;
+            }
+            if (now - start >= CYCLE_US / 3 && plugged == 0 && !waiting) {
+                sim_plug(0);
+                pulled = ocii_time_us();
+                waiting = 1;
+            } else if (waiting && plugged == 0 &&
+                       now - pulled >= OUTAGE_US) {
+                sim_plug(1);
+                plugged = ocii_time_us();
+            }
+
+            if (ocii_read_wait(ocii_channel0, &packet,
+                               ocii_time_us() + 2000U) !=
+                    OCII_ERROR_NO_ERROR ||
+                packet.count == 0 || plugged == 0 || !waiting)
+                continue;
+
+            now = ocii_time_us() - plugged;
+            outage += now;
+            if (now > outage_max)
+                outage_max = now;
+            waiting = 0;
+        }
+
+        (void)pthread_mutex_lock(&lock);
+        noticed += removed.removed_us - pulled;
+        found += resumed.arrived_us - plugged;
+        replay += resumed.resumed_us - resumed.arrived_us;
+        (void)pthread_mutex_unlock(&lock);
+    }
+    sim_background(ocii_channel0, 0x100, 0);
+    (void)ocii_write_flush(ocii_channel1);
+
+    (void)pthread_mutex_lock(&sim.lock);
+    sent = sim.channel[ocii_channel1].sent;
+    (void)pthread_mutex_unlock(&sim.lock);
+
+    (void)fprintf(stdout,
+                  "%d/%d removals, %d/%d resumes, removal noticed after %llu "
+                  "us, found %llu us after the replug, replay %llu us\n",
+                  removals, CYCLES, resumes, CYCLES,
+                  (unsigned long long)(noticed / CYCLES),
+                  (unsigned long long)(found / CYCLES),
+                  (unsigned long long)(replay / CYCLES));
+    (void)fprintf(stdout,
+                  "first message %llu us after the replug (max %llu us)\n",
+                  (unsigned long long)(outage / CYCLES),
+                  (unsigned long long)outage_max);
+    (void)fprintf(stdout,
+                  "TX: %llu messages accepted, %llu rejected while removed, "
+                  "%llu delivered\n",
+                  (unsigned long long)accepted, (unsigned long long)rejected,
+                  (unsigned long long)sent);
+
+    (void)ocii_close_device();
+
+    return removals == CYCLES && resumes == CYCLES ? 0 : -1;
+}
@@ -0,0 +1,154 @@
+/**
+ * Automatic bus-off recovery: how long a channel is off the bus and how many
+ * frames it loses, at different status poll periods
+ *
+ * No adapter is needed, it runs against the emulated device of sim_device.h.
+ * Every USB transfer costs USB_US and channel 0 receives a numbered message
+ * every PERIOD_US. Every FAULT_US the emulated controller goes bus-off, from
+ * then on it misses the messages until it is initialized again. Recovery
+ * time is taken by the module from the poll that saw bus-off to the restart.
+ * Outage is taken from the fault to the first message read after it, and
+ * lost frames are the gaps in the numbering
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ocii_recovery.h>
+#include <opencanalystii.h>
+#include <sim_device.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define USB_US 40
+#define PERIOD_US 200
+#define FAULT_US 50000U
+#define FAULTS 20
+
+static atomic_uint_least64_t faulted; /* When the emulated fault began */
+static uint64_t detection_us;
+
+static void event(void *user, const ocii_recovery_event_t *event) {
+    (void)user;
+    detection_us += event->detected_us - atomic_load(&faulted);
+}
+
+static void fault(void) {
+    (void)pthread_mutex_lock(&sim.lock);
+    (void)sim_pending(ocii_channel0, ocii_time_us());
+    sim.channel[ocii_channel0].status.reg_status = 0xC0; /* Bus-off, warning */
+    sim.channel[ocii_channel0].status.reg_te_counter = 255;
+    atomic_store(&faulted, ocii_time_us());
+    (void)pthread_mutex_unlock(&sim.lock);
+}
+
+static int run(const char *name, uint32_t period_ms, int clear_rx) {
+    static ocii_recovery_t recovery;
+    ocii_recovery_stats_t stats;
+    ocii_packet_t packet;
+    uint64_t start, next_fault, outage = 0, outage_max = 0, lost = 0;
+    uint32_t expected = 0;
+    int error_code, faults = 0, pending = 0;
+
+    if ((error_code = ocii_recovery_init(&recovery, clear_rx, 0, event,
+                                         NULL)) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(error_code));
+        return -1;
+    }
+    (void)ocii_set_status_period(period_ms);
+
+    (void)pthread_mutex_lock(&sim.lock);
+    sim.channel[ocii_channel0].tail = sim.channel[ocii_channel0].head;
+    sim.channel[ocii_channel0].sequence = 0;
+    memset(&sim.channel[ocii_channel0].status, 0,
+           sizeof(sim.channel[ocii_channel0].status));
+    (void)pthread_mutex_unlock(&sim.lock);
+    while (ocii_read(ocii_channel0, &packet) == OCII_ERROR_NO_ERROR)
+        ;
+    detection_us = 0;
+
+    start = ocii_time_us();
+    next_fault = start + FAULT_US / 2;
+    sim_background(ocii_channel0, 0x100, PERIOD_US);
+
+    while (ocii_time_us() - start < (FAULTS + 1) * (uint64_t)FAULT_US) {
+        if (faults < FAULTS && ocii_time_us() >= next_fault) {
+            fault();
+            faults++;
+            pending = 1;
+            next_fault += FAULT_US;
+        }
+        if (ocii_read_wait(ocii_channel0, &packet, ocii_time_us() + 2000U) !=
+            OCII_ERROR_NO_ERROR)
+            continue;
+        for (int i = 0; i < packet.count; i++) {
+            uint32_t sequence;
+
+            memcpy(&sequence, packet.message[i].data, sizeof(sequence));
+            if (sequence != expected && pending) {
+                uint64_t elapsed = ocii_time_us() - atomic_load(&faulted);
+
+                outage += elapsed;
+                if (elapsed > outage_max)
+                    outage_max = elapsed;
+                pending = 0;
+            }
+            lost += sequence - expected;
+            expected = sequence + 1;
+        }
+    }
+    sim_background(ocii_channel0, 0x100, 0);
+    (void)ocii_set_status_period(0);
+
+    (void)ocii_recovery_stats(&recovery, ocii_channel0, &stats);
+    (void)fprintf(stdout,
+                  "%-28s %2llu/%d recovered  detected after %5llu us  "
+                  "recovery %4llu us (max %4llu)  outage %5llu us (max "
+                  "%5llu)  %4.1f frames lost\n",
+                  name, (unsigned long long)stats.recoveries, FAULTS,
+                  (unsigned long long)(detection_us / FAULTS),
+                  (unsigned long long)(stats.recoveries != 0
+                                           ? stats.total_us / stats.recoveries
+                                           : 0),
+                  (unsigned long long)stats.max_us,
+                  (unsigned long long)(outage / FAULTS),
+                  (unsigned long long)outage_max, (double)lost / FAULTS);
+
+    return ocii_recovery_deinit(&recovery);
+}
+
+int main(void) {
+    ocii_packet_t init = {.acc_code = 0x00,
+                          .acc_mask = 0xFFFFFFFF,
+                          .filter = 0x01,
+                          .timing = {[0] = OCIIBR500000[0],
+                                     [1] = OCIIBR500000[1]},
+                          .mode = 0x00};
+    int ret;
+
+    sim_usb_us = USB_US;
+    if ((ret = ocii_open_device()) != OCII_ERROR_NO_ERROR ||
+        (ret = ocii_init(ocii_channel0, &init)) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(ret));
+        return -1;
+    }
+    (void)ocii_start(ocii_channel0);
+    (void)ocii_start_io_thread();
+
+    (void)fprintf(stdout,
+                  "emulated device: %d us per transfer, a message every %d "
+                  "us, bus-off every %u ms\n",
+                  USB_US, PERIOD_US, FAULT_US / 1000U);
+
+    ret = run("polls every 10 ms", 10, 0);
+    ret |= run("polls every 10 ms, clear RX", 10, 1);
+    ret |= run("polls every 1 ms", 1, 0);
+    ret |= run("polls every 1 ms, clear RX", 1, 1);
+
+    (void)ocii_stop_io_thread();
+    (void)ocii_close_device();
+
+    return ret;
+}
@@ -0,0 +1,122 @@
+/**
+ * Service restarts: reopening the device and configuring channel 0 again
+ * with ocii_init and ocii_start, or with ocii_ensure_configured
+ *
+ * No adapter is needed, it runs against the emulated device of sim_device.h.
+ * Every USB transfer costs USB_US and channel 0 receives a message every
+ * PERIOD_US. The emulated controller misses them from INIT to START, which
+ * stands for the time a reset keeps a real one off the bus. Every restart
+ * closes the device, reopens it and restores the record saved with
+ * ocii_get_config, as a new process would
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <opencanalystii.h>
+#include <sim_device.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define USB_US 40
+#define PERIOD_US 50
+#define RESTARTS 100
+
+static int init_start(ocii_channel_t channel, ocii_packet_t *init) {
+    int error_code;
+
+    if ((error_code = ocii_init(channel, init)) != OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    return ocii_start(channel);
+}
+
+static int run(const char *name,
+               int (*configure)(ocii_channel_t, ocii_packet_t *)) {
+    ocii_packet_t init, saved;
+    uint64_t took = 0, missed;
+    int error_code = OCII_ERROR_NO_ERROR, skipped = 0;
+
+    (void)pthread_mutex_lock(&sim.lock);
+    (void)sim_pending(ocii_channel0, ocii_time_us());
+    missed = sim.channel[ocii_channel0].missed;
+    (void)pthread_mutex_unlock(&sim.lock);
+
+    for (int i = 0; i < RESTARTS && error_code >= 0; i++) {
+        uint64_t start;
+
+        (void)ocii_get_config(ocii_channel0, &saved);
+        init = saved;
+        (void)ocii_close_device();
+
+        start = ocii_time_us();
+        if ((error_code = ocii_open_device()) != OCII_ERROR_NO_ERROR ||
+            (error_code = ocii_set_config(ocii_channel0, &saved)) !=
+                OCII_ERROR_NO_ERROR ||
+            (error_code = configure(ocii_channel0, &init)) < 0)
+            break;
+        took += ocii_time_us() - start;
+        skipped += error_code == 1;
+    }
+
+    (void)pthread_mutex_lock(&sim.lock);
+    (void)sim_pending(ocii_channel0, ocii_time_us());
+    missed = sim.channel[ocii_channel0].missed - missed;
+    (void)pthread_mutex_unlock(&sim.lock);
+
+    if (error_code < 0) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(error_code));
+        return -1;
+    }
+
+    (void)fprintf(stdout,
+                  "%-24s restart %5.1f us  %3d/%d resets skipped  %5.2f "
+                  "frames missed per restart\n",
+                  name, (double)took / RESTARTS, skipped, RESTARTS,
+                  (double)missed / RESTARTS);
+
+    return 0;
+}
+
+int main(void) {
+    ocii_packet_t init = {.acc_code = 0x00,
+                          .acc_mask = 0xFFFFFFFF,
+                          .filter = 0x01,
+                          .timing = {[0] = OCIIBR500000[0],
+                                     [1] = OCIIBR500000[1]},
+                          .mode = 0x00};
+    int ret;
+
+    sim_usb_us = USB_US;
+    if ((ret = ocii_open_device()) != OCII_ERROR_NO_ERROR ||
+        (ret = init_start(ocii_channel0, &init)) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(ret));
+        return -1;
+    }
+
+    (void)fprintf(stdout,
+                  "emulated device: %d us per transfer, a message every %d "
+                  "us, %d restarts\n",
+                  USB_US, PERIOD_US, RESTARTS);
+
+    sim_background(ocii_channel0, 0x100, PERIOD_US);
+
+    ret = run("ocii_init, ocii_start", init_start);
+    ret |= run("ocii_ensure_configured", ocii_ensure_configured);
+
+    /**
+     * A changed configuration is applied
+     */
+    init.timing[0] = OCIIBR250000[0];
+    init.timing[1] = OCIIBR250000[1];
+    if (ocii_ensure_configured(ocii_channel0, &init) != 0) {
+        (void)fprintf(stderr, "changed timing not applied\n");
+        ret = -1;
+    }
+
+    sim_background(ocii_channel0, 0x100, 0);
+    (void)ocii_close_device();
+
+    return ret;
+}
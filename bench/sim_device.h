@@ -0,0 +1,330 @@
+/**
+ * Emulated Canalyst-II for the benchmarks
+ *
+ * Replaces the libusb calls of the library at link time (see SIM_WRAP in the
+ * Makefile), so benchmarks run without an adapter. Every bulk transfer costs
+ * sim_usb_us. Received messages are queued per channel with the time they
+ * arrive. Messages sent with OCII_SEND_TYPE_ECHO come back as received ones.
+ * Sent messages are handed to sim_tx_handler, which may queue responses with
+ * sim_inject. CAN_STATUS is answered from sim.channel[].status, which the
+ * benchmark may change under sim.lock. A channel that is stopped or reports
+ * bus-off there misses its background messages. INIT resets the status
+ * and stops the channel, and a stopped one reports reset mode in reg_mode.
+ * Call sim_pending under the lock before changing the status, so that the
+ * messages due before are made under the old one. sim_plug removes the
+ * adapter and brings it back with the state lost, it is found again on the
+ * same port through the emulated device list. libusb_init costs
+ * sim_enumerate_us for the scan of the buses, the device list is kept from
+ * there on, as libusb does with hotplug events.
+ * Include it from exactly one file, which must define _POSIX_C_SOURCE for
+ * nanosleep
+ */
+#ifndef sim_device_h
+#define sim_device_h
+
+#include <libusb/libusb.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_QUEUE 4096
+
+typedef void (*sim_tx_handler_t)(int channel, const ocii_message_t *message,
+                                 uint64_t now);
+
+static sim_tx_handler_t sim_tx_handler;
+static uint32_t sim_usb_us = 40;
+static uint32_t sim_enumerate_us;
+
+typedef struct {
+    ocii_message_t message[SIM_QUEUE];
+    uint64_t ready[SIM_QUEUE];
+    uint32_t head, tail;
+    ocii_packet_t command; /* Last command, answered on the next IN */
+    ocii_packet_t status;  /* Answer to OCII_COMMAND_CAN_STATUS */
+    uint64_t sent;         /* Messages the library wrote */
+    uint64_t missed;       /* Background messages lost while off the bus */
+    int stopped;           /* Between STOP and START */
+    uint32_t background_id;
+    uint32_t background_us;
+    uint64_t background; /* Time of the next background message */
+    uint32_t sequence;
+} sim_channel_t;
+
+static struct {
+    pthread_mutex_t lock;
+    sim_channel_t channel[ocii_channel_sizeof];
+    int unplugged;
+} sim = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * Queues a message that the device receives at ready, the lock must be held
+ * or the caller must be the TX handler
+ */
+static inline void sim_inject(int channel, const ocii_message_t *message,
+                              uint64_t ready) {
+    sim_channel_t *c = &sim.channel[channel];
+
+    if (c->head - c->tail == SIM_QUEUE)
+        return;
+    c->message[c->head % SIM_QUEUE] = *message;
+    c->ready[c->head++ % SIM_QUEUE] = ready;
+}
+
+/**
+ * Makes the device receive a message with can_id every period_us, the data
+ * carries a sequence number
+ */
+static inline void sim_background(int channel, uint32_t can_id, uint32_t period_us) {
+    (void)pthread_mutex_lock(&sim.lock);
+    sim.channel[channel].background_id = can_id;
+    sim.channel[channel].background_us = period_us;
+    sim.channel[channel].background = ocii_time_us();
+    (void)pthread_mutex_unlock(&sim.lock);
+}
+
+static int sim_pending(int channel, uint64_t now) {
+    sim_channel_t *c = &sim.channel[channel];
+    int count = 0;
+
+    while (c->background_us != 0 && c->background <= now) {
+        ocii_message_t message = {.can_id = c->background_id, .data_len = 8};
+
+        memcpy(message.data, &c->sequence, sizeof(c->sequence));
+        c->sequence++;
+        if (sim.unplugged || c->stopped || c->status.reg_status & 0x80)
+            c->missed++;
+        else
+            sim_inject(channel, &message, c->background);
+        c->background += c->background_us;
+    }
+
+    for (uint32_t i = c->tail; i != c->head; i++, count++)
+        if (c->ready[i % SIM_QUEUE] > now)
+            break;
+
+    return count;
+}
+
+/**
+ * Removes the adapter, or plugs it back in with its channels stopped and
+ * their buffers empty
+ */
+static inline void sim_plug(int plugged) {
+    uint64_t now = ocii_time_us();
+
+    (void)pthread_mutex_lock(&sim.lock);
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        sim_channel_t *c = &sim.channel[channel];
+
+        (void)sim_pending(channel, now);
+        if (plugged) {
+            memset(&c->command, 0, sizeof(c->command));
+            memset(&c->status, 0, sizeof(c->status));
+            c->stopped = 1;
+            c->tail = c->head;
+        }
+    }
+    sim.unplugged = !plugged;
+    (void)pthread_mutex_unlock(&sim.lock);
+}
+
+int __wrap_libusb_bulk_transfer(libusb_device_handle *handle,
+                                unsigned char endpoint, unsigned char *data,
+                                int length, int *transferred,
+                                unsigned int timeout) {
+    struct timespec ts = {.tv_nsec = (long)sim_usb_us * 1000};
+    ocii_packet_t *packet = (ocii_packet_t *)data;
+    int channel = ((endpoint & 0x0F) - 1) / 2 % ocii_channel_sizeof;
+    sim_channel_t *c = &sim.channel[channel];
+    uint64_t now;
+
+    (void)handle;
+    (void)timeout;
+
+    if (sim_usb_us != 0)
+        (void)nanosleep(&ts, NULL);
+    now = ocii_time_us();
+    *transferred = length;
+
+    (void)pthread_mutex_lock(&sim.lock);
+    if (sim.unplugged) {
+        *transferred = 0;
+        (void)pthread_mutex_unlock(&sim.lock);
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    if ((endpoint & 0x0F) % 2 == 0) {
+        if (endpoint & OCII_USB_ENDPOINT_IN) {
+            *packet = c->command;
+            if (c->command.command == OCII_COMMAND_CAN_STATUS) {
+                *packet = c->status;
+                packet->command = OCII_COMMAND_CAN_STATUS;
+                packet->reg_mode |= c->stopped ? 0x01 : 0;
+            } else if (c->command.command == OCII_COMMAND_MESSAGE_STATUS) {
+                packet->rx_pending = (uint32_t)sim_pending(channel, now);
+                packet->tx_pending = 0;
+            }
+        } else {
+            /**
+             * Background messages are made on demand, those due before the
+             * command are made under the old state
+             */
+            (void)sim_pending(channel, now);
+            c->command = *packet;
+            if (packet->command == OCII_COMMAND_STOP)
+                c->stopped = 1;
+            else if (packet->command == OCII_COMMAND_START)
+                c->stopped = 0;
+            else if (packet->command == OCII_COMMAND_INIT) {
+                memset(&c->status, 0, sizeof(c->status));
+                c->stopped = 1;
+            }
+            else if (packet->command == OCII_COMMAND_CLEAR_RX_BUFFER)
+                c->tail = c->head;
+        }
+    } else if (endpoint & OCII_USB_ENDPOINT_IN) {
+        int pending = sim_pending(channel, now);
+
+        *transferred = 0;
+        for (int i = 0; i < length / (int)sizeof(ocii_packet_t) && pending;
+             i++) {
+            memset(&packet[i], 0, sizeof(packet[i]));
+            for (; packet[i].count < 3 && pending; pending--)
+                packet[i].message[packet[i].count++] =
+                    c->message[c->tail++ % SIM_QUEUE];
+            *transferred += (int)sizeof(ocii_packet_t);
+        }
+    } else {
+        c->sent += packet->count;
+        for (int i = 0; i < packet->count; i++) {
+            if (packet->message[i].send_type & OCII_SEND_TYPE_ECHO)
+                sim_inject(channel, &packet->message[i], now);
+            if (sim_tx_handler != NULL)
+                sim_tx_handler(channel, &packet->message[i], now);
+        }
+    }
+    (void)pthread_mutex_unlock(&sim.lock);
+
+    return 0;
+}
+
+int __wrap_libusb_init(libusb_context **ctx) {
+    struct timespec ts = {.tv_sec = sim_enumerate_us / 1000000U,
+                          .tv_nsec = (long)(sim_enumerate_us % 1000000U) *
+                                     1000};
+
+    if (sim_enumerate_us != 0)
+        (void)nanosleep(&ts, NULL);
+    if (ctx != NULL)
+        *ctx = NULL;
+    return 0;
+}
+
+void __wrap_libusb_exit(libusb_context *ctx) { (void)ctx; }
+
+libusb_device_handle *__wrap_libusb_open_device_with_vid_pid(
+    libusb_context *ctx, uint16_t vendor_id, uint16_t product_id) {
+    static char handle;
+
+    (void)ctx;
+    (void)vendor_id;
+    (void)product_id;
+    return (libusb_device_handle *)&handle;
+}
+
+int __wrap_libusb_get_configuration(libusb_device_handle *handle,
+                                    int *config) {
+    (void)handle;
+    *config = 1;
+    return 0;
+}
+
+int __wrap_libusb_kernel_driver_active(libusb_device_handle *handle,
+                                       int interface) {
+    (void)handle;
+    (void)interface;
+    return 0;
+}
+
+int __wrap_libusb_claim_interface(libusb_device_handle *handle,
+                                  int interface) {
+    (void)handle;
+    (void)interface;
+    return 0;
+}
+
+int __wrap_libusb_release_interface(libusb_device_handle *handle,
+                                    int interface) {
+    (void)handle;
+    (void)interface;
+    return 0;
+}
+
+void __wrap_libusb_close(libusb_device_handle *handle) { (void)handle; }
+
+/**
+ * The emulated adapter, the only device on bus 1, port 4
+ */
+static char sim_usb_device;
+
+int __wrap_libusb_has_capability(uint32_t capability) {
+    (void)capability;
+    return 0;
+}
+
+ssize_t __wrap_libusb_get_device_list(libusb_context *ctx,
+                                      libusb_device ***list) {
+    static libusb_device *devices[2];
+    ssize_t count;
+
+    (void)ctx;
+    (void)pthread_mutex_lock(&sim.lock);
+    count = sim.unplugged ? 0 : 1;
+    (void)pthread_mutex_unlock(&sim.lock);
+    devices[0] = count != 0 ? (libusb_device *)&sim_usb_device : NULL;
+    *list = devices;
+    return count;
+}
+
+void __wrap_libusb_free_device_list(libusb_device **list, int unref) {
+    (void)list;
+    (void)unref;
+}
+
+int __wrap_libusb_get_device_descriptor(
+    libusb_device *device, struct libusb_device_descriptor *descriptor) {
+    (void)device;
+    memset(descriptor, 0, sizeof(*descriptor));
+    descriptor->idVendor = OCII_USB_ID_VENDOR;
+    descriptor->idProduct = OCII_USB_ID_PRODUCT;
+    return 0;
+}
+
+uint8_t __wrap_libusb_get_bus_number(libusb_device *device) {
+    (void)device;
+    return 1;
+}
+
+int __wrap_libusb_get_port_numbers(libusb_device *device, uint8_t *ports,
+                                   int length) {
+    (void)device;
+    if (length < 1)
+        return LIBUSB_ERROR_OVERFLOW;
+    ports[0] = 4;
+    return 1;
+}
+
+libusb_device *__wrap_libusb_get_device(libusb_device_handle *handle) {
+    (void)handle;
+    return (libusb_device *)&sim_usb_device;
+}
+
+int __wrap_libusb_open(libusb_device *device, libusb_device_handle **handle) {
+    (void)device;
+    *handle = __wrap_libusb_open_device_with_vid_pid(NULL, 0, 0);
+    return 0;
+}
+
+#endif /* sim_device_h */
@@ -0,0 +1,166 @@
+/**
+ * Request/response round trips: ocii_transact against a hand-written write
+ * and read loop
+ *
+ * No adapter is needed, it runs against the emulated device of sim_device.h.
+ * Every USB transfer costs USB_US, and an ECU answers each request on 0x600
+ * with a response on 0x580 after ECU_US. Unrelated traffic on 0x100 arrives
+ * every BACKGROUND_US. The latencies are therefore the library overhead and
+ * wakeup path on top of a fixed device round trip
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <opencanalystii.h>
+#include <sim_device.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define ROUNDS 2000
+#define USB_US 40
+#define ECU_US 200
+#define BACKGROUND_US 500
+
+/**
+ * The emulated ECU, it answers every request on 0x600
+ */
+static void ecu(int channel, const ocii_message_t *message, uint64_t now) {
+    ocii_message_t response = *message;
+
+    if (message->can_id != 0x600)
+        return;
+    response.can_id = 0x580;
+    response.data[0] = 0x43;
+    sim_inject(channel, &response, now + ECU_US);
+}
+
+static int compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, uint64_t *latency, int count,
+                   double cpu) {
+    qsort(latency, (size_t)count, sizeof(*latency), compare);
+    (void)fprintf(stdout,
+                  "%-26s p50 %5llu us  p90 %5llu us  p99 %5llu us  max %5llu "
+                  "us  cpu %3.0f%%\n",
+                  name, (unsigned long long)latency[count / 2],
+                  (unsigned long long)latency[count * 9 / 10],
+                  (unsigned long long)latency[count * 99 / 100],
+                  (unsigned long long)latency[count - 1], cpu * 100.0);
+}
+
+/**
+ * What callers write today: send, then read and throw away what does not
+ * match until the response shows up
+ */
+static int hand_written(const ocii_message_t *request,
+                        ocii_message_t *response) {
+    ocii_packet_t packet = {.count = 1, .message = {*request}};
+    uint64_t deadline = ocii_time_us() + 100000U;
+    int error_code;
+
+    if ((error_code = ocii_write(ocii_channel0, &packet)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    while (ocii_time_us() < deadline) {
+        if ((error_code = ocii_read(ocii_channel0, &packet)) ==
+            OCII_ERROR_BUFFER_EMPTY)
+            continue;
+        if (error_code != OCII_ERROR_NO_ERROR)
+            return error_code;
+        for (int i = 0; i < packet.count; i++)
+            if (packet.message[i].can_id == 0x580 &&
+                packet.message[i].data[0] == 0x43) {
+                *response = packet.message[i];
+                return OCII_ERROR_NO_ERROR;
+            }
+    }
+
+    return OCII_ERROR_TIMEOUT;
+}
+
+static int run(const char *name, int transact) {
+    static uint64_t latency[ROUNDS];
+    ocii_message_t request = {.can_id = 0x600, .data_len = 8},
+                   response;
+    ocii_match_t match = {.can_id = 0x580,
+                          .id_mask = 0x7FF,
+                          .data = {0x43},
+                          .data_mask = {0xFF}};
+    ocii_packet_t packet;
+    int error_code, background = 0;
+    clock_t cpu = clock();
+    uint64_t wall = ocii_time_us();
+
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t start = ocii_time_us();
+
+        request.data[0] = 0x40;
+        memcpy(&request.data[4], &round, sizeof(round));
+        error_code =
+            transact ? ocii_transact(ocii_channel0, &request, &match,
+                                     &response, start + 100000U)
+                     : hand_written(&request, &response);
+        if (error_code != OCII_ERROR_NO_ERROR) {
+            (void)fprintf(stderr, "%s: %s\n", name,
+                          ocii_error_code_to_string(error_code));
+            return -1;
+        }
+        latency[round] = ocii_time_us() - start;
+
+        /**
+         * The unrelated messages must still reach the ordinary reader
+         */
+        while (ocii_read(ocii_channel0, &packet) == OCII_ERROR_NO_ERROR)
+            background += packet.count;
+    }
+
+    report(name, latency, ROUNDS,
+           (double)(clock() - cpu) / CLOCKS_PER_SEC /
+               ((double)(ocii_time_us() - wall) / 1e6));
+    if (transact)
+        (void)fprintf(stdout, "%-26s %d background messages delivered\n", "",
+                      background);
+
+    return 0;
+}
+
+int main(void) {
+    int ret;
+
+    sim_usb_us = USB_US;
+    sim_tx_handler = ecu;
+    sim_background(ocii_channel0, 0x100, BACKGROUND_US);
+    if ((ret = ocii_open_device()) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(ret));
+        return -1;
+    }
+    (void)ocii_start(ocii_channel0);
+
+    (void)fprintf(stdout,
+                  "emulated device: %d us per transfer, ECU answers after %d "
+                  "us\n",
+                  USB_US, ECU_US);
+
+    ret = run("write + ocii_read loop", 0);
+    (void)ocii_set_wait_profile(OCII_WAIT_SPIN);
+    ret |= run("ocii_transact, spin", 1);
+    (void)ocii_set_wait_profile(OCII_WAIT_BALANCED);
+    ret |= run("ocii_transact, balanced", 1);
+    if (ocii_start_io_thread() == OCII_ERROR_NO_ERROR) {
+        ret |= run("ocii_transact, I/O thread", 1);
+        (void)ocii_stop_io_thread();
+    }
+
+    (void)ocii_close_device();
+
+    return ret;
+}
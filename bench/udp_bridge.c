@@ -0,0 +1,261 @@
+/**
+ * CAN over UDP on loopback: capture and injection latency through the bridge,
+ * and raw frame throughput of batched datagrams against one datagram per
+ * frame
+ *
+ * No adapter is needed, it runs against the emulated device of sim_device.h.
+ * Every USB transfer costs USB_US and channel 0 receives 0x100 every
+ * PERIOD_US. Capture latency is taken from the time the device received a
+ * message to the time the analysis end decoded it. Injection latency is taken
+ * from ocii_udp_send on the analysis end to the write at the device
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <ocii_udp.h>
+#include <opencanalystii.h>
+#include <sim_device.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define USB_US 40
+#define PERIOD_US 250
+#define INJECT_US 1000
+#define RUN_US 1000000U
+#define BRIDGE_PORT 29536
+#define HOST_PORT 29537
+#define FRAMES 480000
+
+static uint64_t start;
+static uint64_t capture[RUN_US / PERIOD_US + 16];
+static uint64_t inject[RUN_US / INJECT_US + 16];
+static int captured, injected;
+
+/**
+ * Records the injected messages arriving at the device, their data carries
+ * the send time
+ */
+static void bus(int channel, const ocii_message_t *message, uint64_t now) {
+    uint64_t sent;
+
+    if (channel != ocii_channel1 || message->can_id != 0x300 ||
+        injected == (int)(sizeof(inject) / sizeof(inject[0])))
+        return;
+    memcpy(&sent, message->data, sizeof(sent));
+    inject[injected++] = now - sent;
+}
+
+static int compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, uint64_t *latency, int count) {
+    if (count == 0) {
+        (void)fprintf(stdout, "%-26s nothing arrived\n", name);
+        return;
+    }
+    qsort(latency, (size_t)count, sizeof(*latency), compare);
+    (void)fprintf(stdout,
+                  "%-26s %6d frames  p50 %5llu us  p99 %5llu us  max %5llu "
+                  "us\n",
+                  name, count, (unsigned long long)latency[count / 2],
+                  (unsigned long long)latency[count * 99 / 100],
+                  (unsigned long long)latency[count - 1]);
+}
+
+static int bridge(const char *name, uint32_t flush_us) {
+    static ocii_udp_t adapter, host;
+    ocii_udp_frame_t frames[OCII_UDP_FRAMES];
+    ocii_packet_t packets[16];
+    uint64_t next = 0;
+    int error_code;
+
+    if ((error_code = ocii_udp_init(&adapter, "127.0.0.1", HOST_PORT,
+                                    BRIDGE_PORT)) != OCII_ERROR_NO_ERROR ||
+        (error_code = ocii_udp_open(&host, "127.0.0.1", BRIDGE_PORT,
+                                    HOST_PORT)) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s: %s\n", name,
+                      ocii_error_code_to_string(error_code));
+        return -1;
+    }
+    adapter.flush_us = flush_us;
+
+    (void)pthread_mutex_lock(&sim.lock);
+    sim.channel[ocii_channel0].tail = sim.channel[ocii_channel0].head;
+    sim.channel[ocii_channel0].sequence = 0;
+    captured = injected = 0;
+    (void)pthread_mutex_unlock(&sim.lock);
+    start = ocii_time_us();
+    sim_background(ocii_channel0, 0x100, PERIOD_US);
+
+    while (ocii_time_us() - start < RUN_US) {
+        uint64_t now = ocii_time_us();
+        int count;
+
+        /**
+         * The adapter end: read, which captures, then forward and inject
+         */
+        (void)ocii_read_many(ocii_channel0, packets, 16);
+        (void)ocii_udp_poll(&adapter);
+
+        /**
+         * The analysis end
+         */
+        while ((count = ocii_udp_receive(&host, frames, OCII_UDP_FRAMES)) > 0)
+            for (int i = 0; i < count; i++) {
+                uint32_t sequence;
+
+                if (frames[i].message.can_id != 0x100 ||
+                    captured == (int)(sizeof(capture) / sizeof(capture[0])))
+                    continue;
+                memcpy(&sequence, frames[i].message.data, sizeof(sequence));
+                capture[captured++] = ocii_time_us() - start -
+                                      (uint64_t)sequence * PERIOD_US;
+            }
+        if (now >= next) {
+            ocii_message_t message = {.can_id = 0x300, .data_len = 8};
+
+            memcpy(message.data, &now, sizeof(now));
+            (void)ocii_udp_send(&host, ocii_channel1, &message);
+            (void)ocii_udp_flush(&host);
+            next = now + INJECT_US;
+        }
+    }
+
+    (void)fprintf(stdout,
+                  "%s: %llu datagrams, %.1f frames per datagram, %.1f "
+                  "datagrams per sendmmsg, %llu lost\n",
+                  name, (unsigned long long)adapter.stats.datagrams_sent,
+                  adapter.stats.datagrams_sent != 0
+                      ? (double)adapter.stats.frames_sent /
+                            (double)adapter.stats.datagrams_sent
+                      : 0.0,
+                  adapter.stats.syscalls != 0
+                      ? (double)adapter.stats.datagrams_sent /
+                            (double)adapter.stats.syscalls
+                      : 0.0,
+                  (unsigned long long)host.stats.lost);
+    report("  capture", capture, captured);
+    report("  inject", inject, injected);
+
+    (void)ocii_udp_close(&host);
+    return ocii_udp_deinit(&adapter);
+}
+
+/**
+ * Frames per second from one end to the other, batched by the bridge
+ */
+static int throughput_batched(void) {
+    static ocii_udp_t a, b;
+    static ocii_udp_frame_t frames[OCII_UDP_FRAMES * OCII_UDP_BATCH];
+    ocii_message_t message = {.can_id = 0x100, .data_len = 8};
+    uint64_t begin, received = 0;
+    int count;
+
+    if (ocii_udp_open(&a, "127.0.0.1", HOST_PORT, BRIDGE_PORT) != 0 ||
+        ocii_udp_open(&b, "127.0.0.1", BRIDGE_PORT, HOST_PORT) != 0)
+        return -1;
+
+    begin = ocii_time_us();
+    for (int i = 0; i < FRAMES; i++) {
+        memcpy(message.data, &i, sizeof(i));
+        (void)ocii_udp_send(&a, ocii_channel0, &message);
+        if (i % (OCII_UDP_FRAMES * OCII_UDP_BATCH) == 0)
+            while ((count = ocii_udp_receive(&b, frames,
+                                             (int)(sizeof(frames) /
+                                                   sizeof(frames[0])))) > 0)
+                received += (uint64_t)count;
+    }
+    (void)ocii_udp_flush(&a);
+    while ((count = ocii_udp_receive(
+                &b, frames, (int)(sizeof(frames) / sizeof(frames[0])))) > 0)
+        received += (uint64_t)count;
+
+    (void)fprintf(stdout,
+                  "%-26s %8.0f frames/s, %llu received, %llu datagrams lost\n",
+                  "batched, sendmmsg",
+                  (double)received * 1e6 / (double)(ocii_time_us() - begin),
+                  (unsigned long long)received,
+                  (unsigned long long)b.stats.lost);
+
+    (void)ocii_udp_close(&a);
+    return ocii_udp_close(&b);
+}
+
+/**
+ * The same with one sendto and one recv per frame
+ */
+static int throughput_single(void) {
+    struct sockaddr_in peer = {.sin_family = AF_INET,
+                               .sin_port = htons(HOST_PORT)},
+                       local = {.sin_family = AF_INET,
+                                .sin_port = htons(HOST_PORT)};
+    ocii_message_t message = {.can_id = 0x100, .data_len = 8};
+    int tx = socket(AF_INET, SOCK_DGRAM, 0), rx = socket(AF_INET, SOCK_DGRAM, 0);
+    uint64_t begin, received = 0;
+
+    (void)inet_pton(AF_INET, "127.0.0.1", &peer.sin_addr);
+    (void)inet_pton(AF_INET, "127.0.0.1", &local.sin_addr);
+    if (tx < 0 || rx < 0 ||
+        bind(rx, (struct sockaddr *)&local, sizeof(local)) != 0)
+        return -1;
+
+    begin = ocii_time_us();
+    for (int i = 0; i < FRAMES; i++) {
+        memcpy(message.data, &i, sizeof(i));
+        (void)sendto(tx, &message, sizeof(message), 0,
+                     (struct sockaddr *)&peer, sizeof(peer));
+        if (i % 64 == 0) /* Small datagrams fill the socket buffer sooner */
+            while (recv(rx, &message, sizeof(message), MSG_DONTWAIT) > 0)
+                received++;
+    }
+    while (recv(rx, &message, sizeof(message), MSG_DONTWAIT) > 0)
+        received++;
+
+    (void)fprintf(stdout, "%-26s %8.0f frames/s, %llu received\n",
+                  "one datagram per frame",
+                  (double)received * 1e6 / (double)(ocii_time_us() - begin),
+                  (unsigned long long)received);
+
+    (void)close(tx);
+    (void)close(rx);
+    return 0;
+}
+
+int main(void) {
+    int ret;
+
+    sim_usb_us = USB_US;
+    sim_tx_handler = bus;
+    if ((ret = ocii_open_device()) != OCII_ERROR_NO_ERROR) {
+        (void)fprintf(stderr, "%s\n", ocii_error_code_to_string(ret));
+        return -1;
+    }
+    (void)ocii_start(ocii_channel0);
+    (void)ocii_start(ocii_channel1);
+
+    (void)fprintf(stdout,
+                  "emulated device: %d us per transfer, a message every %d "
+                  "us, an injection every %d us\n",
+                  USB_US, PERIOD_US, INJECT_US);
+
+    ret = bridge("bridge, flush every poll", 0);
+    ret |= bridge("bridge, flush 5 ms", 5000);
+
+    (void)ocii_close_device();
+
+    (void)fprintf(stdout, "loopback throughput, %d frames\n", FRAMES);
+    ret |= throughput_batched();
+    ret |= throughput_single();
+
+    return ret;
+}
@@ -0,0 +1,172 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Bus load estimate per channel from the received frames
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_busload_h
+#define ocii_busload_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Wire bits are summed into buckets of OCII_BUSLOAD_BUCKET_US, the ring of
+ * OCII_BUSLOAD_BUCKETS limits the longest window. The buckets must be a power
+ * of two
+ */
+#ifndef OCII_BUSLOAD_BUCKET_US
+#define OCII_BUSLOAD_BUCKET_US 10000
+#endif
+#ifndef OCII_BUSLOAD_BUCKETS
+#define OCII_BUSLOAD_BUCKETS 1024
+#endif
+
+#if (OCII_BUSLOAD_BUCKETS & (OCII_BUSLOAD_BUCKETS - 1)) != 0
+#error "OCII_BUSLOAD_BUCKETS must be a power of two"
+#endif
+
+/**
+ * CAN controller clock the bit timing registers of ocii_init count in
+ */
+#define OCII_BUSLOAD_CLOCK 16000000U
+
+typedef struct {
+    atomic_uint bitrate;            /* Bits per second, 0 until it is set */
+    atomic_uint_least64_t newest;   /* Bucket of the last frame, time / size */
+    atomic_uint_least64_t frames;   /* Since init */
+    atomic_uint_least64_t bits;     /* Wire bits since init */
+    atomic_uint_least64_t stuffing; /* Stuff bits among them */
+    atomic_uint bucket[OCII_BUSLOAD_BUCKETS];
+} ocii_busload_channel_t;
+
+/**
+ * Each channel must be read from the device by one thread at a time, any
+ * number of threads may query the load
+ */
+typedef struct {
+    ocii_busload_channel_t channel[ocii_channel_sizeof];
+} ocii_busload_t;
+
+/**
+ * @brief Bit rate set by the bit timing registers of an init command
+ *
+ * @param timing The two bit timing registers, as in ocii_packet_t.timing
+ * @return uint32_t Returns the bit rate in bits per second
+ */
+extern uint32_t ocii_busload_bitrate(const uint32_t timing[2]);
+
+/**
+ * @brief Bits a frame takes on the wire, from the start of frame to the end
+ * of the interframe space
+ *
+ * Stuff bits are counted exactly from the ID, the control field, the data and
+ * the CRC of the frame, with tables over whole bytes
+ *
+ * @param message The frame
+ * @param stuffing Receives the stuff bits among them, may be NULL
+ * @return uint32_t Returns the number of bits
+ */
+extern uint32_t ocii_busload_frame_bits(const ocii_message_t *message,
+                                        uint32_t *stuffing);
+
+/**
+ * @brief Initializes the estimator and attaches it to the RX path
+ *
+ * @param load The estimator to initialize
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_busload_init(ocii_busload_t *load);
+
+/**
+ * @brief Detaches the estimator from the RX path
+ *
+ * @param load The estimator to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_busload_deinit(ocii_busload_t *load);
+
+/**
+ * @brief Takes the bit rate of a channel from the command it was initialized
+ * with
+ *
+ * @param load The estimator
+ * @param channel The channel
+ * @param init The command passed to ocii_init
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_busload_set_timing(ocii_busload_t *load,
+                                   ocii_channel_t channel,
+                                   const ocii_packet_t *init);
+
+/**
+ * @brief Accounts a frame seen on the bus at a given time
+ *
+ * Called by the RX hook, exposed for frames the RX path does not see and for
+ * replaying recorded traffic. Frames of a channel must be accounted by one
+ * thread at a time, so not next to the RX hook of that channel
+ *
+ * @param load The estimator
+ * @param channel The channel
+ * @param message The frame
+ * @param time_us Time it was seen, in ocii_time_us() microseconds
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_busload_add(ocii_busload_t *load, ocii_channel_t channel,
+                            const ocii_message_t *message, uint64_t time_us);
+
+/**
+ * @brief RX hook, accounts every received frame
+ *
+ * Added by ocii_busload_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_busload_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns 0, the message is left to the application
+ */
+extern int ocii_busload_rx_hook(void *user, ocii_channel_t channel,
+                                ocii_message_t *message);
+
+/**
+ * @brief Bus load of a channel over the window that ends with the last whole
+ * bucket before now
+ *
+ * @param load The estimator
+ * @param channel The channel
+ * @param window_us Length of the window, rounded down to whole buckets
+ * @param now_us End of the window, ocii_time_us() for the live bus
+ * @param result Receives the share of the bit rate used, 0.0 to 1.0
+ * @return int Returns 0 on success, OCII_ERROR_INVALID_ARG if the bit rate is
+ * not set or the window does not fit the buckets, or another negative error
+ * code on failure
+ */
+extern int ocii_busload_get(ocii_busload_t *load, ocii_channel_t channel,
+                            uint32_t window_us, uint64_t now_us,
+                            double *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_busload_h */
@@ -0,0 +1,345 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * CANopen services built on top of the core driver
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_canopen_h
+#define ocii_canopen_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <ocii_timer.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * CANopen node IDs are 7 bits wide, 0 is reserved for broadcast
+ */
+#define OCII_CANOPEN_NODES 128
+
+#define OCII_SDO_TX_COB_ID 0x600 /* Client to server */
+#define OCII_SDO_RX_COB_ID 0x580 /* Server to client */
+
+/**
+ * Number of frames the SDO client can stage for transmission between two calls
+ * of ocii_sdo_poll. A whole block of a block download has to fit in here
+ */
+#define OCII_SDO_TX_QUEUE 256
+
+/**
+ * Default values of the SDO client parameters
+ */
+#define OCII_SDO_TIMEOUT_US 500000U
+#define OCII_SDO_BLOCK_SIZE 127
+
+/**
+ * SDO abort codes sent by the client itself
+ */
+#define OCII_SDO_ABORT_TOGGLE 0x05030000
+#define OCII_SDO_ABORT_TIMEOUT 0x05040000
+#define OCII_SDO_ABORT_SEQUENCE 0x05040003
+#define OCII_SDO_ABORT_CRC 0x05040004
+#define OCII_SDO_ABORT_MEMORY 0x05040005
+
+typedef enum {
+    ocii_sdo_upload,   /* Read an object from the server */
+    ocii_sdo_download, /* Write an object to the server */
+} ocii_sdo_direction_t;
+
+typedef struct ocii_sdo_request ocii_sdo_request_t;
+
+/**
+ * Called once the request has finished, successfully or not
+ */
+typedef void (*ocii_sdo_callback_t)(void *user, ocii_sdo_request_t *request);
+
+/**
+ * SDO transfer description. The memory is owned by the caller and must stay
+ * valid until the callback has been called
+ */
+struct ocii_sdo_request {
+    uint8_t node;       /* Server node ID, 1 to 127 */
+    uint16_t index;     /* Object index */
+    uint8_t subindex;   /* Object subindex */
+    uint8_t direction;  /* One of ocii_sdo_direction_t */
+    uint8_t block;      /* Set to use block transfer instead of segmented */
+    uint8_t *data;      /* Data to download or buffer to upload into */
+    uint32_t size;      /* Download length or upload buffer capacity */
+    uint32_t length;    /* Number of bytes actually transferred */
+    int status;         /* Result, one of OCII_ERROR error codes */
+    uint32_t abort_code;     /* Abort code if status is OCII_ERROR_SDO_ABORT */
+    uint64_t submit_time;    /* When the request was submitted, us */
+    uint64_t issue_time;     /* When the first frame was staged, us */
+    uint64_t latency;        /* From issue to completion, us */
+    ocii_sdo_callback_t callback; /* May be NULL */
+    void *user;                   /* Passed back to the callback */
+
+    /**
+     * Private state of the transfer, do not touch
+     */
+    ocii_sdo_request_t *next;
+    uint64_t deadline;
+    uint32_t offset;
+    uint8_t state;
+    uint8_t toggle;
+    uint8_t seqno;
+    uint8_t blksize;
+    uint8_t crc_enabled;
+};
+
+/**
+ * SDO client. Requests to different nodes run concurrently, requests to the
+ * same node are queued and run one after another, as the protocol requires.
+ * Callbacks run with the lock held, it is recursive, so they may submit the
+ * next request
+ */
+typedef struct {
+    pthread_mutex_t lock; /* The RX hook may run on the library I/O thread */
+    ocii_channel_t channel;
+    uint32_t timeout_us; /* Per transfer step, OCII_SDO_TIMEOUT_US by default */
+    uint8_t block_size;  /* Segments per block, OCII_SDO_BLOCK_SIZE by default */
+    uint32_t pending;    /* Number of requests not finished yet */
+    ocii_sdo_request_t *head[OCII_CANOPEN_NODES];
+    ocii_sdo_request_t *tail[OCII_CANOPEN_NODES];
+    ocii_message_t tx[OCII_SDO_TX_QUEUE];
+    uint16_t tx_head;
+    uint16_t tx_count;
+} ocii_sdo_client_t;
+
+/**
+ * @brief Initializes an SDO client and attaches it to the RX path
+ *
+ * Responses are picked out of the RX stream by the hook, so every ocii_read
+ * call, including the ones done by ocii_sdo_poll, advances the transfers
+ *
+ * @param client The client to initialize
+ * @param channel The channel the SDO servers are on
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_sdo_init(ocii_sdo_client_t *client, ocii_channel_t channel);
+
+/**
+ * @brief Detaches the SDO client from the RX path
+ *
+ * Requests that are still pending are completed with OCII_ERROR_TIMEOUT
+ *
+ * @param client The client to deinitialize
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_sdo_deinit(ocii_sdo_client_t *client);
+
+/**
+ * @brief Queues an SDO request
+ *
+ * The request starts immediately if no other request to the same node is in
+ * progress. Frames are only staged here, they go out on ocii_sdo_poll
+ *
+ * @param client The client to queue the request on
+ * @param request The request to queue
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_sdo_submit(ocii_sdo_client_t *client,
+                           ocii_sdo_request_t *request);
+
+/**
+ * @brief Feeds a received frame to the SDO client
+ *
+ * This is the RX hook attached by ocii_sdo_init, it can also be called by hand
+ * with frames obtained some other way
+ *
+ * @param user The client, as a void pointer
+ * @param channel The channel the frame was received on
+ * @param message The received frame
+ * @return int Returns 1 if the frame was an SDO response consumed by the client
+ */
+extern int ocii_sdo_rx_hook(void *user, ocii_channel_t channel,
+                            ocii_message_t *message);
+
+/**
+ * @brief Sends staged frames and expires requests that ran out of time
+ *
+ * Use this instead of ocii_sdo_poll when the application reads the channel
+ * itself, responses then reach the client through the RX hook
+ *
+ * @param client The client to service
+ * @return int Returns the number of pending requests, or a negative error code
+ */
+extern int ocii_sdo_service(ocii_sdo_client_t *client);
+
+/**
+ * @brief Drives the SDO client
+ *
+ * Sends staged frames packed three per packet, reads all received frames the
+ * device has and expires requests that ran out of time. Frames that are not
+ * SDO responses are dropped, so do not use it on a channel someone else reads
+ *
+ * @param client The client to drive
+ * @return int Returns the number of pending requests, or a negative error code
+ */
+extern int ocii_sdo_poll(ocii_sdo_client_t *client);
+
+#define OCII_HB_COB_ID 0x700 /* Heartbeat, boot-up and node guarding */
+
+/**
+ * NMT states reported in heartbeat and node guarding frames
+ */
+#define OCII_NMT_BOOTUP 0x00
+#define OCII_NMT_STOPPED 0x04
+#define OCII_NMT_OPERATIONAL 0x05
+#define OCII_NMT_PRE_OPERATIONAL 0x7F
+#define OCII_NMT_UNKNOWN 0xFF
+
+typedef enum {
+    ocii_hb_event_bootup,    /* Boot-up frame received */
+    ocii_hb_event_state,     /* NMT state changed */
+    ocii_hb_event_timeout,   /* Heartbeat or guard response missed */
+    ocii_hb_event_recovered, /* Node heard again after a timeout */
+    ocii_hb_event_toggle,    /* Node guarding toggle bit did not alternate */
+} ocii_hb_event_type_t;
+
+typedef struct {
+    ocii_channel_t channel;
+    uint8_t node;
+    uint8_t type;      /* One of ocii_hb_event_type_t */
+    uint8_t nmt_state; /* Last reported NMT state */
+    uint64_t time;     /* When the event was detected, us */
+} ocii_hb_event_t;
+
+typedef void (*ocii_hb_callback_t)(void *user, const ocii_hb_event_t *event);
+
+/**
+ * Per node bookkeeping of the monitor
+ */
+typedef struct {
+    ocii_timer_t timer;  /* Fires when the node has been silent for too long */
+    ocii_timer_t guard;  /* Fires when the next guard request is due */
+    uint64_t last_seen;  /* us */
+    uint32_t timeout_us; /* Heartbeat consumer time or node life time */
+    uint32_t guard_us;   /* Guard time, 0 for heartbeat consumers */
+    uint8_t nmt_state;
+    uint8_t watched;
+    uint8_t alive;
+    uint8_t toggle;
+} ocii_hb_node_t;
+
+/**
+ * Heartbeat and node guarding monitor. It lives in the RX path, so a frame
+ * costs one table lookup and one O(1) timer restart. Events are delivered
+ * with the recursive lock held
+ */
+typedef struct {
+    pthread_mutex_t lock; /* The RX hook may run on the library I/O thread */
+    ocii_timer_wheel_t wheel;
+    ocii_hb_callback_t callback;
+    void *user;
+    uint8_t consume; /* Set to strip heartbeat frames from the RX stream */
+    ocii_hb_node_t node[ocii_channel_sizeof][OCII_CANOPEN_NODES];
+    uint8_t guard_queue[ocii_channel_sizeof][OCII_CANOPEN_NODES];
+    uint8_t guard_count[ocii_channel_sizeof];
+} ocii_hb_monitor_t;
+
+/**
+ * @brief Initializes a heartbeat monitor and attaches it to the RX path
+ *
+ * @param monitor The monitor to initialize
+ * @param callback The function to deliver events to
+ * @param user Opaque pointer passed back to the callback
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_hb_init(ocii_hb_monitor_t *monitor, ocii_hb_callback_t callback,
+                        void *user);
+
+/**
+ * @brief Detaches the heartbeat monitor from the RX path
+ *
+ * @param monitor The monitor to deinitialize
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_hb_deinit(ocii_hb_monitor_t *monitor);
+
+/**
+ * @brief Starts consuming heartbeats of a node
+ *
+ * A node that never sends a heartbeat times out as well
+ *
+ * @param monitor The monitor to use
+ * @param channel The channel the node is on
+ * @param node The node ID, 1 to 127
+ * @param timeout_us Heartbeat consumer time in microseconds
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_hb_watch(ocii_hb_monitor_t *monitor, ocii_channel_t channel,
+                         uint8_t node, uint32_t timeout_us);
+
+/**
+ * @brief Starts guarding a node
+ *
+ * A remote request is sent to the node every guard time, the node is reported
+ * missing after guard time times life time factor without a response
+ *
+ * @param monitor The monitor to use
+ * @param channel The channel the node is on
+ * @param node The node ID, 1 to 127
+ * @param guard_us Guard time in microseconds
+ * @param life_factor Life time factor
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_hb_guard(ocii_hb_monitor_t *monitor, ocii_channel_t channel,
+                         uint8_t node, uint32_t guard_us, uint8_t life_factor);
+
+/**
+ * @brief Stops monitoring a node
+ *
+ * @param monitor The monitor to use
+ * @param channel The channel the node is on
+ * @param node The node ID, 1 to 127
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_hb_unwatch(ocii_hb_monitor_t *monitor, ocii_channel_t channel,
+                           uint8_t node);
+
+/**
+ * @brief Feeds a received frame to the heartbeat monitor
+ *
+ * @param user The monitor, as a void pointer
+ * @param channel The channel the frame was received on
+ * @param message The received frame
+ * @return int Returns 1 if the frame was consumed
+ */
+extern int ocii_hb_rx_hook(void *user, ocii_channel_t channel,
+                           ocii_message_t *message);
+
+/**
+ * @brief Detects missed heartbeats and sends due guard requests
+ *
+ * Call it periodically, at least once per timer wheel tick for full accuracy
+ *
+ * @param monitor The monitor to drive
+ * @return int Returns the number of expired timers, or a negative error code
+ */
+extern int ocii_hb_tick(ocii_hb_monitor_t *monitor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_canopen_h */
@@ -0,0 +1,233 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Pre and post trigger capture of received frames
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_capture_h
+#define ocii_capture_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Ring size per channel, a power of two. Frames kept before a trigger, the
+ * trigger frame and frames recorded after it must fit into it. Predicates
+ * per channel, at most 16
+ */
+#ifndef OCII_CAPTURE_FRAMES
+#define OCII_CAPTURE_FRAMES 4096
+#endif
+#ifndef OCII_CAPTURE_TRIGGERS
+#define OCII_CAPTURE_TRIGGERS 8
+#endif
+
+#if (OCII_CAPTURE_FRAMES & (OCII_CAPTURE_FRAMES - 1)) != 0
+#error "OCII_CAPTURE_FRAMES must be a power of two"
+#endif
+#if OCII_CAPTURE_TRIGGERS > 16
+#error "OCII_CAPTURE_TRIGGERS must be at most 16"
+#endif
+
+/**
+ * Causes of a capture. Bit i of ocii_capture_event_t.cause is set if the
+ * trigger frame matched predicate i, the higher bits name the other triggers
+ */
+#define OCII_CAPTURE_GAP (1U << 16)    /* Silence longer than gap_us */
+#define OCII_CAPTURE_STATUS (1U << 17) /* Error status change */
+#define OCII_CAPTURE_MANUAL (1U << 18) /* ocii_capture_trigger */
+
+typedef struct {
+    ocii_match_t match[OCII_CAPTURE_TRIGGERS]; /* Predicates on frames */
+    int matches;       /* Predicates in use */
+    uint32_t gap_us;   /* Trigger on silence longer than this, 0 for none */
+    uint8_t status;    /* Trigger on a change passed to ocii_capture_status */
+    uint8_t manual;    /* Record for ocii_capture_trigger alone */
+    uint16_t pre;      /* Frames kept before the trigger frame */
+    uint16_t post;     /* Frames recorded after it */
+} ocii_capture_config_t;
+
+typedef struct {
+    uint64_t time_us; /* ocii_time_us() when it was received */
+    ocii_message_t message;
+} ocii_capture_frame_t;
+
+/**
+ * A finished capture as handed to the sink. frames[pre] is the trigger frame,
+ * fewer than the configured frames are kept before it if the channel had not
+ * received as many yet
+ */
+typedef struct {
+    uint64_t sequence; /* Captures handed to the sink before this one */
+    uint32_t cause;    /* Logical OR of the triggers that fired */
+    ocii_channel_t channel;
+    int pre;
+    int count;
+    const ocii_capture_frame_t *frames;
+} ocii_capture_event_t;
+
+/**
+ * Writes a finished capture out, called on the writer thread of the capture.
+ * Returns 0 on success, or a negative error code that is counted in failed
+ */
+typedef int (*ocii_capture_sink_t)(void *user,
+                                   const ocii_capture_event_t *event);
+
+typedef struct {
+    uint64_t data;
+    uint64_t data_mask;
+    uint32_t can_id;
+    uint32_t id_mask;
+    uint32_t extended;
+} ocii_capture_trigger_t;
+
+typedef struct {
+    ocii_capture_trigger_t trigger[OCII_CAPTURE_TRIGGERS];
+    int triggers;
+    int pre;
+    int post;
+    uint8_t status;
+    uint8_t enabled;
+    uint64_t gap_us;  /* UINT64_MAX for none */
+    uint64_t last_us; /* Receive time of the last frame */
+    uint64_t head;    /* Frames written to the ring */
+    uint64_t at;      /* Ring position of the trigger frame */
+    uint64_t stop;    /* Ring position that ends the capture, 0 while armed */
+    uint32_t cause;
+    atomic_uint pending;     /* Causes raised by other threads */
+    uint32_t error_state[3]; /* Status and counters of ocii_capture_status */
+    uint8_t error_known;
+    ocii_capture_frame_t ring[OCII_CAPTURE_FRAMES];
+} ocii_capture_channel_t;
+
+/**
+ * Each channel records into its own ring and is armed again as soon as a
+ * capture is handed over. A capture is copied out of the ring once, on the RX
+ * path, and written by a thread of its own. While that thread is still busy
+ * with the previous capture of the channel, new ones are counted in missed
+ */
+typedef struct {
+    ocii_capture_channel_t channel[ocii_channel_sizeof];
+    struct {
+        ocii_capture_event_t event;
+        int state; /* Free, ready or being written */
+        ocii_capture_frame_t frames[OCII_CAPTURE_FRAMES];
+    } out[ocii_channel_sizeof];
+    ocii_capture_sink_t sink;
+    void *user;
+    uint64_t captures; /* Handed to the sink */
+    uint64_t missed;   /* Triggered while the writer was busy */
+    uint64_t failed;   /* Rejected by the sink */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int running;
+} ocii_capture_t;
+
+/**
+ * @brief Initializes the capture, starts its writer thread and attaches it to
+ * the RX path
+ *
+ * Each channel must be read from the device by one thread at a time, which is
+ * the case with the I/O thread or with one reader per channel
+ *
+ * @param capture The capture to initialize
+ * @param config One configuration per channel, a channel without triggers is
+ * not recorded
+ * @param sink Writes finished captures, e.g. ocii_capture_sink_file
+ * @param user Opaque pointer passed back to the sink
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_capture_init(ocii_capture_t *capture,
+                             const ocii_capture_config_t *config,
+                             ocii_capture_sink_t sink, void *user);
+
+/**
+ * @brief Detaches the capture from the RX path, hands over captures still
+ * recording with the frames they have and waits for the writer thread
+ *
+ * @param capture The capture to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_capture_deinit(ocii_capture_t *capture);
+
+/**
+ * @brief RX hook, records the frame and checks it against the triggers
+ *
+ * Added by ocii_capture_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_capture_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns 0, the message is left to the application
+ */
+extern int ocii_capture_rx_hook(void *user, ocii_channel_t channel,
+                                ocii_message_t *message);
+
+/**
+ * @brief Triggers a capture of a channel, taken at its next frame
+ *
+ * Only channels with a trigger configured record frames. One that relies on
+ * this call alone needs manual set in its config
+ *
+ * @param capture The capture
+ * @param channel The channel to capture
+ * @return int Returns 0 on success, OCII_ERROR_INVALID_ARG if the channel
+ * does not record, or another negative error code on failure
+ */
+extern int ocii_capture_trigger(ocii_capture_t *capture,
+                                ocii_channel_t channel);
+
+/**
+ * @brief Passes a status read with ocii_get_status, a change of the status
+ * register or a rising error counter triggers a capture at the next frame if
+ * the channel is configured for it
+ *
+ * The first status of a channel only sets the reference. Statuses of a
+ * channel must come from one thread at a time
+ *
+ * @param capture The capture
+ * @param channel The channel the status belongs to
+ * @param status The status packet
+ * @return int Returns 1 if it triggered, 0 if not, or a negative error code
+ */
+extern int ocii_capture_status(ocii_capture_t *capture, ocii_channel_t channel,
+                               const ocii_packet_t *status);
+
+/**
+ * @brief Sink that writes each capture to a file in the candump log format,
+ * named capture-<sequence>-can<channel>.log
+ *
+ * @param user Directory to write to as a const char *, NULL for the current
+ * @param event The finished capture
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_capture_sink_file(void *user,
+                                  const ocii_capture_event_t *event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_capture_h */
@@ -0,0 +1,119 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Payload-change-only delivery of received messages
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_change_h
+#define ocii_change_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Hash table for 29-bit IDs per channel, a power of two at least twice the
+ * number of extended IDs on the bus. Messages of IDs that do not fit are
+ * always delivered
+ */
+#ifndef OCII_CHANGE_EXT_SLOTS
+#define OCII_CHANGE_EXT_SLOTS 1024
+#endif
+
+/**
+ * Last delivered value of an ID
+ */
+typedef struct {
+    uint64_t payload; /* Data with the bytes past data_len cleared */
+    uint32_t time;    /* In units of 100 us, like the device time stamp */
+    uint8_t flags;    /* Data length, remote and valid bits */
+} ocii_change_value_t;
+
+typedef struct {
+    atomic_uchar enabled[ocii_channel_sizeof];
+    atomic_uchar reset[ocii_channel_sizeof]; /* Tables cleared by the RX path */
+    uint32_t refresh_ms; /* Deliver an unchanged message this often, 0 never */
+    ocii_change_value_t standard[ocii_channel_sizeof][2048];
+    struct {
+        uint32_t key; /* ID + 1, 0 for a free slot */
+        ocii_change_value_t value;
+    } extended[ocii_channel_sizeof][OCII_CHANGE_EXT_SLOTS];
+    uint64_t delivered[ocii_channel_sizeof];
+    uint64_t suppressed[ocii_channel_sizeof];
+    uint64_t refreshed[ocii_channel_sizeof]; /* Delivered only as a refresh */
+    uint64_t overflow[ocii_channel_sizeof];  /* Delivered for lack of a slot */
+} ocii_change_t;
+
+/**
+ * @brief Initializes change-only delivery and attaches it to the RX path
+ *
+ * Both channels start enabled. A message is delivered when its data, data
+ * length or remote flag differ from the last one delivered with its ID, or
+ * when refresh_ms passed since then. Other messages are consumed. RX hooks
+ * run in the order they were added, add the ones that must see every
+ * message first. Each channel must be read by one thread at a time
+ *
+ * @param change The filter to initialize
+ * @param refresh_ms Period of the still-alive refresh, 0 for none
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_change_init(ocii_change_t *change, uint32_t refresh_ms);
+
+/**
+ * @brief Detaches the filter from the RX path
+ *
+ * @param change The filter to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_change_deinit(ocii_change_t *change);
+
+/**
+ * @brief Switches change-only delivery of a channel on or off
+ *
+ * Switching it on forgets the last values, so every ID is delivered once
+ *
+ * @param change The filter
+ * @param channel The channel
+ * @param enable Non-zero to deliver only changes
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_change_enable(ocii_change_t *change, ocii_channel_t channel,
+                              int enable);
+
+/**
+ * @brief RX hook, consumes messages that repeat the last delivered value
+ *
+ * Added by ocii_change_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_change_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns non-zero if the message is suppressed
+ */
+extern int ocii_change_rx_hook(void *user, ocii_channel_t channel,
+                               ocii_message_t *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_change_h */
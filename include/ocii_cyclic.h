@@ -0,0 +1,168 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Cyclic TX scheduler, timer wheel dispatch with packet coalescing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_cyclic_h
+#define ocii_cyclic_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <ocii_timer.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+
+/**
+ * Number of cyclic frames one scheduler can hold, enough for the rest-bus of
+ * a whole vehicle. Override at compile time if more are needed
+ */
+#ifndef OCII_CYCLIC_MAX
+#define OCII_CYCLIC_MAX 512
+#endif
+
+/**
+ * Called right before a frame is queued for sending, may rewrite the payload
+ * (counters, checksums, simulated signals)
+ */
+typedef void (*ocii_cyclic_update_t)(void *user, ocii_message_t *frame);
+
+/**
+ * Send statistics of one cyclic frame. Jitter is how late the frame was
+ * handed to the device compared to its ideal time, in microseconds
+ */
+typedef struct {
+    uint64_t sent;     /* Frames written */
+    uint64_t skipped;  /* Cycles missed because the scheduler ran late */
+    uint64_t overruns; /* Cycles that fired while the last frame was queued */
+    int64_t jitter_min;
+    int64_t jitter_max;
+    double jitter_mean;
+    double jitter_m2; /* Sum of squared deviations, variance is m2 / sent */
+} ocii_cyclic_stats_t;
+
+typedef struct {
+    ocii_timer_t timer;
+    ocii_message_t frame;
+    ocii_cyclic_update_t update;
+    void *user;
+    uint64_t due;       /* Ideal time of the next cycle, us */
+    uint64_t queued_at; /* Ideal time of the queued frame, us */
+    uint32_t period_us; /* 0 for a one-shot frame */
+    uint8_t channel;
+    uint8_t in_use;
+    uint8_t queued;
+    ocii_cyclic_stats_t stats;
+} ocii_cyclic_entry_t;
+
+typedef struct {
+    ocii_timer_wheel_t wheel;
+    ocii_cyclic_entry_t entry[OCII_CYCLIC_MAX];
+    uint64_t packets; /* Packets written, frames / packets is the coalescing */
+    uint64_t frames;
+
+    /**
+     * Frames due for sending in firing order, as entry indexes
+     */
+    uint16_t queue[ocii_channel_sizeof][OCII_CYCLIC_MAX];
+    uint16_t queue_count[ocii_channel_sizeof];
+} ocii_cyclic_t;
+
+/**
+ * @brief Initializes a cyclic scheduler
+ *
+ * @param scheduler The scheduler to initialize
+ * @param tick_us Timer wheel resolution in microseconds, 0 for the default
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_cyclic_init(ocii_cyclic_t *scheduler, uint32_t tick_us);
+
+/**
+ * @brief Registers a cyclic frame
+ *
+ * The first frame goes out phase_us after the call, the following ones every
+ * period_us. Cycles are computed from the ideal times, so late polls do not
+ * make the schedule drift. A one-shot frame frees its handle once it has been
+ * written, it only needs ocii_cyclic_remove to cancel it before that
+ *
+ * @param scheduler The scheduler to use
+ * @param channel The channel to send on
+ * @param frame The frame to send, copied
+ * @param period_us The period in microseconds, 0 to send it once
+ * @param phase_us Delay of the first frame in microseconds
+ * @param update Payload update callback, may be NULL
+ * @param user Opaque pointer passed back to the callback
+ * @return int Returns the handle of the frame, or a negative error code
+ */
+extern int ocii_cyclic_add(ocii_cyclic_t *scheduler, ocii_channel_t channel,
+                           const ocii_message_t *frame, uint32_t period_us,
+                           uint32_t phase_us, ocii_cyclic_update_t update,
+                           void *user);
+
+/**
+ * @brief Unregisters a cyclic frame, a queued copy is dropped
+ *
+ * @param scheduler The scheduler to use
+ * @param handle The handle returned by ocii_cyclic_add
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_cyclic_remove(ocii_cyclic_t *scheduler, int handle);
+
+/**
+ * @brief Replaces the payload of a cyclic frame, used from the next cycle on
+ *
+ * @param scheduler The scheduler to use
+ * @param handle The handle returned by ocii_cyclic_add
+ * @param data The new payload
+ * @param length Payload length, at most 8
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_cyclic_set_data(ocii_cyclic_t *scheduler, int handle,
+                                const uint8_t *data, uint8_t length);
+
+/**
+ * @brief Reads the send statistics of a cyclic frame
+ *
+ * @param scheduler The scheduler to use
+ * @param handle The handle returned by ocii_cyclic_add
+ * @param stats Receives the statistics
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_cyclic_stats(const ocii_cyclic_t *scheduler, int handle,
+                             ocii_cyclic_stats_t *stats);
+
+/**
+ * @brief Fires the frames that came due and writes them
+ *
+ * Frames due in the same tick are coalesced into packets of three per
+ * channel. Frames the device has no room for stay queued for the next poll.
+ * Call it at least once per tick, e.g. from the main loop of a rest-bus
+ * simulation
+ *
+ * @param scheduler The scheduler to drive
+ * @return int Returns the number of frames written, or a negative error code
+ */
+extern int ocii_cyclic_poll(ocii_cyclic_t *scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_cyclic_h */
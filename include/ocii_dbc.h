@@ -0,0 +1,243 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * DBC driven signal decoding with precompiled extraction plans
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_dbc_h
+#define ocii_dbc_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OCII_DBC_NAME 64
+#define OCII_DBC_UNIT 16
+
+/**
+ * Value of ocii_dbc_signal_t.mux_value for signals that are always present
+ */
+#define OCII_DBC_NOT_MULTIPLEXED -1
+
+typedef enum {
+    ocii_dbc_integer,
+    ocii_dbc_float32,
+    ocii_dbc_float64,
+} ocii_dbc_value_type_t;
+
+/**
+ * Signal as described by the DBC file
+ */
+typedef struct {
+    char name[OCII_DBC_NAME];
+    char unit[OCII_DBC_UNIT];
+    uint16_t message;    /* Index of the owning message */
+    uint8_t start;       /* Start bit as written in the DBC file */
+    uint8_t length;      /* Length in bits */
+    uint8_t intel;       /* Set for little endian (@1), clear for Motorola */
+    uint8_t is_signed;   /* Set for two's complement (-) signals */
+    uint8_t value_type;  /* One of ocii_dbc_value_type_t */
+    uint8_t multiplexer; /* Set if this is the multiplexer switch (M) */
+    int32_t mux_value;   /* Switch value (m<n>), OCII_DBC_NOT_MULTIPLEXED */
+    double factor;
+    double offset;
+    double minimum;
+    double maximum;
+} ocii_dbc_signal_t;
+
+typedef struct {
+    char name[OCII_DBC_NAME];
+    uint32_t can_id;
+    uint8_t extended;
+    uint8_t dlc;
+    uint8_t big_endian; /* Set if any signal needs the big endian word */
+    int16_t mux;        /* Signal index of the multiplexer, or -1 */
+    uint32_t first;     /* Index of the first signal and plan step */
+    uint32_t count;     /* Number of signals */
+} ocii_dbc_message_t;
+
+typedef enum {
+    ocii_dbc_step_word,    /* Shift and mask the 64-bit payload word */
+    ocii_dbc_step_u8,      /* Byte aligned little endian loads */
+    ocii_dbc_step_u16,
+    ocii_dbc_step_u32,
+    ocii_dbc_step_float32, /* IEEE 754 signals */
+    ocii_dbc_step_float64,
+} ocii_dbc_step_kind_t;
+
+/**
+ * One entry of a compiled extraction plan. The payload is read once as a
+ * little endian and, if needed, a big endian 64-bit word, so that every
+ * signal boils down to a shift and a mask of one of them. Byte aligned little
+ * endian signals load their bytes directly instead
+ */
+typedef struct {
+    uint8_t kind;  /* One of ocii_dbc_step_kind_t */
+    uint8_t word;  /* 0 for the little endian word, 1 for the big endian one */
+    uint8_t shift; /* Right shift of the word, or first byte of direct loads */
+    uint8_t pad;
+    uint64_t mask;
+    uint64_t sign; /* Sign bit of signed signals, 0 for unsigned ones */
+    double factor;
+    double offset;
+} ocii_dbc_step_t;
+
+/**
+ * Loaded database with one plan step per signal, steps and signals share
+ * their indexes. Messages are found through a perfect hash of the CAN ID
+ */
+typedef struct {
+    ocii_dbc_message_t *message;
+    uint32_t messages;
+    ocii_dbc_signal_t *signal;
+    ocii_dbc_step_t *step;
+    uint32_t signals;
+    uint32_t hash_multiplier;
+    uint8_t hash_bits;
+    uint32_t *hash_key;    /* CAN ID with bit 31 set for extended frames */
+    uint16_t *hash_value;  /* Message index plus one, 0 for empty slots */
+} ocii_dbc_t;
+
+/**
+ * Columnar decode output. Signal s owns values[s * rows] to
+ * values[(s + 1) * rows - 1], rows are counted per message, so all signals of
+ * a message share the row index and the time stamp
+ */
+typedef struct {
+    uint32_t rows;     /* Capacity, rows per message */
+    uint32_t *count;   /* Filled rows, per message */
+    uint32_t *time;    /* Device time stamps, time[message * rows + row] */
+    double *values;    /* NaN where a multiplexed signal was absent */
+    uint64_t dropped;  /* Frames that did not fit */
+} ocii_dbc_buffer_t;
+
+/**
+ * @brief Parses DBC text and compiles the extraction plans
+ *
+ * @param text The DBC file contents, does not need to be zero terminated
+ * @param length Length of the text in bytes
+ * @param db Receives the database, free it with ocii_dbc_free
+ * @param line Receives the line of a parse error, such as a second BO_ of
+ * the same ID, may be NULL
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_dbc_parse(const char *text, size_t length, ocii_dbc_t **db,
+                          uint32_t *line);
+
+/**
+ * @brief Loads a DBC file and compiles the extraction plans
+ *
+ * @param path Path to the DBC file
+ * @param db Receives the database, free it with ocii_dbc_free
+ * @param line Receives the line of a parse error, such as a second BO_ of
+ * the same ID, may be NULL
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_dbc_load(const char *path, ocii_dbc_t **db, uint32_t *line);
+
+/**
+ * @brief Releases a database
+ *
+ * @param db The database to release, may be NULL
+ */
+extern void ocii_dbc_free(ocii_dbc_t *db);
+
+/**
+ * @brief Looks up the message of a CAN ID, O(1)
+ *
+ * @param db The database to search
+ * @param can_id The CAN ID
+ * @param extended Set for 29-bit identifiers
+ * @return int Returns the message index, or -1 if the ID is unknown
+ */
+extern int ocii_dbc_find(const ocii_dbc_t *db, uint32_t can_id,
+                         uint8_t extended);
+
+/**
+ * @brief Looks up a signal by name
+ *
+ * @param db The database to search
+ * @param message Message name, or NULL to search all messages
+ * @param signal Signal name
+ * @return int Returns the signal index, or -1 if there is no such signal
+ */
+extern int ocii_dbc_signal_index(const ocii_dbc_t *db, const char *message,
+                                 const char *signal);
+
+/**
+ * @brief Decodes all signals of one frame
+ *
+ * @param db The database to use
+ * @param frame The received frame
+ * @param values Receives one value per signal of the message, in DBC order
+ * @return int Returns the message index, or -1 if the ID is unknown
+ */
+extern int ocii_dbc_decode_frame(const ocii_dbc_t *db,
+                                 const ocii_message_t *frame, double *values);
+
+/**
+ * @brief Allocates a columnar buffer for a database
+ *
+ * @param db The database the buffer is for
+ * @param buffer The buffer to initialize
+ * @param rows Number of rows per message
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_dbc_buffer_init(const ocii_dbc_t *db, ocii_dbc_buffer_t *buffer,
+                                uint32_t rows);
+
+/**
+ * @brief Empties a columnar buffer without releasing it
+ *
+ * @param db The database the buffer is for
+ * @param buffer The buffer to empty
+ */
+extern void ocii_dbc_buffer_reset(const ocii_dbc_t *db,
+                                  ocii_dbc_buffer_t *buffer);
+
+/**
+ * @brief Releases the memory of a columnar buffer
+ *
+ * @param buffer The buffer to release
+ */
+extern void ocii_dbc_buffer_free(ocii_dbc_buffer_t *buffer);
+
+/**
+ * @brief Decodes a batch of frames into a columnar buffer
+ *
+ * Frames of unknown IDs, remote frames and frames whose message is full are
+ * skipped, the latter are counted in buffer->dropped
+ *
+ * @param db The database to use
+ * @param frames The received frames
+ * @param count Number of frames
+ * @param buffer The buffer to append to
+ * @return int Returns the number of decoded frames
+ */
+extern int ocii_dbc_decode(const ocii_dbc_t *db, const ocii_message_t *frames,
+                           size_t count, ocii_dbc_buffer_t *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_dbc_h */
@@ -0,0 +1,160 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * TX confirmation by matching the echoes of sent messages
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_echo_h
+#define ocii_echo_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * Number of sent messages that can wait for their echo at once, a power of
+ * two. Override at compile time if more are needed
+ */
+#ifndef OCII_ECHO_MAX
+#define OCII_ECHO_MAX 1024
+#endif
+
+/**
+ * The hash table has twice as many buckets as entries, so chains stay short
+ */
+#define OCII_ECHO_BUCKETS (2 * OCII_ECHO_MAX)
+
+#define OCII_ECHO_TIMEOUT_US 100000U
+
+/**
+ * Called once per sent message. status is 0 once its echo arrived,
+ * OCII_ERROR_TX_LOST if a later message was echoed first, or
+ * OCII_ERROR_TIMEOUT if no echo came in time. latency_us is the time from
+ * ocii_echo_write to the echo, 0 if there was none
+ */
+typedef void (*ocii_echo_callback_t)(void *user, ocii_channel_t channel,
+                                     const ocii_message_t *message,
+                                     uintptr_t tag, int status,
+                                     uint64_t latency_us);
+
+typedef struct {
+    ocii_message_t message;
+    uint64_t queued_at; /* When it was handed to ocii_write, us */
+    uint64_t sequence;  /* Send order on the channel */
+    uintptr_t tag;
+    uint32_t hash;
+    uint16_t chain; /* Next entry of the bucket or of the free list, 1-based */
+    uint16_t prev;  /* Neighbours in send order on the channel, 1-based */
+    uint16_t next;
+    uint8_t channel;
+} ocii_echo_entry_t;
+
+/**
+ * Outstanding messages are kept in a hash table keyed by channel, ID and
+ * payload, each bucket in send order, and in one send order list per
+ * channel. An echo is matched to the oldest outstanding message with the
+ * same key
+ */
+typedef struct {
+    pthread_mutex_t lock; /* The RX hook may run on the library I/O thread */
+    ocii_echo_callback_t callback;
+    void *user;
+    uint32_t timeout_us; /* OCII_ECHO_TIMEOUT_US by default */
+    uint32_t outstanding;
+    uint64_t sequence;
+    uint16_t free;
+    uint16_t bucket_head[OCII_ECHO_BUCKETS];
+    uint16_t bucket_tail[OCII_ECHO_BUCKETS];
+    uint16_t oldest[ocii_channel_sizeof];
+    uint16_t newest[ocii_channel_sizeof];
+    ocii_echo_entry_t entry[OCII_ECHO_MAX];
+
+    /**
+     * Statistics, latencies in microseconds
+     */
+    uint64_t confirmed;
+    uint64_t lost;
+    uint64_t timed_out;
+    uint64_t latency_min;
+    uint64_t latency_max;
+    uint64_t latency_sum;
+} ocii_echo_t;
+
+/**
+ * @brief Initializes TX confirmation and attaches it to the RX path
+ *
+ * @param echo The state to initialize
+ * @param callback Called for every sent message once its fate is known
+ * @param user Opaque pointer passed back to the callback
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_echo_init(ocii_echo_t *echo, ocii_echo_callback_t callback,
+                          void *user);
+
+/**
+ * @brief Detaches TX confirmation from the RX path, outstanding messages are
+ * forgotten
+ *
+ * @param echo The state to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_echo_deinit(ocii_echo_t *echo);
+
+/**
+ * @brief Writes a packet with echo requested for every message and tracks
+ * the messages until they are confirmed
+ *
+ * @param echo The state to use
+ * @param channel The channel to write to
+ * @param packet The packet to send, OCII_SEND_TYPE_ECHO is set on its messages
+ * @param tag Opaque value passed back to the callback of each message
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_echo_write(ocii_echo_t *echo, ocii_channel_t channel,
+                           ocii_packet_t *packet, uintptr_t tag);
+
+/**
+ * @brief RX hook, consumes the echoes of tracked messages
+ *
+ * Added by ocii_echo_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_echo_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns non-zero if the message was an echo and was consumed
+ */
+extern int ocii_echo_rx_hook(void *user, ocii_channel_t channel,
+                             ocii_message_t *message);
+
+/**
+ * @brief Reports the messages whose echo did not come within timeout_us
+ *
+ * @param echo The state to check
+ * @return int Returns the number of messages reported, or a negative error code
+ */
+extern int ocii_echo_poll(ocii_echo_t *echo);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_echo_h */
@@ -0,0 +1,178 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Channel to channel gateway with ID rewrite and rate limiting
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_gateway_h
+#define ocii_gateway_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * Sizes of the routing table and of the per-channel forwarding queues.
+ * OCII_GATEWAY_EXT_SLOTS is the hash table for 29-bit IDs, a power of two at
+ * least twice the number of extended rules
+ */
+#ifndef OCII_GATEWAY_ROUTES
+#define OCII_GATEWAY_ROUTES 256
+#endif
+#ifndef OCII_GATEWAY_EXT_SLOTS
+#define OCII_GATEWAY_EXT_SLOTS 512
+#endif
+#ifndef OCII_GATEWAY_QUEUE
+#define OCII_GATEWAY_QUEUE 384
+#endif
+
+/**
+ * Forwarding latency histogram, bucket i counts latencies below 2^i us
+ */
+#define OCII_GATEWAY_HISTOGRAM 24
+
+typedef enum {
+    OCII_GATEWAY_PASS,    /* Leave the message to the application */
+    OCII_GATEWAY_FORWARD, /* Send it on the other channel */
+    OCII_GATEWAY_DROP,    /* Discard it */
+    OCII_GATEWAY_REMAP    /* Send it on the other channel with another ID */
+} ocii_gateway_action_t;
+
+/**
+ * Called for every message about to be forwarded, may rewrite it. Return
+ * non-zero to drop the message instead
+ */
+typedef int (*ocii_gateway_transform_t)(void *user, ocii_channel_t from,
+                                        ocii_message_t *message);
+
+typedef struct {
+    uint32_t can_id;
+    uint8_t extended;
+    uint8_t from;   /* Channel the rule applies to */
+    uint8_t action; /* One of ocii_gateway_action_t */
+    uint32_t remap_id;
+    uint8_t remap_extended;
+    ocii_gateway_transform_t transform; /* May be NULL */
+    void *user;                         /* Passed back to transform */
+    uint32_t rate;  /* Messages per second, 0 for no limit */
+    uint32_t burst; /* Bucket size, at least 1 if rate is set */
+} ocii_gateway_rule_t;
+
+typedef struct {
+    ocii_gateway_rule_t rule;
+    uint64_t tokens;  /* Millionths of a message */
+    uint64_t refill;  /* Time of the last refill, us */
+    uint64_t matched; /* Messages that hit the rule */
+    uint64_t limited; /* Messages dropped by the rate limit */
+} ocii_gateway_route_t;
+
+typedef struct {
+    uint64_t forwarded;
+    uint64_t dropped;  /* By rule or transform */
+    uint64_t limited;  /* By rate limit */
+    uint64_t overflow; /* Forwarding queue full */
+    uint64_t packets;  /* Packets written, forwarded / packets is the batching */
+    uint64_t latency[OCII_GATEWAY_HISTOGRAM];
+} ocii_gateway_stats_t;
+
+/**
+ * Routes are looked up through a direct table for 11-bit IDs and a hash table
+ * for 29-bit IDs. Forwarded messages are queued per destination channel with
+ * their arrival time and written three per packet
+ */
+typedef struct {
+    pthread_mutex_t lock; /* The RX hook may run on the library I/O thread */
+    uint32_t flush_us;    /* Longest wait of a partial packet, 0 for a poll */
+    uint8_t default_action[ocii_channel_sizeof];
+    uint16_t routes;
+    ocii_gateway_route_t route[OCII_GATEWAY_ROUTES];
+    uint16_t standard[ocii_channel_sizeof][2048]; /* Route + 1, 0 for none */
+    struct {
+        uint32_t key; /* ID with the channel in bit 31 */
+        uint16_t route; /* Route + 1, 0 for a free slot */
+    } extended[OCII_GATEWAY_EXT_SLOTS];
+    ocii_message_t queue[ocii_channel_sizeof][OCII_GATEWAY_QUEUE];
+    uint64_t arrival[ocii_channel_sizeof][OCII_GATEWAY_QUEUE];
+    uint16_t queue_count[ocii_channel_sizeof];
+    ocii_gateway_stats_t stats;
+} ocii_gateway_t;
+
+/**
+ * @brief Initializes a gateway and attaches it to the RX path
+ *
+ * @param gateway The gateway to initialize
+ * @param default_action What happens to messages without a rule, PASS,
+ * FORWARD or DROP
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_gateway_init(ocii_gateway_t *gateway,
+                             ocii_gateway_action_t default_action);
+
+/**
+ * @brief Detaches a gateway from the RX path, queued messages are dropped
+ *
+ * @param gateway The gateway to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_gateway_deinit(ocii_gateway_t *gateway);
+
+/**
+ * @brief Adds a rule to the routing table, replacing one for the same ID
+ *
+ * @param gateway The gateway to configure
+ * @param rule The rule, copied
+ * @return int Returns the index of the route, or a negative error code
+ */
+extern int ocii_gateway_add_rule(ocii_gateway_t *gateway,
+                                 const ocii_gateway_rule_t *rule);
+
+/**
+ * @brief RX hook, routes every received message
+ *
+ * Added by ocii_gateway_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_gateway_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns non-zero if the message was forwarded or dropped
+ */
+extern int ocii_gateway_rx_hook(void *user, ocii_channel_t channel,
+                                ocii_message_t *message);
+
+/**
+ * @brief Writes the queued messages that did not fill a packet yet
+ *
+ * Full packets are written by the RX hook right away, partial ones once they
+ * waited flush_us. With flush_us at 0 they wait for this call instead. Call
+ * it after every read of the main loop, or periodically when the I/O thread
+ * does the reading
+ *
+ * @param gateway The gateway to drive
+ * @return int Returns the number of messages written, or a negative error code
+ */
+extern int ocii_gateway_poll(ocii_gateway_t *gateway);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_gateway_h */
@@ -0,0 +1,271 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * SAE J1939 PGN decoding and transport protocol reassembly
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_j1939_h
+#define ocii_j1939_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <ocii_timer.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define OCII_J1939_PGN_TP_CM 0x00EC00U  /* Transport protocol, connection */
+#define OCII_J1939_PGN_TP_DT 0x00EB00U  /* Transport protocol, data */
+#define OCII_J1939_PGN_ETP_CM 0x00C800U /* Extended TP, connection */
+#define OCII_J1939_PGN_ETP_DT 0x00C700U /* Extended TP, data */
+
+#define OCII_J1939_GLOBAL 0xFF     /* Global destination address */
+#define OCII_J1939_NO_ADDRESS 0xFE /* Null address, listen only */
+
+/**
+ * Reassembly pools. BAM and RTS/CTS sessions own one buffer of
+ * OCII_J1939_BUFFER_SIZE bytes, 1785 is the largest TP message. Extended TP
+ * messages are 1786 bytes and up, their sessions come from a separate pool
+ * of OCII_J1939_ETP_BUFFER_SIZE byte buffers, and larger ones are refused.
+ * So are TP announcements under 9 bytes, which fit a single frame, and ETP
+ * announcements that TP would carry.
+ * Override at compile time to trade memory for larger ETP messages, at most
+ * 255 sessions in all
+ */
+#ifndef OCII_J1939_SESSIONS
+#define OCII_J1939_SESSIONS 32
+#endif
+#ifndef OCII_J1939_BUFFER_SIZE
+#define OCII_J1939_BUFFER_SIZE 1785
+#endif
+#ifndef OCII_J1939_ETP_SESSIONS
+#define OCII_J1939_ETP_SESSIONS 2
+#endif
+#ifndef OCII_J1939_ETP_BUFFER_SIZE
+#define OCII_J1939_ETP_BUFFER_SIZE 65536
+#endif
+
+#define OCII_J1939_SUBSCRIPTIONS 64
+#define OCII_J1939_LEAVES 16 /* PDU2 PGN pages with subscriptions */
+#define OCII_J1939_TX_QUEUE 64
+
+/**
+ * Transport protocol timeouts, us
+ */
+#define OCII_J1939_T1_US 750000U  /* Between two data packets */
+#define OCII_J1939_T2_US 1250000U /* After sending a CTS */
+
+/**
+ * Connection abort reasons
+ */
+#define OCII_J1939_ABORT_RESOURCES 2
+#define OCII_J1939_ABORT_TIMEOUT 3
+#define OCII_J1939_ABORT_TOO_LARGE 9
+#define OCII_J1939_ABORT_OTHER 250
+
+/**
+ * Fields of a 29-bit J1939 identifier
+ */
+typedef struct {
+    uint32_t pgn;
+    uint8_t priority;
+    uint8_t sa; /* Source address */
+    uint8_t da; /* Destination address, OCII_J1939_GLOBAL for PDU2 */
+} ocii_j1939_id_t;
+
+/**
+ * @brief Splits a 29-bit identifier into PGN, priority, source and destination
+ *
+ * Branch free: for PDU2 formats (PF >= 240) the PS byte belongs to the PGN,
+ * otherwise it is the destination address
+ *
+ * @param can_id The 29-bit CAN identifier
+ * @return ocii_j1939_id_t The decoded fields
+ */
+static inline ocii_j1939_id_t ocii_j1939_decode_id(uint32_t can_id) {
+    uint32_t pf = can_id >> 16 & 0xFF, ps = can_id >> 8 & 0xFF;
+    uint32_t pdu2 = 0U - ((pf + 16) >> 8); /* All ones if PF >= 240 */
+
+    return (ocii_j1939_id_t){.pgn = (can_id >> 8 & 0x3FF00) | (ps & pdu2),
+                             .priority = (uint8_t)(can_id >> 26 & 0x07),
+                             .sa = (uint8_t)can_id,
+                             .da = (uint8_t)(ps | (pdu2 & 0xFF))};
+}
+
+/**
+ * @brief Builds a 29-bit identifier, the inverse of ocii_j1939_decode_id
+ *
+ * @param priority Priority, 0 to 7
+ * @param pgn Parameter group number
+ * @param sa Source address
+ * @param da Destination address, ignored for PDU2 PGNs
+ * @return uint32_t The 29-bit CAN identifier
+ */
+static inline uint32_t ocii_j1939_encode_id(uint8_t priority, uint32_t pgn,
+                                            uint8_t sa, uint8_t da) {
+    uint32_t pdu2 = 0U - (((pgn >> 8 & 0xFF) + 16) >> 8);
+
+    return (uint32_t)(priority & 0x07) << 26 | (pgn & 0x3FF00) << 8 |
+           (((pgn & pdu2) | (da & ~pdu2)) & 0xFF) << 8 | sa;
+}
+
+/**
+ * Complete parameter group, either a single frame or a reassembled message
+ */
+typedef struct {
+    ocii_channel_t channel;
+    uint32_t pgn;
+    uint8_t priority;
+    uint8_t sa;
+    uint8_t da;
+    uint32_t length;
+    const uint8_t *data; /* Only valid during the callback */
+    uint64_t time;       /* When the last frame was received, us */
+} ocii_j1939_message_t;
+
+/**
+ * Called with the lock of the stack held, it must not call into the stack
+ */
+typedef void (*ocii_j1939_callback_t)(void *user,
+                                      const ocii_j1939_message_t *message);
+
+typedef enum {
+    ocii_j1939_session_bam,
+    ocii_j1939_session_tp,
+    ocii_j1939_session_etp,
+} ocii_j1939_session_type_t;
+
+/**
+ * Reassembly session, taken from one of the pools in ocii_j1939_t
+ */
+typedef struct {
+    ocii_timer_t timer;
+    uint32_t pgn;
+    uint32_t size;    /* Message size, bytes */
+    uint32_t packets; /* Total number of data packets */
+    uint32_t next;    /* Next expected packet number, counted from 1 */
+    uint32_t window;  /* Last packet number of the current CTS window */
+    uint32_t offset;  /* ETP data packet offset */
+    uint8_t channel;
+    uint8_t sa;
+    uint8_t da;
+    uint8_t type;     /* One of ocii_j1939_session_type_t */
+    uint8_t priority;
+    uint8_t responder; /* Set if this node sends the CTS and EOMA */
+    uint8_t limit;     /* Most packets per CTS the sender takes, from RTS */
+    uint8_t link;      /* Next session of the same source, or free list */
+    uint8_t in_use;
+    uint8_t *data; /* Buffer of the pool the session belongs to */
+} ocii_j1939_session_t;
+
+typedef struct {
+    pthread_mutex_t lock; /* The RX hook may run on the library I/O thread */
+    uint8_t address;         /* Own address, or OCII_J1939_NO_ADDRESS */
+    uint8_t cts_packets;     /* Packets requested per CTS, 16 by default */
+    uint8_t consume;         /* Set to strip J1939 frames from the RX stream */
+    ocii_j1939_callback_t fallback; /* Receives unsubscribed PGNs, may be NULL */
+    void *fallback_user;
+
+    uint32_t completed; /* Messages reassembled */
+    uint32_t aborted;   /* Sessions aborted or timed out */
+    uint32_t refused;   /* Sessions refused for their size or lack of room */
+
+    /**
+     * PGN lookup: page[pgn >> 8] holds the subscription for PDU1 PGNs, or the
+     * leaf that holds the subscriptions of the 256 PDU2 PGNs of that page
+     */
+    uint16_t page[1024];
+    uint8_t leaf[OCII_J1939_LEAVES][256];
+    uint8_t leaves;
+    struct {
+        ocii_j1939_callback_t callback;
+        void *user;
+        uint8_t next; /* Next subscription of the same PGN, 1-based */
+    } subscription[OCII_J1939_SUBSCRIPTIONS];
+    uint8_t subscriptions;
+
+    ocii_timer_wheel_t wheel;
+    ocii_j1939_session_t
+        session[OCII_J1939_SESSIONS + OCII_J1939_ETP_SESSIONS];
+    uint8_t buffer[OCII_J1939_SESSIONS][OCII_J1939_BUFFER_SIZE];
+    uint8_t etp_buffer[OCII_J1939_ETP_SESSIONS][OCII_J1939_ETP_BUFFER_SIZE];
+    uint8_t source[ocii_channel_sizeof][256]; /* First session, 1-based */
+    uint8_t free;                             /* Free list, 1-based */
+    uint8_t etp_free;                         /* Free ETP sessions */
+    ocii_message_t tx[ocii_channel_sizeof][OCII_J1939_TX_QUEUE];
+    uint8_t tx_count[ocii_channel_sizeof];
+} ocii_j1939_t;
+
+/**
+ * @brief Initializes a J1939 stack and attaches it to the RX path
+ *
+ * @param stack The stack to initialize
+ * @param address Own address for RTS/CTS sessions, or OCII_J1939_NO_ADDRESS
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_j1939_init(ocii_j1939_t *stack, uint8_t address);
+
+/**
+ * @brief Detaches the J1939 stack from the RX path
+ *
+ * @param stack The stack to deinitialize
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_j1939_deinit(ocii_j1939_t *stack);
+
+/**
+ * @brief Subscribes to a parameter group
+ *
+ * Single frame and reassembled messages of the PGN are delivered to the
+ * callback. Several callbacks may subscribe to the same PGN
+ *
+ * @param stack The stack to subscribe on
+ * @param pgn The parameter group number
+ * @param callback The function to call for every message
+ * @param user Opaque pointer passed back to the callback
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_j1939_subscribe(ocii_j1939_t *stack, uint32_t pgn,
+                                ocii_j1939_callback_t callback, void *user);
+
+/**
+ * @brief Feeds a received frame to the J1939 stack
+ *
+ * @param user The stack, as a void pointer
+ * @param channel The channel the frame was received on
+ * @param message The received frame
+ * @return int Returns 1 if the frame was consumed
+ */
+extern int ocii_j1939_rx_hook(void *user, ocii_channel_t channel,
+                              ocii_message_t *message);
+
+/**
+ * @brief Expires stale sessions and sends the staged CTS, EOMA and abort frames
+ *
+ * @param stack The stack to drive
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_j1939_poll(ocii_j1939_t *stack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_j1939_h */
@@ -0,0 +1,142 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Latest received message per ID for lock-free readers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_latest_h
+#define ocii_latest_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Number of IDs kept over both channels, and the hash table for 29-bit IDs,
+ * a power of two at least twice the number of extended IDs expected
+ */
+#ifndef OCII_LATEST_IDS
+#define OCII_LATEST_IDS 1024
+#endif
+#ifndef OCII_LATEST_EXT_SLOTS
+#define OCII_LATEST_EXT_SLOTS 2048
+#endif
+
+typedef struct {
+    ocii_message_t message;
+    uint8_t channel;
+    uint64_t time_us; /* ocii_time_us() when it was received */
+    uint64_t count;   /* Messages of the ID so far, tells a reader it is new */
+} ocii_latest_entry_t;
+
+/**
+ * An entry behind a sequence lock. Only the RX path writes it, readers copy
+ * it and retry if the sequence moved
+ */
+typedef struct {
+    atomic_uint sequence; /* Odd while the entry is written */
+    ocii_latest_entry_t entry;
+} ocii_latest_slot_t;
+
+/**
+ * Entries are allocated from a pool on the first message of an ID and never
+ * freed. 11-bit IDs are found through a direct table per channel, 29-bit IDs
+ * through an open-addressed hash table
+ */
+typedef struct {
+    atomic_uint used;               /* Entries taken from the pool */
+    atomic_uint_least64_t overflow; /* Messages of IDs that did not fit */
+    atomic_ushort standard[ocii_channel_sizeof][2048]; /* Slot + 1, or 0 */
+    struct {
+        atomic_uint key;    /* ID + 1 with the channel in bit 31 */
+        atomic_ushort slot; /* Slot + 1, 0 while it is published */
+    } extended[OCII_LATEST_EXT_SLOTS];
+    ocii_latest_slot_t slot[OCII_LATEST_IDS];
+} ocii_latest_t;
+
+/**
+ * @brief Initializes the table and attaches it to the RX path
+ *
+ * Any number of threads may read. Each channel must be read from the device
+ * by one thread at a time, which is the case with the I/O thread or with one
+ * reader per channel
+ *
+ * @param latest The table to initialize
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_latest_init(ocii_latest_t *latest);
+
+/**
+ * @brief Detaches the table from the RX path
+ *
+ * @param latest The table to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_latest_deinit(ocii_latest_t *latest);
+
+/**
+ * @brief RX hook, stores every received message as the latest of its ID
+ *
+ * Added by ocii_latest_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_latest_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns 0, the message is left to the application
+ */
+extern int ocii_latest_rx_hook(void *user, ocii_channel_t channel,
+                               ocii_message_t *message);
+
+/**
+ * @brief Copies the latest message of one ID, without blocking the RX path
+ *
+ * @param latest The table to read
+ * @param channel Channel of the ID
+ * @param can_id The ID
+ * @param extended Set for a 29-bit ID
+ * @param entry Receives the message, its receive time and count
+ * @return int Returns 0 on success, OCII_ERROR_BUFFER_EMPTY if the ID was not
+ * seen, or another negative error code on failure
+ */
+extern int ocii_latest_get(ocii_latest_t *latest, ocii_channel_t channel,
+                           uint32_t can_id, uint8_t extended,
+                           ocii_latest_entry_t *entry);
+
+/**
+ * @brief Copies the latest message of every ID seen, without blocking the RX
+ * path
+ *
+ * Each entry is consistent in itself, entries are copied one after another
+ *
+ * @param latest The table to read
+ * @param entries Receives the messages, in the order IDs were first seen
+ * @param capacity Number of entries the array can hold
+ * @return int Returns the number of entries, or a negative error code
+ */
+extern int ocii_latest_snapshot(ocii_latest_t *latest,
+                                ocii_latest_entry_t *entries, int capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_latest_h */
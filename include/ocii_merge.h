@@ -0,0 +1,143 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Timestamp-ordered merge of several RX streams into one
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_merge_h
+#define ocii_merge_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <stdint.h>
+
+/**
+ * Number of streams one merge can combine, e.g. both channels of four
+ * adapters
+ */
+#ifndef OCII_MERGE_SOURCES
+#define OCII_MERGE_SOURCES 8
+#endif
+
+/**
+ * Packets read from a stream at once
+ */
+#ifndef OCII_MERGE_BATCH
+#define OCII_MERGE_BATCH 32
+#endif
+
+/**
+ * Reads up to capacity packets of a stream without blocking, like
+ * ocii_read_many. Returns the number of packets, 0 or OCII_ERROR_BUFFER_EMPTY
+ * if there are none, or a negative error code
+ */
+typedef int (*ocii_merge_read_t)(void *user, ocii_packet_t *packets,
+                                 int capacity);
+
+typedef struct {
+    ocii_merge_read_t read;
+    void *user;
+    uint8_t clock;   /* Streams with the same clock share the time base */
+    uint16_t count;  /* Packets in the buffer */
+    uint16_t packet; /* Position of the next message */
+    uint8_t message;
+    uint64_t head_time; /* Normalized time of the next message, us */
+    uint64_t arrival;   /* When the buffer was read, us */
+    ocii_packet_t buffer[OCII_MERGE_BATCH];
+} ocii_merge_source_t;
+
+/**
+ * Device time stamps count 100 us and wrap after five days. They are unwrapped
+ * to 64 bits and mapped onto ocii_time_us with the smallest arrival minus
+ * time stamp seen, i.e. the offset of the message that spent the least time
+ * in transit
+ */
+typedef struct {
+    int64_t offset; /* ocii_time_us minus device time, us */
+    uint64_t last;  /* Latest unwrapped time stamp, 100 us */
+    uint8_t valid;
+} ocii_merge_clock_t;
+
+typedef struct {
+    uint32_t window_us; /* How long a message may wait for older ones */
+    uint8_t sources;
+    uint8_t heap_count;
+    uint8_t heap[OCII_MERGE_SOURCES]; /* Sources with messages, by head_time */
+    ocii_merge_source_t source[OCII_MERGE_SOURCES];
+    ocii_merge_clock_t clock[OCII_MERGE_SOURCES];
+    uint64_t last_time; /* Normalized time of the last message returned */
+    uint64_t late;      /* Messages returned after a newer one */
+} ocii_merge_t;
+
+/**
+ * @brief Initializes a merge
+ *
+ * @param merge The merge to initialize
+ * @param window_us Reorder window. A message is held back until every stream
+ * has a message, or until it is window_us old
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_merge_init(ocii_merge_t *merge, uint32_t window_us);
+
+/**
+ * @brief Adds a stream to a merge
+ *
+ * @param merge The merge to extend
+ * @param read Reads packets of the stream, their messages must be in time order
+ * @param user Opaque pointer passed back to read
+ * @param clock Time base of the stream. Channels of one adapter share their
+ * clock, streams of different adapters must use different ones
+ * @return int Returns the index of the stream, or a negative error code
+ */
+extern int ocii_merge_add_source(ocii_merge_t *merge, ocii_merge_read_t read,
+                                 void *user, uint8_t clock);
+
+/**
+ * @brief Adds a channel of the open adapter to a merge, read with
+ * ocii_read_many on clock 0
+ *
+ * @param merge The merge to extend
+ * @param channel The channel to read
+ * @return int Returns the index of the stream, or a negative error code
+ */
+extern int ocii_merge_add_channel(ocii_merge_t *merge, ocii_channel_t channel);
+
+/**
+ * @brief Returns the next message in time order
+ *
+ * The message is not copied, it points into the buffer of its stream and
+ * stays valid until the next call
+ *
+ * @param merge The merge to read from
+ * @param message Receives a pointer to the message
+ * @param source Receives the index of its stream, may be NULL
+ * @param time_us Receives its normalized ocii_time_us time, may be NULL
+ * @return int Returns 0 on success, OCII_ERROR_BUFFER_EMPTY if no message can
+ * be returned yet, or a negative error code
+ */
+extern int ocii_merge_next(ocii_merge_t *merge, const ocii_message_t **message,
+                           int *source, uint64_t *time_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_merge_h */
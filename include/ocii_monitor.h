@@ -0,0 +1,202 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * CAN controller status monitor with error counter history
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_monitor_h
+#define ocii_monitor_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * Error counter changes and state transitions kept per channel
+ */
+#ifndef OCII_MONITOR_HISTORY
+#define OCII_MONITOR_HISTORY 1024
+#endif
+#ifndef OCII_MONITOR_TRANSITIONS
+#define OCII_MONITOR_TRANSITIONS 64
+#endif
+
+/**
+ * Bits of reg_status, as in the status register of the SJA1000
+ */
+#define OCII_MONITOR_STATUS_BUS_OFF 0x80
+#define OCII_MONITOR_STATUS_WARNING 0x40
+
+/**
+ * Error states of the controller, ordered by severity
+ */
+typedef enum {
+    OCII_MONITOR_ACTIVE,
+    OCII_MONITOR_WARNING, /* A counter at 96 or above */
+    OCII_MONITOR_PASSIVE, /* A counter at 128 or above */
+    OCII_MONITOR_BUS_OFF
+} ocii_monitor_state_t;
+
+/**
+ * What changed in an event
+ */
+#define OCII_MONITOR_COUNTERS 0x01
+#define OCII_MONITOR_STATE 0x02
+
+typedef struct {
+    uint64_t time_us; /* ocii_time_us() of the poll */
+    uint32_t status;  /* reg_status */
+    uint32_t re_counter;
+    uint32_t te_counter;
+    uint8_t state; /* One of ocii_monitor_state_t */
+} ocii_monitor_sample_t;
+
+typedef struct {
+    ocii_channel_t channel;
+    uint8_t changes; /* Logical OR of OCII_MONITOR_COUNTERS and _STATE */
+    ocii_monitor_sample_t previous;
+    ocii_monitor_sample_t current;
+} ocii_monitor_event_t;
+
+/**
+ * Called on every poll that changed the counters or the state, outside the
+ * lock of the monitor
+ */
+typedef void (*ocii_monitor_callback_t)(void *user,
+                                        const ocii_monitor_event_t *event);
+
+typedef struct {
+    ocii_monitor_sample_t current; /* Zeros, error active, before the first */
+    uint64_t polls;
+    uint32_t re_max;
+    uint32_t te_max;
+    uint64_t entered[OCII_MONITOR_BUS_OFF + 1]; /* Transitions into a state */
+} ocii_monitor_summary_t;
+
+typedef struct {
+    ocii_monitor_summary_t summary;
+    ocii_monitor_sample_t history[OCII_MONITOR_HISTORY];
+    uint64_t changes; /* Samples ever put into the history */
+    ocii_monitor_event_t transition[OCII_MONITOR_TRANSITIONS];
+    uint64_t transitions;
+} ocii_monitor_channel_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    ocii_monitor_channel_t channel[ocii_channel_sizeof];
+    ocii_monitor_callback_t callback;
+    void *user;
+} ocii_monitor_t;
+
+/**
+ * @brief Error state that a status response stands for
+ *
+ * @param status The CAN_STATUS response
+ * @return ocii_monitor_state_t Returns the state
+ */
+extern ocii_monitor_state_t ocii_monitor_classify(const ocii_packet_t *status);
+
+/**
+ * @brief Initializes the monitor and attaches it to the status polls of the
+ * I/O thread
+ *
+ * Polling is set with ocii_set_status_period. Without the I/O thread, call
+ * ocii_monitor_poll instead
+ *
+ * @param monitor The monitor to initialize
+ * @param callback Called on changes, may be NULL
+ * @param user Opaque pointer passed back to the callback
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_monitor_init(ocii_monitor_t *monitor,
+                             ocii_monitor_callback_t callback, void *user);
+
+/**
+ * @brief Detaches the monitor from the status polls
+ *
+ * @param monitor The monitor to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_monitor_deinit(ocii_monitor_t *monitor);
+
+/**
+ * @brief Status hook, records a polled status and raises the events
+ *
+ * Added by ocii_monitor_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_monitor_t
+ * @param channel The channel the status belongs to
+ * @param status The CAN_STATUS response
+ */
+extern void ocii_monitor_status_hook(void *user, ocii_channel_t channel,
+                                     const ocii_packet_t *status);
+
+/**
+ * @brief Polls the status of both channels once from the calling thread
+ *
+ * @param monitor The monitor
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_monitor_poll(ocii_monitor_t *monitor);
+
+/**
+ * @brief Copies the summary of a channel
+ *
+ * @param monitor The monitor
+ * @param channel The channel
+ * @param summary Receives the summary
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_monitor_summary(ocii_monitor_t *monitor, ocii_channel_t channel,
+                                ocii_monitor_summary_t *summary);
+
+/**
+ * @brief Copies the latest error counter changes of a channel
+ *
+ * @param monitor The monitor
+ * @param channel The channel
+ * @param samples Receives the samples, oldest first
+ * @param capacity Number of samples the array can hold
+ * @return int Returns the number of samples, or a negative error code
+ */
+extern int ocii_monitor_history(ocii_monitor_t *monitor, ocii_channel_t channel,
+                                ocii_monitor_sample_t *samples, int capacity);
+
+/**
+ * @brief Copies the latest state transitions of a channel
+ *
+ * @param monitor The monitor
+ * @param channel The channel
+ * @param transitions Receives the transitions, oldest first
+ * @param capacity Number of transitions the array can hold
+ * @return int Returns the number of transitions, or a negative error code
+ */
+extern int ocii_monitor_transitions(ocii_monitor_t *monitor,
+                                    ocii_channel_t channel,
+                                    ocii_monitor_event_t *transitions,
+                                    int capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_monitor_h */
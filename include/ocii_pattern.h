@@ -0,0 +1,136 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Payload pattern matcher over many rules, compiled into per-ID groups
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_pattern_h
+#define ocii_pattern_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <stdint.h>
+
+/**
+ * Called for every rule a message matches, in the order the rules were given
+ */
+typedef void (*ocii_pattern_callback_t)(void *user, int rule,
+                                        ocii_channel_t channel,
+                                        const ocii_message_t *message);
+
+/**
+ * A message matches a rule if its ID and extended flag equal those of the
+ * rule, it was received on one of the channels and its data equals data in
+ * the bits set in data_mask. Bytes past the data length read as 0
+ */
+typedef struct {
+    uint32_t can_id;
+    uint8_t extended;
+    uint8_t channels; /* Bit per channel, 0 for all of them */
+    uint8_t data[8];
+    uint8_t data_mask[8];
+    ocii_pattern_callback_t callback; /* May be NULL to only count */
+    void *user;                       /* Passed back to callback */
+} ocii_pattern_rule_t;
+
+/**
+ * Rules of one ID, stored next to each other
+ */
+typedef struct {
+    uint32_t key;   /* CAN ID with bit 31 set for extended frames */
+    uint32_t first; /* First rule in the compiled arrays */
+    uint32_t count;
+} ocii_pattern_group_t;
+
+/**
+ * Compiled rule set. Rules are ordered by ID, the values and masks of a group
+ * are contiguous arrays of 64-bit words, so that a message is compared
+ * against its whole group in one pass without branches. Groups are found
+ * through a perfect hash of the CAN ID
+ */
+typedef struct {
+    ocii_pattern_group_t *group;
+    uint32_t groups;
+    uint64_t *value;           /* Data under the mask, per compiled rule */
+    uint64_t *mask;            /* Data mask, per compiled rule */
+    uint8_t *channels;         /* Channel bits, per compiled rule */
+    int *index;                /* Rule as given, per compiled rule */
+    ocii_pattern_rule_t *rule; /* Rules as given */
+    uint32_t rules;
+    uint64_t *hits;            /* Matches per rule as given */
+    uint32_t hash_multiplier;
+    uint8_t hash_bits;
+    uint32_t *hash_key;   /* CAN ID with bit 31 set for extended frames */
+    uint32_t *hash_value; /* Group index plus one, 0 for empty slots */
+} ocii_pattern_t;
+
+/**
+ * @brief Compiles a rule set
+ *
+ * @param rules The rules, copied
+ * @param count Number of rules
+ * @param pattern Receives the compiled set, free it with ocii_pattern_free
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_pattern_compile(const ocii_pattern_rule_t *rules, int count,
+                                ocii_pattern_t **pattern);
+
+/**
+ * @brief Releases a compiled rule set
+ *
+ * @param pattern The rule set to release, may be NULL
+ */
+extern void ocii_pattern_free(ocii_pattern_t *pattern);
+
+/**
+ * @brief Matches a message against the rules of its ID and calls the
+ * callback of each rule it matches
+ *
+ * A rule set must be used by one thread at a time, its hit counters are not
+ * atomic
+ *
+ * @param pattern The compiled rule set
+ * @param channel The channel the message was received on
+ * @param message The message
+ * @return int Returns the number of rules matched, or a negative error code
+ */
+extern int ocii_pattern_match(ocii_pattern_t *pattern, ocii_channel_t channel,
+                              const ocii_message_t *message);
+
+/**
+ * @brief RX hook, matches every received message
+ *
+ * Attach it with ocii_add_rx_hook(ocii_pattern_rx_hook, pattern). With both
+ * channels read by different threads, use one rule set per channel
+ *
+ * @param user The ocii_pattern_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns 0, the message is left to the application
+ */
+extern int ocii_pattern_rx_hook(void *user, ocii_channel_t channel,
+                                ocii_message_t *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_pattern_h */
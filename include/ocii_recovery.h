@@ -0,0 +1,140 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Automatic bus-off recovery on the status polls of the I/O thread
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_recovery_h
+#define ocii_recovery_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+
+typedef struct {
+    ocii_channel_t channel;
+    int error_code;        /* Result of ocii_recover */
+    uint64_t detected_us;  /* ocii_time_us() of the poll that started it */
+    uint64_t recovered_us; /* ocii_time_us() when the channel ran again */
+    ocii_packet_t status;  /* The CAN_STATUS response that reported it */
+} ocii_recovery_event_t;
+
+/**
+ * Called after every recovery attempt, outside the lock of the recovery
+ */
+typedef void (*ocii_recovery_callback_t)(void *user,
+                                         const ocii_recovery_event_t *event);
+
+typedef struct {
+    uint64_t bus_offs;   /* Polls that reported bus-off */
+    uint64_t recoveries; /* Attempts that brought the channel back */
+    uint64_t failures;   /* Attempts that failed */
+    uint64_t held_off;   /* Reports ignored within the hold-off time */
+    uint64_t last_us;    /* Recovery time of the last attempt */
+    uint64_t max_us;
+    uint64_t total_us; /* Over all successful attempts */
+} ocii_recovery_stats_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    ocii_recovery_callback_t callback;
+    void *user;
+    uint64_t holdoff_us;
+    int clear_rx;
+    struct {
+        ocii_recovery_stats_t stats;
+        uint64_t attempt_us; /* Start of the last attempt */
+        int attempted;
+        int failed; /* The last attempt failed, retried on the next poll */
+    } channel[ocii_channel_sizeof];
+} ocii_recovery_t;
+
+/**
+ * @brief Initializes the recovery and attaches it to the status polls of the
+ * I/O thread
+ *
+ * A channel that reports bus-off is restarted with ocii_recover right from
+ * the status hook, so it comes back one status period after the fault at
+ * most, plus four command round trips. It must have been initialized with
+ * ocii_init before. A failed attempt is retried on the following polls,
+ * bus-off or not, once the hold-off time has passed. Polling is set with
+ * ocii_set_status_period. Without the I/O thread, call ocii_recovery_poll
+ * instead
+ *
+ * @param recovery The recovery to initialize
+ * @param clear_rx Non-zero to clear the RX buffer of the device on recovery
+ * @param holdoff_ms Minimum time between two attempts on a channel, 0 for
+ * none. A bus that fails again right away is not flooded with restarts then
+ * @param callback Called after every attempt, may be NULL
+ * @param user Opaque pointer passed back to the callback
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_recovery_init(ocii_recovery_t *recovery, int clear_rx,
+                              uint32_t holdoff_ms,
+                              ocii_recovery_callback_t callback, void *user);
+
+/**
+ * @brief Detaches the recovery from the status polls
+ *
+ * @param recovery The recovery to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_recovery_deinit(ocii_recovery_t *recovery);
+
+/**
+ * @brief Status hook, restarts a channel that reports bus-off
+ *
+ * Added by ocii_recovery_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_recovery_t
+ * @param channel The channel the status belongs to
+ * @param status The CAN_STATUS response
+ */
+extern void ocii_recovery_status_hook(void *user, ocii_channel_t channel,
+                                      const ocii_packet_t *status);
+
+/**
+ * @brief Polls the status of both channels once from the calling thread and
+ * recovers those in bus-off
+ *
+ * @param recovery The recovery
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_recovery_poll(ocii_recovery_t *recovery);
+
+/**
+ * @brief Copies the counters of a channel
+ *
+ * @param recovery The recovery
+ * @param channel The channel
+ * @param stats Receives the counters
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_recovery_stats(ocii_recovery_t *recovery,
+                               ocii_channel_t channel,
+                               ocii_recovery_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_recovery_h */
@@ -0,0 +1,166 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Per-ID traffic statistics with lock-free snapshots
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_stats_h
+#define ocii_stats_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Number of IDs tracked over both channels, and the hash table for 29-bit
+ * IDs, a power of two at least twice the number of extended IDs expected
+ */
+#ifndef OCII_STATS_IDS
+#define OCII_STATS_IDS 1024
+#endif
+#ifndef OCII_STATS_EXT_SLOTS
+#define OCII_STATS_EXT_SLOTS 2048
+#endif
+
+/**
+ * Statistics of one ID on one channel. Periods are measured with the device
+ * time stamp when there is one, and with the receive time otherwise. The
+ * period variance is period_m2 / (periods - 1), see ocii_stats_variance
+ */
+typedef struct {
+    uint32_t can_id;
+    uint8_t extended;
+    uint8_t channel;
+    uint8_t data_len; /* Of the last message */
+    uint8_t data[8];  /* Of the last message */
+    uint64_t count;
+    uint64_t first_us;       /* ocii_time_us() of the first message */
+    uint64_t last_us;        /* ocii_time_us() of the last message */
+    uint64_t last_change_us; /* ocii_time_us() of the last payload change */
+    uint64_t changes;        /* Messages whose payload differed from the last */
+    uint64_t periods;
+    double period_mean_us;
+    double period_m2; /* Welford sum of squared deviations */
+    uint32_t period_min_us;
+    uint32_t period_max_us;
+} ocii_stats_entry_t;
+
+/**
+ * An entry behind a sequence lock. Only the RX path writes it, readers copy
+ * it and retry if the sequence moved
+ */
+typedef struct {
+    atomic_uint sequence; /* Odd while the entry is written */
+    ocii_stats_entry_t entry;
+    uint32_t last_stamp; /* Device time stamp of the last message */
+    uint8_t stamped;     /* Set if the last message had a time stamp */
+} ocii_stats_slot_t;
+
+/**
+ * Entries are allocated from a pool on the first message of an ID and never
+ * freed. 11-bit IDs are found through a direct table per channel, 29-bit IDs
+ * through an open-addressed hash table
+ */
+typedef struct {
+    atomic_uint used; /* Entries taken from the pool */
+    atomic_uint_least64_t overflow; /* Messages of IDs that did not fit */
+    atomic_ushort standard[ocii_channel_sizeof][2048]; /* Slot + 1, or 0 */
+    struct {
+        atomic_uint key;    /* ID + 1 with the channel in bit 31 */
+        atomic_ushort slot; /* Slot + 1, 0 while it is published */
+    } extended[OCII_STATS_EXT_SLOTS];
+    ocii_stats_slot_t slot[OCII_STATS_IDS];
+} ocii_stats_t;
+
+/**
+ * @brief Initializes the statistics and attaches them to the RX path
+ *
+ * Each channel must be read by one thread at a time, which is the case with
+ * the I/O thread or with one reader per channel
+ *
+ * @param stats The statistics to initialize
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_stats_init(ocii_stats_t *stats);
+
+/**
+ * @brief Detaches the statistics from the RX path
+ *
+ * @param stats The statistics to detach
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_stats_deinit(ocii_stats_t *stats);
+
+/**
+ * @brief RX hook, accounts for every received message
+ *
+ * Added by ocii_stats_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_stats_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns 0, the message is left to the application
+ */
+extern int ocii_stats_rx_hook(void *user, ocii_channel_t channel,
+                              ocii_message_t *message);
+
+/**
+ * @brief Copies the statistics of one ID, without blocking the RX path
+ *
+ * @param stats The statistics to read
+ * @param channel Channel of the ID
+ * @param can_id The ID
+ * @param extended Set for a 29-bit ID
+ * @param entry Receives the statistics
+ * @return int Returns 0 on success, OCII_ERROR_BUFFER_EMPTY if the ID was not
+ * seen, or another negative error code on failure
+ */
+extern int ocii_stats_get(ocii_stats_t *stats, ocii_channel_t channel,
+                          uint32_t can_id, uint8_t extended,
+                          ocii_stats_entry_t *entry);
+
+/**
+ * @brief Copies the statistics of every ID seen, without blocking the RX path
+ *
+ * Each entry is consistent in itself, entries are copied one after another
+ *
+ * @param stats The statistics to read
+ * @param entries Receives the statistics, in the order IDs were first seen
+ * @param capacity Number of entries the array can hold
+ * @return int Returns the number of entries, or a negative error code
+ */
+extern int ocii_stats_snapshot(ocii_stats_t *stats, ocii_stats_entry_t *entries,
+                               int capacity);
+
+/**
+ * @brief Sample variance of the period of an entry
+ *
+ * @param entry The statistics of an ID
+ * @return double Returns the variance in us^2, 0 with less than two periods
+ */
+extern double ocii_stats_variance(const ocii_stats_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_stats_h */
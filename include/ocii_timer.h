@@ -0,0 +1,133 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Hierarchical timer wheel shared by the modules that run periodic work
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_timer_h
+#define ocii_timer_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Every level has 64 slots, so four levels cover 2^24 ticks, which is more
+ * than four hours at the default 1 ms tick. Longer timers sit in the last
+ * level and get cascaded again until they are due
+ */
+#define OCII_TIMER_LEVEL_BITS 6
+#define OCII_TIMER_LEVEL_SIZE (1 << OCII_TIMER_LEVEL_BITS)
+#define OCII_TIMER_LEVELS 4
+
+#define OCII_TIMER_TICK_US 1000U
+
+typedef struct ocii_timer ocii_timer_t;
+
+/**
+ * Called from ocii_timer_advance once the timer is due. The timer is already
+ * stopped at that point, so the callback may start it again
+ */
+typedef void (*ocii_timer_callback_t)(void *user, ocii_timer_t *timer);
+
+/**
+ * Timers are embedded in the objects they belong to, the wheel never allocates
+ */
+struct ocii_timer {
+    ocii_timer_t *next;
+    ocii_timer_t *prev;
+    uint64_t expires; /* In ticks */
+    ocii_timer_callback_t callback;
+    void *user;
+};
+
+typedef struct {
+    uint64_t now;     /* Last processed tick */
+    uint64_t origin;  /* Time of tick 0, us */
+    uint32_t tick_us; /* Tick length, us */
+    uint32_t count;   /* Number of running timers */
+    ocii_timer_t slot[OCII_TIMER_LEVELS][OCII_TIMER_LEVEL_SIZE];
+} ocii_timer_wheel_t;
+
+/**
+ * @brief Initializes a timer wheel
+ *
+ * @param wheel The wheel to initialize
+ * @param tick_us Tick length in microseconds, 0 selects OCII_TIMER_TICK_US
+ * @param now_us Current time in microseconds, usually ocii_time_us()
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_timer_wheel_init(ocii_timer_wheel_t *wheel, uint32_t tick_us,
+                                 uint64_t now_us);
+
+/**
+ * @brief Prepares a timer for use
+ *
+ * @param timer The timer to initialize
+ * @param callback The function to call once the timer is due
+ * @param user Opaque pointer passed back to the callback
+ */
+extern void ocii_timer_init(ocii_timer_t *timer,
+                            ocii_timer_callback_t callback, void *user);
+
+/**
+ * @brief Starts or restarts a timer, O(1)
+ *
+ * @param wheel The wheel to run the timer on
+ * @param timer The timer to start, it is stopped first if running
+ * @param expires_us Absolute time in microseconds the timer is due at
+ */
+extern void ocii_timer_start(ocii_timer_wheel_t *wheel, ocii_timer_t *timer,
+                             uint64_t expires_us);
+
+/**
+ * @brief Stops a timer, O(1). Stopping a timer that is not running is allowed
+ *
+ * @param wheel The wheel the timer runs on
+ * @param timer The timer to stop
+ */
+extern void ocii_timer_stop(ocii_timer_wheel_t *wheel, ocii_timer_t *timer);
+
+/**
+ * @brief Tells whether a timer is running
+ *
+ * @param timer The timer to check
+ * @return int Returns non-zero if the timer is running
+ */
+extern int ocii_timer_running(const ocii_timer_t *timer);
+
+/**
+ * @brief Moves the wheel forward and runs the callbacks of all due timers
+ *
+ * The cost is proportional to the number of elapsed ticks that have timers
+ * pending plus the number of expired timers. An empty wheel jumps straight
+ * to the current time
+ *
+ * @param wheel The wheel to advance
+ * @param now_us Current time in microseconds
+ * @return int Returns the number of timers that expired
+ */
+extern int ocii_timer_advance(ocii_timer_wheel_t *wheel, uint64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_timer_h */
@@ -0,0 +1,227 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * CAN over UDP bridge for remote capture and injection, Linux only
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_udp_h
+#define ocii_udp_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/**
+ * Frames per datagram and datagrams per sendmmsg/recvmmsg call. The default
+ * datagram of 1360 bytes fits an Ethernet MTU without fragmentation
+ */
+#ifndef OCII_UDP_FRAMES
+#define OCII_UDP_FRAMES 48
+#endif
+#ifndef OCII_UDP_BATCH
+#define OCII_UDP_BATCH 16
+#endif
+
+/**
+ * Wire format, all fields little-endian.
+ *
+ * Datagram header, 16 bytes:
+ *   uint32 magic "OCII", uint8 version, uint8 reserved, uint16 frame count,
+ *   uint32 sequence number, uint32 frames the sender had to drop so far
+ *
+ * Frame, 28 bytes:
+ *   uint64 capture time in us, uint32 CAN ID with the extended flag in bit 31
+ *   and the remote flag in bit 30, uint32 device time stamp, uint8 channel,
+ *   uint8 data length, uint8 flags with the time stamp flag in bit 0,
+ *   uint8 reserved, 8 data bytes
+ */
+#define OCII_UDP_MAGIC 0x4949434FU
+#define OCII_UDP_VERSION 1
+#define OCII_UDP_HEADER 16
+#define OCII_UDP_FRAME 28
+#define OCII_UDP_DATAGRAM (OCII_UDP_HEADER + OCII_UDP_FRAMES * OCII_UDP_FRAME)
+
+typedef struct {
+    uint64_t time_us; /* ocii_time_us() of the sender when it was queued */
+    uint8_t channel;
+    ocii_message_t message;
+} ocii_udp_frame_t;
+
+typedef struct {
+    uint64_t frames_sent;
+    uint64_t datagrams_sent;
+    uint64_t syscalls;     /* sendmmsg calls, datagrams_sent / syscalls */
+    uint64_t dropped;      /* Frames dropped because the batch was full */
+    uint64_t frames_received;
+    uint64_t datagrams_received;
+    uint64_t lost;         /* Datagrams missing from the sequence */
+    uint64_t reordered;    /* Datagrams older than the last one */
+    uint64_t resyncs;      /* Sequence restarts, e.g. of a restarted peer */
+    uint64_t malformed;    /* Datagrams that failed to decode */
+    uint64_t peer_dropped; /* Frames the peer reported as dropped */
+    uint64_t injected;     /* Frames written to the adapter */
+    uint64_t inject_errors;
+} ocii_udp_stats_t;
+
+/**
+ * One end of the bridge. The adapter side captures every received message
+ * through the RX hook and writes frames coming from the peer to the adapter.
+ * The analysis host opens the same structure without the hook
+ */
+typedef struct {
+    pthread_mutex_t lock; /* The RX hook may run on the library I/O thread */
+    int fd;
+    int hooked;
+    struct sockaddr_storage peer;
+    socklen_t peer_length;
+    uint32_t flush_us; /* Longest wait of a partial batch, 0 for a poll */
+    uint32_t tx_sequence;
+    uint32_t rx_sequence; /* Next expected sequence number */
+    uint8_t rx_synced;
+    uint8_t out[OCII_UDP_BATCH][OCII_UDP_DATAGRAM];
+    uint16_t out_ready;  /* Sealed datagrams waiting for sendmmsg */
+    uint16_t out_frames; /* Frames in the datagram being filled */
+    uint64_t out_first;  /* Queue time of the oldest unsent frame */
+    uint8_t in[OCII_UDP_BATCH][OCII_UDP_DATAGRAM];
+    uint16_t in_length[OCII_UDP_BATCH];
+    uint16_t in_count; /* Datagrams of the last recvmmsg */
+    uint16_t in_datagram;
+    uint16_t in_frame;
+    ocii_udp_stats_t stats;
+} ocii_udp_t;
+
+/**
+ * @brief Opens a UDP socket to a peer without attaching it to the adapter
+ *
+ * Used on the analysis host, with ocii_udp_send, ocii_udp_flush and
+ * ocii_udp_receive
+ *
+ * @param udp The bridge end to open
+ * @param host Numeric address or name of the peer
+ * @param port UDP port of the peer
+ * @param local_port UDP port to receive on, 0 for any
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_udp_open(ocii_udp_t *udp, const char *host, uint16_t port,
+                         uint16_t local_port);
+
+/**
+ * @brief Sends what is queued and closes the socket
+ *
+ * @param udp The bridge end to close
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_udp_close(ocii_udp_t *udp);
+
+/**
+ * @brief Opens a UDP socket and captures every received message to it
+ *
+ * The RX hook only copies messages, they still reach the application
+ *
+ * @param udp The bridge end to open
+ * @param host Numeric address or name of the peer
+ * @param port UDP port of the peer
+ * @param local_port UDP port to receive frames to inject on, 0 for any
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_udp_init(ocii_udp_t *udp, const char *host, uint16_t port,
+                         uint16_t local_port);
+
+/**
+ * @brief Detaches the bridge from the RX path and closes it
+ *
+ * @param udp The bridge end to close
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_udp_deinit(ocii_udp_t *udp);
+
+/**
+ * @brief RX hook, queues every received message for the peer
+ *
+ * Added by ocii_udp_init, exposed for chaining in custom hooks
+ *
+ * @param user The ocii_udp_t
+ * @param channel The channel the message was received on
+ * @param message The received message
+ * @return int Returns 0, the message is left to the application
+ */
+extern int ocii_udp_rx_hook(void *user, ocii_channel_t channel,
+                            ocii_message_t *message);
+
+/**
+ * @brief Queues a frame for the peer
+ *
+ * Frames are sent once OCII_UDP_BATCH datagrams are full, once the oldest
+ * waited flush_us, or on ocii_udp_flush
+ *
+ * @param udp The bridge end
+ * @param channel Channel the frame belongs to
+ * @param message The message, copied
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_udp_send(ocii_udp_t *udp, ocii_channel_t channel,
+                         const ocii_message_t *message);
+
+/**
+ * @brief Sends every queued frame, in one sendmmsg call per batch
+ *
+ * @param udp The bridge end
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_udp_flush(ocii_udp_t *udp);
+
+/**
+ * @brief Takes frames received from the peer, it does not block
+ *
+ * Datagrams are read OCII_UDP_BATCH at a time with recvmmsg. Missing and
+ * reordered sequence numbers are counted in the stats. A datagram more than
+ * OCII_UDP_BATCH behind is taken as a restart of the sequence instead.
+ * Only one thread may receive
+ *
+ * @param udp The bridge end
+ * @param frames Receives the frames
+ * @param capacity Number of frames the array can hold
+ * @return int Returns the number of frames, or a negative error code,
+ * OCII_ERROR_BUFFER_EMPTY if nothing arrived
+ */
+extern int ocii_udp_receive(ocii_udp_t *udp, ocii_udp_frame_t *frames,
+                            int capacity);
+
+/**
+ * @brief Drives the adapter side of the bridge
+ *
+ * Sends the queued captures once the oldest waited flush_us and writes the
+ * frames received from the peer to their channels, three per packet. Call it
+ * after every read of the main loop, or periodically when the I/O thread does
+ * the reading
+ *
+ * @param udp The bridge end
+ * @return int Returns the number of frames written, or a negative error code
+ */
+extern int ocii_udp_poll(ocii_udp_t *udp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ocii_udp_h */
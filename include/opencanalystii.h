@@ -60,6 +60,30 @@ extern "C" {
 #define OCII_ERROR_BUFFER_OVERFLOW -12
 /* RX buffer is empty */
 #define OCII_ERROR_BUFFER_EMPTY -13
+/* Operation did not complete before its deadline */
+#define OCII_ERROR_TIMEOUT -14
+/* No free slot is left in a fixed-size table */
+#define OCII_ERROR_NO_SLOT -15
+/* Invalid argument was passed */
+#define OCII_ERROR_INVALID_ARG -16
+/* Remote node aborted the SDO transfer */
+#define OCII_ERROR_SDO_ABORT -17
+/* Input could not be parsed */
+#define OCII_ERROR_PARSE -18
+/* Memory allocation failed */
+#define OCII_ERROR_NO_MEMORY -19
+/* File could not be opened or read */
+#define OCII_ERROR_FILE -20
+/* Library thread could not be started */
+#define OCII_ERROR_THREAD -21
+/* Sent message was not echoed while a later one was */
+#define OCII_ERROR_TX_LOST -22
+/* Socket could not be opened, sent to or read from */
+#define OCII_ERROR_SOCKET -23
+/* Channel has not been initialized with ocii_init */
+#define OCII_ERROR_NOT_CONFIGURED -24
+/* Device was removed and has not been reconnected */
+#define OCII_ERROR_NO_DEVICE -25
 
 #define OCII_USB_ENDPOINT_IN 0x80
 #define OCII_USB_ENDPOINT_OUT 0x00
@@ -204,6 +228,106 @@ typedef enum {
 #define OCII_CHANNEL_TO_COMMAND_EP ((uint8_t[]){0x02, 0x04})
 #define OCII_CHANNEL_TO_MESSAGE_EP ((uint8_t[]){0x01, 0x03})
 
+/**
+ * Maximum number of hooks that can be attached to the RX path at once
+ */
+#define OCII_RX_HOOKS_MAX 16
+
+/**
+ * Maximum number of hooks that can be attached to the status monitor at once
+ */
+#define OCII_STATUS_HOOKS_MAX 8
+
+/**
+ * Number of packets the RX ring of the I/O thread holds per channel, a power
+ * of two. Once it is full the I/O thread stops reading the channel and the
+ * device buffers the messages
+ */
+#ifndef OCII_RX_RING
+#define OCII_RX_RING 256
+#endif
+
+/**
+ * How long blocking calls spin before they yield and then sleep with the
+ * balanced profile, and the longest single sleep of the sleep profile, us
+ */
+#define OCII_WAIT_SPIN_US 50
+#define OCII_WAIT_SLEEP_MAX_US 1000
+
+/**
+ * How blocking calls wait when the I/O thread is not running, and how the I/O
+ * thread waits when the device is idle
+ */
+typedef enum {
+    OCII_WAIT_SPIN,     /* Busy-poll, lowest latency, one core per waiter */
+    OCII_WAIT_BALANCED, /* Spin briefly, then yield, then short sleeps */
+    OCII_WAIT_SLEEP     /* Sleep with exponential backoff, lowest CPU */
+} ocii_wait_profile_t;
+
+/**
+ * Maximum number of ocii_transact calls that can wait at once
+ */
+#ifndef OCII_TRANSACT_MAX
+#define OCII_TRANSACT_MAX 16
+#endif
+
+/**
+ * How often the reconnect thread looks for a removed adapter, ms. With hotplug
+ * support the arrival wakes it up earlier
+ */
+#ifndef OCII_RECONNECT_POLL_MS
+#define OCII_RECONNECT_POLL_MS 10
+#endif
+
+/**
+ * Reconnect events, see ocii_start_reconnect
+ */
+#define OCII_RECONNECT_REMOVED 1
+#define OCII_RECONNECT_RESUMED 2
+
+typedef struct {
+    int event;           /* OCII_RECONNECT_REMOVED or OCII_RECONNECT_RESUMED */
+    int error_code;      /* Result of the replay once resumed */
+    uint64_t removed_us; /* ocii_time_us() when the removal was noticed */
+    uint64_t arrived_us; /* When the adapter was found again */
+    uint64_t resumed_us; /* When the channels were running again */
+} ocii_reconnect_event_t;
+
+/**
+ * Reconnect hook. It is called by the reconnect thread when the adapter is
+ * removed and once it runs again
+ */
+typedef void (*ocii_reconnect_hook_t)(void *user,
+                                      const ocii_reconnect_event_t *event);
+
+/**
+ * Response predicate of ocii_transact. A message matches if its ID equals
+ * can_id in the bits set in id_mask, its data equals data in the bits set in
+ * data_mask and its extended flag equals extended
+ */
+typedef struct {
+    uint32_t can_id;
+    uint32_t id_mask;
+    uint8_t extended;
+    uint8_t data[8];
+    uint8_t data_mask[8];
+} ocii_match_t;
+
+/**
+ * RX path hook. It is called by ocii_read for every received message before
+ * the message is handed to the caller. Return non-zero to consume the message,
+ * i.e. to strip it from the packet returned by ocii_read
+ */
+typedef int (*ocii_rx_hook_t)(void *user, ocii_channel_t channel,
+                              ocii_message_t *message);
+
+/**
+ * Status hook. It is called by the I/O thread with the CAN_STATUS response of
+ * every started channel, once per period set with ocii_set_status_period
+ */
+typedef void (*ocii_status_hook_t)(void *user, ocii_channel_t channel,
+                                   const ocii_packet_t *status);
+
 /**
  * @brief Opens a device for communication
  * 
@@ -214,6 +338,53 @@ typedef enum {
  */
 extern int ocii_open_device(void);
 
+/**
+ * @brief Opens the adapter at a USB port path
+ * 
+ * Only the device at the path is checked, instead of every device on the
+ * buses. The path is the one of /sys/bus/usb/devices, 1-4.2 is bus 1 and
+ * ports {4, 2}
+ * 
+ * @param bus Bus number
+ * @param ports Port numbers from the root hub down
+ * @param count Number of port numbers, up to 7
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_open_device_path(uint8_t bus, const uint8_t *ports,
+                                 int count);
+
+/**
+ * @brief Opens the adapter from a file descriptor of its usbfs node
+ * 
+ * For callers that get the descriptor from elsewhere, e.g. an Android
+ * UsbDeviceConnection or a privileged broker. The descriptor stays owned by
+ * the caller and must stay open until ocii_close_device. The reconnect
+ * thread can only find such an adapter again if the bus can be enumerated
+ * 
+ * @param fd Open file descriptor of the device node
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_open_device_fd(int fd);
+
+/**
+ * @brief Keeps the libusb context of the library alive between devices
+ * 
+ * The context is created by the first open and freed by the last close.
+ * libusb_init scans every bus, so callers that open and close adapters
+ * often hold a reference and reopen without that scan. References are
+ * counted
+ * 
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_hold_context(void);
+
+/**
+ * @brief Drops a reference taken with ocii_hold_context
+ * 
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_release_context(void);
+
 /**
  * @brief Closes the device connection
  * 
@@ -283,6 +454,68 @@ extern int ocii_start(ocii_channel_t channel);
  */
 extern int ocii_stop(ocii_channel_t channel);
 
+/**
+ * @brief Copies the configuration a channel was last initialized with
+ * 
+ * The library keeps the packet of the last successful ocii_init of each
+ * channel, so that the channel can be brought back after a reset
+ * 
+ * @param channel The channel
+ * @param command Receives the init packet
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_get_config(ocii_channel_t channel, ocii_packet_t *command);
+
+/**
+ * @brief Sets the configuration the library records for a channel, without
+ * sending anything to the device
+ * 
+ * For a process that restarts while the adapter keeps running, the record
+ * saved with ocii_get_config by the previous run is restored this way
+ * before ocii_ensure_configured
+ * 
+ * @param channel The channel
+ * @param command The init packet the channel runs with
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_set_config(ocii_channel_t channel,
+                           const ocii_packet_t *command);
+
+/**
+ * @brief Initializes and starts a channel unless it already runs with the
+ * requested configuration
+ * 
+ * Timing, acc_code, acc_mask, filter and mode are compared with the record
+ * of the channel. If they match, CAN_STATUS must show the controller out of
+ * reset mode and not bus-off, and the channel is then taken over as started
+ * without a reset, so it stays on the bus. The timing registers cannot be
+ * read back, the record is trusted for them
+ * 
+ * @param channel The channel
+ * @param command The init packet, as for ocii_init
+ * @return int Returns 1 if the channel was left running, 0 if it was
+ * initialized and started, or a negative error code on failure
+ */
+extern int ocii_ensure_configured(ocii_channel_t channel,
+                                  ocii_packet_t *command);
+
+/**
+ * @brief Restarts a channel with the configuration it was last initialized
+ * with
+ * 
+ * Stops the channel, optionally clears its RX buffer, initializes it again
+ * and starts it, which resets the CAN controller and takes it out of
+ * bus-off. The sequence runs back to back, one command round trip per step.
+ * A channel left stopped by a failed attempt is still status polled by the
+ * I/O thread and started by a reconnect, until ocii_stop or a successful
+ * start
+ * 
+ * @param channel The channel to recover
+ * @param clear_rx Non-zero to clear the RX buffer of the device as well
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_recover(ocii_channel_t channel, int clear_rx);
+
 /**
  * @brief Writes a message to a specified channel
  * 
@@ -295,6 +528,31 @@ extern int ocii_stop(ocii_channel_t channel);
  */
 extern int ocii_write(ocii_channel_t channel, ocii_packet_t *message);
 
+/**
+ * @brief Turns write combining on or off for a specified channel
+ * 
+ * With write combining on, ocii_write only queues the messages of the packet.
+ * The queue is sent as one packet as soon as it holds three messages, or
+ * when the oldest of them has waited for deadline_us, whichever comes first.
+ * A library thread enforces the deadline. Errors of its writes are returned
+ * by the next ocii_write or ocii_write_flush on the channel. Turning write
+ * combining off sends what is queued
+ * 
+ * @param channel The channel to configure
+ * @param deadline_us Longest time a message may wait in the queue, 0 for off
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_set_write_combining(ocii_channel_t channel,
+                                    uint32_t deadline_us);
+
+/**
+ * @brief Sends the messages that wait in the write combining queue
+ * 
+ * @param channel The channel to flush the queue of
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_write_flush(ocii_channel_t channel);
+
 /**
  * @brief Reads a message from a specified channel
  * 
@@ -307,6 +565,122 @@ extern int ocii_write(ocii_channel_t channel, ocii_packet_t *message);
  */
 extern int ocii_read(ocii_channel_t channel, ocii_packet_t *message);
 
+/**
+ * @brief Reads every pending packet of a channel in one bulk transfer
+ * 
+ * The transfer is sized to what the device reports as pending, up to the
+ * capacity of the caller, so a full device buffer drains in a few USB
+ * transactions instead of two per packet
+ * 
+ * @param channel The channel to read from
+ * @param packets Array that receives the packets
+ * @param capacity Number of packets the array can hold
+ * @return int Returns the number of packets read, or a negative error code
+ */
+extern int ocii_read_many(ocii_channel_t channel, ocii_packet_t *packets,
+                          int capacity);
+
+/**
+ * @brief Reads a message, waiting until one arrives or the deadline passes
+ * 
+ * With the I/O thread running, the caller sleeps until the thread puts a
+ * packet into the RX ring. Otherwise the device is polled with the backoff of
+ * the wait profile
+ * 
+ * @param channel The channel to read the message from
+ * @param message Pointer to the message packet where the received data will be stored
+ * @param deadline_us Absolute ocii_time_us() deadline, UINT64_MAX to wait forever
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_read_wait(ocii_channel_t channel, ocii_packet_t *message,
+                          uint64_t deadline_us);
+
+/**
+ * @brief Writes a message, waiting for TX room until the deadline passes
+ * 
+ * With the I/O thread running, the caller sleeps until the thread sees the
+ * TX buffer of the device drain. Otherwise the device is polled with the
+ * backoff of the wait profile
+ * 
+ * @param channel The channel to write the message to
+ * @param message Pointer to the message packet to be sent
+ * @param deadline_us Absolute ocii_time_us() deadline, UINT64_MAX to wait forever
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_write_wait(ocii_channel_t channel, ocii_packet_t *message,
+                           uint64_t deadline_us);
+
+/**
+ * @brief Sends a message and waits for the first received message matching
+ * a predicate
+ * 
+ * The response is taken from the RX path before the RX hooks run and does not
+ * reach any other consumer. Every other message is delivered as usual. With
+ * the I/O thread running, the thread wakes the caller directly. Otherwise the
+ * caller polls the device and queues the other messages for ocii_read, and
+ * fails with OCII_ERROR_BUFFER_OVERFLOW once that queue is full
+ * 
+ * @param channel The channel to send on and to receive the response from
+ * @param request The message to send
+ * @param match Predicate the response must satisfy
+ * @param response Receives the matching message
+ * @param deadline_us Absolute ocii_time_us() deadline, UINT64_MAX to wait forever
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_transact(ocii_channel_t channel, const ocii_message_t *request,
+                         const ocii_match_t *match, ocii_message_t *response,
+                         uint64_t deadline_us);
+
+/**
+ * @brief Starts the I/O thread of the library
+ * 
+ * The thread polls the started channels, runs the RX hooks and queues the packets
+ * into per-channel RX rings that ocii_read and ocii_read_wait take from. One
+ * thread then serves every waiter instead of each of them polling the device.
+ * The RX hooks are called from this thread while it runs
+ * 
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_start_io_thread(void);
+
+/**
+ * @brief Stops the I/O thread, blocked callers fall back to polling
+ * 
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_stop_io_thread(void);
+
+/**
+ * @brief Starts the reconnect thread of the library
+ * 
+ * Once a transfer fails with the adapter gone, or hotplug reports its
+ * removal, the calls return OCII_ERROR_NO_DEVICE right away. The thread
+ * looks for the adapter on the same port, or by its serial number on
+ * another one, reopens and claims it, and replays ocii_init and ocii_start
+ * of every channel that had them. Messages queued by write combining are
+ * kept over the outage and sent after the replay
+ * 
+ * @param hook Called on removal and resume, may be NULL
+ * @param user Opaque pointer passed back to the hook
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_start_reconnect(ocii_reconnect_hook_t hook, void *user);
+
+/**
+ * @brief Stops the reconnect thread
+ * 
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_stop_reconnect(void);
+
+/**
+ * @brief Sets how blocking calls and the idle I/O thread wait
+ * 
+ * @param profile One of the OCII_WAIT_ profiles, OCII_WAIT_BALANCED by default
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_set_wait_profile(ocii_wait_profile_t profile);
+
 /**
  * @brief Gets the status of a specified channel
  * 
@@ -319,6 +693,75 @@ extern int ocii_read(ocii_channel_t channel, ocii_packet_t *message);
  */
 extern int ocii_get_status(ocii_channel_t channel, ocii_packet_t *status);
 
+/**
+ * @brief Attaches a hook to the RX path
+ * 
+ * Hooks are called in the order they were added. Once a hook consumes a
+ * message, the remaining hooks do not see it
+ * 
+ * @param hook The function to call for every received message
+ * @param user Opaque pointer passed back to the hook
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_add_rx_hook(ocii_rx_hook_t hook, void *user);
+
+/**
+ * @brief Detaches a hook previously attached with ocii_add_rx_hook
+ * 
+ * Waits until a call of the hook that is running in another thread has
+ * returned, so its user data may be freed afterwards. Must not be called
+ * from a hook
+ * 
+ * @param hook The function that was passed to ocii_add_rx_hook
+ * @param user The opaque pointer that was passed to ocii_add_rx_hook
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_remove_rx_hook(ocii_rx_hook_t hook, void *user);
+
+/**
+ * @brief Sets how often the I/O thread polls the CAN status of the channels
+ * 
+ * Each poll is one command round trip per started channel, made by the I/O
+ * thread between its reads, so it never holds up a transfer of the caller.
+ * The responses are passed to the status hooks
+ * 
+ * @param period_ms Poll period, 0 to stop polling
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_set_status_period(uint32_t period_ms);
+
+/**
+ * @brief Attaches a hook to the status monitor of the I/O thread
+ * 
+ * @param hook The function to call for every polled status
+ * @param user Opaque pointer passed back to the hook
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_add_status_hook(ocii_status_hook_t hook, void *user);
+
+/**
+ * @brief Detaches a hook previously attached with ocii_add_status_hook
+ * 
+ * Waits until a call of the hook that is running in another thread has
+ * returned, so its user data may be freed afterwards. Must not be called
+ * from a hook
+ * 
+ * @param hook The function that was passed to ocii_add_status_hook
+ * @param user The opaque pointer that was passed to ocii_add_status_hook
+ * @return int Returns 0 on success, or a negative error code on failure
+ */
+extern int ocii_remove_status_hook(ocii_status_hook_t hook, void *user);
+
+/**
+ * @brief Returns a monotonic timestamp in microseconds
+ * 
+ * The origin is unspecified, so only differences between two values are
+ * meaningful. Used by the library for deadlines and latency measurements
+ * 
+ * @return uint64_t Current monotonic time in microseconds
+ */
+extern uint64_t ocii_time_us(void);
+
 /**
  * @brief Converts an error code to a human-readable string
  * 
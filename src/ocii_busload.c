@@ -0,0 +1,297 @@
+#include <ocii_busload.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * CRC delimiter, ACK slot, ACK delimiter, end of frame and interframe space,
+ * none of them stuffed
+ */
+#define BUSLOAD_TAIL_BITS 13
+
+/**
+ * Stuffing state before a byte is the last bit and the length of its run,
+ * state = bit * 6 + run. An entry holds the stuff bits inserted within the
+ * byte in the upper nibble and the state after it in the lower one
+ */
+static uint8_t stuff_table[12][256];
+static uint16_t crc_table[256];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+static void busload_tables(void) {
+    for (int state = 0; state < 12; state++)
+        for (int value = 0; value < 256; value++) {
+            int last = state / 6, run = state % 6, stuffed = 0;
+
+            for (int i = 7; i >= 0; i--) {
+                int bit = value >> i & 1;
+
+                if (run != 0 && bit == last)
+                    run++;
+                else {
+                    last = bit;
+                    run = 1;
+                }
+                if (run == 5) {
+                    stuffed++;
+                    last = !last;
+                    run = 1;
+                }
+            }
+            stuff_table[state][value] =
+                (uint8_t)(stuffed << 4 | (last * 6 + run));
+        }
+
+    /**
+     * CRC-15/CAN, x^15 + x^14 + x^10 + x^8 + x^7 + x^4 + x^3 + 1
+     */
+    for (int value = 0; value < 256; value++) {
+        uint16_t crc = (uint16_t)(value << 7);
+
+        for (int i = 0; i < 8; i++)
+            crc = (uint16_t)((crc & 0x4000 ? crc << 1 ^ 0x4599 : crc << 1) &
+                             0x7FFF);
+        crc_table[value] = crc;
+    }
+}
+
+/**
+ * Frame bits, most significant first, packed into whole bytes
+ */
+typedef struct {
+    uint8_t byte[20];
+    int length;
+    int pending; /* Bits in acc not yet written out */
+    uint64_t acc;
+} busload_stream_t;
+
+static void busload_put(busload_stream_t *stream, uint32_t value, int bits) {
+    stream->acc = stream->acc << bits | (value & ((1ULL << bits) - 1));
+    stream->pending += bits;
+    while (stream->pending >= 8) {
+        stream->pending -= 8;
+        stream->byte[stream->length++] = (uint8_t)(stream->acc >>
+                                                   stream->pending);
+    }
+}
+
+/**
+ * Start of frame, arbitration and control field and data
+ */
+static void busload_fields(busload_stream_t *stream,
+                           const ocii_message_t *message, int bytes) {
+    if (!message->extended) {
+        busload_put(stream, 0, 1);
+        busload_put(stream, message->can_id, 11);
+        busload_put(stream, message->remote ? 1 : 0, 1);
+        busload_put(stream, 0, 2); /* IDE, r0 */
+    } else {
+        busload_put(stream, 0, 1);
+        busload_put(stream, message->can_id >> 18, 11);
+        busload_put(stream, 3, 2); /* SRR, IDE */
+        busload_put(stream, message->can_id, 18);
+        busload_put(stream, message->remote ? 1 : 0, 1);
+        busload_put(stream, 0, 2); /* r1, r0 */
+    }
+    busload_put(stream, message->data_len, 4);
+    for (int i = 0; i < bytes; i++)
+        busload_put(stream, message->data[i], 8);
+}
+
+static void busload_count(atomic_uint_least64_t *counter, uint64_t value) {
+    atomic_store_explicit(
+        counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+        memory_order_relaxed);
+}
+
+extern uint32_t ocii_busload_bitrate(const uint32_t timing[2]) {
+    uint32_t prescaler, quanta;
+
+    if (timing == NULL)
+        return 0;
+
+    /**
+     * SJA1000 layout: BTR0 holds the prescaler, BTR1 both time segments
+     */
+    prescaler = 2U * ((timing[0] & 0x3F) + 1);
+    quanta = 3U + (timing[1] & 0x0F) + (timing[1] >> 4 & 0x07);
+
+    return OCII_BUSLOAD_CLOCK / (prescaler * quanta);
+}
+
+extern uint32_t ocii_busload_frame_bits(const ocii_message_t *message,
+                                        uint32_t *stuffing) {
+    busload_stream_t crc = {0}, wire = {0};
+    int bytes, header, state = 0;
+    uint32_t stuffed = 0;
+    uint16_t sum = 0;
+
+    if (message == NULL)
+        return 0;
+
+    (void)pthread_once(&table_once, busload_tables);
+
+    bytes = message->remote ? 0 : message->data_len < 8 ? message->data_len : 8;
+    header = message->extended ? 39 : 19;
+
+    /**
+     * Leading zeros leave a CRC with a zero initial value unchanged, so the
+     * bits before the CRC are aligned to whole bytes that way
+     */
+    busload_put(&crc, 0, (8 - (header + bytes * 8) % 8) % 8);
+    busload_fields(&crc, message, bytes);
+    for (int i = 0; i < crc.length; i++)
+        sum = (uint16_t)((sum << 8 ^ crc_table[(sum >> 7 ^ crc.byte[i]) &
+                                               0xFF]) &
+                         0x7FFF);
+
+    /**
+     * Alternating bits ending in a recessive one align the stuffed part the
+     * same way. They never make a run of five, and the dominant start of
+     * frame begins a new run as it does after bus idle
+     */
+    busload_put(&wire, 0x55, (8 - (header + bytes * 8 + 15) % 8) % 8);
+    busload_fields(&wire, message, bytes);
+    busload_put(&wire, sum, 15);
+    for (int i = 0; i < wire.length; i++) {
+        uint8_t entry = stuff_table[state][wire.byte[i]];
+
+        stuffed += entry >> 4;
+        state = entry & 0x0F;
+    }
+
+    if (stuffing != NULL)
+        *stuffing = stuffed;
+
+    return (uint32_t)(header + bytes * 8 + 15) + stuffed + BUSLOAD_TAIL_BITS;
+}
+
+extern int ocii_busload_init(ocii_busload_t *load) {
+    if (load == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(load, 0, sizeof(*load));
+    (void)pthread_once(&table_once, busload_tables);
+
+    return ocii_add_rx_hook(ocii_busload_rx_hook, load);
+}
+
+extern int ocii_busload_deinit(ocii_busload_t *load) {
+    if (load == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    return ocii_remove_rx_hook(ocii_busload_rx_hook, load);
+}
+
+extern int ocii_busload_set_timing(ocii_busload_t *load,
+                                   ocii_channel_t channel,
+                                   const ocii_packet_t *init) {
+    uint32_t timing[2];
+
+    if (load == NULL || init == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    timing[0] = init->timing[0];
+    timing[1] = init->timing[1];
+    atomic_store_explicit(&load->channel[channel].bitrate,
+                          ocii_busload_bitrate(timing), memory_order_relaxed);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_busload_add(ocii_busload_t *load, ocii_channel_t channel,
+                            const ocii_message_t *message, uint64_t time_us) {
+    ocii_busload_channel_t *state;
+    uint64_t bucket = time_us / OCII_BUSLOAD_BUCKET_US, newest;
+    uint32_t stuffing, bits;
+    atomic_uint *slot;
+
+    if (load == NULL || message == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    state = &load->channel[channel];
+    bits = ocii_busload_frame_bits(message, &stuffing);
+
+    /**
+     * Buckets skipped since the last frame are cleared before the newest
+     * bucket moves, so readers never sum a stale one
+     */
+    newest = atomic_load_explicit(&state->newest, memory_order_relaxed);
+    if (bucket > newest) {
+        uint64_t skipped = bucket - newest < OCII_BUSLOAD_BUCKETS
+                               ? bucket - newest
+                               : OCII_BUSLOAD_BUCKETS;
+
+        for (uint64_t i = 0; i < skipped; i++)
+            atomic_store_explicit(
+                &state->bucket[(bucket - i) & (OCII_BUSLOAD_BUCKETS - 1)], 0,
+                memory_order_relaxed);
+        atomic_store_explicit(&state->newest, bucket, memory_order_release);
+    } else if (newest - bucket >= OCII_BUSLOAD_BUCKETS)
+        return OCII_ERROR_NO_ERROR;
+
+    /**
+     * One writer per channel, the sums are updated without locked
+     * instructions
+     */
+    slot = &state->bucket[bucket & (OCII_BUSLOAD_BUCKETS - 1)];
+    atomic_store_explicit(
+        slot, atomic_load_explicit(slot, memory_order_relaxed) + bits,
+        memory_order_relaxed);
+    busload_count(&state->frames, 1);
+    busload_count(&state->bits, bits);
+    busload_count(&state->stuffing, stuffing);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_busload_rx_hook(void *user, ocii_channel_t channel,
+                                ocii_message_t *message) {
+    (void)ocii_busload_add(user, channel, message, ocii_time_us());
+
+    return 0;
+}
+
+extern int ocii_busload_get(ocii_busload_t *load, ocii_channel_t channel,
+                            uint32_t window_us, uint64_t now_us,
+                            double *result) {
+    ocii_busload_channel_t *state;
+    uint64_t end = now_us / OCII_BUSLOAD_BUCKET_US, newest, sum = 0;
+    uint32_t buckets = window_us / OCII_BUSLOAD_BUCKET_US, bitrate;
+
+    if (load == NULL || result == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof || buckets == 0 ||
+        buckets >= OCII_BUSLOAD_BUCKETS || buckets > end)
+        return OCII_ERROR_INVALID_ARG;
+
+    state = &load->channel[channel];
+    if ((bitrate = atomic_load_explicit(&state->bitrate,
+                                        memory_order_relaxed)) == 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    /**
+     * The bucket of now is still filling and left out. Buckets past the
+     * newest one were idle and may still hold older sums
+     */
+    newest = atomic_load_explicit(&state->newest, memory_order_acquire);
+    for (uint64_t bucket = end - buckets; bucket < end; bucket++)
+        if (bucket <= newest && newest - bucket < OCII_BUSLOAD_BUCKETS)
+            sum += atomic_load_explicit(
+                &state->bucket[bucket & (OCII_BUSLOAD_BUCKETS - 1)],
+                memory_order_relaxed);
+
+    *result = (double)sum * 1e6 /
+              ((double)bitrate * buckets * OCII_BUSLOAD_BUCKET_US);
+
+    return OCII_ERROR_NO_ERROR;
+}
@@ -0,0 +1,858 @@
+#define _POSIX_C_SOURCE 200809L /* PTHREAD_MUTEX_RECURSIVE */
+
+#include <ocii_canopen.h>
+#include <ocii_timer.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
+
+/**
+ * SDO transfer states, the request waits for the named server response
+ */
+enum {
+    sdo_queued,
+    sdo_upload_init,
+    sdo_upload_segment,
+    sdo_download_init,
+    sdo_download_segment,
+    sdo_block_upload_init,
+    sdo_block_upload_data,
+    sdo_block_upload_end,
+    sdo_block_download_init,
+    sdo_block_download_data,
+    sdo_block_download_end,
+};
+
+/**
+ * Block download segments leave this many slots free in the TX queue, so that
+ * every node can always stage one protocol frame
+ */
+#define SDO_TX_RESERVE OCII_CANOPEN_NODES
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/**
+ * CRC-16-CCITT as used by SDO block transfers, polynomial 0x1021, initial 0
+ */
+static uint16_t sdo_crc(const uint8_t *data, uint32_t length) {
+    uint16_t crc = 0;
+
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (uint16_t)(crc << 1 ^ 0x1021)
+                                 : (uint16_t)(crc << 1);
+    }
+
+    return crc;
+}
+
+/**
+ * The callbacks run under the lock and may call back into the module
+ */
+static int canopen_lock_init(pthread_mutex_t *lock) {
+    pthread_mutexattr_t attr;
+    int failed;
+
+    if (pthread_mutexattr_init(&attr) != 0)
+        return OCII_ERROR_THREAD;
+
+    failed = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0 ||
+             pthread_mutex_init(lock, &attr) != 0;
+    (void)pthread_mutexattr_destroy(&attr);
+
+    return failed ? OCII_ERROR_THREAD : OCII_ERROR_NO_ERROR;
+}
+
+static int sdo_stage(ocii_sdo_client_t *client, ocii_sdo_request_t *request,
+                     const uint8_t frame[8]) {
+    ocii_message_t *message;
+
+    if (client->tx_count >= sizeof_arr(client->tx))
+        return OCII_ERROR_NO_SLOT;
+
+    message = &client->tx[(client->tx_head + client->tx_count++) %
+                          sizeof_arr(client->tx)];
+    *message = (ocii_message_t){
+        .can_id = OCII_SDO_TX_COB_ID + request->node, .data_len = 8};
+    memcpy(message->data, frame, sizeof(message->data));
+
+    request->deadline = ocii_time_us() + client->timeout_us;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+static void sdo_start(ocii_sdo_client_t *client, ocii_sdo_request_t *request);
+
+static void sdo_complete(ocii_sdo_client_t *client,
+                         ocii_sdo_request_t *request, int status) {
+    uint8_t node = request->node;
+
+    request->status = status;
+    request->latency = ocii_time_us() - request->issue_time;
+
+    client->pending--;
+    if ((client->head[node] = request->next) == NULL)
+        client->tail[node] = NULL;
+    else
+        sdo_start(client, client->head[node]);
+
+    if (request->callback != NULL)
+        request->callback(request->user, request);
+}
+
+static void sdo_abort(ocii_sdo_client_t *client, ocii_sdo_request_t *request,
+                      uint32_t abort_code, int status) {
+    uint8_t frame[8] = {0x80, (uint8_t)request->index,
+                        (uint8_t)(request->index >> 8), request->subindex};
+
+    put_le32(&frame[4], abort_code);
+    (void)sdo_stage(client, request, frame);
+
+    request->abort_code = abort_code;
+    sdo_complete(client, request, status);
+}
+
+/**
+ * Stages as many segments of the current block as the TX queue allows
+ */
+static void sdo_stage_block(ocii_sdo_client_t *client,
+                            ocii_sdo_request_t *request) {
+    while (request->seqno < request->blksize &&
+           request->offset + request->seqno * 7U < request->size &&
+           client->tx_count < sizeof_arr(client->tx) - SDO_TX_RESERVE) {
+        uint32_t position = request->offset + request->seqno * 7U;
+        uint32_t bytes = request->size - position;
+        uint8_t frame[8] = {0};
+
+        request->seqno++;
+        frame[0] = request->seqno;
+        if (bytes <= 7)
+            frame[0] |= 0x80;
+        else
+            bytes = 7;
+
+        memcpy(&frame[1], &request->data[position], bytes);
+        (void)sdo_stage(client, request, frame);
+    }
+}
+
+static void sdo_stage_segment(ocii_sdo_client_t *client,
+                              ocii_sdo_request_t *request) {
+    uint32_t bytes = request->size - request->offset;
+    uint8_t frame[8] = {0};
+
+    if (bytes > 7)
+        bytes = 7;
+
+    frame[0] = (uint8_t)(request->toggle << 4 | (7 - bytes) << 1 |
+                         (request->offset + bytes >= request->size));
+    memcpy(&frame[1], &request->data[request->offset], bytes);
+
+    if (sdo_stage(client, request, frame) != OCII_ERROR_NO_ERROR)
+        sdo_complete(client, request, OCII_ERROR_NO_SLOT);
+}
+
+static void sdo_start(ocii_sdo_client_t *client, ocii_sdo_request_t *request) {
+    uint8_t frame[8] = {0, (uint8_t)request->index,
+                        (uint8_t)(request->index >> 8), request->subindex};
+
+    request->issue_time = ocii_time_us();
+    request->offset = request->length = 0;
+    request->toggle = request->seqno = 0;
+
+    if (request->direction == ocii_sdo_upload) {
+        if (request->block) {
+            frame[0] = 0xA4; /* Block upload, CRC supported */
+            frame[4] = client->block_size;
+            request->state = sdo_block_upload_init;
+        } else {
+            frame[0] = 0x40;
+            request->state = sdo_upload_init;
+        }
+    } else if (request->block) {
+        frame[0] = 0xC6; /* Block download, CRC supported, size indicated */
+        put_le32(&frame[4], request->size);
+        request->state = sdo_block_download_init;
+    } else if (request->size <= 4) {
+        frame[0] = (uint8_t)(0x23 | (4 - request->size) << 2);
+        memcpy(&frame[4], request->data, request->size);
+        request->state = sdo_download_init;
+    } else {
+        frame[0] = 0x21;
+        put_le32(&frame[4], request->size);
+        request->state = sdo_download_init;
+    }
+
+    if (sdo_stage(client, request, frame) != OCII_ERROR_NO_ERROR)
+        sdo_complete(client, request, OCII_ERROR_NO_SLOT);
+}
+
+extern int ocii_sdo_init(ocii_sdo_client_t *client, ocii_channel_t channel) {
+    int error_code;
+
+    if (client == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    *client = (ocii_sdo_client_t){.channel = channel,
+                                  .timeout_us = OCII_SDO_TIMEOUT_US,
+                                  .block_size = OCII_SDO_BLOCK_SIZE};
+
+    if ((error_code = canopen_lock_init(&client->lock)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    if ((error_code = ocii_add_rx_hook(ocii_sdo_rx_hook, client)) !=
+        OCII_ERROR_NO_ERROR)
+        (void)pthread_mutex_destroy(&client->lock);
+
+    return error_code;
+}
+
+extern int ocii_sdo_deinit(ocii_sdo_client_t *client) {
+    int error_code;
+
+    if (client == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((error_code = ocii_remove_rx_hook(ocii_sdo_rx_hook, client)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    (void)pthread_mutex_lock(&client->lock);
+    for (int node = 0; node < OCII_CANOPEN_NODES; node++)
+        while (client->head[node] != NULL)
+            sdo_complete(client, client->head[node], OCII_ERROR_TIMEOUT);
+    (void)pthread_mutex_unlock(&client->lock);
+    (void)pthread_mutex_destroy(&client->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_sdo_submit(ocii_sdo_client_t *client,
+                           ocii_sdo_request_t *request) {
+    uint8_t node;
+
+    if (client == NULL || request == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((node = request->node) == 0 || node >= OCII_CANOPEN_NODES)
+        return OCII_ERROR_INVALID_ARG;
+
+    if (request->size != 0 && request->data == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (request->direction == ocii_sdo_download && request->size == 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    request->next = NULL;
+    request->status = OCII_ERROR_NO_ERROR;
+    request->abort_code = 0;
+    request->state = sdo_queued;
+    request->submit_time = ocii_time_us();
+
+    (void)pthread_mutex_lock(&client->lock);
+    client->pending++;
+    if (client->tail[node] != NULL) {
+        client->tail[node]->next = request;
+        client->tail[node] = request;
+    } else {
+        client->head[node] = client->tail[node] = request;
+        sdo_start(client, request);
+    }
+    (void)pthread_mutex_unlock(&client->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+static int sdo_multiplexer_matches(const ocii_sdo_request_t *request,
+                                   const uint8_t *data) {
+    return data[1] == (uint8_t)request->index &&
+           data[2] == (uint8_t)(request->index >> 8) &&
+           data[3] == request->subindex;
+}
+
+static void sdo_upload_store(ocii_sdo_client_t *client,
+                             ocii_sdo_request_t *request, const uint8_t *data,
+                             uint32_t bytes) {
+    if (request->length + bytes > request->size) {
+        sdo_abort(client, request, OCII_SDO_ABORT_MEMORY, OCII_ERROR_NO_SLOT);
+        return;
+    }
+
+    memcpy(&request->data[request->length], data, bytes);
+    request->length += bytes;
+}
+
+static void sdo_block_upload_segment(ocii_sdo_client_t *client,
+                                     ocii_sdo_request_t *request,
+                                     const uint8_t *data) {
+    uint8_t seqno = data[0] & 0x7F, last = data[0] & 0x80;
+
+    if (seqno == request->seqno + 1) {
+        uint32_t position = request->offset + request->seqno * 7U;
+        uint32_t bytes = position < request->size ? request->size - position
+                                                  : 0;
+
+        if (bytes == 0 && last == 0) {
+            sdo_abort(client, request, OCII_SDO_ABORT_MEMORY,
+                      OCII_ERROR_NO_SLOT);
+            return;
+        }
+
+        /**
+         * The last segment may carry padding, its real size is only known
+         * from the end frame, so copy what fits and sort it out there
+         */
+        memcpy(&request->data[position], &data[1], bytes < 7 ? bytes : 7);
+        request->seqno = seqno;
+        request->toggle = last != 0;
+    } else if (last == 0 && seqno != request->blksize) {
+        return; /* Out of sequence, acknowledged at the end of the block */
+    }
+
+    if (seqno == request->blksize || last != 0) {
+        uint8_t frame[8] = {0xA2, request->seqno, client->block_size};
+
+        request->offset += request->seqno * 7U;
+        request->seqno = 0;
+        request->blksize = client->block_size;
+        if (request->toggle)
+            request->state = sdo_block_upload_end;
+
+        (void)sdo_stage(client, request, frame);
+    }
+}
+
+static void sdo_block_download_ack(ocii_sdo_client_t *client,
+                                   ocii_sdo_request_t *request,
+                                   const uint8_t *data) {
+    uint32_t acked = data[1] * 7U;
+
+    if (data[1] > request->seqno || data[2] == 0 || data[2] > 127) {
+        sdo_abort(client, request, OCII_SDO_ABORT_SEQUENCE,
+                  OCII_ERROR_SDO_ABORT);
+        return;
+    }
+
+    if (acked > request->size - request->offset)
+        acked = request->size - request->offset;
+    request->offset += acked;
+    request->seqno = 0;
+    request->blksize = data[2];
+
+    if (request->offset < request->size) {
+        sdo_stage_block(client, request);
+    } else {
+        uint8_t frame[8] = {0};
+        uint16_t crc = sdo_crc(request->data, request->size);
+
+        frame[0] = (uint8_t)(0xC1 | (6 - (request->size - 1) % 7) << 2);
+        frame[1] = (uint8_t)crc;
+        frame[2] = (uint8_t)(crc >> 8);
+        request->state = sdo_block_download_end;
+
+        (void)sdo_stage(client, request, frame);
+    }
+}
+
+/**
+ * Advances the transfer of a node with a server response, the lock must be
+ * held. Returns 1 if the response belonged to it
+ */
+static int sdo_response(ocii_sdo_client_t *client, uint32_t node,
+                        const uint8_t *data) {
+    ocii_sdo_request_t *request;
+
+    if ((request = client->head[node]) == NULL ||
+        request->state == sdo_queued)
+        return 0;
+
+    /**
+     * Block data segments have no command specifier, anything goes there
+     * but an abort: sequence number 0 is never a valid segment
+     */
+    if (request->state == sdo_block_upload_data &&
+        (data[0] != 0x80 || !sdo_multiplexer_matches(request, data))) {
+        sdo_block_upload_segment(client, request, data);
+        return 1;
+    }
+
+    if (data[0] == 0x80) {
+        if (get_le32(data) >> 8 != 0 && !sdo_multiplexer_matches(request, data))
+            return 0;
+        request->abort_code = get_le32(&data[4]);
+        sdo_complete(client, request, OCII_ERROR_SDO_ABORT);
+        return 1;
+    }
+
+    switch (request->state) {
+    case sdo_upload_init:
+        if ((data[0] & 0xE0) != 0x40 || !sdo_multiplexer_matches(request, data))
+            return 0;
+        if (data[0] & 0x02) {
+            uint32_t bytes = data[0] & 0x01 ? 4 - (data[0] >> 2 & 0x03) : 4;
+
+            sdo_upload_store(client, request, &data[4], bytes);
+            if (request->state == sdo_upload_init)
+                sdo_complete(client, request, OCII_ERROR_NO_ERROR);
+        } else if ((data[0] & 0x01) && get_le32(&data[4]) > request->size) {
+            sdo_abort(client, request, OCII_SDO_ABORT_MEMORY,
+                      OCII_ERROR_NO_SLOT);
+        } else {
+            uint8_t frame[8] = {0x60};
+
+            request->state = sdo_upload_segment;
+            (void)sdo_stage(client, request, frame);
+        }
+        return 1;
+
+    case sdo_upload_segment:
+        if ((data[0] & 0xE0) != 0x00)
+            return 0;
+        if ((data[0] >> 4 & 0x01) != request->toggle) {
+            sdo_abort(client, request, OCII_SDO_ABORT_TOGGLE,
+                      OCII_ERROR_SDO_ABORT);
+            return 1;
+        }
+        sdo_upload_store(client, request, &data[1], 7 - (data[0] >> 1 & 0x07));
+        if (request->state != sdo_upload_segment)
+            return 1;
+        if (data[0] & 0x01) {
+            sdo_complete(client, request, OCII_ERROR_NO_ERROR);
+        } else {
+            uint8_t frame[8] = {0};
+
+            request->toggle ^= 1;
+            frame[0] = (uint8_t)(0x60 | request->toggle << 4);
+            (void)sdo_stage(client, request, frame);
+        }
+        return 1;
+
+    case sdo_download_init:
+        if (data[0] != 0x60 || !sdo_multiplexer_matches(request, data))
+            return 0;
+        if (request->size <= 4) {
+            request->length = request->size;
+            sdo_complete(client, request, OCII_ERROR_NO_ERROR);
+        } else {
+            request->state = sdo_download_segment;
+            sdo_stage_segment(client, request);
+        }
+        return 1;
+
+    case sdo_download_segment:
+        if ((data[0] & 0xE0) != 0x20)
+            return 0;
+        if ((data[0] >> 4 & 0x01) != request->toggle) {
+            sdo_abort(client, request, OCII_SDO_ABORT_TOGGLE,
+                      OCII_ERROR_SDO_ABORT);
+            return 1;
+        }
+        request->offset += request->size - request->offset > 7
+                               ? 7
+                               : request->size - request->offset;
+        request->length = request->offset;
+        if (request->offset >= request->size) {
+            sdo_complete(client, request, OCII_ERROR_NO_ERROR);
+        } else {
+            request->toggle ^= 1;
+            sdo_stage_segment(client, request);
+        }
+        return 1;
+
+    case sdo_block_upload_init:
+        if ((data[0] & 0xE1) != 0xC0 || !sdo_multiplexer_matches(request, data))
+            return 0;
+        if ((data[0] & 0x02) && get_le32(&data[4]) > request->size) {
+            sdo_abort(client, request, OCII_SDO_ABORT_MEMORY,
+                      OCII_ERROR_NO_SLOT);
+        } else {
+            uint8_t frame[8] = {0xA3};
+
+            request->crc_enabled = (data[0] & 0x04) != 0;
+            request->blksize = client->block_size;
+            request->state = sdo_block_upload_data;
+            (void)sdo_stage(client, request, frame);
+        }
+        return 1;
+
+    case sdo_block_upload_end:
+        if ((data[0] & 0xE1) != 0xC1)
+            return 0;
+        if (request->offset < (data[0] >> 2 & 0x07) ||
+            (request->length = request->offset - (data[0] >> 2 & 0x07)) >
+                request->size) {
+            sdo_abort(client, request, OCII_SDO_ABORT_MEMORY,
+                      OCII_ERROR_NO_SLOT);
+        } else if (request->crc_enabled &&
+                   sdo_crc(request->data, request->length) !=
+                       (uint16_t)(data[1] | data[2] << 8)) {
+            sdo_abort(client, request, OCII_SDO_ABORT_CRC,
+                      OCII_ERROR_SDO_ABORT);
+        } else {
+            uint8_t frame[8] = {0xA1};
+
+            (void)sdo_stage(client, request, frame);
+            sdo_complete(client, request, OCII_ERROR_NO_ERROR);
+        }
+        return 1;
+
+    case sdo_block_download_init:
+        if ((data[0] & 0xE3) != 0xA0 || !sdo_multiplexer_matches(request, data))
+            return 0;
+        if (data[4] == 0 || data[4] > 127) {
+            sdo_abort(client, request, OCII_SDO_ABORT_SEQUENCE,
+                      OCII_ERROR_SDO_ABORT);
+            return 1;
+        }
+        request->blksize = data[4];
+        request->state = sdo_block_download_data;
+        sdo_stage_block(client, request);
+        return 1;
+
+    case sdo_block_download_data:
+        if (data[0] != 0xA2)
+            return 0;
+        sdo_block_download_ack(client, request, data);
+        return 1;
+
+    case sdo_block_download_end:
+        if (data[0] != 0xA1)
+            return 0;
+        request->length = request->size;
+        sdo_complete(client, request, OCII_ERROR_NO_ERROR);
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+extern int ocii_sdo_rx_hook(void *user, ocii_channel_t channel,
+                            ocii_message_t *message) {
+    ocii_sdo_client_t *client = user;
+    uint32_t node = message->can_id - OCII_SDO_RX_COB_ID;
+    int consumed;
+
+    if (channel != client->channel || message->extended || message->remote ||
+        message->data_len != 8 || node == 0 || node >= OCII_CANOPEN_NODES)
+        return 0;
+
+    (void)pthread_mutex_lock(&client->lock);
+    consumed = sdo_response(client, node, message->data);
+    (void)pthread_mutex_unlock(&client->lock);
+
+    return consumed;
+}
+
+extern int ocii_sdo_service(ocii_sdo_client_t *client) {
+    uint64_t now = ocii_time_us();
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    if (client == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_mutex_lock(&client->lock);
+    for (int node = 1; node < OCII_CANOPEN_NODES; node++) {
+        ocii_sdo_request_t *request = client->head[node];
+
+        if (request == NULL)
+            continue;
+
+        if ((int64_t)(now - request->deadline) > 0)
+            sdo_abort(client, request, OCII_SDO_ABORT_TIMEOUT,
+                      OCII_ERROR_TIMEOUT);
+        else if (request->state == sdo_block_download_data)
+            sdo_stage_block(client, request);
+    }
+
+    while (client->tx_count > 0) {
+        ocii_packet_t packet = {.count = 0};
+
+        for (uint16_t i = client->tx_head;
+             packet.count < sizeof_arr(packet.message) &&
+             packet.count < client->tx_count;
+             i = (i + 1) % sizeof_arr(client->tx))
+            packet.message[packet.count++] = client->tx[i];
+
+        if ((error_code = ocii_write(client->channel, &packet)) !=
+            OCII_ERROR_NO_ERROR)
+            break;
+
+        client->tx_head = (client->tx_head + packet.count) %
+                          sizeof_arr(client->tx);
+        client->tx_count -= packet.count;
+    }
+    if (error_code == OCII_ERROR_NO_ERROR ||
+        error_code == OCII_ERROR_BUFFER_OVERFLOW)
+        error_code = (int)client->pending;
+    (void)pthread_mutex_unlock(&client->lock);
+
+    return error_code;
+}
+
+extern int ocii_sdo_poll(ocii_sdo_client_t *client) {
+    ocii_packet_t packet;
+    int error_code;
+
+    if ((error_code = ocii_sdo_service(client)) < 0)
+        return error_code;
+
+    while ((error_code = ocii_read(client->channel, &packet)) ==
+           OCII_ERROR_NO_ERROR)
+        ; /* Not an SDO response, nobody else is reading here */
+
+    if (error_code != OCII_ERROR_BUFFER_EMPTY)
+        return error_code;
+
+    return ocii_sdo_service(client);
+}
+
+static void hb_event(ocii_hb_monitor_t *monitor, ocii_hb_node_t *entry,
+                     uint8_t type, uint64_t now) {
+    ptrdiff_t index = entry - &monitor->node[0][0];
+    ocii_hb_event_t event = {.channel = index / OCII_CANOPEN_NODES,
+                             .node = index % OCII_CANOPEN_NODES,
+                             .type = type,
+                             .nmt_state = entry->nmt_state,
+                             .time = now};
+
+    if (monitor->callback != NULL)
+        monitor->callback(monitor->user, &event);
+}
+
+static void hb_timeout(void *user, ocii_timer_t *timer) {
+    ocii_hb_node_t *entry = (ocii_hb_node_t *)timer;
+
+    entry->alive = 0;
+    hb_event(user, entry, ocii_hb_event_timeout, ocii_time_us());
+}
+
+static void hb_guard(void *user, ocii_timer_t *timer) {
+    ocii_hb_monitor_t *monitor = user;
+    ocii_hb_node_t *entry =
+        (ocii_hb_node_t *)((uint8_t *)timer - offsetof(ocii_hb_node_t, guard));
+    ptrdiff_t index = entry - &monitor->node[0][0];
+    int channel = index / OCII_CANOPEN_NODES;
+
+    if (monitor->guard_count[channel] < OCII_CANOPEN_NODES)
+        monitor->guard_queue[channel][monitor->guard_count[channel]++] =
+            index % OCII_CANOPEN_NODES;
+    ocii_timer_start(&monitor->wheel, &entry->guard,
+                     ocii_time_us() + entry->guard_us);
+}
+
+extern int ocii_hb_init(ocii_hb_monitor_t *monitor, ocii_hb_callback_t callback,
+                        void *user) {
+    int error_code;
+
+    if (monitor == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    *monitor = (ocii_hb_monitor_t){.callback = callback, .user = user};
+    if ((error_code = canopen_lock_init(&monitor->lock)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+    (void)ocii_timer_wheel_init(&monitor->wheel, 0, ocii_time_us());
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        for (int node = 0; node < OCII_CANOPEN_NODES; node++) {
+            ocii_hb_node_t *entry = &monitor->node[channel][node];
+
+            ocii_timer_init(&entry->timer, hb_timeout, monitor);
+            ocii_timer_init(&entry->guard, hb_guard, monitor);
+            entry->nmt_state = OCII_NMT_UNKNOWN;
+        }
+
+    if ((error_code = ocii_add_rx_hook(ocii_hb_rx_hook, monitor)) !=
+        OCII_ERROR_NO_ERROR)
+        (void)pthread_mutex_destroy(&monitor->lock);
+
+    return error_code;
+}
+
+extern int ocii_hb_deinit(ocii_hb_monitor_t *monitor) {
+    int error_code;
+
+    if (monitor == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((error_code = ocii_remove_rx_hook(ocii_hb_rx_hook, monitor)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    (void)pthread_mutex_destroy(&monitor->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+static ocii_hb_node_t *hb_entry(ocii_hb_monitor_t *monitor,
+                                ocii_channel_t channel, uint8_t node) {
+    if (monitor == NULL || (unsigned)channel >= ocii_channel_sizeof ||
+        node == 0 || node >= OCII_CANOPEN_NODES)
+        return NULL;
+
+    return &monitor->node[channel][node];
+}
+
+extern int ocii_hb_watch(ocii_hb_monitor_t *monitor, ocii_channel_t channel,
+                         uint8_t node, uint32_t timeout_us) {
+    ocii_hb_node_t *entry = hb_entry(monitor, channel, node);
+
+    if (entry == NULL || timeout_us == 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    ocii_timer_stop(&monitor->wheel, &entry->guard);
+    entry->timeout_us = timeout_us;
+    entry->guard_us = 0;
+    entry->watched = 1;
+    ocii_timer_start(&monitor->wheel, &entry->timer,
+                     ocii_time_us() + timeout_us);
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_hb_guard(ocii_hb_monitor_t *monitor, ocii_channel_t channel,
+                         uint8_t node, uint32_t guard_us,
+                         uint8_t life_factor) {
+    ocii_hb_node_t *entry = hb_entry(monitor, channel, node);
+    uint64_t now = ocii_time_us();
+
+    if (entry == NULL || guard_us == 0 || life_factor == 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    entry->timeout_us = guard_us * life_factor;
+    entry->guard_us = guard_us;
+    entry->toggle = 0;
+    entry->watched = 1;
+    ocii_timer_start(&monitor->wheel, &entry->timer, now + entry->timeout_us);
+    ocii_timer_start(&monitor->wheel, &entry->guard, now);
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_hb_unwatch(ocii_hb_monitor_t *monitor, ocii_channel_t channel,
+                           uint8_t node) {
+    ocii_hb_node_t *entry = hb_entry(monitor, channel, node);
+
+    if (entry == NULL)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    ocii_timer_stop(&monitor->wheel, &entry->timer);
+    ocii_timer_stop(&monitor->wheel, &entry->guard);
+    entry->watched = entry->alive = 0;
+    entry->nmt_state = OCII_NMT_UNKNOWN;
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_hb_rx_hook(void *user, ocii_channel_t channel,
+                           ocii_message_t *message) {
+    ocii_hb_monitor_t *monitor = user;
+    ocii_hb_node_t *entry;
+    uint32_t node = message->can_id - OCII_HB_COB_ID;
+    uint8_t state, toggle;
+    uint64_t now;
+
+    if (node == 0 || node >= OCII_CANOPEN_NODES || message->extended ||
+        message->remote || message->data_len != 1)
+        return 0;
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    if (!(entry = &monitor->node[channel][node])->watched) {
+        (void)pthread_mutex_unlock(&monitor->lock);
+        return 0;
+    }
+
+    now = ocii_time_us();
+    state = message->data[0] & 0x7F;
+    toggle = message->data[0] >> 7;
+
+    entry->last_seen = now;
+    ocii_timer_start(&monitor->wheel, &entry->timer, now + entry->timeout_us);
+
+    if (entry->guard_us != 0 && state != OCII_NMT_BOOTUP) {
+        if (toggle != entry->toggle)
+            hb_event(monitor, entry, ocii_hb_event_toggle, now);
+        entry->toggle = toggle ^ 1;
+    }
+
+    if (!entry->alive) {
+        entry->alive = 1;
+        entry->nmt_state = state;
+        hb_event(monitor, entry,
+                 state == OCII_NMT_BOOTUP ? ocii_hb_event_bootup
+                                          : ocii_hb_event_recovered,
+                 now);
+    } else if (state != entry->nmt_state) {
+        entry->nmt_state = state;
+        hb_event(monitor, entry,
+                 state == OCII_NMT_BOOTUP ? ocii_hb_event_bootup
+                                          : ocii_hb_event_state,
+                 now);
+    }
+
+    if (state == OCII_NMT_BOOTUP)
+        entry->toggle = 0;
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    return monitor->consume;
+}
+
+extern int ocii_hb_tick(ocii_hb_monitor_t *monitor) {
+    int expired, error_code;
+
+    if (monitor == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    expired = ocii_timer_advance(&monitor->wheel, ocii_time_us());
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        uint8_t *queue = monitor->guard_queue[channel];
+        int count = monitor->guard_count[channel], sent = 0;
+
+        while (sent < count) {
+            ocii_packet_t packet = {.count = 0};
+
+            while (packet.count < sizeof_arr(packet.message) && sent < count)
+                packet.message[packet.count++] = (ocii_message_t){
+                    .can_id = OCII_HB_COB_ID + queue[sent++],
+                    .remote = 1,
+                    .data_len = 1};
+
+            if ((error_code = ocii_write(channel, &packet)) !=
+                OCII_ERROR_NO_ERROR) {
+                monitor->guard_count[channel] = 0;
+                (void)pthread_mutex_unlock(&monitor->lock);
+                return error_code;
+            }
+        }
+
+        monitor->guard_count[channel] = 0;
+    }
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    return expired;
+}
@@ -0,0 +1,330 @@
+#include <inttypes.h>
+#include <ocii_capture.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+enum { CAPTURE_FREE, CAPTURE_READY, CAPTURE_WRITING };
+
+static uint64_t capture_load(const uint8_t *data) {
+    uint64_t value;
+
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/**
+ * Copies the window around the trigger out of the ring and hands it to the
+ * writer thread, then arms the channel again
+ */
+static void capture_finish(ocii_capture_t *capture, int channel) {
+    ocii_capture_channel_t *state = &capture->channel[channel];
+    uint64_t pre = state->at < (uint64_t)state->pre ? state->at
+                                                    : (uint64_t)state->pre,
+             first = state->at - pre, count = state->head - first,
+             start = first & (OCII_CAPTURE_FRAMES - 1);
+
+    (void)pthread_mutex_lock(&capture->lock);
+    if (capture->out[channel].state != CAPTURE_FREE)
+        capture->missed++;
+    else {
+        uint64_t part = OCII_CAPTURE_FRAMES - start < count
+                            ? OCII_CAPTURE_FRAMES - start
+                            : count;
+
+        memcpy(capture->out[channel].frames, &state->ring[start],
+               part * sizeof(state->ring[0]));
+        memcpy(&capture->out[channel].frames[part], state->ring,
+               (count - part) * sizeof(state->ring[0]));
+        capture->out[channel].event = (ocii_capture_event_t){
+            .cause = state->cause,
+            .channel = (ocii_channel_t)channel,
+            .pre = (int)pre,
+            .count = (int)count,
+            .frames = capture->out[channel].frames};
+        capture->out[channel].state = CAPTURE_READY;
+        (void)pthread_cond_signal(&capture->cond);
+    }
+    (void)pthread_mutex_unlock(&capture->lock);
+
+    state->stop = 0;
+}
+
+/**
+ * Hands ready captures to the sink until it is stopped and nothing is left
+ */
+static void *capture_writer(void *arg) {
+    ocii_capture_t *capture = arg;
+
+    (void)pthread_mutex_lock(&capture->lock);
+    for (;;) {
+        int channel = 0, error_code;
+
+        while (channel < ocii_channel_sizeof &&
+               capture->out[channel].state != CAPTURE_READY)
+            channel++;
+        if (channel == ocii_channel_sizeof) {
+            if (!capture->running)
+                break;
+            (void)pthread_cond_wait(&capture->cond, &capture->lock);
+            continue;
+        }
+
+        capture->out[channel].state = CAPTURE_WRITING;
+        capture->out[channel].event.sequence = capture->captures++;
+        (void)pthread_mutex_unlock(&capture->lock);
+
+        error_code = capture->sink(capture->user, &capture->out[channel].event);
+
+        (void)pthread_mutex_lock(&capture->lock);
+        if (error_code != OCII_ERROR_NO_ERROR)
+            capture->failed++;
+        capture->out[channel].state = CAPTURE_FREE;
+    }
+    (void)pthread_mutex_unlock(&capture->lock);
+
+    return NULL;
+}
+
+static void capture_stop(ocii_capture_t *capture) {
+    (void)pthread_mutex_lock(&capture->lock);
+    capture->running = 0;
+    (void)pthread_cond_signal(&capture->cond);
+    (void)pthread_mutex_unlock(&capture->lock);
+
+    (void)pthread_join(capture->thread, NULL);
+    (void)pthread_cond_destroy(&capture->cond);
+    (void)pthread_mutex_destroy(&capture->lock);
+}
+
+extern int ocii_capture_init(ocii_capture_t *capture,
+                             const ocii_capture_config_t *config,
+                             ocii_capture_sink_t sink, void *user) {
+    uint64_t now = ocii_time_us();
+    int error_code;
+
+    if (capture == NULL || config == NULL || sink == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        if (config[channel].matches < 0 ||
+            config[channel].matches > OCII_CAPTURE_TRIGGERS ||
+            config[channel].pre + 1 + config[channel].post >
+                OCII_CAPTURE_FRAMES)
+            return OCII_ERROR_INVALID_ARG;
+
+    memset(capture, 0, sizeof(*capture));
+    capture->sink = sink;
+    capture->user = user;
+
+    /**
+     * Predicates are kept as 64-bit masks, so that the RX path checks each
+     * with one expression and no early exit
+     */
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        const ocii_capture_config_t *from = &config[channel];
+        ocii_capture_channel_t *state = &capture->channel[channel];
+
+        for (int i = 0; i < from->matches; i++)
+            state->trigger[i] = (ocii_capture_trigger_t){
+                .data = capture_load(from->match[i].data) &
+                        capture_load(from->match[i].data_mask),
+                .data_mask = capture_load(from->match[i].data_mask),
+                .can_id = from->match[i].can_id & from->match[i].id_mask,
+                .id_mask = from->match[i].id_mask,
+                .extended = from->match[i].extended ? 1 : 0};
+        state->triggers = from->matches;
+        state->pre = from->pre;
+        state->post = from->post;
+        state->status = from->status ? 1 : 0;
+        state->gap_us = from->gap_us != 0 ? from->gap_us : UINT64_MAX;
+        state->last_us = now;
+        state->enabled = from->matches != 0 || from->gap_us != 0 ||
+                         from->status || from->manual;
+    }
+
+    if (pthread_mutex_init(&capture->lock, NULL) != 0)
+        return OCII_ERROR_THREAD;
+    if (pthread_cond_init(&capture->cond, NULL) != 0) {
+        (void)pthread_mutex_destroy(&capture->lock);
+        return OCII_ERROR_THREAD;
+    }
+
+    capture->running = 1;
+    if (pthread_create(&capture->thread, NULL, capture_writer, capture) != 0) {
+        (void)pthread_cond_destroy(&capture->cond);
+        (void)pthread_mutex_destroy(&capture->lock);
+        return OCII_ERROR_THREAD;
+    }
+
+    if ((error_code = ocii_add_rx_hook(ocii_capture_rx_hook, capture)) !=
+        OCII_ERROR_NO_ERROR)
+        capture_stop(capture);
+
+    return error_code;
+}
+
+extern int ocii_capture_deinit(ocii_capture_t *capture) {
+    int error_code;
+
+    if (capture == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    error_code = ocii_remove_rx_hook(ocii_capture_rx_hook, capture);
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        if (capture->channel[channel].stop != 0)
+            capture_finish(capture, channel);
+
+    capture_stop(capture);
+
+    return error_code;
+}
+
+extern int ocii_capture_rx_hook(void *user, ocii_channel_t channel,
+                                ocii_message_t *message) {
+    ocii_capture_t *capture = user;
+    ocii_capture_channel_t *state;
+    uint64_t now = ocii_time_us(), data, gap;
+    uint32_t cause = 0;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return 0;
+
+    state = &capture->channel[channel];
+    if (!state->enabled)
+        return 0;
+
+    state->ring[state->head & (OCII_CAPTURE_FRAMES - 1)] =
+        (ocii_capture_frame_t){.time_us = now, .message = *message};
+    gap = now - state->last_us;
+    state->last_us = now;
+
+    if (state->stop != 0) {
+        if (++state->head == state->stop)
+            capture_finish(capture, channel);
+        return 0;
+    }
+
+    /**
+     * Every predicate is evaluated, the only branch taken per frame is the
+     * one on the combined result
+     */
+    data = capture_load(message->data);
+    for (int i = 0; i < state->triggers; i++) {
+        const ocii_capture_trigger_t *trigger = &state->trigger[i];
+
+        cause |= (uint32_t)((((message->can_id & trigger->id_mask) ^
+                              trigger->can_id) |
+                             ((data & trigger->data_mask) ^ trigger->data) |
+                             (uint64_t)((message->extended ? 1U : 0U) ^
+                                        trigger->extended)) == 0)
+                 << i;
+    }
+    cause |= (uint32_t)(gap > state->gap_us) * OCII_CAPTURE_GAP;
+    cause |= atomic_load_explicit(&state->pending, memory_order_relaxed);
+
+    state->head++;
+    if (cause == 0)
+        return 0;
+
+    state->cause = cause | atomic_exchange_explicit(&state->pending, 0,
+                                                    memory_order_relaxed);
+    state->at = state->head - 1;
+    state->stop = state->head + (uint64_t)state->post;
+    if (state->post == 0)
+        capture_finish(capture, channel);
+
+    return 0;
+}
+
+extern int ocii_capture_trigger(ocii_capture_t *capture,
+                                ocii_channel_t channel) {
+    if (capture == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof ||
+        !capture->channel[channel].enabled)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)atomic_fetch_or_explicit(&capture->channel[channel].pending,
+                                   OCII_CAPTURE_MANUAL, memory_order_relaxed);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_capture_status(ocii_capture_t *capture, ocii_channel_t channel,
+                               const ocii_packet_t *status) {
+    ocii_capture_channel_t *state;
+    int changed;
+
+    if (capture == NULL || status == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    state = &capture->channel[channel];
+    changed = state->error_known &&
+              (status->reg_status != state->error_state[0] ||
+               status->reg_re_counter > state->error_state[1] ||
+               status->reg_te_counter > state->error_state[2]);
+    state->error_state[0] = status->reg_status;
+    state->error_state[1] = status->reg_re_counter;
+    state->error_state[2] = status->reg_te_counter;
+    state->error_known = 1;
+
+    if (!changed || !state->status)
+        return 0;
+
+    (void)atomic_fetch_or_explicit(&state->pending, OCII_CAPTURE_STATUS,
+                                   memory_order_relaxed);
+
+    return 1;
+}
+
+extern int ocii_capture_sink_file(void *user,
+                                  const ocii_capture_event_t *event) {
+    const char *directory = user != NULL ? user : ".";
+    char path[4096];
+    FILE *file;
+    int ok = 1;
+
+    if (event == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (snprintf(path, sizeof(path), "%s/capture-%" PRIu64 "-can%d.log",
+                 directory, event->sequence,
+                 (int)event->channel) >= (int)sizeof(path) ||
+        (file = fopen(path, "w")) == NULL)
+        return OCII_ERROR_FILE;
+
+    for (int i = 0; i < event->count && ok; i++) {
+        const ocii_capture_frame_t *frame = &event->frames[i];
+        const ocii_message_t *message = &frame->message;
+        int length = message->data_len < sizeof(message->data)
+                         ? message->data_len
+                         : (int)sizeof(message->data);
+
+        ok = fprintf(file, "(%" PRIu64 ".%06" PRIu64 ") can%d ",
+                     frame->time_us / 1000000U, frame->time_us % 1000000U,
+                     (int)event->channel) > 0 &&
+             fprintf(file,
+                     message->extended ? "%08" PRIX32 "#" : "%03" PRIX32 "#",
+                     message->can_id) > 0;
+        if (message->remote)
+            ok = ok && fputc('R', file) != EOF;
+        else
+            for (int j = 0; j < length && ok; j++)
+                ok = fprintf(file, "%02X", message->data[j]) > 0;
+        ok = ok && fputc('\n', file) != EOF;
+    }
+
+    if (fclose(file) != 0 || !ok)
+        return OCII_ERROR_FILE;
+
+    return OCII_ERROR_NO_ERROR;
+}
@@ -0,0 +1,131 @@
+#include <ocii_change.h>
+#include <opencanalystii.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CHANGE_VALID 0x80
+#define CHANGE_REMOTE 0x40
+
+static uint32_t change_hash(uint32_t key) {
+    return (key * 0x9E3779B1U) >> 16;
+}
+
+/**
+ * Last value of an ID, a free one on its first message. Returns NULL if the
+ * hash table is full
+ */
+static ocii_change_value_t *change_value(ocii_change_t *change, int channel,
+                                         const ocii_message_t *message) {
+    uint32_t key, slot;
+
+    if (!message->extended)
+        return &change->standard[channel][message->can_id & 0x7FF];
+
+    key = (message->can_id & 0x1FFFFFFF) + 1;
+    slot = change_hash(key) & (OCII_CHANGE_EXT_SLOTS - 1);
+
+    for (uint32_t probe = 0; probe < OCII_CHANGE_EXT_SLOTS; probe++) {
+        if (change->extended[channel][slot].key == key)
+            return &change->extended[channel][slot].value;
+
+        if (change->extended[channel][slot].key == 0) {
+            change->extended[channel][slot].key = key;
+            return &change->extended[channel][slot].value;
+        }
+
+        slot = (slot + 1) & (OCII_CHANGE_EXT_SLOTS - 1);
+    }
+
+    return NULL;
+}
+
+extern int ocii_change_init(ocii_change_t *change, uint32_t refresh_ms) {
+    if (change == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(change, 0, sizeof(*change));
+    change->refresh_ms = refresh_ms;
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        atomic_store(&change->enabled[channel], 1);
+
+    return ocii_add_rx_hook(ocii_change_rx_hook, change);
+}
+
+extern int ocii_change_deinit(ocii_change_t *change) {
+    if (change == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    return ocii_remove_rx_hook(ocii_change_rx_hook, change);
+}
+
+extern int ocii_change_enable(ocii_change_t *change, ocii_channel_t channel,
+                              int enable) {
+    if (change == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    /**
+     * The RX path owns the tables, it clears them on its next message
+     */
+    if (enable && !atomic_load(&change->enabled[channel]))
+        atomic_store(&change->reset[channel], 1);
+    atomic_store(&change->enabled[channel], enable ? 1 : 0);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_change_rx_hook(void *user, ocii_channel_t channel,
+                               ocii_message_t *message) {
+    ocii_change_t *change = user;
+    ocii_change_value_t *value;
+    uint64_t payload = 0;
+    uint32_t now;
+    uint8_t flags, length;
+
+    if ((unsigned)channel >= ocii_channel_sizeof ||
+        !atomic_load_explicit(&change->enabled[channel], memory_order_relaxed))
+        return 0;
+
+    if (atomic_load_explicit(&change->reset[channel], memory_order_relaxed) &&
+        atomic_exchange(&change->reset[channel], 0)) {
+        memset(change->standard[channel], 0, sizeof(change->standard[channel]));
+        memset(change->extended[channel], 0, sizeof(change->extended[channel]));
+    }
+
+    if ((value = change_value(change, channel, message)) == NULL) {
+        change->overflow[channel]++;
+        change->delivered[channel]++;
+        return 0;
+    }
+
+    length = message->data_len < sizeof(message->data) ? message->data_len
+                                                       : sizeof(message->data);
+    memcpy(&payload, message->data, length);
+    flags = CHANGE_VALID | (message->remote ? CHANGE_REMOTE : 0) | length;
+
+    /**
+     * The device clock keeps USB batching out of the refresh period
+     */
+    now = message->time_flag ? message->time_stamp
+                             : (uint32_t)(ocii_time_us() / 100U);
+
+    if (payload == value->payload && flags == value->flags) {
+        if (change->refresh_ms == 0 ||
+            now - value->time < change->refresh_ms * 10U) {
+            change->suppressed[channel]++;
+            return 1;
+        }
+        change->refreshed[channel]++;
+    }
+
+    value->payload = payload;
+    value->flags = flags;
+    value->time = now;
+    change->delivered[channel]++;
+
+    return 0;
+}
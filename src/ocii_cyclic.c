@@ -0,0 +1,231 @@
+#include <ocii_cyclic.h>
+#include <ocii_timer.h>
+#include <opencanalystii.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
+
+static ocii_cyclic_entry_t *cyclic_entry(ocii_cyclic_t *scheduler,
+                                         int handle) {
+    if (scheduler == NULL || handle < 0 || handle >= OCII_CYCLIC_MAX ||
+        !scheduler->entry[handle].in_use)
+        return NULL;
+
+    return &scheduler->entry[handle];
+}
+
+/**
+ * Timer callback, queues the frame and re-arms the timer for the next ideal
+ * time. Cycles that are already in the past are skipped instead of sent in a
+ * burst
+ */
+static void cyclic_fire(void *user, ocii_timer_t *timer) {
+    ocii_cyclic_t *scheduler = user;
+    ocii_cyclic_entry_t *entry = (ocii_cyclic_entry_t *)timer;
+    uint64_t now = ocii_time_us();
+
+    if (entry->update != NULL)
+        entry->update(entry->user, &entry->frame);
+
+    if (entry->queued)
+        entry->stats.overruns++;
+    else {
+        entry->queued = 1;
+        entry->queued_at = entry->due;
+        scheduler->queue[entry->channel]
+                        [scheduler->queue_count[entry->channel]++] =
+            (uint16_t)(entry - scheduler->entry);
+    }
+
+    if (entry->period_us == 0)
+        return;
+
+    entry->due += entry->period_us;
+    if (entry->due <= now) {
+        uint64_t missed = (now - entry->due) / entry->period_us + 1;
+
+        entry->stats.skipped += missed;
+        entry->due += missed * entry->period_us;
+    }
+
+    ocii_timer_start(&scheduler->wheel, &entry->timer, entry->due);
+}
+
+/**
+ * Welford's online update of the jitter mean and variance
+ */
+static void cyclic_account(ocii_cyclic_entry_t *entry, uint64_t now) {
+    ocii_cyclic_stats_t *stats = &entry->stats;
+    int64_t jitter = (int64_t)(now - entry->queued_at);
+    double delta;
+
+    if (stats->sent == 0 || jitter < stats->jitter_min)
+        stats->jitter_min = jitter;
+    if (stats->sent == 0 || jitter > stats->jitter_max)
+        stats->jitter_max = jitter;
+
+    stats->sent++;
+    delta = (double)jitter - stats->jitter_mean;
+    stats->jitter_mean += delta / (double)stats->sent;
+    stats->jitter_m2 += delta * ((double)jitter - stats->jitter_mean);
+}
+
+extern int ocii_cyclic_init(ocii_cyclic_t *scheduler, uint32_t tick_us) {
+    if (scheduler == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(scheduler, 0, sizeof(*scheduler));
+
+    return ocii_timer_wheel_init(&scheduler->wheel, tick_us, ocii_time_us());
+}
+
+extern int ocii_cyclic_add(ocii_cyclic_t *scheduler, ocii_channel_t channel,
+                           const ocii_message_t *frame, uint32_t period_us,
+                           uint32_t phase_us, ocii_cyclic_update_t update,
+                           void *user) {
+    ocii_cyclic_entry_t *entry;
+    int handle;
+
+    if (scheduler == NULL || frame == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof || frame->data_len > 8)
+        return OCII_ERROR_INVALID_ARG;
+
+    for (handle = 0; handle < OCII_CYCLIC_MAX; handle++)
+        if (!scheduler->entry[handle].in_use)
+            break;
+
+    if (handle == OCII_CYCLIC_MAX)
+        return OCII_ERROR_NO_SLOT;
+
+    entry = &scheduler->entry[handle];
+    *entry = (ocii_cyclic_entry_t){.frame = *frame,
+                                   .update = update,
+                                   .user = user,
+                                   .due = ocii_time_us() + phase_us,
+                                   .period_us = period_us,
+                                   .channel = (uint8_t)channel,
+                                   .in_use = 1};
+
+    ocii_timer_init(&entry->timer, cyclic_fire, scheduler);
+    ocii_timer_start(&scheduler->wheel, &entry->timer, entry->due);
+
+    return handle;
+}
+
+extern int ocii_cyclic_remove(ocii_cyclic_t *scheduler, int handle) {
+    ocii_cyclic_entry_t *entry = cyclic_entry(scheduler, handle);
+
+    if (entry == NULL)
+        return OCII_ERROR_INVALID_ARG;
+
+    ocii_timer_stop(&scheduler->wheel, &entry->timer);
+
+    if (entry->queued) {
+        uint16_t *queue = scheduler->queue[entry->channel];
+        uint16_t *count = &scheduler->queue_count[entry->channel];
+
+        for (int i = 0; i < *count; i++) {
+            if (queue[i] != handle)
+                continue;
+            memmove(&queue[i], &queue[i + 1],
+                    (size_t)(*count - i - 1) * sizeof(*queue));
+            (*count)--;
+            break;
+        }
+    }
+
+    entry->in_use = 0;
+    entry->queued = 0;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_cyclic_set_data(ocii_cyclic_t *scheduler, int handle,
+                                const uint8_t *data, uint8_t length) {
+    ocii_cyclic_entry_t *entry = cyclic_entry(scheduler, handle);
+
+    if (entry == NULL || length > sizeof(entry->frame.data))
+        return OCII_ERROR_INVALID_ARG;
+
+    if (data == NULL && length != 0)
+        return OCII_ERROR_NULL_PTR;
+
+    if (length != 0)
+        memcpy(entry->frame.data, data, length);
+    entry->frame.data_len = length;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_cyclic_stats(const ocii_cyclic_t *scheduler, int handle,
+                             ocii_cyclic_stats_t *stats) {
+    if (stats == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (scheduler == NULL || handle < 0 || handle >= OCII_CYCLIC_MAX ||
+        !scheduler->entry[handle].in_use)
+        return OCII_ERROR_INVALID_ARG;
+
+    *stats = scheduler->entry[handle].stats;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_cyclic_poll(ocii_cyclic_t *scheduler) {
+    int written = 0, error_code;
+
+    if (scheduler == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)ocii_timer_advance(&scheduler->wheel, ocii_time_us());
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        uint16_t *queue = scheduler->queue[channel];
+        int count = scheduler->queue_count[channel], sent = 0;
+
+        while (sent < count) {
+            ocii_packet_t packet = {.count = 0};
+            uint64_t now;
+            int n;
+
+            for (n = 0; n < (int)sizeof_arr(packet.message) && sent + n < count;
+                 n++)
+                packet.message[packet.count++] =
+                    scheduler->entry[queue[sent + n]].frame;
+
+            error_code = ocii_write(channel, &packet);
+            if (error_code == OCII_ERROR_BUFFER_OVERFLOW)
+                break; /* Device is full, retry on the next poll */
+            if (error_code != OCII_ERROR_NO_ERROR) {
+                memmove(queue, &queue[sent],
+                        (size_t)(count - sent) * sizeof(*queue));
+                scheduler->queue_count[channel] = (uint16_t)(count - sent);
+                return error_code;
+            }
+
+            now = ocii_time_us();
+            for (int i = 0; i < n; i++) {
+                ocii_cyclic_entry_t *entry = &scheduler->entry[queue[sent + i]];
+
+                cyclic_account(entry, now);
+                entry->queued = 0;
+                if (entry->period_us == 0)
+                    entry->in_use = 0; /* A one-shot frame is done */
+            }
+
+            sent += n;
+            scheduler->packets++;
+            scheduler->frames += (uint64_t)n;
+        }
+
+        memmove(queue, &queue[sent], (size_t)(count - sent) * sizeof(*queue));
+        scheduler->queue_count[channel] = (uint16_t)(count - sent);
+        written += sent;
+    }
+
+    return written;
+}
@@ -0,0 +1,660 @@
+#include <math.h>
+#include <ocii_dbc.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DBC_EXTENDED 0x80000000U
+
+/**
+ * Vector tools put orphan signals into a pseudo message with this ID
+ */
+#define DBC_INDEPENDENT_SIGNALS 0xC0000000U
+
+static inline uint64_t load_le64(const uint8_t *p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+           (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+           (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+/**
+ * Parser state, current is the message that SG_ lines belong to
+ */
+typedef struct {
+    ocii_dbc_t *db;
+    uint32_t message_capacity;
+    uint32_t signal_capacity;
+    int current; /* DBC_NO_MESSAGE, DBC_PSEUDO_MESSAGE or a message index */
+} dbc_parser_t;
+
+#define DBC_NO_MESSAGE -1
+#define DBC_PSEUDO_MESSAGE -2
+
+static const char *skip_space(const char *p) {
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+static const char *read_name(const char *p, char *name, size_t size) {
+    size_t length = 0;
+
+    p = skip_space(p);
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != ':' &&
+           *p != '\r' && *p != '\n') {
+        if (length + 1 < size)
+            name[length++] = *p;
+        p++;
+    }
+    name[length] = '\0';
+
+    return length != 0 ? p : NULL;
+}
+
+static const char *expect(const char *p, char c) {
+    p = skip_space(p);
+    return *p == c ? p + 1 : NULL;
+}
+
+static int dbc_grow(void **array, uint32_t count, uint32_t *capacity,
+                    size_t size) {
+    void *grown;
+
+    if (count < *capacity)
+        return OCII_ERROR_NO_ERROR;
+
+    if ((grown = realloc(*array, (*capacity ? *capacity * 2 : 64) * size)) ==
+        NULL)
+        return OCII_ERROR_NO_MEMORY;
+
+    *array = grown;
+    *capacity = *capacity ? *capacity * 2 : 64;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+static int dbc_parse_message(dbc_parser_t *parser, const char *p) {
+    ocii_dbc_t *db = parser->db;
+    ocii_dbc_message_t message;
+    unsigned long id;
+    char *end;
+
+    id = strtoul(p, &end, 10);
+    if (end == p)
+        return OCII_ERROR_PARSE;
+
+    message = (ocii_dbc_message_t){.can_id = (uint32_t)id & 0x1FFFFFFF,
+                                   .extended = (id & DBC_EXTENDED) != 0,
+                                   .mux = -1,
+                                   .first = db->signals};
+
+    if ((p = read_name(end, message.name, sizeof(message.name))) == NULL ||
+        (p = expect(p, ':')) == NULL)
+        return OCII_ERROR_PARSE;
+
+    message.dlc = (uint8_t)strtoul(p, NULL, 10);
+
+    /**
+     * The signals of the pseudo message are parsed, but dropped
+     */
+    if (id == DBC_INDEPENDENT_SIGNALS) {
+        parser->current = DBC_PSEUDO_MESSAGE;
+        return OCII_ERROR_NO_ERROR;
+    }
+
+    /**
+     * A second definition of an ID would leave two messages that no hash
+     * tells apart
+     */
+    for (uint32_t m = 0; m < db->messages; m++)
+        if (db->message[m].can_id == message.can_id &&
+            db->message[m].extended == message.extended)
+            return OCII_ERROR_PARSE;
+
+    if (dbc_grow((void **)&db->message, db->messages,
+                 &parser->message_capacity,
+                 sizeof(*db->message)) != OCII_ERROR_NO_ERROR)
+        return OCII_ERROR_NO_MEMORY;
+
+    parser->current = (int)db->messages;
+    db->message[db->messages++] = message;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+static int dbc_parse_signal(dbc_parser_t *parser, const char *p) {
+    ocii_dbc_signal_t signal = {.mux_value = OCII_DBC_NOT_MULTIPLEXED};
+    ocii_dbc_t *db = parser->db;
+    ocii_dbc_message_t *message;
+    char token[OCII_DBC_NAME];
+    unsigned long start, length;
+    char *end;
+
+    if (parser->current == DBC_NO_MESSAGE)
+        return OCII_ERROR_PARSE;
+
+    if ((p = read_name(p, signal.name, sizeof(signal.name))) == NULL)
+        return OCII_ERROR_PARSE;
+
+    if (*(p = skip_space(p)) != ':') {
+        if ((p = read_name(p, token, sizeof(token))) == NULL)
+            return OCII_ERROR_PARSE;
+        if (token[0] == 'M')
+            signal.multiplexer = 1;
+        else if (token[0] == 'm')
+            signal.mux_value = (int32_t)strtol(&token[1], NULL, 10);
+        else
+            return OCII_ERROR_PARSE;
+    }
+
+    if ((p = expect(p, ':')) == NULL)
+        return OCII_ERROR_PARSE;
+
+    start = strtoul(p, &end, 10);
+    if (end == p || (p = expect(end, '|')) == NULL)
+        return OCII_ERROR_PARSE;
+    length = strtoul(p, &end, 10);
+    if (end == p || (p = expect(end, '@')) == NULL)
+        return OCII_ERROR_PARSE;
+    if ((*p != '0' && *p != '1') || (p[1] != '+' && p[1] != '-'))
+        return OCII_ERROR_PARSE;
+    if (start > 63 || length == 0 || length > 64)
+        return OCII_ERROR_PARSE;
+
+    signal.start = (uint8_t)start;
+    signal.length = (uint8_t)length;
+    signal.intel = p[0] == '1';
+    signal.is_signed = p[1] == '-';
+
+    if ((p = expect(p + 2, '(')) == NULL)
+        return OCII_ERROR_PARSE;
+    signal.factor = strtod(p, &end);
+    if ((p = expect(end, ',')) == NULL)
+        return OCII_ERROR_PARSE;
+    signal.offset = strtod(p, &end);
+    if ((p = expect(end, ')')) == NULL || (p = expect(p, '[')) == NULL)
+        return OCII_ERROR_PARSE;
+    signal.minimum = strtod(p, &end);
+    if ((p = expect(end, '|')) == NULL)
+        return OCII_ERROR_PARSE;
+    signal.maximum = strtod(p, &end);
+    if ((p = expect(end, ']')) == NULL)
+        return OCII_ERROR_PARSE;
+
+    if ((p = expect(p, '"')) != NULL) {
+        size_t unit = 0;
+
+        while (*p != '\0' && *p != '"') {
+            if (unit + 1 < sizeof(signal.unit))
+                signal.unit[unit++] = *p;
+            p++;
+        }
+    }
+
+    if (parser->current == DBC_PSEUDO_MESSAGE)
+        return OCII_ERROR_NO_ERROR;
+
+    if (dbc_grow((void **)&db->signal, db->signals, &parser->signal_capacity,
+                 sizeof(*db->signal)) != OCII_ERROR_NO_ERROR)
+        return OCII_ERROR_NO_MEMORY;
+
+    message = &db->message[parser->current];
+    signal.message = (uint16_t)parser->current;
+    if (signal.multiplexer)
+        message->mux = (int16_t)(db->signals - message->first);
+    message->count++;
+    db->signal[db->signals++] = signal;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+static int dbc_parse_value_type(dbc_parser_t *parser, const char *p) {
+    ocii_dbc_t *db = parser->db;
+    char name[OCII_DBC_NAME];
+    unsigned long id;
+    char *end;
+
+    id = strtoul(p, &end, 10);
+    if (end == p || (p = read_name(end, name, sizeof(name))) == NULL ||
+        (p = expect(p, ':')) == NULL)
+        return OCII_ERROR_PARSE;
+
+    for (uint32_t m = 0; m < db->messages; m++) {
+        ocii_dbc_message_t *message = &db->message[m];
+
+        if (message->can_id != ((uint32_t)id & 0x1FFFFFFF) ||
+            message->extended != ((id & DBC_EXTENDED) != 0))
+            continue;
+
+        for (uint32_t s = message->first; s < message->first + message->count;
+             s++)
+            if (strcmp(db->signal[s].name, name) == 0)
+                db->signal[s].value_type = (uint8_t)strtoul(p, NULL, 10);
+    }
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+/**
+ * Turns a signal description into a plan step
+ */
+static int dbc_compile_step(const ocii_dbc_signal_t *signal,
+                            ocii_dbc_step_t *step) {
+    unsigned lsb;
+
+    *step = (ocii_dbc_step_t){
+        .kind = ocii_dbc_step_word,
+        .mask = signal->length == 64 ? UINT64_MAX
+                                     : (1ULL << signal->length) - 1,
+        .sign = signal->is_signed ? 1ULL << (signal->length - 1) : 0,
+        .factor = signal->factor,
+        .offset = signal->offset};
+
+    if (signal->intel) {
+        if (signal->start + signal->length > 64)
+            return OCII_ERROR_PARSE;
+        step->shift = signal->start;
+        lsb = signal->start;
+    } else {
+        /**
+         * Motorola start bits point at the MSB in the sawtooth numbering,
+         * count the LSB from the top of the big endian word instead
+         */
+        lsb = (signal->start / 8U) * 8U + (7U - signal->start % 8U) +
+              signal->length - 1U;
+        if (lsb > 63)
+            return OCII_ERROR_PARSE;
+        step->word = 1;
+        step->shift = (uint8_t)(63 - lsb);
+    }
+
+    if (signal->value_type == ocii_dbc_float32 && signal->length == 32)
+        step->kind = ocii_dbc_step_float32;
+    else if (signal->value_type == ocii_dbc_float64 && signal->length == 64)
+        step->kind = ocii_dbc_step_float64;
+    else if (signal->intel && lsb % 8 == 0 &&
+             (signal->length == 8 || signal->length == 16 ||
+              signal->length == 32)) {
+        step->kind = signal->length == 8    ? ocii_dbc_step_u8
+                     : signal->length == 16 ? ocii_dbc_step_u16
+                                            : ocii_dbc_step_u32;
+        step->shift = (uint8_t)(lsb / 8);
+    }
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+/**
+ * Searches a multiplicative hash without collisions over the message keys.
+ * Returns OCII_ERROR_NO_SLOT if there is none with up to 2^20 slots
+ */
+static int dbc_build_hash(ocii_dbc_t *db) {
+    uint32_t seed = 0x9E3779B9U;
+
+    for (uint8_t bits = 1; bits <= 20; bits++) {
+        uint32_t size = 1U << bits;
+
+        if (size < db->messages)
+            continue;
+
+        free(db->hash_key);
+        free(db->hash_value);
+        db->hash_key = calloc(size, sizeof(*db->hash_key));
+        db->hash_value = calloc(size, sizeof(*db->hash_value));
+        if (db->hash_key == NULL || db->hash_value == NULL)
+            return OCII_ERROR_NO_MEMORY;
+
+        for (int attempt = 0; attempt < 256; attempt++) {
+            uint32_t m;
+
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            db->hash_multiplier = seed | 1;
+            db->hash_bits = bits;
+
+            memset(db->hash_value, 0, size * sizeof(*db->hash_value));
+            for (m = 0; m < db->messages; m++) {
+                uint32_t key = db->message[m].can_id |
+                               (db->message[m].extended ? DBC_EXTENDED : 0);
+                uint32_t slot = (key * db->hash_multiplier) >> (32 - bits);
+
+                if (db->hash_value[slot] != 0)
+                    break;
+                db->hash_key[slot] = key;
+                db->hash_value[slot] = (uint16_t)(m + 1);
+            }
+
+            if (m == db->messages)
+                return OCII_ERROR_NO_ERROR;
+        }
+    }
+
+    return OCII_ERROR_NO_SLOT;
+}
+
+static int dbc_compile(ocii_dbc_t *db) {
+    int error_code;
+
+    if (db->messages >= UINT16_MAX)
+        return OCII_ERROR_NO_SLOT;
+
+    if (db->signals != 0 &&
+        (db->step = calloc(db->signals, sizeof(*db->step))) == NULL)
+        return OCII_ERROR_NO_MEMORY;
+
+    for (uint32_t s = 0; s < db->signals; s++) {
+        if ((error_code = dbc_compile_step(&db->signal[s], &db->step[s])) !=
+            OCII_ERROR_NO_ERROR)
+            return error_code;
+        if (db->step[s].word)
+            db->message[db->signal[s].message].big_endian = 1;
+    }
+
+    return dbc_build_hash(db);
+}
+
+extern int ocii_dbc_parse(const char *text, size_t length, ocii_dbc_t **db,
+                          uint32_t *line) {
+    dbc_parser_t parser = {.current = DBC_NO_MESSAGE};
+    int error_code = OCII_ERROR_NO_ERROR;
+    uint32_t number = 0;
+    char *copy, *p;
+
+    if (text == NULL || db == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((parser.db = calloc(1, sizeof(*parser.db))) == NULL)
+        return OCII_ERROR_NO_MEMORY;
+
+    if ((copy = malloc(length + 1)) == NULL) {
+        free(parser.db);
+        return OCII_ERROR_NO_MEMORY;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    for (p = copy; *p != '\0' && error_code == OCII_ERROR_NO_ERROR;) {
+        char *next = strchr(p, '\n');
+        const char *q;
+
+        if (next != NULL)
+            *next++ = '\0';
+        else
+            next = p + strlen(p);
+        number++;
+
+        q = skip_space(p);
+        if (strncmp(q, "BO_ ", 4) == 0)
+            error_code = dbc_parse_message(&parser, q + 4);
+        else if (strncmp(q, "SG_ ", 4) == 0)
+            error_code = dbc_parse_signal(&parser, q + 4);
+        else if (strncmp(q, "SIG_VALTYPE_ ", 13) == 0)
+            error_code = dbc_parse_value_type(&parser, q + 13);
+        else if (*q != '\0' && *q != '\r')
+            parser.current = DBC_NO_MESSAGE;
+
+        p = next;
+    }
+
+    free(copy);
+
+    if (error_code == OCII_ERROR_NO_ERROR)
+        error_code = dbc_compile(parser.db);
+    else if (line != NULL)
+        *line = number;
+
+    if (error_code != OCII_ERROR_NO_ERROR) {
+        ocii_dbc_free(parser.db);
+        return error_code;
+    }
+
+    *db = parser.db;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_dbc_load(const char *path, ocii_dbc_t **db, uint32_t *line) {
+    FILE *file;
+    char *text;
+    long length;
+    int error_code;
+
+    if (path == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((file = fopen(path, "rb")) == NULL)
+        return OCII_ERROR_FILE;
+
+    if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) != 0) {
+        (void)fclose(file);
+        return OCII_ERROR_FILE;
+    }
+
+    if ((text = malloc((size_t)length + 1)) == NULL) {
+        (void)fclose(file);
+        return OCII_ERROR_NO_MEMORY;
+    }
+
+    if (fread(text, 1, (size_t)length, file) != (size_t)length) {
+        free(text);
+        (void)fclose(file);
+        return OCII_ERROR_FILE;
+    }
+    (void)fclose(file);
+
+    error_code = ocii_dbc_parse(text, (size_t)length, db, line);
+    free(text);
+
+    return error_code;
+}
+
+extern void ocii_dbc_free(ocii_dbc_t *db) {
+    if (db == NULL)
+        return;
+
+    free(db->message);
+    free(db->signal);
+    free(db->step);
+    free(db->hash_key);
+    free(db->hash_value);
+    free(db);
+}
+
+extern int ocii_dbc_find(const ocii_dbc_t *db, uint32_t can_id,
+                         uint8_t extended) {
+    uint32_t key = can_id | (extended ? DBC_EXTENDED : 0), slot;
+
+    if (db == NULL || db->hash_value == NULL)
+        return -1;
+
+    slot = (key * db->hash_multiplier) >> (32 - db->hash_bits);
+
+    return db->hash_key[slot] == key && db->hash_value[slot] != 0
+               ? db->hash_value[slot] - 1
+               : -1;
+}
+
+extern int ocii_dbc_signal_index(const ocii_dbc_t *db, const char *message,
+                                 const char *signal) {
+    if (db == NULL || signal == NULL)
+        return -1;
+
+    for (uint32_t s = 0; s < db->signals; s++)
+        if (strcmp(db->signal[s].name, signal) == 0 &&
+            (message == NULL ||
+             strcmp(db->message[db->signal[s].message].name, message) == 0))
+            return (int)s;
+
+    return -1;
+}
+
+static inline uint64_t dbc_raw(const ocii_dbc_step_t *step,
+                               const uint64_t word[2], const uint8_t *data) {
+    switch (step->kind) {
+    case ocii_dbc_step_u8:
+        return data[step->shift];
+    case ocii_dbc_step_u16:
+        return (uint64_t)data[step->shift] |
+               (uint64_t)data[step->shift + 1] << 8;
+    case ocii_dbc_step_u32:
+        return (uint64_t)data[step->shift] |
+               (uint64_t)data[step->shift + 1] << 8 |
+               (uint64_t)data[step->shift + 2] << 16 |
+               (uint64_t)data[step->shift + 3] << 24;
+    default:
+        return (word[step->word] >> step->shift) & step->mask;
+    }
+}
+
+static inline double dbc_value(const ocii_dbc_step_t *step, uint64_t raw) {
+    switch (step->kind) {
+    case ocii_dbc_step_float32: {
+        uint32_t bits = (uint32_t)raw;
+        float value;
+
+        memcpy(&value, &bits, sizeof(value));
+        return (double)value * step->factor + step->offset;
+    }
+    case ocii_dbc_step_float64: {
+        double value;
+
+        memcpy(&value, &raw, sizeof(value));
+        return value * step->factor + step->offset;
+    }
+    default:
+        /**
+         * sign is the sign bit of a signed signal, the xor and subtract
+         * extend it. Unsigned signals keep all 64 bits and skip the cast
+         */
+        if (step->sign != 0)
+            return (double)(int64_t)((raw ^ step->sign) - step->sign) *
+                       step->factor +
+                   step->offset;
+        return (double)raw * step->factor + step->offset;
+    }
+}
+
+/**
+ * Runs the plan of one message, value i goes to out[i * stride]
+ */
+static inline void dbc_run(const ocii_dbc_t *db,
+                           const ocii_dbc_message_t *message,
+                           const uint8_t *data, double *out, size_t stride) {
+    const ocii_dbc_step_t *step = &db->step[message->first];
+    const ocii_dbc_signal_t *signal = &db->signal[message->first];
+    uint64_t word[2];
+    int64_t mux = -1;
+
+    word[0] = load_le64(data);
+    word[1] = message->big_endian ? __builtin_bswap64(word[0]) : 0;
+
+    if (message->mux < 0) {
+        for (uint32_t i = 0; i < message->count; i++)
+            out[i * stride] = dbc_value(&step[i], dbc_raw(&step[i], word, data));
+        return;
+    }
+
+    mux = (int64_t)dbc_raw(&step[message->mux], word, data);
+    for (uint32_t i = 0; i < message->count; i++)
+        out[i * stride] = signal[i].mux_value == OCII_DBC_NOT_MULTIPLEXED ||
+                                  signal[i].mux_value == mux
+                              ? dbc_value(&step[i], dbc_raw(&step[i], word, data))
+                              : NAN;
+}
+
+extern int ocii_dbc_decode_frame(const ocii_dbc_t *db,
+                                 const ocii_message_t *frame, double *values) {
+    int index;
+
+    if (db == NULL || frame == NULL || values == NULL || frame->remote)
+        return -1;
+
+    if ((index = ocii_dbc_find(db, frame->can_id, frame->extended)) < 0)
+        return -1;
+
+    dbc_run(db, &db->message[index], frame->data, values, 1);
+
+    return index;
+}
+
+extern int ocii_dbc_buffer_init(const ocii_dbc_t *db, ocii_dbc_buffer_t *buffer,
+                                uint32_t rows) {
+    if (db == NULL || buffer == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (rows == 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    *buffer = (ocii_dbc_buffer_t){.rows = rows};
+    buffer->count = calloc(db->messages + 1, sizeof(*buffer->count));
+    buffer->time = calloc((size_t)(db->messages + 1) * rows,
+                          sizeof(*buffer->time));
+    buffer->values = calloc((size_t)(db->signals + 1) * rows,
+                            sizeof(*buffer->values));
+
+    if (buffer->count == NULL || buffer->time == NULL ||
+        buffer->values == NULL) {
+        ocii_dbc_buffer_free(buffer);
+        return OCII_ERROR_NO_MEMORY;
+    }
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern void ocii_dbc_buffer_reset(const ocii_dbc_t *db,
+                                  ocii_dbc_buffer_t *buffer) {
+    if (db == NULL || buffer == NULL || buffer->count == NULL)
+        return;
+
+    memset(buffer->count, 0, db->messages * sizeof(*buffer->count));
+    buffer->dropped = 0;
+}
+
+extern void ocii_dbc_buffer_free(ocii_dbc_buffer_t *buffer) {
+    if (buffer == NULL)
+        return;
+
+    free(buffer->count);
+    free(buffer->time);
+    free(buffer->values);
+    *buffer = (ocii_dbc_buffer_t){0};
+}
+
+extern int ocii_dbc_decode(const ocii_dbc_t *db, const ocii_message_t *frames,
+                           size_t count, ocii_dbc_buffer_t *buffer) {
+    int decoded = 0;
+
+    if (db == NULL || frames == NULL || buffer == NULL)
+        return 0;
+
+    for (size_t f = 0; f < count; f++) {
+        const ocii_dbc_message_t *message;
+        uint32_t row;
+        int index;
+
+        if (frames[f].remote ||
+            (index = ocii_dbc_find(db, frames[f].can_id, frames[f].extended)) <
+                0)
+            continue;
+
+        message = &db->message[index];
+        if ((row = buffer->count[index]) >= buffer->rows) {
+            buffer->dropped++;
+            continue;
+        }
+
+        buffer->time[(size_t)index * buffer->rows + row] =
+            frames[f].time_stamp;
+        dbc_run(db, message, frames[f].data,
+                &buffer->values[(size_t)message->first * buffer->rows + row],
+                buffer->rows);
+        buffer->count[index] = row + 1;
+        decoded++;
+    }
+
+    return decoded;
+}
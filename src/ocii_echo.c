@@ -0,0 +1,297 @@
+#include <ocii_echo.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
+
+/**
+ * Payload with the bytes past data_len cleared, echoes need not carry them
+ */
+static uint64_t echo_payload(const ocii_message_t *message) {
+    uint64_t value = 0;
+
+    memcpy(&value, message->data,
+           message->data_len < sizeof(message->data) ? message->data_len
+                                                     : sizeof(message->data));
+
+    return value;
+}
+
+static uint32_t echo_hash(int channel, const ocii_message_t *message) {
+    uint64_t key = echo_payload(message) ^
+                   ((uint64_t)message->can_id << 7 |
+                    (uint64_t)message->extended << 6 |
+                    (uint64_t)message->remote << 5 |
+                    (uint64_t)(message->data_len & 0x0F) << 1 |
+                    (uint64_t)channel) *
+                       0x9E3779B97F4A7C15ULL;
+
+    /**
+     * Murmur3 finalizer
+     */
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB93FE53C2F63ULL;
+    key ^= key >> 33;
+
+    return (uint32_t)key;
+}
+
+static int echo_equal(const ocii_echo_entry_t *entry, int channel,
+                      const ocii_message_t *message) {
+    return entry->channel == channel &&
+           entry->message.can_id == message->can_id &&
+           entry->message.extended == message->extended &&
+           entry->message.remote == message->remote &&
+           entry->message.data_len == message->data_len &&
+           echo_payload(&entry->message) == echo_payload(message);
+}
+
+/**
+ * Unlinks an entry from its bucket, its channel list and returns it to the
+ * free list. Entries are 1-based
+ */
+static void echo_release(ocii_echo_t *echo, uint16_t index) {
+    ocii_echo_entry_t *entry = &echo->entry[index - 1];
+    uint32_t bucket = entry->hash & (OCII_ECHO_BUCKETS - 1);
+    uint16_t *link = &echo->bucket_head[bucket], prev = 0;
+
+    while (*link != index) {
+        prev = *link;
+        link = &echo->entry[*link - 1].chain;
+    }
+    *link = entry->chain;
+    if (echo->bucket_tail[bucket] == index)
+        echo->bucket_tail[bucket] = prev;
+
+    if (entry->prev != 0)
+        echo->entry[entry->prev - 1].next = entry->next;
+    else
+        echo->oldest[entry->channel] = entry->next;
+    if (entry->next != 0)
+        echo->entry[entry->next - 1].prev = entry->prev;
+    else
+        echo->newest[entry->channel] = entry->prev;
+
+    entry->chain = echo->free;
+    echo->free = index;
+    echo->outstanding--;
+}
+
+static uint16_t echo_track(ocii_echo_t *echo, int channel,
+                           const ocii_message_t *message, uintptr_t tag,
+                           uint64_t now) {
+    uint16_t index = echo->free;
+    ocii_echo_entry_t *entry = &echo->entry[index - 1];
+    uint32_t bucket;
+
+    echo->free = entry->chain;
+    echo->outstanding++;
+
+    *entry = (ocii_echo_entry_t){.message = *message,
+                                 .queued_at = now,
+                                 .sequence = echo->sequence++,
+                                 .tag = tag,
+                                 .hash = echo_hash(channel, message),
+                                 .prev = echo->newest[channel],
+                                 .channel = (uint8_t)channel};
+
+    bucket = entry->hash & (OCII_ECHO_BUCKETS - 1);
+    if (echo->bucket_tail[bucket] != 0)
+        echo->entry[echo->bucket_tail[bucket] - 1].chain = index;
+    else
+        echo->bucket_head[bucket] = index;
+    echo->bucket_tail[bucket] = index;
+
+    if (echo->newest[channel] != 0)
+        echo->entry[echo->newest[channel] - 1].next = index;
+    else
+        echo->oldest[channel] = index;
+    echo->newest[channel] = index;
+
+    return index;
+}
+
+/**
+ * Takes the oldest outstanding message of a channel if it was sent before
+ * sequence, or if it is older than deadline. Returns non-zero if one was
+ * taken, the lock must be held
+ */
+static int echo_take_oldest(ocii_echo_t *echo, int channel, uint64_t sequence,
+                            uint64_t deadline, ocii_echo_entry_t *taken) {
+    uint16_t index = echo->oldest[channel];
+
+    if (index == 0 || (echo->entry[index - 1].sequence >= sequence &&
+                       echo->entry[index - 1].queued_at >= deadline))
+        return 0;
+
+    *taken = echo->entry[index - 1];
+    echo_release(echo, index);
+
+    return 1;
+}
+
+extern int ocii_echo_init(ocii_echo_t *echo, ocii_echo_callback_t callback,
+                          void *user) {
+    if (echo == NULL || callback == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(echo, 0, sizeof(*echo));
+    echo->callback = callback;
+    echo->user = user;
+    echo->timeout_us = OCII_ECHO_TIMEOUT_US;
+
+    for (int i = 0; i < OCII_ECHO_MAX; i++)
+        echo->entry[i].chain = i + 1 < OCII_ECHO_MAX ? i + 2 : 0;
+    echo->free = 1;
+
+    if (pthread_mutex_init(&echo->lock, NULL) != 0)
+        return OCII_ERROR_THREAD;
+
+    return ocii_add_rx_hook(ocii_echo_rx_hook, echo);
+}
+
+extern int ocii_echo_deinit(ocii_echo_t *echo) {
+    int error_code;
+
+    if (echo == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((error_code = ocii_remove_rx_hook(ocii_echo_rx_hook, echo)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    (void)pthread_mutex_destroy(&echo->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_echo_write(ocii_echo_t *echo, ocii_channel_t channel,
+                           ocii_packet_t *packet, uintptr_t tag) {
+    uint16_t index[sizeof_arr(packet->message)];
+    uint64_t now = ocii_time_us();
+    int error_code, count;
+
+    if (echo == NULL || packet == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    count = packet->count < sizeof_arr(packet->message)
+                ? packet->count
+                : (int)sizeof_arr(packet->message);
+
+    /**
+     * Tracked before the write, the echo may arrive before it returns
+     */
+    (void)pthread_mutex_lock(&echo->lock);
+    if (echo->outstanding + (uint32_t)count > OCII_ECHO_MAX) {
+        (void)pthread_mutex_unlock(&echo->lock);
+        return OCII_ERROR_NO_SLOT;
+    }
+    for (int i = 0; i < count; i++) {
+        packet->message[i].send_type |= OCII_SEND_TYPE_ECHO;
+        index[i] = echo_track(echo, channel, &packet->message[i], tag, now);
+    }
+    (void)pthread_mutex_unlock(&echo->lock);
+
+    if ((error_code = ocii_write(channel, packet)) == OCII_ERROR_NO_ERROR)
+        return OCII_ERROR_NO_ERROR;
+
+    /**
+     * Not sent, forget the messages unless a stray echo took them already
+     */
+    (void)pthread_mutex_lock(&echo->lock);
+    for (int i = 0; i < count; i++) {
+        uint16_t link = echo->oldest[channel];
+
+        while (link != 0 && link != index[i])
+            link = echo->entry[link - 1].next;
+        if (link != 0)
+            echo_release(echo, index[i]);
+    }
+    (void)pthread_mutex_unlock(&echo->lock);
+
+    return error_code;
+}
+
+extern int ocii_echo_rx_hook(void *user, ocii_channel_t channel,
+                             ocii_message_t *message) {
+    ocii_echo_t *echo = user;
+    ocii_echo_entry_t matched, lost;
+    uint32_t hash = echo_hash(channel, message);
+    uint64_t latency;
+    uint16_t index;
+
+    (void)pthread_mutex_lock(&echo->lock);
+    for (index = echo->bucket_head[hash & (OCII_ECHO_BUCKETS - 1)];
+         index != 0; index = echo->entry[index - 1].chain)
+        if (echo->entry[index - 1].hash == hash &&
+            echo_equal(&echo->entry[index - 1], channel, message))
+            break;
+
+    if (index == 0) {
+        (void)pthread_mutex_unlock(&echo->lock);
+        return 0;
+    }
+
+    matched = echo->entry[index - 1];
+    echo_release(echo, index);
+
+    latency = ocii_time_us() - matched.queued_at;
+    if (echo->confirmed == 0 || latency < echo->latency_min)
+        echo->latency_min = latency;
+    if (latency > echo->latency_max)
+        echo->latency_max = latency;
+    echo->latency_sum += latency;
+    echo->confirmed++;
+
+    /**
+     * The device sends in order, whatever was sent before and is still
+     * outstanding did not make it onto the bus
+     */
+    while (echo_take_oldest(echo, channel, matched.sequence, 0, &lost)) {
+        echo->lost++;
+        (void)pthread_mutex_unlock(&echo->lock);
+        echo->callback(echo->user, channel, &lost.message, lost.tag,
+                       OCII_ERROR_TX_LOST, 0);
+        (void)pthread_mutex_lock(&echo->lock);
+    }
+    (void)pthread_mutex_unlock(&echo->lock);
+
+    echo->callback(echo->user, channel, &matched.message, matched.tag,
+                   OCII_ERROR_NO_ERROR, latency);
+
+    return 1;
+}
+
+extern int ocii_echo_poll(ocii_echo_t *echo) {
+    ocii_echo_entry_t expired;
+    uint64_t now = ocii_time_us();
+    int count = 0;
+
+    if (echo == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_mutex_lock(&echo->lock);
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        while (echo_take_oldest(echo, channel, 0,
+                                now > echo->timeout_us ? now - echo->timeout_us
+                                                       : 0,
+                                &expired)) {
+            echo->timed_out++;
+            count++;
+            (void)pthread_mutex_unlock(&echo->lock);
+            echo->callback(echo->user, channel, &expired.message, expired.tag,
+                           OCII_ERROR_TIMEOUT, 0);
+            (void)pthread_mutex_lock(&echo->lock);
+        }
+    (void)pthread_mutex_unlock(&echo->lock);
+
+    return count;
+}
@@ -0,0 +1,299 @@
+#include <ocii_gateway.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
+
+static uint32_t gateway_key(int channel, uint32_t can_id) {
+    return (can_id & 0x1FFFFFFF) | (uint32_t)channel << 31;
+}
+
+static uint32_t gateway_hash(uint32_t key) {
+    return (key * 0x9E3779B1U) >> 16;
+}
+
+/**
+ * Slot of an extended ID in the hash table, the free slot it would go into
+ * if it is not there
+ */
+static uint32_t gateway_slot(const ocii_gateway_t *gateway, uint32_t key) {
+    uint32_t slot = gateway_hash(key) & (OCII_GATEWAY_EXT_SLOTS - 1);
+
+    while (gateway->extended[slot].route != 0 &&
+           gateway->extended[slot].key != key)
+        slot = (slot + 1) & (OCII_GATEWAY_EXT_SLOTS - 1);
+
+    return slot;
+}
+
+static ocii_gateway_route_t *gateway_route(ocii_gateway_t *gateway,
+                                           int channel,
+                                           const ocii_message_t *message) {
+    uint16_t route;
+
+    if (!message->extended)
+        route = gateway->standard[channel][message->can_id & 0x7FF];
+    else
+        route = gateway
+                    ->extended[gateway_slot(
+                        gateway, gateway_key(channel, message->can_id))]
+                    .route;
+
+    return route != 0 ? &gateway->route[route - 1] : NULL;
+}
+
+/**
+ * Token bucket with tokens in millionths of a message, so that one token per
+ * microsecond and message rate add up without division
+ */
+static int gateway_admit(ocii_gateway_route_t *route, uint64_t now) {
+    uint64_t cap = (uint64_t)route->rule.burst * 1000000U;
+
+    if (route->rule.rate == 0)
+        return 1;
+
+    route->tokens += (now - route->refill) * route->rule.rate;
+    if (route->tokens > cap)
+        route->tokens = cap;
+    route->refill = now;
+
+    if (route->tokens < 1000000U)
+        return 0;
+
+    route->tokens -= 1000000U;
+    return 1;
+}
+
+static void gateway_account(ocii_gateway_t *gateway, uint64_t latency) {
+    int bucket = 0;
+
+    while (bucket < OCII_GATEWAY_HISTOGRAM - 1 && latency >> bucket != 0)
+        bucket++;
+    gateway->stats.latency[bucket]++;
+}
+
+/**
+ * Writes the queue of a channel in packets of three, a partial packet only
+ * with partial set. The lock must be held. Returns the messages written
+ */
+static int gateway_flush(ocii_gateway_t *gateway, int channel, int partial) {
+    ocii_message_t *queue = gateway->queue[channel];
+    uint16_t *count = &gateway->queue_count[channel];
+    int sent = 0, error_code = OCII_ERROR_NO_ERROR;
+
+    while (sent < *count) {
+        ocii_packet_t packet = {.count = 0};
+        uint64_t now;
+
+        if (*count - sent < (int)sizeof_arr(packet.message) && !partial)
+            break;
+
+        while (packet.count < sizeof_arr(packet.message) &&
+               sent + packet.count < *count) {
+            packet.message[packet.count] = queue[sent + packet.count];
+            packet.count++;
+        }
+
+        if ((error_code = ocii_write(channel, &packet)) != OCII_ERROR_NO_ERROR)
+            break; /* Retried on the next flush */
+
+        now = ocii_time_us();
+        for (int i = 0; i < packet.count; i++)
+            gateway_account(gateway, now - gateway->arrival[channel][sent + i]);
+        gateway->stats.forwarded += packet.count;
+        gateway->stats.packets++;
+        sent += packet.count;
+    }
+
+    memmove(queue, &queue[sent], (size_t)(*count - sent) * sizeof(*queue));
+    memmove(gateway->arrival[channel], &gateway->arrival[channel][sent],
+            (size_t)(*count - sent) * sizeof(gateway->arrival[channel][0]));
+    *count = (uint16_t)(*count - sent);
+
+    if (error_code != OCII_ERROR_NO_ERROR &&
+        error_code != OCII_ERROR_BUFFER_OVERFLOW)
+        return error_code;
+
+    return sent;
+}
+
+extern int ocii_gateway_init(ocii_gateway_t *gateway,
+                             ocii_gateway_action_t default_action) {
+    if (gateway == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (default_action != OCII_GATEWAY_PASS &&
+        default_action != OCII_GATEWAY_FORWARD &&
+        default_action != OCII_GATEWAY_DROP)
+        return OCII_ERROR_INVALID_ARG;
+
+    memset(gateway, 0, sizeof(*gateway));
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        gateway->default_action[channel] = (uint8_t)default_action;
+
+    if (pthread_mutex_init(&gateway->lock, NULL) != 0)
+        return OCII_ERROR_THREAD;
+
+    return ocii_add_rx_hook(ocii_gateway_rx_hook, gateway);
+}
+
+extern int ocii_gateway_deinit(ocii_gateway_t *gateway) {
+    int error_code;
+
+    if (gateway == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((error_code = ocii_remove_rx_hook(ocii_gateway_rx_hook, gateway)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    (void)pthread_mutex_destroy(&gateway->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_gateway_add_rule(ocii_gateway_t *gateway,
+                                 const ocii_gateway_rule_t *rule) {
+    ocii_gateway_route_t *route;
+    uint16_t *entry;
+    uint32_t slot = 0;
+    int index;
+
+    if (gateway == NULL || rule == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (rule->from >= ocii_channel_sizeof ||
+        rule->action > OCII_GATEWAY_REMAP ||
+        rule->can_id > (rule->extended ? 0x1FFFFFFFU : 0x7FFU) ||
+        (rule->rate != 0 && rule->burst == 0))
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&gateway->lock);
+
+    if (!rule->extended)
+        entry = &gateway->standard[rule->from][rule->can_id];
+    else {
+        slot = gateway_slot(gateway, gateway_key(rule->from, rule->can_id));
+        entry = &gateway->extended[slot].route;
+    }
+
+    if (*entry != 0)
+        index = *entry - 1;
+    else if (gateway->routes == OCII_GATEWAY_ROUTES ||
+             (rule->extended &&
+              gateway->routes >= OCII_GATEWAY_EXT_SLOTS / 2)) {
+        (void)pthread_mutex_unlock(&gateway->lock);
+        return OCII_ERROR_NO_SLOT;
+    } else
+        index = gateway->routes++;
+
+    route = &gateway->route[index];
+    *route = (ocii_gateway_route_t){.rule = *rule,
+                                    .tokens = (uint64_t)rule->burst * 1000000U,
+                                    .refill = ocii_time_us()};
+    *entry = (uint16_t)(index + 1);
+    if (rule->extended)
+        gateway->extended[slot].key =
+            gateway_key(rule->from, rule->can_id);
+
+    (void)pthread_mutex_unlock(&gateway->lock);
+
+    return index;
+}
+
+extern int ocii_gateway_rx_hook(void *user, ocii_channel_t channel,
+                                ocii_message_t *message) {
+    ocii_gateway_t *gateway = user;
+    ocii_gateway_route_t *route;
+    uint64_t now = ocii_time_us();
+    int to = (channel + 1) % ocii_channel_sizeof, action;
+    ocii_message_t forward;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return 0;
+
+    (void)pthread_mutex_lock(&gateway->lock);
+
+    route = gateway_route(gateway, channel, message);
+    action = route != NULL ? route->rule.action
+                           : gateway->default_action[channel];
+
+    if (action == OCII_GATEWAY_PASS) {
+        (void)pthread_mutex_unlock(&gateway->lock);
+        return 0;
+    }
+
+    if (route != NULL) {
+        route->matched++;
+        if (action != OCII_GATEWAY_DROP && !gateway_admit(route, now)) {
+            route->limited++;
+            gateway->stats.limited++;
+            goto ocii_flush;
+        }
+    }
+
+    forward = *message;
+    forward.send_type = 0;
+    if (action == OCII_GATEWAY_REMAP) {
+        forward.can_id = route->rule.remap_id;
+        forward.extended = route->rule.remap_extended;
+    }
+
+    if (action == OCII_GATEWAY_DROP ||
+        (route != NULL && route->rule.transform != NULL &&
+         route->rule.transform(route->rule.user, channel, &forward) != 0)) {
+        gateway->stats.dropped++;
+        goto ocii_flush;
+    }
+
+    if (gateway->queue_count[to] == OCII_GATEWAY_QUEUE) {
+        gateway->stats.overflow++;
+        goto ocii_flush;
+    }
+
+    gateway->arrival[to][gateway->queue_count[to]] = now;
+    gateway->queue[to][gateway->queue_count[to]++] = forward;
+ocii_flush:
+    /**
+     * A full packet goes out right away, so does one that waited flush_us
+     * while the reads kept the application from polling. Errors are left to
+     * the next poll
+     */
+    if (gateway->queue_count[to] >= sizeof_arr(((ocii_packet_t *)0)->message) ||
+        (gateway->flush_us != 0 && gateway->queue_count[to] != 0 &&
+         now - gateway->arrival[to][0] >= gateway->flush_us))
+        (void)gateway_flush(gateway, to, 1);
+    (void)pthread_mutex_unlock(&gateway->lock);
+
+    return 1;
+}
+
+extern int ocii_gateway_poll(ocii_gateway_t *gateway) {
+    uint64_t now = ocii_time_us();
+    int written = 0, error_code = OCII_ERROR_NO_ERROR;
+
+    if (gateway == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_mutex_lock(&gateway->lock);
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        int sent;
+
+        if (gateway->queue_count[channel] == 0)
+            continue;
+
+        sent = gateway_flush(gateway, channel,
+                             now - gateway->arrival[channel][0] >=
+                                 gateway->flush_us);
+        if (sent < 0)
+            error_code = sent;
+        else
+            written += sent;
+    }
+    (void)pthread_mutex_unlock(&gateway->lock);
+
+    return error_code != OCII_ERROR_NO_ERROR ? error_code : written;
+}
@@ -0,0 +1,180 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * Per-ID entry pool shared by the statistics and the latest value table
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ocii_idpool_h
+#define ocii_idpool_h
+
+#include <opencanalystii.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The lookup tables and the pool counter of a table of entries. Entries are
+ * taken from the pool on the first message of an ID and never freed. 11-bit
+ * IDs are found through a direct table per channel, 29-bit IDs through an
+ * open-addressed hash table of ext_slots, a power of two. The hash table is
+ * an array of key and slot pairs in the struct of the caller, ext_key and
+ * ext_slot point into its first entry
+ */
+typedef struct {
+    atomic_uint *used;
+    unsigned ids;
+    atomic_ushort (*standard)[2048];
+    atomic_uint *ext_key;
+    atomic_ushort *ext_slot;
+    size_t ext_stride; /* Size of a hash table entry */
+    uint32_t ext_slots;
+} idpool_t;
+
+static inline atomic_uint *idpool_ext_key(const idpool_t *pool,
+                                          uint32_t index) {
+    return (atomic_uint *)((char *)pool->ext_key + index * pool->ext_stride);
+}
+
+static inline atomic_ushort *idpool_ext_slot(const idpool_t *pool,
+                                             uint32_t index) {
+    return (atomic_ushort *)((char *)pool->ext_slot +
+                             index * pool->ext_stride);
+}
+
+static inline uint32_t idpool_key(int channel, uint32_t can_id) {
+    return ((can_id & 0x1FFFFFFF) + 1) | (uint32_t)channel << 31;
+}
+
+static inline uint32_t idpool_hash(uint32_t key) {
+    return (key * 0x9E3779B1U) >> 16;
+}
+
+/**
+ * Takes an entry from the pool for a new ID. Returns the slot + 1, or 0 if
+ * the pool is exhausted. Readers skip entries with a count of 0
+ */
+static inline uint16_t idpool_claim(const idpool_t *pool) {
+    unsigned index =
+        atomic_fetch_add_explicit(pool->used, 1, memory_order_relaxed);
+
+    if (index >= pool->ids) {
+        atomic_store_explicit(pool->used, pool->ids, memory_order_relaxed);
+        return 0;
+    }
+
+    return (uint16_t)(index + 1);
+}
+
+/**
+ * Slot + 1 of an ID, allocated on its first message with insert set.
+ * Returns 0 if it is not there or did not fit
+ */
+static inline uint16_t idpool_find(const idpool_t *pool, int channel,
+                                   uint32_t can_id, int extended, int insert) {
+    uint32_t key, index;
+    uint16_t slot;
+
+    if (!extended) {
+        atomic_ushort *entry = &pool->standard[channel][can_id & 0x7FF];
+
+        slot = atomic_load_explicit(entry, memory_order_acquire);
+        if (slot == 0 && insert && (slot = idpool_claim(pool)) != 0)
+            atomic_store_explicit(entry, slot, memory_order_release);
+        return slot;
+    }
+
+    key = idpool_key(channel, can_id);
+    index = idpool_hash(key) & (pool->ext_slots - 1);
+
+    for (uint32_t probe = 0; probe < pool->ext_slots; probe++) {
+        uint32_t found = atomic_load_explicit(idpool_ext_key(pool, index),
+                                              memory_order_acquire);
+
+        if (found == key)
+            return atomic_load_explicit(idpool_ext_slot(pool, index),
+                                        memory_order_acquire);
+
+        /**
+         * Both channels may insert at once, the compare-exchange settles a
+         * race for the same empty slot
+         */
+        if (found == 0) {
+            if (!insert)
+                return 0;
+            if (atomic_compare_exchange_strong_explicit(
+                    idpool_ext_key(pool, index), &found, key,
+                    memory_order_acq_rel, memory_order_acquire)) {
+                slot = idpool_claim(pool);
+                atomic_store_explicit(idpool_ext_slot(pool, index), slot,
+                                      memory_order_release);
+                return slot;
+            }
+            if (found == key)
+                return atomic_load_explicit(idpool_ext_slot(pool, index),
+                                            memory_order_acquire);
+        }
+
+        index = (index + 1) & (pool->ext_slots - 1);
+    }
+
+    return 0;
+}
+
+/**
+ * Brackets a write of the RX path, the sequence is odd in between. Returns
+ * the sequence to hand to idpool_write_end
+ */
+static inline unsigned idpool_write_begin(atomic_uint *sequence) {
+    unsigned value = atomic_load_explicit(sequence, memory_order_relaxed);
+
+    atomic_store_explicit(sequence, value + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    return value;
+}
+
+static inline void idpool_write_end(atomic_uint *sequence, unsigned value) {
+    atomic_store_explicit(sequence, value + 2, memory_order_release);
+}
+
+/**
+ * Copies size bytes of an entry behind the sequence lock, retrying while the
+ * RX path writes it
+ */
+static inline void idpool_read(atomic_uint *sequence, void *entry,
+                               const void *source, size_t size) {
+    unsigned before, after, spins = 0;
+
+    do {
+        /**
+         * The writer may have been preempted mid-write, give it the CPU
+         */
+        while ((before = atomic_load_explicit(sequence,
+                                              memory_order_acquire)) &
+               1)
+            if (++spins % 64 == 0)
+                (void)sched_yield();
+        memcpy(entry, source, size);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(sequence, memory_order_relaxed);
+    } while (before != after);
+}
+
+#endif
@@ -0,0 +1,556 @@
+#include <ocii_j1939.h>
+#include <ocii_timer.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
+
+#define J1939_PAGE_LEAF 0x8000 /* Page entry refers to a leaf */
+
+/**
+ * Control bytes of TP.CM and ETP.CM
+ */
+#define TP_CM_RTS 16
+#define TP_CM_CTS 17
+#define TP_CM_EOMA 19
+#define TP_CM_BAM 32
+#define ETP_CM_RTS 20
+#define ETP_CM_CTS 21
+#define ETP_CM_DPO 22
+#define ETP_CM_EOMA 23
+#define TP_CM_ABORT 255
+
+static inline uint32_t get_le24(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+}
+
+static inline void put_le24(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+}
+
+static void j1939_dispatch(ocii_j1939_t *stack,
+                           const ocii_j1939_message_t *message) {
+    uint16_t entry = stack->page[message->pgn >> 8 & 0x3FF];
+    uint8_t index;
+
+    if (entry & J1939_PAGE_LEAF)
+        index = stack->leaf[entry & 0xFF][message->pgn & 0xFF];
+    else
+        index = (uint8_t)entry;
+
+    if (index == 0 && stack->fallback != NULL)
+        stack->fallback(stack->fallback_user, message);
+
+    for (; index != 0; index = stack->subscription[index - 1].next)
+        stack->subscription[index - 1].callback(
+            stack->subscription[index - 1].user, message);
+}
+
+static void j1939_stage(ocii_j1939_t *stack, uint8_t channel, uint8_t sa,
+                        uint8_t da, uint32_t pgn, const uint8_t data[8]) {
+    ocii_message_t *message;
+
+    if (stack->tx_count[channel] >= OCII_J1939_TX_QUEUE)
+        return; /* The peer times out and retries */
+
+    message = &stack->tx[channel][stack->tx_count[channel]++];
+    *message = (ocii_message_t){
+        .can_id = ocii_j1939_encode_id(7, pgn, sa, da),
+        .extended = 1,
+        .data_len = 8};
+    memcpy(message->data, data, sizeof(message->data));
+}
+
+static void j1939_stage_abort(ocii_j1939_t *stack, uint8_t channel,
+                              uint8_t type, uint8_t da, uint32_t pgn,
+                              uint8_t reason) {
+    uint8_t frame[8] = {TP_CM_ABORT, reason, 0xFF, 0xFF, 0xFF};
+
+    if (stack->address == OCII_J1939_NO_ADDRESS)
+        return;
+
+    put_le24(&frame[5], pgn);
+    j1939_stage(stack, channel, stack->address, da,
+                type == ocii_j1939_session_etp ? OCII_J1939_PGN_ETP_CM
+                                               : OCII_J1939_PGN_TP_CM,
+                frame);
+}
+
+static ocii_j1939_session_t *j1939_find(ocii_j1939_t *stack, uint8_t channel,
+                                        uint8_t sa, uint8_t da) {
+    for (uint8_t index = stack->source[channel][sa]; index != 0;
+         index = stack->session[index - 1].link)
+        if (stack->session[index - 1].da == da)
+            return &stack->session[index - 1];
+
+    return NULL;
+}
+
+static void j1939_release(ocii_j1939_t *stack, ocii_j1939_session_t *session) {
+    uint8_t index = (uint8_t)(session - stack->session + 1);
+    uint8_t *link = &stack->source[session->channel][session->sa];
+
+    while (*link != index)
+        link = &stack->session[*link - 1].link;
+    *link = session->link;
+
+    ocii_timer_stop(&stack->wheel, &session->timer);
+    session->in_use = 0;
+    if (index > OCII_J1939_SESSIONS) {
+        session->link = stack->etp_free;
+        stack->etp_free = index;
+    } else {
+        session->link = stack->free;
+        stack->free = index;
+    }
+}
+
+static void j1939_expire(void *user, ocii_timer_t *timer) {
+    ocii_j1939_t *stack = user;
+    ocii_j1939_session_t *session = (ocii_j1939_session_t *)timer;
+
+    if (session->responder)
+        j1939_stage_abort(stack, session->channel, session->type, session->sa,
+                          session->pgn, OCII_J1939_ABORT_TIMEOUT);
+
+    stack->aborted++;
+    j1939_release(stack, session);
+}
+
+static ocii_j1939_session_t *j1939_open(ocii_j1939_t *stack, uint8_t channel,
+                                        uint8_t type, const ocii_j1939_id_t *id,
+                                        uint32_t pgn, uint32_t size) {
+    ocii_j1939_session_t *session;
+    uint8_t index;
+
+    /**
+     * A new announcement from the same source to the same destination
+     * replaces the previous session, as the standard requires
+     */
+    if ((session = j1939_find(stack, channel, id->sa, id->da)) != NULL) {
+        stack->aborted++;
+        j1939_release(stack, session);
+    }
+
+    if ((index = type == ocii_j1939_session_etp ? stack->etp_free
+                                                : stack->free) == 0) {
+        stack->refused++;
+        return NULL;
+    }
+
+    session = &stack->session[index - 1];
+    if (type == ocii_j1939_session_etp)
+        stack->etp_free = session->link;
+    else
+        stack->free = session->link;
+
+    session->pgn = pgn;
+    session->size = size;
+    session->packets = (size + 6) / 7;
+    session->next = 1;
+    session->window = session->packets;
+    session->offset = 0;
+    session->channel = channel;
+    session->sa = id->sa;
+    session->da = id->da;
+    session->type = type;
+    session->priority = id->priority;
+    session->responder = 0;
+    session->limit = 0xFF;
+    session->in_use = 1;
+    session->link = stack->source[channel][id->sa];
+    stack->source[channel][id->sa] = index;
+
+    return session;
+}
+
+static void j1939_stage_cts(ocii_j1939_t *stack, ocii_j1939_session_t *session) {
+    uint32_t count = session->packets - session->next + 1;
+    uint8_t frame[8] = {0};
+
+    if (count > stack->cts_packets)
+        count = stack->cts_packets;
+    if (count > session->limit)
+        count = session->limit;
+
+    if (session->type == ocii_j1939_session_etp) {
+        frame[0] = ETP_CM_CTS;
+        frame[1] = (uint8_t)count;
+        put_le24(&frame[2], session->next);
+    } else {
+        frame[0] = TP_CM_CTS;
+        frame[1] = (uint8_t)count;
+        frame[2] = (uint8_t)session->next;
+        frame[3] = frame[4] = 0xFF;
+    }
+    put_le24(&frame[5], session->pgn);
+
+    session->window = session->next + count - 1;
+    j1939_stage(stack, session->channel, stack->address, session->sa,
+                session->type == ocii_j1939_session_etp ? OCII_J1939_PGN_ETP_CM
+                                                        : OCII_J1939_PGN_TP_CM,
+                frame);
+    ocii_timer_start(&stack->wheel, &session->timer,
+                     ocii_time_us() + OCII_J1939_T2_US);
+}
+
+static void j1939_finish(ocii_j1939_t *stack, ocii_j1939_session_t *session,
+                         uint64_t now) {
+    ocii_j1939_message_t message = {.channel = session->channel,
+                                    .pgn = session->pgn,
+                                    .priority = session->priority,
+                                    .sa = session->sa,
+                                    .da = session->da,
+                                    .length = session->size,
+                                    .data = session->data,
+                                    .time = now};
+
+    if (session->responder) {
+        uint8_t frame[8] = {0};
+
+        if (session->type == ocii_j1939_session_etp) {
+            frame[0] = ETP_CM_EOMA;
+            frame[1] = (uint8_t)session->size;
+            put_le24(&frame[2], session->size >> 8);
+        } else {
+            frame[0] = TP_CM_EOMA;
+            frame[1] = (uint8_t)session->size;
+            frame[2] = (uint8_t)(session->size >> 8);
+            frame[3] = (uint8_t)session->packets;
+            frame[4] = 0xFF;
+        }
+        put_le24(&frame[5], session->pgn);
+        j1939_stage(stack, session->channel, stack->address, session->sa,
+                    session->type == ocii_j1939_session_etp
+                        ? OCII_J1939_PGN_ETP_CM
+                        : OCII_J1939_PGN_TP_CM,
+                    frame);
+    }
+
+    stack->completed++;
+    j1939_dispatch(stack, &message);
+    j1939_release(stack, session);
+}
+
+static void j1939_connection(ocii_j1939_t *stack, uint8_t channel,
+                             const ocii_j1939_id_t *id, const uint8_t *data,
+                             int extended) {
+    ocii_j1939_session_t *session;
+    uint32_t pgn = get_le24(&data[5]), size;
+    uint8_t type;
+
+    switch (data[0]) {
+    case TP_CM_BAM:
+    case TP_CM_RTS:
+    case ETP_CM_RTS:
+        if (extended) {
+            size = get_le24(&data[1]) | (uint32_t)data[4] << 24;
+            type = ocii_j1939_session_etp;
+        } else {
+            size = data[1] | (uint32_t)data[2] << 8;
+            type = data[0] == TP_CM_BAM ? ocii_j1939_session_bam
+                                        : ocii_j1939_session_tp;
+        }
+
+        /**
+         * TP carries 9 to 1785 bytes, ETP takes over from there. A session
+         * of another size would never complete and only hold a buffer
+         */
+        if (size < (type == ocii_j1939_session_etp ? 1786U : 9U)) {
+            if (id->da == stack->address)
+                j1939_stage_abort(stack, channel, type, id->sa, pgn,
+                                  OCII_J1939_ABORT_OTHER);
+            stack->refused++;
+            return;
+        }
+
+        if (size > (type == ocii_j1939_session_etp
+                        ? OCII_J1939_ETP_BUFFER_SIZE
+                        : OCII_J1939_BUFFER_SIZE)) {
+            if (id->da == stack->address)
+                j1939_stage_abort(stack, channel, type, id->sa, pgn,
+                                  OCII_J1939_ABORT_TOO_LARGE);
+            stack->refused++;
+            return;
+        }
+
+        if ((session = j1939_open(stack, channel, type, id, pgn, size)) ==
+            NULL) {
+            if (id->da == stack->address)
+                j1939_stage_abort(stack, channel, type, id->sa, pgn,
+                                  OCII_J1939_ABORT_RESOURCES);
+            return;
+        }
+
+        /**
+         * A TP sender announces how many packets it sends per CTS at most,
+         * 0xFF for no limit
+         */
+        if (data[0] == TP_CM_RTS && data[4] != 0)
+            session->limit = data[4];
+
+        if (type != ocii_j1939_session_bam && id->da == stack->address &&
+            stack->address != OCII_J1939_NO_ADDRESS) {
+            session->responder = 1;
+            j1939_stage_cts(stack, session);
+        } else {
+            ocii_timer_start(&stack->wheel, &session->timer,
+                             ocii_time_us() + OCII_J1939_T2_US);
+        }
+        return;
+
+    case ETP_CM_DPO:
+        if ((session = j1939_find(stack, channel, id->sa, id->da)) == NULL)
+            return;
+        session->offset = get_le24(&data[2]);
+        return;
+
+    case TP_CM_CTS:
+    case ETP_CM_CTS:
+        /**
+         * Seen on sessions between two other nodes, the CTS comes from the
+         * receiver, so the session is keyed the other way round
+         */
+        if ((session = j1939_find(stack, channel, id->da, id->sa)) == NULL ||
+            session->responder)
+            return;
+        ocii_timer_start(&stack->wheel, &session->timer,
+                         ocii_time_us() + OCII_J1939_T2_US);
+        return;
+
+    case TP_CM_ABORT:
+        if ((session = j1939_find(stack, channel, id->sa, id->da)) == NULL &&
+            (session = j1939_find(stack, channel, id->da, id->sa)) == NULL)
+            return;
+        stack->aborted++;
+        j1939_release(stack, session);
+        return;
+
+    default:
+        return;
+    }
+}
+
+static void j1939_data(ocii_j1939_t *stack, uint8_t channel,
+                       const ocii_j1939_id_t *id, const uint8_t *data) {
+    ocii_j1939_session_t *session;
+    uint32_t packet, position, bytes;
+    uint64_t now;
+
+    if ((session = j1939_find(stack, channel, id->sa, id->da)) == NULL)
+        return;
+
+    packet = session->offset + data[0];
+    if (packet != session->next) {
+        if (session->responder) {
+            /**
+             * Ask for the rest of the window again, starting at the gap
+             */
+            j1939_stage_cts(stack, session);
+        } else {
+            stack->aborted++;
+            j1939_release(stack, session);
+        }
+        return;
+    }
+
+    position = (packet - 1) * 7;
+    bytes = session->size - position < 7 ? session->size - position : 7;
+    memcpy(&session->data[position], &data[1], bytes);
+
+    now = ocii_time_us();
+    if (session->next++ == session->packets) {
+        j1939_finish(stack, session, now);
+    } else if (session->responder && packet == session->window) {
+        j1939_stage_cts(stack, session);
+    } else {
+        ocii_timer_start(&stack->wheel, &session->timer,
+                         now + OCII_J1939_T1_US);
+    }
+}
+
+extern int ocii_j1939_init(ocii_j1939_t *stack, uint8_t address) {
+    int error_code;
+
+    if (stack == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(stack, 0, sizeof(*stack));
+    stack->address = address;
+    stack->cts_packets = 16;
+    (void)ocii_timer_wheel_init(&stack->wheel, 0, ocii_time_us());
+
+    for (int i = 0; i < OCII_J1939_SESSIONS; i++) {
+        ocii_timer_init(&stack->session[i].timer, j1939_expire, stack);
+        stack->session[i].data = stack->buffer[i];
+        stack->session[i].link = i + 1 < OCII_J1939_SESSIONS ? i + 2 : 0;
+    }
+    stack->free = 1;
+
+    for (int i = 0; i < OCII_J1939_ETP_SESSIONS; i++) {
+        ocii_j1939_session_t *session =
+            &stack->session[OCII_J1939_SESSIONS + i];
+
+        ocii_timer_init(&session->timer, j1939_expire, stack);
+        session->data = stack->etp_buffer[i];
+        session->link = i + 1 < OCII_J1939_ETP_SESSIONS
+                            ? OCII_J1939_SESSIONS + i + 2
+                            : 0;
+    }
+    stack->etp_free = OCII_J1939_SESSIONS + 1;
+
+    if (pthread_mutex_init(&stack->lock, NULL) != 0)
+        return OCII_ERROR_THREAD;
+
+    if ((error_code = ocii_add_rx_hook(ocii_j1939_rx_hook, stack)) !=
+        OCII_ERROR_NO_ERROR)
+        (void)pthread_mutex_destroy(&stack->lock);
+
+    return error_code;
+}
+
+extern int ocii_j1939_deinit(ocii_j1939_t *stack) {
+    int error_code;
+
+    if (stack == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((error_code = ocii_remove_rx_hook(ocii_j1939_rx_hook, stack)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    (void)pthread_mutex_destroy(&stack->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_j1939_subscribe(ocii_j1939_t *stack, uint32_t pgn,
+                                ocii_j1939_callback_t callback, void *user) {
+    uint16_t *entry;
+    uint8_t head, index;
+
+    if (stack == NULL || callback == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (pgn > 0x3FFFF || ((pgn >> 8 & 0xFF) < 240 && (pgn & 0xFF) != 0))
+        return OCII_ERROR_INVALID_ARG; /* PDU1 PGNs have no PS part */
+
+    (void)pthread_mutex_lock(&stack->lock);
+    entry = &stack->page[pgn >> 8];
+    if (stack->subscriptions >= OCII_J1939_SUBSCRIPTIONS ||
+        ((pgn >> 8 & 0xFF) >= 240 && !(*entry & J1939_PAGE_LEAF) &&
+         stack->leaves >= OCII_J1939_LEAVES)) {
+        (void)pthread_mutex_unlock(&stack->lock);
+        return OCII_ERROR_NO_SLOT;
+    }
+    if ((pgn >> 8 & 0xFF) >= 240 && !(*entry & J1939_PAGE_LEAF))
+        *entry = J1939_PAGE_LEAF | stack->leaves++;
+
+    index = ++stack->subscriptions;
+    stack->subscription[index - 1].callback = callback;
+    stack->subscription[index - 1].user = user;
+    stack->subscription[index - 1].next = 0;
+
+    head = *entry & J1939_PAGE_LEAF ? stack->leaf[*entry & 0xFF][pgn & 0xFF]
+                                    : (uint8_t)*entry;
+    if (head == 0) {
+        if (*entry & J1939_PAGE_LEAF)
+            stack->leaf[*entry & 0xFF][pgn & 0xFF] = index;
+        else
+            *entry = index;
+    } else {
+        while (stack->subscription[head - 1].next != 0)
+            head = stack->subscription[head - 1].next;
+        stack->subscription[head - 1].next = index;
+    }
+    (void)pthread_mutex_unlock(&stack->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_j1939_rx_hook(void *user, ocii_channel_t channel,
+                              ocii_message_t *message) {
+    ocii_j1939_t *stack = user;
+    ocii_j1939_id_t id;
+
+    if (!message->extended || message->remote)
+        return 0;
+
+    id = ocii_j1939_decode_id(message->can_id);
+
+    (void)pthread_mutex_lock(&stack->lock);
+    /**
+     * Destination specific frames for somebody else are still reassembled
+     * when listening to the bus, but only answered when addressed to us
+     */
+    switch (id.pgn) {
+    case OCII_J1939_PGN_TP_CM:
+    case OCII_J1939_PGN_ETP_CM:
+        if (message->data_len == 8)
+            j1939_connection(stack, channel, &id, message->data,
+                             id.pgn == OCII_J1939_PGN_ETP_CM);
+        break;
+
+    case OCII_J1939_PGN_TP_DT:
+    case OCII_J1939_PGN_ETP_DT:
+        if (message->data_len == 8)
+            j1939_data(stack, channel, &id, message->data);
+        break;
+
+    default: {
+        ocii_j1939_message_t pg = {.channel = channel,
+                                   .pgn = id.pgn,
+                                   .priority = id.priority,
+                                   .sa = id.sa,
+                                   .da = id.da,
+                                   .length = message->data_len > 8
+                                                 ? 8
+                                                 : message->data_len,
+                                   .data = message->data,
+                                   .time = ocii_time_us()};
+
+        j1939_dispatch(stack, &pg);
+        break;
+    }
+    }
+    (void)pthread_mutex_unlock(&stack->lock);
+
+    return stack->consume;
+}
+
+extern int ocii_j1939_poll(ocii_j1939_t *stack) {
+    int error_code;
+
+    if (stack == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_mutex_lock(&stack->lock);
+    (void)ocii_timer_advance(&stack->wheel, ocii_time_us());
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        for (int sent = 0; sent < stack->tx_count[channel];) {
+            ocii_packet_t packet = {.count = 0};
+
+            while (packet.count < sizeof_arr(packet.message) &&
+                   sent < stack->tx_count[channel])
+                packet.message[packet.count++] = stack->tx[channel][sent++];
+
+            if ((error_code = ocii_write(channel, &packet)) !=
+                OCII_ERROR_NO_ERROR) {
+                stack->tx_count[channel] = 0;
+                (void)pthread_mutex_unlock(&stack->lock);
+                return error_code;
+            }
+        }
+
+        stack->tx_count[channel] = 0;
+    }
+    (void)pthread_mutex_unlock(&stack->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
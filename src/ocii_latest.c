@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "ocii_idpool.h"
+#include <ocii_latest.h>
+#include <opencanalystii.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static idpool_t latest_pool(ocii_latest_t *latest) {
+    return (idpool_t){.used = &latest->used,
+                      .ids = OCII_LATEST_IDS,
+                      .standard = latest->standard,
+                      .ext_key = &latest->extended[0].key,
+                      .ext_slot = &latest->extended[0].slot,
+                      .ext_stride = sizeof(latest->extended[0]),
+                      .ext_slots = OCII_LATEST_EXT_SLOTS};
+}
+
+static void latest_read(ocii_latest_slot_t *slot, ocii_latest_entry_t *entry) {
+    idpool_read(&slot->sequence, entry, &slot->entry, sizeof(*entry));
+}
+
+extern int ocii_latest_init(ocii_latest_t *latest) {
+    if (latest == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(latest, 0, sizeof(*latest));
+
+    return ocii_add_rx_hook(ocii_latest_rx_hook, latest);
+}
+
+extern int ocii_latest_deinit(ocii_latest_t *latest) {
+    if (latest == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    return ocii_remove_rx_hook(ocii_latest_rx_hook, latest);
+}
+
+extern int ocii_latest_rx_hook(void *user, ocii_channel_t channel,
+                               ocii_message_t *message) {
+    ocii_latest_t *latest = user;
+    idpool_t pool = latest_pool(latest);
+    ocii_latest_slot_t *slot;
+    uint16_t index;
+    unsigned sequence;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return 0;
+
+    if ((index = idpool_find(&pool, channel, message->can_id,
+                             message->extended, 1)) == 0) {
+        atomic_fetch_add_explicit(&latest->overflow, 1, memory_order_relaxed);
+        return 0;
+    }
+    slot = &latest->slot[index - 1];
+
+    sequence = idpool_write_begin(&slot->sequence);
+
+    slot->entry.message = *message;
+    slot->entry.channel = (uint8_t)channel;
+    slot->entry.time_us = ocii_time_us();
+    slot->entry.count++;
+
+    idpool_write_end(&slot->sequence, sequence);
+
+    return 0;
+}
+
+extern int ocii_latest_get(ocii_latest_t *latest, ocii_channel_t channel,
+                           uint32_t can_id, uint8_t extended,
+                           ocii_latest_entry_t *entry) {
+    idpool_t pool;
+    uint16_t index;
+
+    if (latest == NULL || entry == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    pool = latest_pool(latest);
+    if ((index = idpool_find(&pool, channel, can_id, extended, 0)) == 0)
+        return OCII_ERROR_BUFFER_EMPTY;
+
+    latest_read(&latest->slot[index - 1], entry);
+
+    return entry->count != 0 ? OCII_ERROR_NO_ERROR : OCII_ERROR_BUFFER_EMPTY;
+}
+
+extern int ocii_latest_snapshot(ocii_latest_t *latest,
+                                ocii_latest_entry_t *entries, int capacity) {
+    unsigned used;
+    int count = 0;
+
+    if (latest == NULL || entries == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (capacity < 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    used = atomic_load_explicit(&latest->used, memory_order_acquire);
+    if (used > OCII_LATEST_IDS)
+        used = OCII_LATEST_IDS;
+
+    for (unsigned i = 0; i < used && count < capacity; i++) {
+        latest_read(&latest->slot[i], &entries[count]);
+        if (entries[count].count != 0)
+            count++;
+    }
+
+    return count;
+}
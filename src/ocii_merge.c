@@ -0,0 +1,228 @@
+#include <ocii_merge.h>
+#include <opencanalystii.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
+
+static int merge_read_channel(void *user, ocii_packet_t *packets,
+                              int capacity) {
+    return ocii_read_many((ocii_channel_t)(uintptr_t)user, packets, capacity);
+}
+
+/**
+ * Normalized time of a message. Messages without a device time stamp get
+ * their arrival time
+ */
+static uint64_t merge_time(ocii_merge_clock_t *clock,
+                           const ocii_message_t *message, uint64_t now) {
+    uint64_t stamp;
+    int64_t offset;
+
+    if (!message->time_flag)
+        return now;
+
+    /**
+     * Channels deliver in their own order, so a stamp may be slightly older
+     * than the last one. The signed difference unwraps both directions
+     */
+    if (!clock->valid)
+        clock->last = message->time_stamp;
+    stamp = clock->last + (uint64_t)(int64_t)(int32_t)(message->time_stamp -
+                                                       (uint32_t)clock->last);
+    if (stamp > clock->last)
+        clock->last = stamp;
+
+    offset = (int64_t)now - (int64_t)(stamp * 100U);
+    if (!clock->valid || offset < clock->offset) {
+        clock->offset = offset;
+        clock->valid = 1;
+    }
+
+    return (uint64_t)((int64_t)(stamp * 100U) + clock->offset);
+}
+
+static void merge_sift_down(ocii_merge_t *merge, int i) {
+    for (;;) {
+        int child = 2 * i + 1, min = i;
+        uint8_t tmp;
+
+        if (child < merge->heap_count &&
+            merge->source[merge->heap[child]].head_time <
+                merge->source[merge->heap[min]].head_time)
+            min = child;
+        if (child + 1 < merge->heap_count &&
+            merge->source[merge->heap[child + 1]].head_time <
+                merge->source[merge->heap[min]].head_time)
+            min = child + 1;
+        if (min == i)
+            return;
+
+        tmp = merge->heap[i];
+        merge->heap[i] = merge->heap[min];
+        merge->heap[min] = tmp;
+        i = min;
+    }
+}
+
+static void merge_push(ocii_merge_t *merge, int index) {
+    int i = merge->heap_count++;
+
+    while (i > 0 && merge->source[merge->heap[(i - 1) / 2]].head_time >
+                        merge->source[index].head_time) {
+        merge->heap[i] = merge->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    merge->heap[i] = (uint8_t)index;
+}
+
+/**
+ * Reads the next batch of a drained stream and queues it in the heap if it
+ * got any message
+ */
+static int merge_refill(ocii_merge_t *merge, int index, uint64_t now) {
+    ocii_merge_source_t *source = &merge->source[index];
+    int count;
+
+    count = source->read(source->user, source->buffer,
+                         (int)sizeof_arr(source->buffer));
+    if (count == OCII_ERROR_BUFFER_EMPTY || count == 0)
+        return OCII_ERROR_NO_ERROR;
+    if (count < 0)
+        return count;
+
+    source->count = (uint16_t)count;
+    source->packet = 0;
+    source->message = 0;
+    source->arrival = now;
+
+    /**
+     * Empty packets are skipped, every clock gets its offset from the
+     * whole batch before the first message is timed
+     */
+    for (int i = 0; i < count; i++)
+        for (int j = 0; j < source->buffer[i].count &&
+                        j < (int)sizeof_arr(source->buffer[i].message);
+             j++)
+            (void)merge_time(&merge->clock[source->clock],
+                             &source->buffer[i].message[j], now);
+
+    while (source->packet < source->count &&
+           source->buffer[source->packet].count == 0)
+        source->packet++;
+    if (source->packet == source->count) {
+        source->count = 0;
+        return OCII_ERROR_NO_ERROR;
+    }
+
+    source->head_time = merge_time(
+        &merge->clock[source->clock],
+        &source->buffer[source->packet].message[source->message],
+        source->arrival);
+    merge_push(merge, index);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_merge_init(ocii_merge_t *merge, uint32_t window_us) {
+    if (merge == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(merge, 0, sizeof(*merge));
+    merge->window_us = window_us;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_merge_add_source(ocii_merge_t *merge, ocii_merge_read_t read,
+                                 void *user, uint8_t clock) {
+    if (merge == NULL || read == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (clock >= OCII_MERGE_SOURCES)
+        return OCII_ERROR_INVALID_ARG;
+
+    if (merge->sources == OCII_MERGE_SOURCES)
+        return OCII_ERROR_NO_SLOT;
+
+    merge->source[merge->sources] =
+        (ocii_merge_source_t){.read = read, .user = user, .clock = clock};
+
+    return merge->sources++;
+}
+
+extern int ocii_merge_add_channel(ocii_merge_t *merge, ocii_channel_t channel) {
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    return ocii_merge_add_source(merge, merge_read_channel,
+                                 (void *)(uintptr_t)channel, 0);
+}
+
+extern int ocii_merge_next(ocii_merge_t *merge, const ocii_message_t **message,
+                           int *source, uint64_t *time_us) {
+    ocii_merge_source_t *head;
+    uint64_t now = ocii_time_us();
+    int error_code;
+
+    if (merge == NULL || message == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    /**
+     * Streams that ran dry are asked for more before anything is decided
+     */
+    for (int i = 0; i < merge->sources; i++)
+        if (merge->source[i].count == 0 &&
+            (error_code = merge_refill(merge, i, now)) != OCII_ERROR_NO_ERROR)
+            return error_code;
+
+    if (merge->heap_count == 0)
+        return OCII_ERROR_BUFFER_EMPTY;
+
+    /**
+     * Each stream is in order, so once all of them have a message the oldest
+     * head is safe. Otherwise an empty stream may still deliver something
+     * older, wait for it as long as the window allows
+     */
+    head = &merge->source[merge->heap[0]];
+    if (merge->heap_count < merge->sources &&
+        head->head_time + merge->window_us > now)
+        return OCII_ERROR_BUFFER_EMPTY;
+
+    *message = &head->buffer[head->packet].message[head->message];
+    if (source != NULL)
+        *source = merge->heap[0];
+    if (time_us != NULL)
+        *time_us = head->head_time;
+
+    if (head->head_time < merge->last_time)
+        merge->late++;
+    else
+        merge->last_time = head->head_time;
+
+    /**
+     * Advance the stream. A drained one leaves the heap and is refilled on the
+     * next call, so the returned message stays in place until then
+     */
+    if (++head->message >= head->buffer[head->packet].count ||
+        head->message >= sizeof_arr(head->buffer[head->packet].message)) {
+        head->message = 0;
+        do
+            head->packet++;
+        while (head->packet < head->count &&
+               head->buffer[head->packet].count == 0);
+    }
+
+    if (head->packet == head->count) {
+        head->count = 0;
+        merge->heap[0] = merge->heap[--merge->heap_count];
+    } else
+        head->head_time = merge_time(
+            &merge->clock[head->clock],
+            &head->buffer[head->packet].message[head->message],
+            head->arrival);
+    merge_sift_down(merge, 0);
+
+    return OCII_ERROR_NO_ERROR;
+}
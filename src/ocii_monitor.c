@@ -0,0 +1,191 @@
+#include <ocii_monitor.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+extern ocii_monitor_state_t ocii_monitor_classify(const ocii_packet_t *status) {
+    uint32_t worst;
+
+    if (status == NULL)
+        return OCII_MONITOR_ACTIVE;
+
+    worst = status->reg_re_counter > status->reg_te_counter
+                ? status->reg_re_counter
+                : status->reg_te_counter;
+
+    if (status->reg_status & OCII_MONITOR_STATUS_BUS_OFF)
+        return OCII_MONITOR_BUS_OFF;
+    if (worst >= 128)
+        return OCII_MONITOR_PASSIVE;
+    if (worst >= 96 || status->reg_status & OCII_MONITOR_STATUS_WARNING)
+        return OCII_MONITOR_WARNING;
+
+    return OCII_MONITOR_ACTIVE;
+}
+
+extern int ocii_monitor_init(ocii_monitor_t *monitor,
+                             ocii_monitor_callback_t callback, void *user) {
+    int error_code;
+
+    if (monitor == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(monitor, 0, sizeof(*monitor));
+    monitor->callback = callback;
+    monitor->user = user;
+
+    if (pthread_mutex_init(&monitor->lock, NULL) != 0)
+        return OCII_ERROR_THREAD;
+
+    if ((error_code = ocii_add_status_hook(ocii_monitor_status_hook,
+                                           monitor)) != OCII_ERROR_NO_ERROR)
+        (void)pthread_mutex_destroy(&monitor->lock);
+
+    return error_code;
+}
+
+extern int ocii_monitor_deinit(ocii_monitor_t *monitor) {
+    int error_code;
+
+    if (monitor == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    error_code = ocii_remove_status_hook(ocii_monitor_status_hook, monitor);
+    (void)pthread_mutex_destroy(&monitor->lock);
+
+    return error_code;
+}
+
+extern void ocii_monitor_status_hook(void *user, ocii_channel_t channel,
+                                     const ocii_packet_t *status) {
+    ocii_monitor_t *monitor = user;
+    ocii_monitor_channel_t *state;
+    ocii_monitor_event_t event;
+    ocii_monitor_sample_t sample;
+
+    if (monitor == NULL || status == NULL ||
+        (unsigned)channel >= ocii_channel_sizeof)
+        return;
+
+    sample = (ocii_monitor_sample_t){.time_us = ocii_time_us(),
+                                     .status = status->reg_status,
+                                     .re_counter = status->reg_re_counter,
+                                     .te_counter = status->reg_te_counter,
+                                     .state = ocii_monitor_classify(status)};
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    state = &monitor->channel[channel];
+    event = (ocii_monitor_event_t){.channel = channel,
+                                   .previous = state->summary.current,
+                                   .current = sample};
+
+    if (sample.re_counter != event.previous.re_counter ||
+        sample.te_counter != event.previous.te_counter ||
+        sample.status != event.previous.status) {
+        event.changes |= OCII_MONITOR_COUNTERS;
+        state->history[state->changes++ % OCII_MONITOR_HISTORY] = sample;
+    }
+    if (sample.state != event.previous.state) {
+        event.changes |= OCII_MONITOR_STATE;
+        state->transition[state->transitions++ % OCII_MONITOR_TRANSITIONS] =
+            event;
+        state->summary.entered[sample.state]++;
+    }
+
+    state->summary.current = sample;
+    state->summary.polls++;
+    if (sample.re_counter > state->summary.re_max)
+        state->summary.re_max = sample.re_counter;
+    if (sample.te_counter > state->summary.te_max)
+        state->summary.te_max = sample.te_counter;
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    if (event.changes != 0 && monitor->callback != NULL)
+        monitor->callback(monitor->user, &event);
+}
+
+extern int ocii_monitor_poll(ocii_monitor_t *monitor) {
+    if (monitor == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        ocii_packet_t status;
+        int error_code;
+
+        if ((error_code = ocii_get_status(channel, &status)) !=
+            OCII_ERROR_NO_ERROR)
+            return error_code;
+        ocii_monitor_status_hook(monitor, channel, &status);
+    }
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_monitor_summary(ocii_monitor_t *monitor, ocii_channel_t channel,
+                                ocii_monitor_summary_t *summary) {
+    if (monitor == NULL || summary == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    *summary = monitor->channel[channel].summary;
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_monitor_history(ocii_monitor_t *monitor, ocii_channel_t channel,
+                                ocii_monitor_sample_t *samples, int capacity) {
+    ocii_monitor_channel_t *state;
+    uint64_t count;
+
+    if (monitor == NULL || samples == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof || capacity < 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    state = &monitor->channel[channel];
+    count = state->changes < OCII_MONITOR_HISTORY ? state->changes
+                                                  : OCII_MONITOR_HISTORY;
+    if (count > (uint64_t)capacity)
+        count = (uint64_t)capacity;
+    for (uint64_t i = 0; i < count; i++)
+        samples[i] =
+            state->history[(state->changes - count + i) % OCII_MONITOR_HISTORY];
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    return (int)count;
+}
+
+extern int ocii_monitor_transitions(ocii_monitor_t *monitor,
+                                    ocii_channel_t channel,
+                                    ocii_monitor_event_t *transitions,
+                                    int capacity) {
+    ocii_monitor_channel_t *state;
+    uint64_t count;
+
+    if (monitor == NULL || transitions == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof || capacity < 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&monitor->lock);
+    state = &monitor->channel[channel];
+    count = state->transitions < OCII_MONITOR_TRANSITIONS
+                ? state->transitions
+                : OCII_MONITOR_TRANSITIONS;
+    if (count > (uint64_t)capacity)
+        count = (uint64_t)capacity;
+    for (uint64_t i = 0; i < count; i++)
+        transitions[i] = state->transition[(state->transitions - count + i) %
+                                           OCII_MONITOR_TRANSITIONS];
+    (void)pthread_mutex_unlock(&monitor->lock);
+
+    return (int)count;
+}
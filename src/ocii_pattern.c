@@ -0,0 +1,232 @@
+#include <ocii_pattern.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PATTERN_EXTENDED 0x80000000U
+
+static inline uint64_t load_le64(const uint8_t *p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+           (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+           (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static uint32_t pattern_key(const ocii_pattern_rule_t *rule) {
+    return (rule->can_id & 0x1FFFFFFF) |
+           (rule->extended ? PATTERN_EXTENDED : 0);
+}
+
+typedef struct {
+    uint32_t key;
+    int index;
+} pattern_order_t;
+
+/**
+ * By ID, rules of one ID keep the order they were given in
+ */
+static int pattern_compare(const void *a, const void *b) {
+    const pattern_order_t *x = a, *y = b;
+
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ * Searches a multiplicative hash without collisions over the group keys.
+ * Returns OCII_ERROR_NO_SLOT if there is none with up to 2^20 slots
+ */
+static int pattern_build_hash(ocii_pattern_t *pattern) {
+    uint32_t seed = 0x9E3779B9U;
+
+    for (uint8_t bits = 1; bits <= 20; bits++) {
+        uint32_t size = 1U << bits;
+
+        if (size < pattern->groups)
+            continue;
+
+        free(pattern->hash_key);
+        free(pattern->hash_value);
+        pattern->hash_key = calloc(size, sizeof(*pattern->hash_key));
+        pattern->hash_value = calloc(size, sizeof(*pattern->hash_value));
+        if (pattern->hash_key == NULL || pattern->hash_value == NULL)
+            return OCII_ERROR_NO_MEMORY;
+
+        for (int attempt = 0; attempt < 256; attempt++) {
+            uint32_t g;
+
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            pattern->hash_multiplier = seed | 1;
+            pattern->hash_bits = bits;
+
+            memset(pattern->hash_value, 0,
+                   size * sizeof(*pattern->hash_value));
+            for (g = 0; g < pattern->groups; g++) {
+                uint32_t key = pattern->group[g].key;
+                uint32_t slot = (key * pattern->hash_multiplier) >> (32 - bits);
+
+                if (pattern->hash_value[slot] != 0)
+                    break;
+                pattern->hash_key[slot] = key;
+                pattern->hash_value[slot] = g + 1;
+            }
+
+            if (g == pattern->groups)
+                return OCII_ERROR_NO_ERROR;
+        }
+    }
+
+    return OCII_ERROR_NO_SLOT;
+}
+
+extern int ocii_pattern_compile(const ocii_pattern_rule_t *rules, int count,
+                                ocii_pattern_t **pattern) {
+    ocii_pattern_t *compiled;
+    pattern_order_t *order = NULL;
+    size_t n;
+    int error_code;
+
+    if (rules == NULL || pattern == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (count <= 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    if ((compiled = calloc(1, sizeof(*compiled))) == NULL)
+        return OCII_ERROR_NO_MEMORY;
+
+    n = (size_t)count;
+    compiled->rules = (uint32_t)count;
+    compiled->rule = malloc(n * sizeof(*compiled->rule));
+    compiled->value = malloc(n * sizeof(*compiled->value));
+    compiled->mask = malloc(n * sizeof(*compiled->mask));
+    compiled->channels = malloc(n * sizeof(*compiled->channels));
+    compiled->index = malloc(n * sizeof(*compiled->index));
+    compiled->hits = calloc(n, sizeof(*compiled->hits));
+    compiled->group = malloc(n * sizeof(*compiled->group));
+    order = malloc(n * sizeof(*order));
+    if (compiled->rule == NULL || compiled->value == NULL ||
+        compiled->mask == NULL || compiled->channels == NULL ||
+        compiled->index == NULL || compiled->hits == NULL ||
+        compiled->group == NULL || order == NULL) {
+        error_code = OCII_ERROR_NO_MEMORY;
+        goto ocii_fail;
+    }
+    memcpy(compiled->rule, rules, n * sizeof(*compiled->rule));
+
+    for (int i = 0; i < count; i++)
+        order[i] = (pattern_order_t){.key = pattern_key(&rules[i]), .index = i};
+    qsort(order, n, sizeof(*order), pattern_compare);
+
+    for (int i = 0; i < count; i++) {
+        const ocii_pattern_rule_t *rule = &rules[order[i].index];
+        uint32_t key = order[i].key;
+        uint64_t mask = load_le64(rule->data_mask);
+
+        compiled->index[i] = order[i].index;
+        compiled->mask[i] = mask;
+        compiled->value[i] = load_le64(rule->data) & mask;
+        compiled->channels[i] = rule->channels != 0 ? rule->channels : 0xFF;
+
+        if (compiled->groups == 0 ||
+            compiled->group[compiled->groups - 1].key != key)
+            compiled->group[compiled->groups++] =
+                (ocii_pattern_group_t){.key = key, .first = (uint32_t)i};
+        compiled->group[compiled->groups - 1].count++;
+    }
+
+    if ((error_code = pattern_build_hash(compiled)) != OCII_ERROR_NO_ERROR)
+        goto ocii_fail;
+
+    free(order);
+    *pattern = compiled;
+    return OCII_ERROR_NO_ERROR;
+
+ocii_fail:
+    free(order);
+    ocii_pattern_free(compiled);
+    return error_code;
+}
+
+extern void ocii_pattern_free(ocii_pattern_t *pattern) {
+    if (pattern == NULL)
+        return;
+
+    free(pattern->group);
+    free(pattern->value);
+    free(pattern->mask);
+    free(pattern->channels);
+    free(pattern->index);
+    free(pattern->rule);
+    free(pattern->hits);
+    free(pattern->hash_key);
+    free(pattern->hash_value);
+    free(pattern);
+}
+
+extern int ocii_pattern_match(ocii_pattern_t *pattern, ocii_channel_t channel,
+                              const ocii_message_t *message) {
+    const ocii_pattern_group_t *group;
+    uint32_t key, slot;
+    uint64_t data;
+    int matched = 0;
+
+    if (pattern == NULL || message == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    key = (message->can_id & 0x1FFFFFFF) |
+          (message->extended ? PATTERN_EXTENDED : 0);
+    slot = (key * pattern->hash_multiplier) >> (32 - pattern->hash_bits);
+    if (pattern->hash_key[slot] != key || pattern->hash_value[slot] == 0)
+        return 0;
+    group = &pattern->group[pattern->hash_value[slot] - 1];
+
+    data = load_le64(message->data);
+    if (message->data_len < 8)
+        data &= (1ULL << (message->data_len * 8)) - 1;
+
+    /**
+     * The group is compared 64 rules at a time into a bit set, without a
+     * branch per rule, then the callbacks run for the bits set
+     */
+    for (uint32_t base = 0; base < group->count; base += 64) {
+        uint32_t first = group->first + base,
+                 n = group->count - base < 64 ? group->count - base : 64;
+        const uint64_t *value = &pattern->value[first],
+                       *mask = &pattern->mask[first];
+        const uint8_t *channels = &pattern->channels[first];
+        uint64_t bits = 0;
+
+        for (uint32_t i = 0; i < n; i++)
+            bits |= (uint64_t)(((data & mask[i]) == value[i]) &
+                               (channels[i] >> channel))
+                    << i;
+
+        while (bits != 0) {
+            int rule =
+                pattern->index[first + (uint32_t)__builtin_ctzll(bits)];
+
+            bits &= bits - 1;
+            pattern->hits[rule]++;
+            matched++;
+            if (pattern->rule[rule].callback != NULL)
+                pattern->rule[rule].callback(pattern->rule[rule].user, rule,
+                                             channel, message);
+        }
+    }
+
+    return matched;
+}
+
+extern int ocii_pattern_rx_hook(void *user, ocii_channel_t channel,
+                                ocii_message_t *message) {
+    (void)ocii_pattern_match(user, channel, message);
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <ocii_monitor.h>
+#include <ocii_recovery.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+extern int ocii_recovery_init(ocii_recovery_t *recovery, int clear_rx,
+                              uint32_t holdoff_ms,
+                              ocii_recovery_callback_t callback, void *user) {
+    int error_code;
+
+    if (recovery == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(recovery, 0, sizeof(*recovery));
+    recovery->callback = callback;
+    recovery->user = user;
+    recovery->holdoff_us = (uint64_t)holdoff_ms * 1000U;
+    recovery->clear_rx = clear_rx ? 1 : 0;
+
+    if (pthread_mutex_init(&recovery->lock, NULL) != 0)
+        return OCII_ERROR_THREAD;
+
+    if ((error_code = ocii_add_status_hook(ocii_recovery_status_hook,
+                                           recovery)) != OCII_ERROR_NO_ERROR)
+        (void)pthread_mutex_destroy(&recovery->lock);
+
+    return error_code;
+}
+
+extern int ocii_recovery_deinit(ocii_recovery_t *recovery) {
+    int error_code;
+
+    if (recovery == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    error_code = ocii_remove_status_hook(ocii_recovery_status_hook, recovery);
+    (void)pthread_mutex_destroy(&recovery->lock);
+
+    return error_code;
+}
+
+extern void ocii_recovery_status_hook(void *user, ocii_channel_t channel,
+                                      const ocii_packet_t *status) {
+    ocii_recovery_t *recovery = user;
+    ocii_recovery_stats_t *stats;
+    ocii_recovery_event_t event;
+    uint64_t elapsed;
+
+    if (recovery == NULL || status == NULL ||
+        (unsigned)channel >= ocii_channel_sizeof)
+        return;
+
+    event = (ocii_recovery_event_t){.channel = channel,
+                                    .detected_us = ocii_time_us(),
+                                    .status = *status};
+
+    (void)pthread_mutex_lock(&recovery->lock);
+    stats = &recovery->channel[channel].stats;
+    if (status->reg_status & OCII_MONITOR_STATUS_BUS_OFF)
+        stats->bus_offs++;
+    else if (!recovery->channel[channel].failed) {
+        (void)pthread_mutex_unlock(&recovery->lock);
+        return;
+    }
+    if (recovery->channel[channel].attempted &&
+        event.detected_us - recovery->channel[channel].attempt_us <
+            recovery->holdoff_us) {
+        stats->held_off++;
+        (void)pthread_mutex_unlock(&recovery->lock);
+        return;
+    }
+    recovery->channel[channel].attempt_us = event.detected_us;
+    recovery->channel[channel].attempted = 1;
+    (void)pthread_mutex_unlock(&recovery->lock);
+
+    /**
+     * The sequence runs on the polling thread, no other thread has to be
+     * woken up before the controller is reset
+     */
+    event.error_code = ocii_recover(channel, recovery->clear_rx);
+    event.recovered_us = ocii_time_us();
+    elapsed = event.recovered_us - event.detected_us;
+
+    (void)pthread_mutex_lock(&recovery->lock);
+    stats->last_us = elapsed;
+    recovery->channel[channel].failed =
+        event.error_code != OCII_ERROR_NO_ERROR;
+    if (event.error_code != OCII_ERROR_NO_ERROR)
+        stats->failures++;
+    else {
+        stats->recoveries++;
+        stats->total_us += elapsed;
+        if (elapsed > stats->max_us)
+            stats->max_us = elapsed;
+    }
+    (void)pthread_mutex_unlock(&recovery->lock);
+
+    if (recovery->callback != NULL)
+        recovery->callback(recovery->user, &event);
+}
+
+extern int ocii_recovery_poll(ocii_recovery_t *recovery) {
+    if (recovery == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        ocii_packet_t status;
+        int error_code;
+
+        if ((error_code = ocii_get_status(channel, &status)) !=
+            OCII_ERROR_NO_ERROR)
+            return error_code;
+        ocii_recovery_status_hook(recovery, channel, &status);
+    }
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_recovery_stats(ocii_recovery_t *recovery,
+                               ocii_channel_t channel,
+                               ocii_recovery_stats_t *stats) {
+    if (recovery == NULL || stats == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&recovery->lock);
+    *stats = recovery->channel[channel].stats;
+    (void)pthread_mutex_unlock(&recovery->lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
@@ -0,0 +1,170 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "ocii_idpool.h"
+#include <ocii_stats.h>
+#include <opencanalystii.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static idpool_t stats_pool(ocii_stats_t *stats) {
+    return (idpool_t){.used = &stats->used,
+                      .ids = OCII_STATS_IDS,
+                      .standard = stats->standard,
+                      .ext_key = &stats->extended[0].key,
+                      .ext_slot = &stats->extended[0].slot,
+                      .ext_stride = sizeof(stats->extended[0]),
+                      .ext_slots = OCII_STATS_EXT_SLOTS};
+}
+
+static void stats_read(ocii_stats_slot_t *slot, ocii_stats_entry_t *entry) {
+    idpool_read(&slot->sequence, entry, &slot->entry, sizeof(*entry));
+}
+
+extern int ocii_stats_init(ocii_stats_t *stats) {
+    if (stats == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(stats, 0, sizeof(*stats));
+
+    return ocii_add_rx_hook(ocii_stats_rx_hook, stats);
+}
+
+extern int ocii_stats_deinit(ocii_stats_t *stats) {
+    if (stats == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    return ocii_remove_rx_hook(ocii_stats_rx_hook, stats);
+}
+
+extern int ocii_stats_rx_hook(void *user, ocii_channel_t channel,
+                              ocii_message_t *message) {
+    ocii_stats_t *stats = user;
+    idpool_t pool = stats_pool(stats);
+    ocii_stats_slot_t *slot;
+    ocii_stats_entry_t *entry;
+    uint64_t now = ocii_time_us(), data = 0, last = 0;
+    uint16_t index;
+    unsigned sequence;
+    uint8_t length;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return 0;
+
+    if ((index = idpool_find(&pool, channel, message->can_id,
+                             message->extended, 1)) == 0) {
+        atomic_fetch_add_explicit(&stats->overflow, 1, memory_order_relaxed);
+        return 0;
+    }
+    slot = &stats->slot[index - 1];
+    entry = &slot->entry;
+
+    length = message->data_len < sizeof(message->data) ? message->data_len
+                                                       : sizeof(message->data);
+    memcpy(&data, message->data, length);
+    memcpy(&last, entry->data, sizeof(entry->data));
+
+    sequence = idpool_write_begin(&slot->sequence);
+
+    if (entry->count == 0) {
+        entry->can_id = message->can_id;
+        entry->extended = message->extended ? 1 : 0;
+        entry->channel = (uint8_t)channel;
+        entry->first_us = now;
+        entry->last_change_us = now;
+    } else {
+        /**
+         * The device stamps in 100 us steps and is free of USB batching, the
+         * receive time is the fallback
+         */
+        uint64_t period = message->time_flag && slot->stamped
+                              ? (uint64_t)(message->time_stamp -
+                                           slot->last_stamp) * 100U
+                              : now - entry->last_us;
+        double delta = (double)period - entry->period_mean_us;
+
+        if (period > UINT32_MAX)
+            period = UINT32_MAX;
+        if (entry->periods == 0 || period < entry->period_min_us)
+            entry->period_min_us = (uint32_t)period;
+        if (period > entry->period_max_us)
+            entry->period_max_us = (uint32_t)period;
+
+        entry->periods++;
+        entry->period_mean_us += delta / (double)entry->periods;
+        entry->period_m2 += delta * ((double)period - entry->period_mean_us);
+
+        /**
+         * One 64-bit compare covers the payload, bytes past the length are
+         * cleared on both sides
+         */
+        if (data != last || length != entry->data_len) {
+            entry->changes++;
+            entry->last_change_us = now;
+        }
+    }
+
+    entry->count++;
+    entry->last_us = now;
+    entry->data_len = length;
+    memcpy(entry->data, &data, sizeof(entry->data));
+    slot->last_stamp = message->time_stamp;
+    slot->stamped = message->time_flag ? 1 : 0;
+
+    idpool_write_end(&slot->sequence, sequence);
+
+    return 0;
+}
+
+extern int ocii_stats_get(ocii_stats_t *stats, ocii_channel_t channel,
+                          uint32_t can_id, uint8_t extended,
+                          ocii_stats_entry_t *entry) {
+    idpool_t pool;
+    uint16_t index;
+
+    if (stats == NULL || entry == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    pool = stats_pool(stats);
+    if ((index = idpool_find(&pool, channel, can_id, extended, 0)) == 0)
+        return OCII_ERROR_BUFFER_EMPTY;
+
+    stats_read(&stats->slot[index - 1], entry);
+
+    return entry->count != 0 ? OCII_ERROR_NO_ERROR : OCII_ERROR_BUFFER_EMPTY;
+}
+
+extern int ocii_stats_snapshot(ocii_stats_t *stats, ocii_stats_entry_t *entries,
+                               int capacity) {
+    unsigned used;
+    int count = 0;
+
+    if (stats == NULL || entries == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (capacity < 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    used = atomic_load_explicit(&stats->used, memory_order_acquire);
+    if (used > OCII_STATS_IDS)
+        used = OCII_STATS_IDS;
+
+    for (unsigned i = 0; i < used && count < capacity; i++) {
+        stats_read(&stats->slot[i], &entries[count]);
+        if (entries[count].count != 0)
+            count++;
+    }
+
+    return count;
+}
+
+extern double ocii_stats_variance(const ocii_stats_entry_t *entry) {
+    if (entry == NULL || entry->periods < 2)
+        return 0.0;
+
+    return entry->period_m2 / (double)(entry->periods - 1);
+}
@@ -0,0 +1,164 @@
+#include <ocii_timer.h>
+#include <opencanalystii.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_MASK (OCII_TIMER_LEVEL_SIZE - 1)
+#define TIMER_SPAN(level) (1ULL << (OCII_TIMER_LEVEL_BITS * (level)))
+
+static void timer_unlink(ocii_timer_t *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+}
+
+/**
+ * A timer started for a tick already processed goes to the next one. One that
+ * is cascaded on its own tick goes to the slot of the current tick instead,
+ * ocii_timer_advance runs it right after the cascade
+ */
+static void timer_place(ocii_timer_wheel_t *wheel, ocii_timer_t *timer,
+                        int cascading) {
+    uint64_t expires, delta;
+    ocii_timer_t *head;
+    int level;
+
+    if (timer->expires <= wheel->now)
+        timer->expires = cascading ? wheel->now : wheel->now + 1;
+
+    expires = timer->expires;
+    delta = expires - wheel->now;
+
+    for (level = 0; level < OCII_TIMER_LEVELS - 1; level++)
+        if (delta < TIMER_SPAN(level + 1))
+            break;
+
+    /**
+     * Too far away even for the last level, park it in the farthest slot,
+     * the next cascade will look at it again
+     */
+    if (delta >= TIMER_SPAN(OCII_TIMER_LEVELS))
+        expires = wheel->now + TIMER_SPAN(OCII_TIMER_LEVELS) - 1;
+
+    head = &wheel->slot[level][(expires >> (OCII_TIMER_LEVEL_BITS * level)) &
+                              TIMER_MASK];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+extern int ocii_timer_wheel_init(ocii_timer_wheel_t *wheel, uint32_t tick_us,
+                                 uint64_t now_us) {
+    if (wheel == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    wheel->now = 0;
+    wheel->origin = now_us;
+    wheel->tick_us = tick_us != 0 ? tick_us : OCII_TIMER_TICK_US;
+    wheel->count = 0;
+
+    for (int level = 0; level < OCII_TIMER_LEVELS; level++)
+        for (int slot = 0; slot < OCII_TIMER_LEVEL_SIZE; slot++)
+            wheel->slot[level][slot].next = wheel->slot[level][slot].prev =
+                &wheel->slot[level][slot];
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern void ocii_timer_init(ocii_timer_t *timer,
+                            ocii_timer_callback_t callback, void *user) {
+    *timer = (ocii_timer_t){.callback = callback, .user = user};
+}
+
+extern void ocii_timer_start(ocii_timer_wheel_t *wheel, ocii_timer_t *timer,
+                             uint64_t expires_us) {
+    if (timer->next != NULL)
+        timer_unlink(timer);
+    else
+        wheel->count++;
+
+    /**
+     * Round up, a timer must never fire early
+     */
+    timer->expires = expires_us > wheel->origin
+                         ? (expires_us - wheel->origin + wheel->tick_us - 1) /
+                               wheel->tick_us
+                         : 0;
+    timer_place(wheel, timer, 0);
+}
+
+extern void ocii_timer_stop(ocii_timer_wheel_t *wheel, ocii_timer_t *timer) {
+    if (timer->next == NULL)
+        return;
+
+    timer_unlink(timer);
+    wheel->count--;
+}
+
+extern int ocii_timer_running(const ocii_timer_t *timer) {
+    return timer->next != NULL;
+}
+
+static void timer_cascade(ocii_timer_wheel_t *wheel, ocii_timer_t *head) {
+    ocii_timer_t list = {.next = head->next, .prev = head->prev};
+
+    if (head->next == head)
+        return;
+
+    /**
+     * Detach the whole slot first, re-placed timers never land in it again
+     */
+    list.next->prev = list.prev->next = &list;
+    head->next = head->prev = head;
+
+    while (list.next != &list) {
+        ocii_timer_t *timer = list.next;
+
+        timer_unlink(timer);
+        timer_place(wheel, timer, 1);
+    }
+}
+
+extern int ocii_timer_advance(ocii_timer_wheel_t *wheel, uint64_t now_us) {
+    uint64_t target;
+    int expired = 0;
+
+    if (wheel == NULL || now_us < wheel->origin)
+        return 0;
+
+    target = (now_us - wheel->origin) / wheel->tick_us;
+
+    while (wheel->now < target) {
+        ocii_timer_t *head;
+
+        if (wheel->count == 0) {
+            wheel->now = target;
+            break;
+        }
+
+        wheel->now++;
+        for (int level = 1; level < OCII_TIMER_LEVELS; level++) {
+            if (((wheel->now >> (OCII_TIMER_LEVEL_BITS * (level - 1))) &
+                 TIMER_MASK) != 0)
+                break;
+            timer_cascade(
+                wheel,
+                &wheel->slot[level][(wheel->now >>
+                                     (OCII_TIMER_LEVEL_BITS * level)) &
+                                    TIMER_MASK]);
+        }
+
+        head = &wheel->slot[0][wheel->now & TIMER_MASK];
+        while (head->next != head) {
+            ocii_timer_t *timer = head->next;
+
+            timer_unlink(timer);
+            wheel->count--;
+            expired++;
+            timer->callback(timer->user, timer);
+        }
+    }
+
+    return expired;
+}
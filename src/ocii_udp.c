@@ -0,0 +1,521 @@
+#if defined(__linux__)
+
+#define _GNU_SOURCE /* sendmmsg, recvmmsg */
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <ocii_udp.h>
+#include <opencanalystii.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
+
+#define UDP_EXTENDED 0x80000000U
+#define UDP_REMOTE 0x40000000U
+
+static void store_le16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void store_le32(uint8_t *p, uint32_t value) {
+    store_le16(p, (uint16_t)value);
+    store_le16(p + 2, (uint16_t)(value >> 16));
+}
+
+static void store_le64(uint8_t *p, uint64_t value) {
+    store_le32(p, (uint32_t)value);
+    store_le32(p + 4, (uint32_t)(value >> 32));
+}
+
+static uint16_t load_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t load_le32(const uint8_t *p) {
+    return (uint32_t)load_le16(p) | (uint32_t)load_le16(p + 2) << 16;
+}
+
+static uint64_t load_le64(const uint8_t *p) {
+    return (uint64_t)load_le32(p) | (uint64_t)load_le32(p + 4) << 32;
+}
+
+static void udp_encode(uint8_t *p, int channel, const ocii_message_t *message,
+                       uint64_t time_us) {
+    store_le64(p, time_us);
+    store_le32(p + 8, (message->can_id & 0x1FFFFFFF) |
+                          (message->extended ? UDP_EXTENDED : 0) |
+                          (message->remote ? UDP_REMOTE : 0));
+    store_le32(p + 12, message->time_stamp);
+    p[16] = (uint8_t)channel;
+    p[17] = message->data_len;
+    p[18] = message->time_flag ? 1 : 0;
+    p[19] = 0;
+    memcpy(p + 20, message->data, sizeof(message->data));
+}
+
+static void udp_decode(const uint8_t *p, ocii_udp_frame_t *frame) {
+    uint32_t can_id = load_le32(p + 8);
+
+    *frame = (ocii_udp_frame_t){.time_us = load_le64(p), .channel = p[16]};
+    frame->message.can_id = can_id & 0x1FFFFFFF;
+    frame->message.extended = (can_id & UDP_EXTENDED) != 0;
+    frame->message.remote = (can_id & UDP_REMOTE) != 0;
+    frame->message.time_stamp = load_le32(p + 12);
+    frame->message.data_len = p[17] <= 8 ? p[17] : 8;
+    frame->message.time_flag = p[18] & 1;
+    memcpy(frame->message.data, p + 20, sizeof(frame->message.data));
+}
+
+static size_t udp_length(const ocii_udp_t *udp, int datagram) {
+    return OCII_UDP_HEADER +
+           (size_t)load_le16(&udp->out[datagram][6]) * OCII_UDP_FRAME;
+}
+
+/**
+ * Writes the header of the datagram being filled and moves on to the next
+ * one. The lock must be held
+ */
+static void udp_seal(ocii_udp_t *udp) {
+    uint8_t *p = udp->out[udp->out_ready];
+
+    store_le32(p, OCII_UDP_MAGIC);
+    p[4] = OCII_UDP_VERSION;
+    p[5] = 0;
+    store_le16(p + 6, udp->out_frames);
+    store_le32(p + 8, udp->tx_sequence++);
+    store_le32(p + 12, (uint32_t)udp->stats.dropped);
+
+    udp->out_ready++;
+    udp->out_frames = 0;
+}
+
+/**
+ * Sends the sealed datagrams, as many per sendmmsg call as there are. A
+ * full socket buffer leaves them for the next try. The lock must be held
+ */
+static int udp_send_ready(ocii_udp_t *udp) {
+    struct mmsghdr message[OCII_UDP_BATCH];
+    struct iovec iov[OCII_UDP_BATCH];
+    int sent = 0, error_code = OCII_ERROR_NO_ERROR;
+
+    while (sent < udp->out_ready) {
+        int count = udp->out_ready - sent, ret;
+
+        for (int i = 0; i < count; i++) {
+            iov[i] = (struct iovec){.iov_base = udp->out[sent + i],
+                                    .iov_len = udp_length(udp, sent + i)};
+            message[i] = (struct mmsghdr){
+                .msg_hdr = {.msg_name = &udp->peer,
+                            .msg_namelen = udp->peer_length,
+                            .msg_iov = &iov[i],
+                            .msg_iovlen = 1}};
+        }
+
+        ret = sendmmsg(udp->fd, message, (unsigned)count, MSG_DONTWAIT);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        udp->stats.syscalls++;
+        if (ret < 0) {
+            /**
+             * The batch cannot be sent, drop it rather than retry forever
+             */
+            for (int i = sent; i < udp->out_ready; i++)
+                udp->stats.dropped += load_le16(&udp->out[i][6]);
+            sent = udp->out_ready;
+            error_code = OCII_ERROR_SOCKET;
+            break;
+        }
+
+        for (int i = 0; i < ret; i++)
+            udp->stats.frames_sent += load_le16(&udp->out[sent + i][6]);
+        udp->stats.datagrams_sent += (uint64_t)ret;
+        sent += ret;
+    }
+
+    /**
+     * The datagram being filled moves down with the ones left over
+     */
+    memmove(udp->out[0], udp->out[sent],
+            (size_t)(udp->out_ready - sent + (udp->out_frames != 0)) *
+                sizeof(udp->out[0]));
+    udp->out_ready = (uint16_t)(udp->out_ready - sent);
+
+    return error_code;
+}
+
+/**
+ * Queues one frame, the lock must be held
+ */
+static int udp_queue(ocii_udp_t *udp, int channel,
+                     const ocii_message_t *message, uint64_t now) {
+    if (udp->out_ready == OCII_UDP_BATCH) {
+        (void)udp_send_ready(udp);
+        if (udp->out_ready == OCII_UDP_BATCH) {
+            udp->stats.dropped++;
+            return OCII_ERROR_BUFFER_OVERFLOW;
+        }
+    }
+
+    if (udp->out_ready == 0 && udp->out_frames == 0)
+        udp->out_first = now;
+
+    udp_encode(&udp->out[udp->out_ready][OCII_UDP_HEADER +
+                                         udp->out_frames * OCII_UDP_FRAME],
+               channel, message, now);
+    if (++udp->out_frames == OCII_UDP_FRAMES)
+        udp_seal(udp);
+
+    if (udp->out_ready == OCII_UDP_BATCH ||
+        (udp->flush_us != 0 && now - udp->out_first >= udp->flush_us))
+        return udp_send_ready(udp);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+static int udp_flush(ocii_udp_t *udp) {
+    if (udp->out_frames != 0)
+        udp_seal(udp);
+
+    return udp_send_ready(udp);
+}
+
+extern int ocii_udp_open(ocii_udp_t *udp, const char *host, uint16_t port,
+                         uint16_t local_port) {
+    struct addrinfo hints = {.ai_socktype = SOCK_DGRAM}, *info;
+    char service[8];
+
+    if (udp == NULL || host == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    memset(udp, 0, sizeof(*udp));
+    udp->fd = -1;
+
+    (void)snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &info) != 0)
+        return OCII_ERROR_SOCKET;
+
+    memcpy(&udp->peer, info->ai_addr, info->ai_addrlen);
+    udp->peer_length = info->ai_addrlen;
+    udp->fd = socket(info->ai_family, SOCK_DGRAM, 0);
+    freeaddrinfo(info);
+
+    if (udp->fd < 0)
+        return OCII_ERROR_SOCKET;
+
+    if (local_port != 0) {
+        struct sockaddr_storage local;
+        socklen_t length;
+
+        memset(&local, 0, sizeof(local));
+        local.ss_family = udp->peer.ss_family;
+        if (local.ss_family == AF_INET6) {
+            ((struct sockaddr_in6 *)&local)->sin6_port = htons(local_port);
+            length = sizeof(struct sockaddr_in6);
+        } else {
+            ((struct sockaddr_in *)&local)->sin_port = htons(local_port);
+            length = sizeof(struct sockaddr_in);
+        }
+
+        if (bind(udp->fd, (struct sockaddr *)&local, length) != 0) {
+            (void)close(udp->fd);
+            udp->fd = -1;
+            return OCII_ERROR_SOCKET;
+        }
+    }
+
+    if (pthread_mutex_init(&udp->lock, NULL) != 0) {
+        (void)close(udp->fd);
+        udp->fd = -1;
+        return OCII_ERROR_THREAD;
+    }
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_udp_close(ocii_udp_t *udp) {
+    int error_code;
+
+    if (udp == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (udp->fd < 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&udp->lock);
+    error_code = udp_flush(udp);
+    (void)pthread_mutex_unlock(&udp->lock);
+
+    (void)close(udp->fd);
+    udp->fd = -1;
+    (void)pthread_mutex_destroy(&udp->lock);
+
+    return error_code;
+}
+
+extern int ocii_udp_init(ocii_udp_t *udp, const char *host, uint16_t port,
+                         uint16_t local_port) {
+    int error_code;
+
+    if ((error_code = ocii_udp_open(udp, host, port, local_port)) !=
+        OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    if ((error_code = ocii_add_rx_hook(ocii_udp_rx_hook, udp)) !=
+        OCII_ERROR_NO_ERROR) {
+        (void)ocii_udp_close(udp);
+        return error_code;
+    }
+    udp->hooked = 1;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_udp_deinit(ocii_udp_t *udp) {
+    int error_code;
+
+    if (udp == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (udp->hooked &&
+        (error_code = ocii_remove_rx_hook(ocii_udp_rx_hook, udp)) !=
+            OCII_ERROR_NO_ERROR)
+        return error_code;
+    udp->hooked = 0;
+
+    return ocii_udp_close(udp);
+}
+
+extern int ocii_udp_rx_hook(void *user, ocii_channel_t channel,
+                            ocii_message_t *message) {
+    ocii_udp_t *udp = user;
+
+    (void)pthread_mutex_lock(&udp->lock);
+    (void)udp_queue(udp, channel, message, ocii_time_us());
+    (void)pthread_mutex_unlock(&udp->lock);
+
+    return 0;
+}
+
+extern int ocii_udp_send(ocii_udp_t *udp, ocii_channel_t channel,
+                         const ocii_message_t *message) {
+    int error_code;
+
+    if (udp == NULL || message == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if ((unsigned)channel >= ocii_channel_sizeof)
+        return OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_mutex_lock(&udp->lock);
+    error_code = udp_queue(udp, channel, message, ocii_time_us());
+    (void)pthread_mutex_unlock(&udp->lock);
+
+    return error_code;
+}
+
+extern int ocii_udp_flush(ocii_udp_t *udp) {
+    int error_code;
+
+    if (udp == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_mutex_lock(&udp->lock);
+    error_code = udp_flush(udp);
+    (void)pthread_mutex_unlock(&udp->lock);
+
+    return error_code;
+}
+
+/**
+ * Checks a received datagram and accounts for its sequence number. Returns
+ * its frame count, or -1 if it is to be skipped
+ */
+static int udp_accept(ocii_udp_t *udp, const uint8_t *p, size_t length) {
+    uint32_t sequence;
+    int32_t gap;
+    int count;
+
+    if (length < OCII_UDP_HEADER || load_le32(p) != OCII_UDP_MAGIC ||
+        p[4] != OCII_UDP_VERSION ||
+        length != OCII_UDP_HEADER + (size_t)load_le16(p + 6) * OCII_UDP_FRAME) {
+        udp->stats.malformed++;
+        return -1;
+    }
+
+    count = load_le16(p + 6);
+    sequence = load_le32(p + 8);
+    udp->stats.peer_dropped = load_le32(p + 12);
+    udp->stats.datagrams_received++;
+
+    /**
+     * The signed distance to the expected number survives the wrap. A late
+     * datagram is still delivered, it is only counted. One from further back
+     * than a batch comes from a peer that started counting again
+     */
+    gap = (int32_t)(sequence - udp->rx_sequence);
+    if (!udp->rx_synced || gap >= 0 || gap < -OCII_UDP_BATCH) {
+        if (udp->rx_synced && gap >= 0)
+            udp->stats.lost += (uint32_t)gap;
+        else if (udp->rx_synced)
+            udp->stats.resyncs++;
+        udp->rx_sequence = sequence + 1;
+        udp->rx_synced = 1;
+    } else {
+        /**
+         * Counted as lost when the gap opened, it made it after all
+         */
+        udp->stats.reordered++;
+        if (udp->stats.lost != 0)
+            udp->stats.lost--;
+    }
+
+    return count;
+}
+
+/**
+ * Reads the next batch of datagrams with one recvmmsg call and skips to the
+ * first valid one. Returns OCII_ERROR_BUFFER_EMPTY if nothing is waiting
+ */
+static int udp_receive_batch(ocii_udp_t *udp) {
+    struct mmsghdr message[OCII_UDP_BATCH];
+    struct iovec iov[OCII_UDP_BATCH];
+    int ret;
+
+    for (int i = 0; i < OCII_UDP_BATCH; i++) {
+        iov[i] = (struct iovec){.iov_base = udp->in[i],
+                                .iov_len = sizeof(udp->in[i])};
+        message[i] = (struct mmsghdr){
+            .msg_hdr = {.msg_iov = &iov[i], .msg_iovlen = 1}};
+    }
+
+    do
+        ret = recvmmsg(udp->fd, message, OCII_UDP_BATCH, MSG_DONTWAIT, NULL);
+    while (ret < 0 && errno == EINTR);
+
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return OCII_ERROR_BUFFER_EMPTY;
+    if (ret <= 0)
+        return OCII_ERROR_SOCKET;
+
+    for (int i = 0; i < ret; i++)
+        udp->in_length[i] = (uint16_t)message[i].msg_len;
+    udp->in_count = (uint16_t)ret;
+    udp->in_datagram = 0;
+    udp->in_frame = 0;
+
+    while (udp->in_datagram < udp->in_count &&
+           udp_accept(udp, udp->in[udp->in_datagram],
+                      udp->in_length[udp->in_datagram]) < 0)
+        udp->in_datagram++;
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_udp_receive(ocii_udp_t *udp, ocii_udp_frame_t *frames,
+                            int capacity) {
+    int error_code = OCII_ERROR_NO_ERROR, count = 0;
+
+    if (udp == NULL || frames == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (capacity <= 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    while (count < capacity) {
+        const uint8_t *p;
+
+        if (udp->in_datagram == udp->in_count) {
+            if ((error_code = udp_receive_batch(udp)) != OCII_ERROR_NO_ERROR)
+                break;
+            continue;
+        }
+
+        p = udp->in[udp->in_datagram];
+        if (udp->in_frame < load_le16(p + 6)) {
+            udp_decode(&p[OCII_UDP_HEADER + udp->in_frame * OCII_UDP_FRAME],
+                       &frames[count++]);
+            udp->in_frame++;
+            udp->stats.frames_received++;
+            continue;
+        }
+
+        /**
+         * Datagram done, on to the next valid one of the batch
+         */
+        udp->in_frame = 0;
+        while (++udp->in_datagram < udp->in_count &&
+               udp_accept(udp, udp->in[udp->in_datagram],
+                          udp->in_length[udp->in_datagram]) < 0)
+            ;
+    }
+
+    return count != 0 ? count : error_code;
+}
+
+extern int ocii_udp_poll(ocii_udp_t *udp) {
+    ocii_udp_frame_t frames[OCII_UDP_FRAMES];
+    int error_code, flushed, written = 0, count;
+
+    if (udp == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    /**
+     * A partial batch may wait flush_us for more frames
+     */
+    (void)pthread_mutex_lock(&udp->lock);
+    flushed = udp->out_ready != 0 ||
+                      (udp->out_frames != 0 &&
+                       ocii_time_us() - udp->out_first >= udp->flush_us)
+                  ? udp_flush(udp)
+                  : OCII_ERROR_NO_ERROR;
+    (void)pthread_mutex_unlock(&udp->lock);
+
+    /**
+     * Consecutive frames for the same channel share a packet
+     */
+    while ((count = ocii_udp_receive(udp, frames, OCII_UDP_FRAMES)) > 0)
+        for (int i = 0; i < count;) {
+            ocii_packet_t packet = {.count = 0};
+            int channel = frames[i].channel;
+
+            while (i < count && frames[i].channel == channel &&
+                   packet.count < sizeof_arr(packet.message))
+                packet.message[packet.count++] = frames[i++].message;
+
+            if (channel >= ocii_channel_sizeof ||
+                (error_code = ocii_write_wait(
+                     channel, &packet,
+                     ocii_time_us() + (uint64_t)ocii_timeout * 1000U)) !=
+                    OCII_ERROR_NO_ERROR) {
+                udp->stats.inject_errors += packet.count;
+                continue;
+            }
+            udp->stats.injected += packet.count;
+            written += packet.count;
+        }
+
+    if (count != OCII_ERROR_BUFFER_EMPTY)
+        return count;
+
+    return flushed != OCII_ERROR_NO_ERROR ? flushed : written;
+}
+
+#else
+
+/**
+ * The bridge needs sendmmsg and recvmmsg, ISO C wants something here
+ */
+typedef int ocii_udp_unsupported_t;
+
+#endif
@@ -1,6 +1,12 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <libusb/libusb.h>
 #include <opencanalystii.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 
 #define mod(x) ((x) < 0 ? -(x) : (x))
@@ -16,96 +22,417 @@
 
 #define sizeof_arr(arr) (sizeof(arr) / sizeof(arr[0]))
 
+/**
+ * Endpoints 0x01 and 0x02 belong to channel 0, 0x03 and 0x04 to channel 1
+ */
+#define ENDPOINT_TO_CHANNEL(endpoint)                                          \
+    ((((endpoint) & 0x0F) - 1) / 2 % ocii_channel_sizeof)
+
+static libusb_context *usb_ctx;
 static libusb_device_handle *dev_handle;
 
-extern int ocii_open_device(void) {
-    libusb_context *ctx = NULL;
-    int config, error_code;
+/**
+ * References to usb_ctx: the open device and ocii_hold_context. libusb_init
+ * scans the bus, so the context outlives a close while it is held
+ */
+static struct {
+    pthread_mutex_t lock;
+    int refs;
+} usb_refs = {.lock = PTHREAD_MUTEX_INITIALIZER};
 
-    /**
-     * The standard size of a USB packet is 64 bytes
-     */
-    static_assert(sizeof(ocii_packet_t) == 64UL);
+/**
+ * Set once a transfer or the hotplug callback finds the adapter gone, until
+ * the reconnect thread has opened it again
+ */
+static atomic_int device_gone;
+static atomic_uint_least64_t device_removed_us;
+
+static struct {
+    ocii_rx_hook_t hook;
+    void *user;
+} rx_hooks[OCII_RX_HOOKS_MAX];
+static int rx_hooks_count;
+
+static struct {
+    ocii_status_hook_t hook;
+    void *user;
+} status_hooks[OCII_STATUS_HOOKS_MAX];
+static int status_hooks_count;
+
+/**
+ * CAN status polling of the I/O thread, see ocii_set_status_period
+ */
+static struct {
+    atomic_uint period_us; /* 0 if off */
+    uint64_t next;         /* Time of the next poll, us */
+} status_poll;
+
+/**
+ * Dispatch holds these for reading while it walks the hooks, adding and
+ * removing one takes them for writing, so a removed hook is not running
+ * anymore once the removal returns
+ */
+static pthread_rwlock_t rx_hooks_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_rwlock_t status_hooks_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Serializes the request/response pairs on the endpoints of a channel, so that
+ * the library thread and the caller do not interleave them
+ */
+static pthread_mutex_t io_lock[ocii_channel_sizeof] = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * Init packet of the last successful ocii_init per channel, guarded by the
+ * io_lock of the channel
+ */
+static struct {
+    ocii_packet_t init;
+    int valid;
+} io_config[ocii_channel_sizeof];
+
+/**
+ * Write combining queues, see ocii_set_write_combining
+ */
+static struct {
+    pthread_mutex_t lock;
+    ocii_packet_t packet; /* Messages waiting for a full packet */
+    uint64_t deadline;    /* When the oldest of them must be sent, us */
+    uint32_t deadline_us; /* 0 if write combining is off */
+    int error;            /* Error of the last write of the flusher */
+} tx_combine[ocii_channel_sizeof] = {{.lock = PTHREAD_MUTEX_INITIALIZER},
+                                     {.lock = PTHREAD_MUTEX_INITIALIZER}};
+
+/**
+ * Flusher thread, it sleeps until the earliest write combining deadline
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int running;
+    int kick; /* Set when a queue got its first message */
+} tx_flusher = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * RX rings and TX credit of the channels, filled by the I/O thread. Blocked
+ * callers wait on the condition variables instead of polling the device
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t rx_cond; /* Signaled when a packet enters the ring */
+    pthread_cond_t tx_cond; /* Signaled when the device has TX room again */
+    ocii_packet_t ring[OCII_RX_RING];
+    uint32_t head; /* Packets ever pushed */
+    uint32_t tail; /* Packets ever popped */
+    uint32_t tx_pending;
+    int tx_waiters;
+    int error;         /* Error of the last device access of the I/O thread */
+    atomic_int started;    /* Only started channels are polled */
+    atomic_int recovering; /* Left stopped by ocii_recover, status polled */
+} io_channel[ocii_channel_sizeof] = {{.lock = PTHREAD_MUTEX_INITIALIZER},
+                                     {.lock = PTHREAD_MUTEX_INITIALIZER}};
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_t thread;
+    atomic_int running;
+} io_thread = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static pthread_once_t io_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Bulk read buffer of the I/O thread, large enough for a full device buffer
+ */
+static ocii_packet_t io_batch[(OCII_READ_BUFFER + 2) / 3];
+
+static atomic_int wait_profile = OCII_WAIT_BALANCED;
+
+/**
+ * Callers of ocii_transact waiting for their response. The RX path checks
+ * every received message against them before the RX hooks
+ */
+static struct {
+    pthread_mutex_t lock;
+    atomic_int count; /* Slots in use, lets the RX path skip the lock */
+    struct {
+        const ocii_match_t *match;
+        ocii_message_t *response;
+        pthread_cond_t cond;
+        int channel;
+        int in_use;
+        int done;
+    } slot[OCII_TRANSACT_MAX];
+} transact = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * Reconnect thread, see ocii_start_reconnect. The adapter is recognized by
+ * its port path, or by its serial number on another port
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_t thread;
+    atomic_int running;
+    ocii_reconnect_hook_t hook;
+    void *user;
+    libusb_device *device; /* The open adapter, for hotplug removals */
+    libusb_hotplug_callback_handle hotplug;
+    int hotplug_active;
+    uint8_t path[8]; /* Bus number, then the port numbers */
+    int path_length;
+    char serial[64]; /* Empty if the adapter has none */
+} reconnect = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * How much later than asked a short sleep returns, measured once
+ */
+static uint32_t sleep_overshoot_us;
+
+/**
+ * Selects the configuration of an opened adapter and claims its interface
+ */
+static int device_claim(libusb_device_handle *handle) {
+    int config;
+
+    if (libusb_get_configuration(handle, &config) < 0)
+        return OCII_ERROR_USB_GET_CONF;
+
+    if (config != 1)
+        if (libusb_set_configuration(handle, config = 1) < 0)
+            return OCII_ERROR_USB_SET_CONF;
+
+    if (libusb_kernel_driver_active(handle, 0) == 1)
+        if (libusb_detach_kernel_driver(handle, 0) != 0)
+            return OCII_ERROR_USB_DRV_DETACH;
+
+    if (libusb_claim_interface(handle, 0) < 0)
+        return OCII_ERROR_USB_CLAIM;
+
+    return OCII_ERROR_NO_ERROR;
+}
 
-    if (libusb_init(&ctx) < 0) {
+/**
+ * Bus number and port numbers of a device, returns their count
+ */
+static int device_path(libusb_device *device, uint8_t *path, int size) {
+    int ports;
+
+    path[0] = libusb_get_bus_number(device);
+    if ((ports = libusb_get_port_numbers(device, &path[1], size - 1)) < 0)
+        ports = 0;
+
+    return 1 + ports;
+}
+
+static int context_acquire(void) {
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    (void)pthread_mutex_lock(&usb_refs.lock);
+    if (usb_refs.refs == 0 && libusb_init(&usb_ctx) < 0)
         error_code = OCII_ERROR_USB_INIT;
-        goto ocii_leave;
-    }
+    else
+        usb_refs.refs++;
+    (void)pthread_mutex_unlock(&usb_refs.lock);
 
-    dev_handle = libusb_open_device_with_vid_pid(ctx, OCII_USB_ID_VENDOR,
-                                                 OCII_USB_ID_PRODUCT);
-    if (dev_handle == NULL) {
-        error_code = OCII_ERROR_USB_OPEN;
-        goto ocii_exit;
-    }
+    return error_code;
+}
 
-    if (libusb_get_configuration(dev_handle, &config) < 0) {
-        error_code = OCII_ERROR_USB_GET_CONF;
-        goto ocii_exit;
+static int context_release(void) {
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    (void)pthread_mutex_lock(&usb_refs.lock);
+    if (usb_refs.refs == 0)
+        error_code = OCII_ERROR_INVALID_ARG;
+    else if (--usb_refs.refs == 0) {
+        libusb_exit(usb_ctx);
+        usb_ctx = NULL;
     }
+    (void)pthread_mutex_unlock(&usb_refs.lock);
 
-    if (config != 1)
-        if (libusb_set_configuration(dev_handle, config = 1) < 0) {
-            error_code = OCII_ERROR_USB_SET_CONF;
-            goto ocii_exit;
-        }
+    return error_code;
+}
 
-    if (libusb_kernel_driver_active(dev_handle, 0) == 1)
-        if (libusb_detach_kernel_driver(dev_handle, 0) != 0) {
-            error_code = OCII_ERROR_USB_DRV_DETACH;
-            goto ocii_exit;
-        }
+/**
+ * Claims a freshly opened adapter and makes it the device of the library.
+ * Takes over the context reference of the caller, which is dropped on failure
+ */
+static int device_attach(libusb_device_handle *handle) {
+    int error_code;
 
-    if (libusb_claim_interface(dev_handle, 0) < 0) {
-        error_code = OCII_ERROR_USB_CLAIM;
-        goto ocii_close;
+    /**
+     * The standard size of a USB packet is 64 bytes
+     */
+    static_assert(sizeof(ocii_packet_t) == 64UL);
+
+    if (handle == NULL) {
+        error_code = OCII_ERROR_USB_OPEN;
+        goto ocii_release;
     }
 
+    if ((error_code = device_claim(handle)) != OCII_ERROR_NO_ERROR)
+        goto ocii_close;
+
+    dev_handle = handle;
+    atomic_store(&device_gone, 0);
+
     return OCII_ERROR_NO_ERROR;
 ocii_close:
-    libusb_close(dev_handle);
-ocii_exit:
-    libusb_exit(ctx);
-ocii_leave:
+    libusb_close(handle);
+ocii_release:
+    (void)context_release();
     return error_code;
 }
 
+extern int ocii_open_device(void) {
+    int error_code;
+
+    if ((error_code = context_acquire()) != OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    return device_attach(libusb_open_device_with_vid_pid(
+        usb_ctx, OCII_USB_ID_VENDOR, OCII_USB_ID_PRODUCT));
+}
+
+extern int ocii_open_device_path(uint8_t bus, const uint8_t *ports,
+                                 int count) {
+    libusb_device_handle *handle = NULL;
+    libusb_device **list;
+    uint8_t path[8];
+    ssize_t devices;
+    int error_code;
+
+    if (ports == NULL && count != 0)
+        return OCII_ERROR_NULL_PTR;
+
+    if (count < 0 || count >= (int)sizeof(path))
+        return OCII_ERROR_INVALID_ARG;
+
+    if ((error_code = context_acquire()) != OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    /**
+     * Only the device at the path is opened and checked, not every device
+     * with a matching descriptor
+     */
+    if ((devices = libusb_get_device_list(usb_ctx, &list)) >= 0) {
+        for (ssize_t i = 0; i < devices && handle == NULL; i++) {
+            struct libusb_device_descriptor descriptor;
+
+            if (device_path(list[i], path, (int)sizeof(path)) != count + 1 ||
+                path[0] != bus ||
+                (count != 0 && memcmp(&path[1], ports, (size_t)count) != 0))
+                continue;
+
+            if (libusb_get_device_descriptor(list[i], &descriptor) != 0 ||
+                descriptor.idVendor != OCII_USB_ID_VENDOR ||
+                descriptor.idProduct != OCII_USB_ID_PRODUCT ||
+                libusb_open(list[i], &handle) != 0)
+                break;
+        }
+        libusb_free_device_list(list, 1);
+    }
+
+    return device_attach(handle);
+}
+
+extern int ocii_open_device_fd(int fd) {
+    libusb_device_handle *handle = NULL;
+    int error_code;
+
+    if (fd < 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    if ((error_code = context_acquire()) != OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    if (libusb_wrap_sys_device(usb_ctx, (intptr_t)fd, &handle) != 0)
+        handle = NULL;
+
+    return device_attach(handle);
+}
+
+extern int ocii_hold_context(void) {
+    return context_acquire();
+}
+
+extern int ocii_release_context(void) {
+    return context_release();
+}
+
+static void tx_flusher_stop(void);
+
 extern int ocii_close_device(void) {
-    if (dev_handle == NULL)
+    if (dev_handle == NULL && !atomic_load(&device_gone))
         return OCII_ERROR_NULL_PTR;
 
-    if (libusb_release_interface(dev_handle, 0) != 0)
-        return OCII_ERROR_USB_RELEASE;
+    (void)ocii_stop_reconnect();
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        (void)ocii_set_write_combining(channel, 0);
+    tx_flusher_stop();
+    (void)ocii_stop_io_thread();
 
-    libusb_close(dev_handle);
-    libusb_exit(NULL);
+    /**
+     * A removed adapter cannot be released, only its handle is freed
+     */
+    if (dev_handle != NULL) {
+        if (libusb_release_interface(dev_handle, 0) != 0 &&
+            !atomic_load(&device_gone))
+            return OCII_ERROR_USB_RELEASE;
+
+        libusb_close(dev_handle);
+        dev_handle = NULL;
+    }
+    (void)context_release();
+    atomic_store(&device_gone, 0);
 
     return OCII_ERROR_NO_ERROR;
 }
 
-static int ocii_transaction(uint8_t endpoint, ocii_packet_t *request,
-                            ocii_packet_t *response) {
+static void device_lost(void) {
+    if (!atomic_exchange(&device_gone, 1))
+        atomic_store(&device_removed_us, ocii_time_us());
+}
+
+/**
+ * Maps a failed bulk transfer, a removed adapter is noted for the reconnect
+ * thread
+ */
+static int transfer_error(int result) {
+    if (result != LIBUSB_ERROR_NO_DEVICE)
+        return OCII_ERROR_BULK_TRANSFER;
+
+    device_lost();
+
+    return OCII_ERROR_NO_DEVICE;
+}
+
+static int ocii_transfer(uint8_t endpoint, ocii_packet_t *request,
+                         ocii_packet_t *response) {
     int32_t length;
+    int result;
+
+    if (atomic_load(&device_gone))
+        return OCII_ERROR_NO_DEVICE;
 
     if ((request == NULL && response == NULL) || dev_handle == NULL)
         return OCII_ERROR_NULL_PTR;
 
     if (request != NULL) {
-        if (libusb_bulk_transfer(dev_handle, endpoint | OCII_USB_ENDPOINT_OUT,
-                                 (unsigned char *)request,
-                                 sizeof(ocii_packet_t), &length,
-                                 ocii_timeout) != 0)
-            return OCII_ERROR_BULK_TRANSFER;
+        if ((result = libusb_bulk_transfer(
+                 dev_handle, endpoint | OCII_USB_ENDPOINT_OUT,
+                 (unsigned char *)request, sizeof(ocii_packet_t), &length,
+                 ocii_timeout)) != 0)
+            return transfer_error(result);
         if (length != sizeof(ocii_packet_t))
             return OCII_ERROR_BULK_TRANSFER;
     }
 
     if (response != NULL) {
-        if (libusb_bulk_transfer(dev_handle, endpoint | OCII_USB_ENDPOINT_IN,
-                                 (unsigned char *)response,
-                                 sizeof(ocii_packet_t), &length,
-                                 ocii_timeout) != 0)
-            return OCII_ERROR_BULK_TRANSFER;
+        if ((result = libusb_bulk_transfer(
+                 dev_handle, endpoint | OCII_USB_ENDPOINT_IN,
+                 (unsigned char *)response, sizeof(ocii_packet_t), &length,
+                 ocii_timeout)) != 0)
+            return transfer_error(result);
         if (length != sizeof(ocii_packet_t))
             return OCII_ERROR_BULK_TRANSFER;
     }
@@ -113,6 +440,22 @@ static int ocii_transaction(uint8_t endpoint, ocii_packet_t *request,
     return OCII_ERROR_NO_ERROR;
 }
 
+/**
+ * Transfer that holds the lock of the endpoint's channel, so that requests
+ * and responses of concurrent callers stay paired
+ */
+static int ocii_transaction(uint8_t endpoint, ocii_packet_t *request,
+                            ocii_packet_t *response) {
+    pthread_mutex_t *lock = &io_lock[ENDPOINT_TO_CHANNEL(endpoint)];
+    int error_code;
+
+    (void)pthread_mutex_lock(lock);
+    error_code = ocii_transfer(endpoint, request, response);
+    (void)pthread_mutex_unlock(lock);
+
+    return error_code;
+}
+
 extern int ocii_flush_tx_buffer(ocii_channel_t channel, int64_t timeout) {
     uint8_t endpoint =
         OCII_CHANNEL_TO_COMMAND_EP[mod(channel) % ocii_channel_sizeof];
@@ -149,8 +492,8 @@ extern int ocii_clear_rx_buffer(ocii_channel_t channel) {
 }
 
 extern int ocii_init(ocii_channel_t channel, ocii_packet_t *command) {
-    uint8_t endpoint =
-        OCII_CHANNEL_TO_COMMAND_EP[mod(channel) % ocii_channel_sizeof];
+    int index = mod(channel) % ocii_channel_sizeof;
+    int error_code;
 
     if (command == NULL)
         return OCII_ERROR_NULL_PTR;
@@ -158,15 +501,32 @@ extern int ocii_init(ocii_channel_t channel, ocii_packet_t *command) {
     command->command = OCII_COMMAND_INIT;
     command->padding[&command->mode - &command->padding[0] + 1] = 0x01;
 
-    return ocii_transaction(endpoint, command, NULL);
+    (void)pthread_mutex_lock(&io_lock[index]);
+    if ((error_code = ocii_transfer(OCII_CHANNEL_TO_COMMAND_EP[index], command,
+                                    NULL)) == OCII_ERROR_NO_ERROR) {
+        io_config[index].init = *command;
+        io_config[index].valid = 1;
+    }
+    (void)pthread_mutex_unlock(&io_lock[index]);
+
+    return error_code;
 }
 
 extern int ocii_start(ocii_channel_t channel) {
     uint8_t endpoint =
         OCII_CHANNEL_TO_COMMAND_EP[mod(channel) % ocii_channel_sizeof];
     ocii_packet_t req = {.command = OCII_COMMAND_START};
+    int error_code;
 
-    return ocii_transaction(endpoint, &req, NULL);
+    if ((error_code = ocii_transaction(endpoint, &req, NULL)) ==
+        OCII_ERROR_NO_ERROR) {
+        atomic_store(&io_channel[mod(channel) % ocii_channel_sizeof].started,
+                     1);
+        atomic_store(
+            &io_channel[mod(channel) % ocii_channel_sizeof].recovering, 0);
+    }
+
+    return error_code;
 }
 
 extern int ocii_stop(ocii_channel_t channel) {
@@ -174,70 +534,1389 @@ extern int ocii_stop(ocii_channel_t channel) {
         OCII_CHANNEL_TO_COMMAND_EP[mod(channel) % ocii_channel_sizeof];
     ocii_packet_t req = {.command = OCII_COMMAND_STOP};
 
+    atomic_store(&io_channel[mod(channel) % ocii_channel_sizeof].started, 0);
+    atomic_store(&io_channel[mod(channel) % ocii_channel_sizeof].recovering,
+                 0);
+
     return ocii_transaction(endpoint, &req, NULL);
 }
 
-extern int ocii_write(ocii_channel_t channel, ocii_packet_t *message) {
-    uint8_t endpoint;
-    ocii_packet_t req = {.command = OCII_COMMAND_MESSAGE_STATUS};
-    ocii_packet_t rsp = {.command = OCII_COMMAND_MESSAGE_STATUS};
+extern int ocii_get_config(ocii_channel_t channel, ocii_packet_t *command) {
+    int index = mod(channel) % ocii_channel_sizeof;
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    if (command == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_mutex_lock(&io_lock[index]);
+    if (io_config[index].valid)
+        *command = io_config[index].init;
+    else
+        error_code = OCII_ERROR_NOT_CONFIGURED;
+    (void)pthread_mutex_unlock(&io_lock[index]);
+
+    return error_code;
+}
+
+extern int ocii_set_config(ocii_channel_t channel,
+                           const ocii_packet_t *command) {
+    int index = mod(channel) % ocii_channel_sizeof;
+
+    if (command == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_mutex_lock(&io_lock[index]);
+    io_config[index].init = *command;
+    io_config[index].valid = 1;
+    (void)pthread_mutex_unlock(&io_lock[index]);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+/**
+ * Fields of the init packet that the controller is set up from
+ */
+static int config_equal(const ocii_packet_t *a, const ocii_packet_t *b) {
+    return a->acc_code == b->acc_code && a->acc_mask == b->acc_mask &&
+           a->filter == b->filter && a->timing[0] == b->timing[0] &&
+           a->timing[1] == b->timing[1] && a->mode == b->mode;
+}
+
+extern int ocii_ensure_configured(ocii_channel_t channel,
+                                  ocii_packet_t *command) {
+    ocii_packet_t record, status;
     int error_code;
 
-    if (message == NULL)
+    if (command == NULL)
         return OCII_ERROR_NULL_PTR;
 
-    endpoint = OCII_CHANNEL_TO_COMMAND_EP[mod(channel) % ocii_channel_sizeof];
-    if ((error_code = ocii_transaction(endpoint, &req, &rsp)) !=
-        OCII_ERROR_NO_ERROR)
+    /**
+     * SJA1000 layout: reset mode is bit 0 of the mode register, bus-off bit
+     * 7 of the status register
+     */
+    if (ocii_get_config(channel, &record) == OCII_ERROR_NO_ERROR &&
+        config_equal(&record, command) &&
+        ocii_get_status(channel, &status) == OCII_ERROR_NO_ERROR &&
+        !(status.reg_mode & 0x01) && !(status.reg_status & 0x80)) {
+        atomic_store(&io_channel[mod(channel) % ocii_channel_sizeof].started,
+                     1);
+        return 1;
+    }
+
+    if ((error_code = ocii_init(channel, command)) != OCII_ERROR_NO_ERROR)
         return error_code;
 
-    if (rsp.tx_pending > OCII_WRITE_BUFFER)
-        return OCII_ERROR_BUFFER_OVERFLOW;
+    return ocii_start(channel);
+}
 
-    endpoint = OCII_CHANNEL_TO_MESSAGE_EP[mod(channel) % ocii_channel_sizeof];
-    if ((error_code = ocii_transaction(endpoint, message, NULL)) !=
-        OCII_ERROR_NO_ERROR)
+extern int ocii_recover(ocii_channel_t channel, int clear_rx) {
+    ocii_packet_t init;
+    int error_code;
+
+    if ((error_code = ocii_get_config(channel, &init)) != OCII_ERROR_NO_ERROR)
         return error_code;
 
-    return OCII_ERROR_NO_ERROR;
+    /**
+     * The I/O thread leaves the channel alone from the stop on, so nothing
+     * is read from it while the controller resets. Its status is still
+     * polled until the start succeeds, so a failed attempt is retried
+     */
+    error_code = ocii_stop(channel);
+    atomic_store(&io_channel[mod(channel) % ocii_channel_sizeof].recovering,
+                 1);
+    if (error_code != OCII_ERROR_NO_ERROR)
+        return error_code;
+    if (clear_rx &&
+        (error_code = ocii_clear_rx_buffer(channel)) != OCII_ERROR_NO_ERROR)
+        return error_code;
+    if ((error_code = ocii_init(channel, &init)) != OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    return ocii_start(channel);
 }
 
-extern int ocii_read(ocii_channel_t channel, ocii_packet_t *message) {
-    uint8_t endpoint;
+/**
+ * Checks the TX credit of the device and sends one packet
+ */
+static int ocii_write_packet(int channel, ocii_packet_t *message) {
     ocii_packet_t req = {.command = OCII_COMMAND_MESSAGE_STATUS};
     ocii_packet_t rsp = {.command = OCII_COMMAND_MESSAGE_STATUS};
     int error_code;
 
+    (void)pthread_mutex_lock(&io_lock[channel]);
+
+    if ((error_code = ocii_transfer(OCII_CHANNEL_TO_COMMAND_EP[channel], &req,
+                                    &rsp)) != OCII_ERROR_NO_ERROR)
+        goto ocii_unlock;
+
+    (void)pthread_mutex_lock(&io_channel[channel].lock);
+    io_channel[channel].tx_pending = rsp.tx_pending;
+    (void)pthread_mutex_unlock(&io_channel[channel].lock);
+
+    if (rsp.tx_pending > OCII_WRITE_BUFFER) {
+        error_code = OCII_ERROR_BUFFER_OVERFLOW;
+        goto ocii_unlock;
+    }
+
+    error_code =
+        ocii_transfer(OCII_CHANNEL_TO_MESSAGE_EP[channel], message, NULL);
+ocii_unlock:
+    (void)pthread_mutex_unlock(&io_lock[channel]);
+    return error_code;
+}
+
+/**
+ * Sends the write combining queue of a channel, its lock must be held. The
+ * messages stay queued if the device is full or removed, other errors drop
+ * them
+ */
+static int tx_combine_flush(int channel) {
+    int error_code;
+
+    if (tx_combine[channel].packet.count == 0)
+        return OCII_ERROR_NO_ERROR;
+
+    error_code = ocii_write_packet(channel, &tx_combine[channel].packet);
+    if (error_code != OCII_ERROR_BUFFER_OVERFLOW &&
+        error_code != OCII_ERROR_NO_DEVICE)
+        tx_combine[channel].packet.count = 0;
+
+    return error_code;
+}
+
+static void *tx_flusher_main(void *arg) {
+    (void)arg;
+
+    (void)pthread_mutex_lock(&tx_flusher.lock);
+    while (tx_flusher.running) {
+        uint64_t next = UINT64_MAX, now = ocii_time_us();
+
+        tx_flusher.kick = 0;
+        (void)pthread_mutex_unlock(&tx_flusher.lock);
+
+        for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+            (void)pthread_mutex_lock(&tx_combine[channel].lock);
+            if (tx_combine[channel].packet.count != 0 &&
+                tx_combine[channel].deadline <= now) {
+                int error_code = tx_combine_flush(channel);
+
+                /**
+                 * A full or removed device is retried one deadline later
+                 */
+                if (error_code == OCII_ERROR_BUFFER_OVERFLOW ||
+                    error_code == OCII_ERROR_NO_DEVICE)
+                    tx_combine[channel].deadline =
+                        now + tx_combine[channel].deadline_us;
+                else if (error_code != OCII_ERROR_NO_ERROR)
+                    tx_combine[channel].error = error_code;
+            }
+            if (tx_combine[channel].packet.count != 0 &&
+                tx_combine[channel].deadline < next)
+                next = tx_combine[channel].deadline;
+            (void)pthread_mutex_unlock(&tx_combine[channel].lock);
+        }
+
+        (void)pthread_mutex_lock(&tx_flusher.lock);
+        if (!tx_flusher.running || tx_flusher.kick)
+            continue;
+
+        if (next == UINT64_MAX)
+            (void)pthread_cond_wait(&tx_flusher.cond, &tx_flusher.lock);
+        else {
+            struct timespec ts = {.tv_sec = (time_t)(next / 1000000U),
+                                  .tv_nsec = (long)(next % 1000000U) * 1000};
+
+            (void)pthread_cond_timedwait(&tx_flusher.cond, &tx_flusher.lock,
+                                         &ts);
+        }
+    }
+    (void)pthread_mutex_unlock(&tx_flusher.lock);
+
+    return NULL;
+}
+
+static int tx_flusher_start(void) {
+    pthread_condattr_t attr;
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    (void)pthread_mutex_lock(&tx_flusher.lock);
+    if (tx_flusher.running)
+        goto ocii_unlock;
+
+    /**
+     * Deadlines come from ocii_time_us, so the wait uses the same clock
+     */
+    if (pthread_condattr_init(&attr) != 0) {
+        error_code = OCII_ERROR_THREAD;
+        goto ocii_unlock;
+    }
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&tx_flusher.cond, &attr) != 0) {
+        (void)pthread_condattr_destroy(&attr);
+        error_code = OCII_ERROR_THREAD;
+        goto ocii_unlock;
+    }
+    (void)pthread_condattr_destroy(&attr);
+
+    tx_flusher.running = 1;
+    if (pthread_create(&tx_flusher.thread, NULL, tx_flusher_main, NULL) != 0) {
+        tx_flusher.running = 0;
+        (void)pthread_cond_destroy(&tx_flusher.cond);
+        error_code = OCII_ERROR_THREAD;
+    }
+ocii_unlock:
+    (void)pthread_mutex_unlock(&tx_flusher.lock);
+    return error_code;
+}
+
+static void tx_flusher_stop(void) {
+    (void)pthread_mutex_lock(&tx_flusher.lock);
+    if (!tx_flusher.running) {
+        (void)pthread_mutex_unlock(&tx_flusher.lock);
+        return;
+    }
+    tx_flusher.running = 0;
+    (void)pthread_cond_signal(&tx_flusher.cond);
+    (void)pthread_mutex_unlock(&tx_flusher.lock);
+
+    (void)pthread_join(tx_flusher.thread, NULL);
+    (void)pthread_cond_destroy(&tx_flusher.cond);
+}
+
+static void tx_flusher_kick(void) {
+    (void)pthread_mutex_lock(&tx_flusher.lock);
+    tx_flusher.kick = 1;
+    (void)pthread_cond_signal(&tx_flusher.cond);
+    (void)pthread_mutex_unlock(&tx_flusher.lock);
+}
+
+extern int ocii_write(ocii_channel_t channel, ocii_packet_t *message) {
+    ocii_packet_t *queue;
+    int error_code = OCII_ERROR_NO_ERROR, count, first;
+
     if (message == NULL)
         return OCII_ERROR_NULL_PTR;
 
-    endpoint = OCII_CHANNEL_TO_COMMAND_EP[mod(channel) % ocii_channel_sizeof];
-    if ((error_code = ocii_transaction(endpoint, &req, &rsp)) !=
-        OCII_ERROR_NO_ERROR)
-        return error_code;
+    channel = mod(channel) % ocii_channel_sizeof;
+    queue = &tx_combine[channel].packet;
+
+    (void)pthread_mutex_lock(&tx_combine[channel].lock);
+    if (tx_combine[channel].deadline_us == 0) {
+        (void)pthread_mutex_unlock(&tx_combine[channel].lock);
+        return ocii_write_packet(channel, message);
+    }
 
-    if (rsp.rx_pending == 0)
-        return OCII_ERROR_BUFFER_EMPTY;
+    if ((error_code = tx_combine[channel].error) != OCII_ERROR_NO_ERROR) {
+        tx_combine[channel].error = OCII_ERROR_NO_ERROR;
+        goto ocii_unlock;
+    }
+
+    count = message->count < sizeof_arr(message->message)
+                ? message->count
+                : (int)sizeof_arr(message->message);
+
+    /**
+     * Make room first, nothing of this packet is queued if that fails
+     */
+    if (queue->count + count > (int)sizeof_arr(queue->message) &&
+        (error_code = tx_combine_flush(channel)) != OCII_ERROR_NO_ERROR)
+        goto ocii_unlock;
+
+    first = queue->count == 0;
+    for (int i = 0; i < count; i++)
+        queue->message[queue->count++] = message->message[i];
+
+    if (first) {
+        tx_combine[channel].deadline =
+            ocii_time_us() + tx_combine[channel].deadline_us;
+        tx_flusher_kick();
+    }
 
-    endpoint = OCII_CHANNEL_TO_MESSAGE_EP[mod(channel) % ocii_channel_sizeof];
-    if ((error_code = ocii_transaction(endpoint, NULL, message)) !=
-        OCII_ERROR_NO_ERROR)
+    /**
+     * The messages are accepted, a full or removed device only delays them
+     */
+    if (queue->count == sizeof_arr(queue->message) &&
+        ((error_code = tx_combine_flush(channel)) ==
+             OCII_ERROR_BUFFER_OVERFLOW ||
+         error_code == OCII_ERROR_NO_DEVICE))
+        error_code = OCII_ERROR_NO_ERROR;
+ocii_unlock:
+    (void)pthread_mutex_unlock(&tx_combine[channel].lock);
+    return error_code;
+}
+
+extern int ocii_set_write_combining(ocii_channel_t channel,
+                                    uint32_t deadline_us) {
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    channel = mod(channel) % ocii_channel_sizeof;
+
+    if (deadline_us != 0 &&
+        (error_code = tx_flusher_start()) != OCII_ERROR_NO_ERROR)
         return error_code;
 
-    return OCII_ERROR_NO_ERROR;
+    (void)pthread_mutex_lock(&tx_combine[channel].lock);
+    if (deadline_us == 0 &&
+        (error_code = tx_combine_flush(channel)) != OCII_ERROR_NO_ERROR)
+        goto ocii_unlock;
+
+    tx_combine[channel].deadline_us = deadline_us;
+ocii_unlock:
+    (void)pthread_mutex_unlock(&tx_combine[channel].lock);
+    return error_code;
 }
 
-extern int ocii_get_status(ocii_channel_t channel, ocii_packet_t *status) {
-    uint8_t endpoint =
-        OCII_CHANNEL_TO_COMMAND_EP[mod(channel) % ocii_channel_sizeof];
-    ocii_packet_t req = {.command = OCII_COMMAND_CAN_STATUS};
+extern int ocii_write_flush(ocii_channel_t channel) {
+    int error_code;
 
-    if (status == NULL)
-        return OCII_ERROR_NULL_PTR;
+    channel = mod(channel) % ocii_channel_sizeof;
 
-    status->command = OCII_COMMAND_CAN_STATUS;
+    (void)pthread_mutex_lock(&tx_combine[channel].lock);
+    if ((error_code = tx_combine[channel].error) != OCII_ERROR_NO_ERROR)
+        tx_combine[channel].error = OCII_ERROR_NO_ERROR;
+    else
+        error_code = tx_combine_flush(channel);
+    (void)pthread_mutex_unlock(&tx_combine[channel].lock);
 
-    return ocii_transaction(endpoint, &req, status);
+    return error_code;
+}
+
+static uint64_t load_u64(const uint8_t *data) {
+    uint64_t value;
+
+    memcpy(&value, data, sizeof(value));
+
+    return value;
+}
+
+/**
+ * Hands a received message to the first ocii_transact caller it matches and
+ * wakes that caller. Returns non-zero if the message was taken
+ */
+static int transact_match(int channel, const ocii_message_t *message) {
+    int taken = 0;
+
+    (void)pthread_mutex_lock(&transact.lock);
+    for (int i = 0; i < OCII_TRANSACT_MAX && !taken; i++) {
+        const ocii_match_t *match = transact.slot[i].match;
+
+        if (!transact.slot[i].in_use || transact.slot[i].done ||
+            transact.slot[i].channel != channel ||
+            message->extended != match->extended ||
+            ((message->can_id ^ match->can_id) & match->id_mask) != 0 ||
+            ((load_u64(message->data) ^ load_u64(match->data)) &
+             load_u64(match->data_mask)) != 0)
+            continue;
+
+        *transact.slot[i].response = *message;
+        transact.slot[i].done = 1;
+        (void)pthread_cond_signal(&transact.slot[i].cond);
+        taken = 1;
+    }
+    (void)pthread_mutex_unlock(&transact.lock);
+
+    return taken;
+}
+
+/**
+ * Runs the RX hooks over a received packet and compacts it in place, so that
+ * only the messages nobody consumed are left. Returns the remaining count
+ */
+static int ocii_rx_dispatch(ocii_channel_t channel, ocii_packet_t *message) {
+    int count = 0;
+
+    if (message->count > sizeof_arr(message->message))
+        message->count = sizeof_arr(message->message);
+
+    (void)pthread_rwlock_rdlock(&rx_hooks_lock);
+    for (int i = 0; i < message->count; i++) {
+        int consumed = atomic_load(&transact.count) != 0 &&
+                       transact_match(channel, &message->message[i]);
+
+        for (int j = 0; j < rx_hooks_count && consumed == 0; j++)
+            consumed = rx_hooks[j].hook(rx_hooks[j].user, channel,
+                                        &message->message[i]);
+
+        if (consumed == 0 && count++ != i)
+            message->message[count - 1] = message->message[i];
+    }
+    (void)pthread_rwlock_unlock(&rx_hooks_lock);
+
+    return message->count = count;
+}
+
+/**
+ * Queries the message status of a channel and reads what is pending, up to
+ * capacity packets, in one bulk transfer. The status is left in status for
+ * the TX credit. Returns the number of packets read
+ */
+static int ocii_read_packets(int channel, ocii_packet_t *packets, int capacity,
+                             ocii_packet_t *status) {
+    ocii_packet_t req = {.command = OCII_COMMAND_MESSAGE_STATUS};
+    int32_t length = 0;
+    int error_code, count;
+
+    *status = (ocii_packet_t){.command = OCII_COMMAND_MESSAGE_STATUS};
+
+    (void)pthread_mutex_lock(&io_lock[channel]);
+
+    if ((error_code = ocii_transfer(OCII_CHANNEL_TO_COMMAND_EP[channel], &req,
+                                    status)) != OCII_ERROR_NO_ERROR)
+        goto ocii_unlock;
+
+    /**
+     * rx_pending counts messages, the device sends them three per packet
+     */
+    count = (int)((status->rx_pending + sizeof_arr(packets->message) - 1) /
+                  sizeof_arr(packets->message));
+    if (count > capacity)
+        count = capacity;
+
+    if (count == 0)
+        error_code = OCII_ERROR_BUFFER_EMPTY;
+    else if ((error_code = libusb_bulk_transfer(
+                  dev_handle,
+                  OCII_CHANNEL_TO_MESSAGE_EP[channel] | OCII_USB_ENDPOINT_IN,
+                  (unsigned char *)packets, count * (int)sizeof(ocii_packet_t),
+                  &length, ocii_timeout)) != 0)
+        error_code = transfer_error(error_code);
+    else if (length == 0 || length % sizeof(ocii_packet_t) != 0)
+        error_code = OCII_ERROR_BULK_TRANSFER;
+ocii_unlock:
+    (void)pthread_mutex_unlock(&io_lock[channel]);
+
+    if (error_code != OCII_ERROR_NO_ERROR)
+        return error_code;
+
+    return length / (int)sizeof(ocii_packet_t);
+}
+
+/**
+ * Takes the oldest packet of the RX ring. The I/O thread error is reported
+ * once the ring is drained
+ */
+static int io_ring_pop(int channel, ocii_packet_t *message) {
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    if (io_channel[channel].head != io_channel[channel].tail)
+        *message = io_channel[channel]
+                       .ring[io_channel[channel].tail++ % OCII_RX_RING];
+    else if ((error_code = io_channel[channel].error) != OCII_ERROR_NO_ERROR)
+        io_channel[channel].error = OCII_ERROR_NO_ERROR;
+    else
+        error_code = OCII_ERROR_BUFFER_EMPTY;
+
+    return error_code;
+}
+
+extern int ocii_read(ocii_channel_t channel, ocii_packet_t *message) {
+    ocii_packet_t status;
+    int error_code;
+
+    if (message == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    channel = mod(channel) % ocii_channel_sizeof;
+
+    /**
+     * The ring may still hold packets after the I/O thread was stopped
+     */
+    (void)pthread_mutex_lock(&io_channel[channel].lock);
+    error_code = io_ring_pop(channel, message);
+    (void)pthread_mutex_unlock(&io_channel[channel].lock);
+
+    if (error_code != OCII_ERROR_BUFFER_EMPTY ||
+        atomic_load(&io_thread.running))
+        return error_code;
+
+    /**
+     * Packets that the RX hooks consumed entirely are not reported, keep
+     * reading until something is left for the caller or the device is empty
+     */
+    do {
+        if ((error_code = ocii_read_packets(channel, message, 1, &status)) < 0)
+            return error_code;
+    } while (ocii_rx_dispatch(channel, message) == 0);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_read_many(ocii_channel_t channel, ocii_packet_t *packets,
+                          int capacity) {
+    ocii_packet_t status;
+    int error_code = OCII_ERROR_NO_ERROR, count = 0;
+
+    if (packets == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (capacity <= 0)
+        return OCII_ERROR_INVALID_ARG;
+
+    channel = mod(channel) % ocii_channel_sizeof;
+
+    (void)pthread_mutex_lock(&io_channel[channel].lock);
+    while (count < capacity &&
+           (error_code = io_ring_pop(channel, &packets[count])) ==
+               OCII_ERROR_NO_ERROR)
+        count++;
+    (void)pthread_mutex_unlock(&io_channel[channel].lock);
+
+    if (count != 0)
+        return count;
+
+    if (error_code != OCII_ERROR_BUFFER_EMPTY ||
+        atomic_load(&io_thread.running))
+        return error_code;
+
+    /**
+     * Packets the RX hooks consumed entirely are dropped from the batch
+     */
+    do {
+        int read;
+
+        if ((read = ocii_read_packets(channel, packets, capacity, &status)) <
+            0)
+            return read;
+
+        for (int i = 0; i < read; i++)
+            if (ocii_rx_dispatch(channel, &packets[i]) != 0 && count++ != i)
+                packets[count - 1] = packets[i];
+    } while (count == 0);
+
+    return count;
+}
+
+/**
+ * Measures the sleep overshoot and sets up the condition variables on the
+ * clock of ocii_time_us
+ */
+static void io_setup(void) {
+    pthread_condattr_t attr;
+    uint64_t best = UINT64_MAX;
+
+    (void)pthread_condattr_init(&attr);
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        (void)pthread_cond_init(&io_channel[channel].rx_cond, &attr);
+        (void)pthread_cond_init(&io_channel[channel].tx_cond, &attr);
+    }
+    for (int i = 0; i < OCII_TRANSACT_MAX; i++)
+        (void)pthread_cond_init(&transact.slot[i].cond, &attr);
+    (void)pthread_condattr_destroy(&attr);
+
+    for (int i = 0; i < 5; i++) {
+        struct timespec ts = {.tv_nsec = 1000};
+        uint64_t start = ocii_time_us();
+
+        (void)nanosleep(&ts, NULL);
+        if (ocii_time_us() - start < best)
+            best = ocii_time_us() - start;
+    }
+    sleep_overshoot_us = best > 1 ? (uint32_t)best - 1 : 0;
+}
+
+typedef struct {
+    uint64_t start; /* First wait of the caller, us */
+    uint32_t step;  /* Current sleep step, us */
+} io_backoff_t;
+
+/**
+ * One wait step of a polling loop. Spins, yields or sleeps depending on the
+ * wait profile and on how long the caller has been waiting, never past the
+ * deadline
+ */
+static void io_backoff(io_backoff_t *backoff, uint64_t deadline) {
+    int profile = atomic_load(&wait_profile);
+    uint64_t now = ocii_time_us(), wake;
+    uint32_t step_max = OCII_WAIT_SLEEP_MAX_US;
+    struct timespec ts;
+
+    if (backoff->start == 0)
+        backoff->start = now;
+
+    if (profile == OCII_WAIT_SPIN)
+        return;
+
+    if (profile == OCII_WAIT_BALANCED) {
+        if (now - backoff->start < OCII_WAIT_SPIN_US)
+            return;
+        if (now - backoff->start < 4 * OCII_WAIT_SPIN_US) {
+            (void)sched_yield();
+            return;
+        }
+        step_max = OCII_WAIT_SLEEP_MAX_US / 4;
+    }
+
+    backoff->step = backoff->step == 0 ? OCII_WAIT_SPIN_US : backoff->step * 2;
+    if (backoff->step > step_max)
+        backoff->step = step_max;
+
+    /**
+     * A sleep shorter than its overshoot would miss the deadline, yield then
+     */
+    wake = now + backoff->step < deadline ? now + backoff->step : deadline;
+    if (wake <= now + sleep_overshoot_us) {
+        (void)sched_yield();
+        return;
+    }
+
+    wake -= sleep_overshoot_us;
+    ts = (struct timespec){.tv_sec = (time_t)(wake / 1000000U),
+                           .tv_nsec = (long)(wake % 1000000U) * 1000};
+    (void)clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/**
+ * Polls the CAN status of the started channels for the status hooks once the
+ * period is due. Returns the time of the next poll, UINT64_MAX if it is off
+ */
+static uint64_t io_status_poll(void) {
+    uint32_t period = atomic_load(&status_poll.period_us);
+    uint64_t now;
+
+    if (period == 0)
+        return UINT64_MAX;
+
+    if ((now = ocii_time_us()) < status_poll.next)
+        return status_poll.next;
+
+    /**
+     * Skipped periods are not made up for
+     */
+    status_poll.next = now - status_poll.next < period
+                           ? status_poll.next + period
+                           : now + period;
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        ocii_packet_t status;
+
+        if ((!atomic_load(&io_channel[channel].started) &&
+             !atomic_load(&io_channel[channel].recovering)) ||
+            ocii_get_status(channel, &status) != OCII_ERROR_NO_ERROR)
+            continue;
+
+        (void)pthread_rwlock_rdlock(&status_hooks_lock);
+        for (int i = 0; i < status_hooks_count; i++)
+            status_hooks[i].hook(status_hooks[i].user, channel, &status);
+        (void)pthread_rwlock_unlock(&status_hooks_lock);
+    }
+
+    return status_poll.next;
+}
+
+static void *io_thread_main(void *arg) {
+    io_backoff_t backoff = {0};
+
+    (void)arg;
+
+    while (atomic_load(&io_thread.running)) {
+        uint64_t status_next;
+        int active = 0;
+
+        for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+            ocii_packet_t status;
+            int error_code, room, count = 0;
+
+            if (!atomic_load(&io_channel[channel].started))
+                continue;
+
+            (void)pthread_mutex_lock(&io_channel[channel].lock);
+            room = OCII_RX_RING -
+                   (int)(io_channel[channel].head - io_channel[channel].tail);
+            (void)pthread_mutex_unlock(&io_channel[channel].lock);
+            if (room > (int)sizeof_arr(io_batch))
+                room = (int)sizeof_arr(io_batch);
+
+            /**
+             * A full ring is not read from, the device buffers in the
+             * meantime. The status query still runs for the TX credit
+             */
+            if (room == 0) {
+                ocii_packet_t req = {.command = OCII_COMMAND_MESSAGE_STATUS};
+
+                status = req;
+                error_code = ocii_transaction(
+                    OCII_CHANNEL_TO_COMMAND_EP[channel], &req, &status);
+            } else if ((error_code = ocii_read_packets(channel, io_batch, room,
+                                                       &status)) >= 0) {
+                count = error_code;
+                error_code = OCII_ERROR_NO_ERROR;
+                for (int i = 0; i < count; i++)
+                    (void)ocii_rx_dispatch(channel, &io_batch[i]);
+                active = 1;
+            }
+
+            (void)pthread_mutex_lock(&io_channel[channel].lock);
+            if (error_code == OCII_ERROR_NO_ERROR ||
+                error_code == OCII_ERROR_BUFFER_EMPTY) {
+                io_channel[channel].tx_pending = status.tx_pending;
+                if (io_channel[channel].tx_waiters != 0 &&
+                    status.tx_pending <= OCII_WRITE_BUFFER)
+                    (void)pthread_cond_broadcast(&io_channel[channel].tx_cond);
+            } else {
+                io_channel[channel].error = error_code;
+                (void)pthread_cond_broadcast(&io_channel[channel].rx_cond);
+            }
+            for (int i = 0; i < count; i++)
+                if (io_batch[i].count != 0)
+                    io_channel[channel]
+                        .ring[io_channel[channel].head++ % OCII_RX_RING] =
+                        io_batch[i];
+            if (count != 0)
+                (void)pthread_cond_broadcast(&io_channel[channel].rx_cond);
+            (void)pthread_mutex_unlock(&io_channel[channel].lock);
+        }
+
+        status_next = io_status_poll();
+
+        /**
+         * Someone waits for a response, keep polling at full rate
+         */
+        if (active || atomic_load(&transact.count) != 0)
+            backoff = (io_backoff_t){0};
+        else
+            io_backoff(&backoff, status_next);
+    }
+
+    return NULL;
+}
+
+extern int ocii_start_io_thread(void) {
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    /**
+     * The ring indexes wrap around, so the size must divide 2^32
+     */
+    static_assert((OCII_RX_RING & (OCII_RX_RING - 1)) == 0);
+
+    (void)pthread_once(&io_once, io_setup);
+
+    (void)pthread_mutex_lock(&io_thread.lock);
+    if (atomic_load(&io_thread.running))
+        goto ocii_unlock;
+
+    atomic_store(&io_thread.running, 1);
+    if (pthread_create(&io_thread.thread, NULL, io_thread_main, NULL) != 0) {
+        atomic_store(&io_thread.running, 0);
+        error_code = OCII_ERROR_THREAD;
+    }
+ocii_unlock:
+    (void)pthread_mutex_unlock(&io_thread.lock);
+    return error_code;
+}
+
+extern int ocii_stop_io_thread(void) {
+    (void)pthread_mutex_lock(&io_thread.lock);
+    if (!atomic_load(&io_thread.running)) {
+        (void)pthread_mutex_unlock(&io_thread.lock);
+        return OCII_ERROR_NO_ERROR;
+    }
+
+    atomic_store(&io_thread.running, 0);
+    (void)pthread_join(io_thread.thread, NULL);
+
+    /**
+     * Wake the blocked callers, they fall back to polling
+     */
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        (void)pthread_mutex_lock(&io_channel[channel].lock);
+        (void)pthread_cond_broadcast(&io_channel[channel].rx_cond);
+        (void)pthread_cond_broadcast(&io_channel[channel].tx_cond);
+        (void)pthread_mutex_unlock(&io_channel[channel].lock);
+    }
+    (void)pthread_mutex_unlock(&io_thread.lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+static int device_serial(libusb_device_handle *handle, char *serial,
+                         int size) {
+    struct libusb_device_descriptor descriptor;
+
+    serial[0] = '\0';
+    if (libusb_get_device_descriptor(libusb_get_device(handle), &descriptor) !=
+            0 ||
+        descriptor.iSerialNumber == 0 ||
+        libusb_get_string_descriptor_ascii(handle, descriptor.iSerialNumber,
+                                           (unsigned char *)serial, size) < 0)
+        serial[0] = '\0';
+
+    return serial[0] != '\0';
+}
+
+static int LIBUSB_CALL reconnect_hotplug(libusb_context *ctx,
+                                         libusb_device *device,
+                                         libusb_hotplug_event event,
+                                         void *user) {
+    (void)ctx;
+    (void)user;
+
+    /**
+     * Arrivals only wake the reconnect thread up, it looks for the adapter
+     * itself
+     */
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT && device == reconnect.device)
+        device_lost();
+
+    return 0;
+}
+
+static void reconnect_report(const ocii_reconnect_event_t *event) {
+    if (reconnect.hook != NULL)
+        reconnect.hook(reconnect.user, event);
+}
+
+/**
+ * Frees the handle of the removed adapter. The channel locks keep it from
+ * being freed under a transfer
+ */
+static void reconnect_drop(void) {
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        (void)pthread_mutex_lock(&io_lock[channel]);
+    (void)libusb_release_interface(dev_handle, 0);
+    libusb_close(dev_handle);
+    dev_handle = NULL;
+    reconnect.device = NULL;
+    for (int channel = ocii_channel_sizeof - 1; channel >= 0; channel--)
+        (void)pthread_mutex_unlock(&io_lock[channel]);
+
+    reconnect_report(&(ocii_reconnect_event_t){
+        .event = OCII_RECONNECT_REMOVED,
+        .removed_us = atomic_load(&device_removed_us)});
+}
+
+/**
+ * Opens the adapter on its old port, or one with its serial number
+ */
+static libusb_device_handle *reconnect_find(void) {
+    libusb_device_handle *found = NULL;
+    libusb_device **list;
+    ssize_t count;
+
+    if ((count = libusb_get_device_list(usb_ctx, &list)) < 0)
+        return NULL;
+
+    for (ssize_t i = 0; i < count && found == NULL; i++) {
+        struct libusb_device_descriptor descriptor;
+        libusb_device_handle *handle;
+        uint8_t path[sizeof_arr(reconnect.path)];
+        char serial[sizeof_arr(reconnect.serial)];
+        int same_port;
+
+        if (libusb_get_device_descriptor(list[i], &descriptor) != 0 ||
+            descriptor.idVendor != OCII_USB_ID_VENDOR ||
+            descriptor.idProduct != OCII_USB_ID_PRODUCT)
+            continue;
+
+        same_port =
+            device_path(list[i], path, (int)sizeof(path)) ==
+                reconnect.path_length &&
+            memcmp(path, reconnect.path, (size_t)reconnect.path_length) == 0;
+        if ((!same_port && reconnect.serial[0] == '\0') ||
+            libusb_open(list[i], &handle) != 0)
+            continue;
+
+        if (same_port ||
+            (device_serial(handle, serial, (int)sizeof(serial)) &&
+             strcmp(serial, reconnect.serial) == 0))
+            found = handle;
+        else
+            libusb_close(handle);
+    }
+    libusb_free_device_list(list, 1);
+
+    return found;
+}
+
+/**
+ * Reopens the adapter and replays the channel configuration
+ */
+static void reconnect_resume(void) {
+    ocii_reconnect_event_t event = {.event = OCII_RECONNECT_RESUMED};
+    libusb_device_handle *handle;
+
+    if ((handle = reconnect_find()) == NULL)
+        return;
+    event.arrived_us = ocii_time_us();
+
+    if (device_claim(handle) != OCII_ERROR_NO_ERROR) {
+        libusb_close(handle);
+        return;
+    }
+
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++)
+        (void)pthread_mutex_lock(&io_lock[channel]);
+    dev_handle = handle;
+    reconnect.device = libusb_get_device(handle);
+    event.removed_us = atomic_load(&device_removed_us);
+    atomic_store(&device_gone, 0);
+    for (int channel = ocii_channel_sizeof - 1; channel >= 0; channel--)
+        (void)pthread_mutex_unlock(&io_lock[channel]);
+
+    /**
+     * The adapter lost its state with the power, the channels are set up as
+     * the caller left them
+     */
+    for (int channel = 0; channel < ocii_channel_sizeof &&
+                          event.error_code == OCII_ERROR_NO_ERROR;
+         channel++) {
+        ocii_packet_t init;
+
+        if (ocii_get_config(channel, &init) != OCII_ERROR_NO_ERROR)
+            continue;
+        if ((event.error_code = ocii_init(channel, &init)) ==
+                OCII_ERROR_NO_ERROR &&
+            (atomic_load(&io_channel[channel].started) ||
+             atomic_load(&io_channel[channel].recovering)))
+            event.error_code = ocii_start(channel);
+    }
+
+    /**
+     * Messages kept by write combining go out right away
+     */
+    for (int channel = 0; channel < ocii_channel_sizeof; channel++) {
+        (void)pthread_mutex_lock(&tx_combine[channel].lock);
+        tx_combine[channel].deadline = 0;
+        (void)pthread_mutex_unlock(&tx_combine[channel].lock);
+    }
+    (void)pthread_mutex_lock(&tx_flusher.lock);
+    if (tx_flusher.running) {
+        tx_flusher.kick = 1;
+        (void)pthread_cond_signal(&tx_flusher.cond);
+    }
+    (void)pthread_mutex_unlock(&tx_flusher.lock);
+
+    event.resumed_us = ocii_time_us();
+    reconnect_report(&event);
+}
+
+static void *reconnect_main(void *arg) {
+    (void)arg;
+
+    while (atomic_load(&reconnect.running)) {
+        if (reconnect.hotplug_active) {
+            struct timeval tv = {.tv_usec = OCII_RECONNECT_POLL_MS * 1000};
+
+            (void)libusb_handle_events_timeout_completed(usb_ctx, &tv, NULL);
+        } else {
+            struct timespec ts = {.tv_nsec = OCII_RECONNECT_POLL_MS *
+                                             1000000L};
+
+            (void)nanosleep(&ts, NULL);
+        }
+
+        if (!atomic_load(&device_gone))
+            continue;
+        if (dev_handle != NULL)
+            reconnect_drop();
+        reconnect_resume();
+    }
+
+    return NULL;
+}
+
+extern int ocii_start_reconnect(ocii_reconnect_hook_t hook, void *user) {
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    (void)pthread_mutex_lock(&reconnect.lock);
+    if (atomic_load(&reconnect.running))
+        goto ocii_unlock;
+
+    if (dev_handle == NULL) {
+        error_code = OCII_ERROR_NULL_PTR;
+        goto ocii_unlock;
+    }
+
+    reconnect.hook = hook;
+    reconnect.user = user;
+    reconnect.device = libusb_get_device(dev_handle);
+    reconnect.path_length = device_path(reconnect.device, reconnect.path,
+                                        (int)sizeof(reconnect.path));
+    (void)device_serial(dev_handle, reconnect.serial,
+                        (int)sizeof(reconnect.serial));
+
+    /**
+     * Without hotplug support, removals show as failed transfers and the
+     * thread polls for the arrival
+     */
+    reconnect.hotplug_active =
+        libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) &&
+        libusb_hotplug_register_callback(
+            usb_ctx,
+            LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+            0, OCII_USB_ID_VENDOR, OCII_USB_ID_PRODUCT,
+            LIBUSB_HOTPLUG_MATCH_ANY, reconnect_hotplug, NULL,
+            &reconnect.hotplug) == LIBUSB_SUCCESS;
+
+    atomic_store(&reconnect.running, 1);
+    if (pthread_create(&reconnect.thread, NULL, reconnect_main, NULL) != 0) {
+        atomic_store(&reconnect.running, 0);
+        if (reconnect.hotplug_active)
+            libusb_hotplug_deregister_callback(usb_ctx, reconnect.hotplug);
+        error_code = OCII_ERROR_THREAD;
+    }
+ocii_unlock:
+    (void)pthread_mutex_unlock(&reconnect.lock);
+    return error_code;
+}
+
+extern int ocii_stop_reconnect(void) {
+    (void)pthread_mutex_lock(&reconnect.lock);
+    if (!atomic_load(&reconnect.running)) {
+        (void)pthread_mutex_unlock(&reconnect.lock);
+        return OCII_ERROR_NO_ERROR;
+    }
+
+    atomic_store(&reconnect.running, 0);
+    if (reconnect.hotplug_active)
+        libusb_hotplug_deregister_callback(usb_ctx, reconnect.hotplug);
+    (void)pthread_join(reconnect.thread, NULL);
+    reconnect.hotplug_active = 0;
+    (void)pthread_mutex_unlock(&reconnect.lock);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_set_wait_profile(ocii_wait_profile_t profile) {
+    if ((unsigned)profile > OCII_WAIT_SLEEP)
+        return OCII_ERROR_INVALID_ARG;
+
+    atomic_store(&wait_profile, profile);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+/**
+ * Waits on a condition variable of a channel until the deadline, its lock
+ * must be held. Returns non-zero once the deadline has passed
+ */
+static int io_cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock,
+                        uint64_t deadline) {
+    struct timespec ts;
+
+    if (deadline == UINT64_MAX) {
+        (void)pthread_cond_wait(cond, lock);
+        return 0;
+    }
+
+    if (ocii_time_us() >= deadline)
+        return 1;
+
+    ts = (struct timespec){.tv_sec = (time_t)(deadline / 1000000U),
+                           .tv_nsec = (long)(deadline % 1000000U) * 1000};
+    (void)pthread_cond_timedwait(cond, lock, &ts);
+
+    return 0;
+}
+
+extern int ocii_read_wait(ocii_channel_t channel, ocii_packet_t *message,
+                          uint64_t deadline_us) {
+    io_backoff_t backoff = {0};
+    int error_code;
+
+    if (message == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    channel = mod(channel) % ocii_channel_sizeof;
+    (void)pthread_once(&io_once, io_setup);
+
+    for (;;) {
+        if (atomic_load(&io_thread.running)) {
+            (void)pthread_mutex_lock(&io_channel[channel].lock);
+            while ((error_code = io_ring_pop(channel, message)) ==
+                       OCII_ERROR_BUFFER_EMPTY &&
+                   atomic_load(&io_thread.running) &&
+                   !io_cond_wait(&io_channel[channel].rx_cond,
+                                 &io_channel[channel].lock, deadline_us))
+                ;
+            (void)pthread_mutex_unlock(&io_channel[channel].lock);
+        } else
+            error_code = ocii_read(channel, message);
+
+        if (error_code != OCII_ERROR_BUFFER_EMPTY)
+            return error_code;
+        if (ocii_time_us() >= deadline_us)
+            return OCII_ERROR_TIMEOUT;
+
+        /**
+         * No I/O thread to wait for, poll the device
+         */
+        if (!atomic_load(&io_thread.running))
+            io_backoff(&backoff, deadline_us);
+    }
+}
+
+extern int ocii_write_wait(ocii_channel_t channel, ocii_packet_t *message,
+                           uint64_t deadline_us) {
+    io_backoff_t backoff = {0};
+    int error_code;
+
+    if (message == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    channel = mod(channel) % ocii_channel_sizeof;
+    (void)pthread_once(&io_once, io_setup);
+
+    while ((error_code = ocii_write(channel, message)) ==
+           OCII_ERROR_BUFFER_OVERFLOW) {
+        if (ocii_time_us() >= deadline_us)
+            return OCII_ERROR_TIMEOUT;
+
+        if (!atomic_load(&io_thread.running)) {
+            io_backoff(&backoff, deadline_us);
+            continue;
+        }
+
+        /**
+         * The I/O thread signals once its status query sees room again
+         */
+        (void)pthread_mutex_lock(&io_channel[channel].lock);
+        io_channel[channel].tx_waiters++;
+        while (io_channel[channel].tx_pending > OCII_WRITE_BUFFER &&
+               atomic_load(&io_thread.running) &&
+               !io_cond_wait(&io_channel[channel].tx_cond,
+                             &io_channel[channel].lock, deadline_us))
+            ;
+        io_channel[channel].tx_waiters--;
+        (void)pthread_mutex_unlock(&io_channel[channel].lock);
+    }
+
+    return error_code;
+}
+
+/**
+ * Polls the device on behalf of an ocii_transact caller when there is no I/O
+ * thread. Messages that are not the response go to the RX ring, where
+ * ocii_read finds them. Returns the number of packets read, or
+ * OCII_ERROR_BUFFER_OVERFLOW while the ring is full, as the device cannot be
+ * read then and the response would never be seen
+ */
+static int transact_poll(int channel) {
+    ocii_packet_t packets[8], status;
+    int room, count;
+
+    (void)pthread_mutex_lock(&io_channel[channel].lock);
+    room = OCII_RX_RING -
+           (int)(io_channel[channel].head - io_channel[channel].tail);
+    (void)pthread_mutex_unlock(&io_channel[channel].lock);
+    if (room > (int)sizeof_arr(packets))
+        room = (int)sizeof_arr(packets);
+
+    if (room == 0)
+        return OCII_ERROR_BUFFER_OVERFLOW;
+
+    if ((count = ocii_read_packets(channel, packets, room, &status)) < 0)
+        return count;
+
+    for (int i = 0; i < count; i++)
+        (void)ocii_rx_dispatch(channel, &packets[i]);
+
+    (void)pthread_mutex_lock(&io_channel[channel].lock);
+    for (int i = 0; i < count; i++)
+        if (packets[i].count != 0)
+            io_channel[channel]
+                .ring[io_channel[channel].head++ % OCII_RX_RING] = packets[i];
+    (void)pthread_cond_broadcast(&io_channel[channel].rx_cond);
+    (void)pthread_mutex_unlock(&io_channel[channel].lock);
+
+    return count;
+}
+
+extern int ocii_transact(ocii_channel_t channel, const ocii_message_t *request,
+                         const ocii_match_t *match, ocii_message_t *response,
+                         uint64_t deadline_us) {
+    ocii_packet_t packet = {.count = 1};
+    io_backoff_t backoff = {0};
+    int error_code, slot, done = 0;
+
+    if (request == NULL || match == NULL || response == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    if (request->data_len > sizeof(request->data))
+        return OCII_ERROR_INVALID_ARG;
+
+    channel = mod(channel) % ocii_channel_sizeof;
+    (void)pthread_once(&io_once, io_setup);
+
+    /**
+     * The slot is taken before sending, a fast response cannot slip by
+     */
+    (void)pthread_mutex_lock(&transact.lock);
+    for (slot = 0; slot < OCII_TRANSACT_MAX; slot++)
+        if (!transact.slot[slot].in_use)
+            break;
+    if (slot == OCII_TRANSACT_MAX) {
+        (void)pthread_mutex_unlock(&transact.lock);
+        return OCII_ERROR_NO_SLOT;
+    }
+    transact.slot[slot].match = match;
+    transact.slot[slot].response = response;
+    transact.slot[slot].channel = channel;
+    transact.slot[slot].in_use = 1;
+    transact.slot[slot].done = 0;
+    atomic_fetch_add(&transact.count, 1);
+    (void)pthread_mutex_unlock(&transact.lock);
+
+    /**
+     * Queued write combining messages go first to keep the order on the bus,
+     * the request itself bypasses the queue
+     */
+    packet.message[0] = *request;
+    while ((error_code = ocii_write_flush(channel)) ==
+               OCII_ERROR_BUFFER_OVERFLOW ||
+           (error_code == OCII_ERROR_NO_ERROR &&
+            (error_code = ocii_write_packet(channel, &packet)) ==
+                OCII_ERROR_BUFFER_OVERFLOW)) {
+        if (ocii_time_us() >= deadline_us) {
+            error_code = OCII_ERROR_TIMEOUT;
+            break;
+        }
+        io_backoff(&backoff, deadline_us);
+    }
+
+    backoff = (io_backoff_t){0};
+    while (error_code == OCII_ERROR_NO_ERROR) {
+        if (atomic_load(&io_thread.running)) {
+            (void)pthread_mutex_lock(&transact.lock);
+            while (!(done = transact.slot[slot].done) &&
+                   atomic_load(&io_thread.running) &&
+                   !io_cond_wait(&transact.slot[slot].cond, &transact.lock,
+                                 deadline_us))
+                ;
+            (void)pthread_mutex_unlock(&transact.lock);
+        } else {
+            int count = transact_poll(channel);
+
+            if (count < 0 && count != OCII_ERROR_BUFFER_EMPTY) {
+                error_code = count;
+                break;
+            }
+
+            (void)pthread_mutex_lock(&transact.lock);
+            done = transact.slot[slot].done;
+            (void)pthread_mutex_unlock(&transact.lock);
+
+            if (count > 0)
+                backoff = (io_backoff_t){0};
+            else if (!done && ocii_time_us() < deadline_us)
+                io_backoff(&backoff, deadline_us);
+        }
+
+        if (done)
+            break;
+        if (ocii_time_us() >= deadline_us)
+            error_code = OCII_ERROR_TIMEOUT;
+    }
+
+    (void)pthread_mutex_lock(&transact.lock);
+    transact.slot[slot].in_use = 0;
+    atomic_fetch_sub(&transact.count, 1);
+    (void)pthread_mutex_unlock(&transact.lock);
+
+    return error_code;
+}
+
+extern int ocii_get_status(ocii_channel_t channel, ocii_packet_t *status) {
+    uint8_t endpoint =
+        OCII_CHANNEL_TO_COMMAND_EP[mod(channel) % ocii_channel_sizeof];
+    ocii_packet_t req = {.command = OCII_COMMAND_CAN_STATUS};
+
+    if (status == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    status->command = OCII_COMMAND_CAN_STATUS;
+
+    return ocii_transaction(endpoint, &req, status);
+}
+
+extern int ocii_add_rx_hook(ocii_rx_hook_t hook, void *user) {
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    if (hook == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_rwlock_wrlock(&rx_hooks_lock);
+    if (rx_hooks_count < OCII_RX_HOOKS_MAX) {
+        rx_hooks[rx_hooks_count].hook = hook;
+        rx_hooks[rx_hooks_count].user = user;
+        rx_hooks_count++;
+    } else
+        error_code = OCII_ERROR_NO_SLOT;
+    (void)pthread_rwlock_unlock(&rx_hooks_lock);
+
+    return error_code;
+}
+
+extern int ocii_remove_rx_hook(ocii_rx_hook_t hook, void *user) {
+    int error_code = OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_rwlock_wrlock(&rx_hooks_lock);
+    for (int i = 0; i < rx_hooks_count; i++) {
+        if (rx_hooks[i].hook != hook || rx_hooks[i].user != user)
+            continue;
+
+        for (rx_hooks_count--; i < rx_hooks_count; i++)
+            rx_hooks[i] = rx_hooks[i + 1];
+        error_code = OCII_ERROR_NO_ERROR;
+        break;
+    }
+    (void)pthread_rwlock_unlock(&rx_hooks_lock);
+
+    return error_code;
+}
+
+extern int ocii_set_status_period(uint32_t period_ms) {
+    if (period_ms > UINT32_MAX / 1000U)
+        return OCII_ERROR_INVALID_ARG;
+
+    atomic_store(&status_poll.period_us, period_ms * 1000U);
+
+    return OCII_ERROR_NO_ERROR;
+}
+
+extern int ocii_add_status_hook(ocii_status_hook_t hook, void *user) {
+    int error_code = OCII_ERROR_NO_ERROR;
+
+    if (hook == NULL)
+        return OCII_ERROR_NULL_PTR;
+
+    (void)pthread_rwlock_wrlock(&status_hooks_lock);
+    if (status_hooks_count < OCII_STATUS_HOOKS_MAX) {
+        status_hooks[status_hooks_count].hook = hook;
+        status_hooks[status_hooks_count].user = user;
+        status_hooks_count++;
+    } else
+        error_code = OCII_ERROR_NO_SLOT;
+    (void)pthread_rwlock_unlock(&status_hooks_lock);
+
+    return error_code;
+}
+
+extern int ocii_remove_status_hook(ocii_status_hook_t hook, void *user) {
+    int error_code = OCII_ERROR_INVALID_ARG;
+
+    (void)pthread_rwlock_wrlock(&status_hooks_lock);
+    for (int i = 0; i < status_hooks_count; i++) {
+        if (status_hooks[i].hook != hook || status_hooks[i].user != user)
+            continue;
+
+        for (status_hooks_count--; i < status_hooks_count; i++)
+            status_hooks[i] = status_hooks[i + 1];
+        error_code = OCII_ERROR_NO_ERROR;
+        break;
+    }
+    (void)pthread_rwlock_unlock(&status_hooks_lock);
+
+    return error_code;
+}
+
+extern uint64_t ocii_time_us(void) {
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U;
 }
 
 extern const char *ocii_error_code_to_string(int error_code) {
@@ -269,7 +1948,31 @@ extern const char *ocii_error_code_to_string(int error_code) {
         [mod(OCII_ERROR_BUFFER_OVERFLOW)] = /* */
         "TX buffer has overflowed",
         [mod(OCII_ERROR_BUFFER_EMPTY)] = /* */
-        "RX buffer is empty"};
+        "RX buffer is empty",
+        [mod(OCII_ERROR_TIMEOUT)] = /* */
+        "Operation did not complete before its deadline",
+        [mod(OCII_ERROR_NO_SLOT)] = /* */
+        "No free slot is left in a fixed-size table",
+        [mod(OCII_ERROR_INVALID_ARG)] = /* */
+        "Invalid argument was passed",
+        [mod(OCII_ERROR_SDO_ABORT)] = /* */
+        "Remote node aborted the SDO transfer",
+        [mod(OCII_ERROR_PARSE)] = /* */
+        "Input could not be parsed",
+        [mod(OCII_ERROR_NO_MEMORY)] = /* */
+        "Memory allocation failed",
+        [mod(OCII_ERROR_FILE)] = /* */
+        "File could not be opened or read",
+        [mod(OCII_ERROR_THREAD)] = /* */
+        "Library thread could not be started",
+        [mod(OCII_ERROR_TX_LOST)] = /* */
+        "Sent message was not echoed while a later one was",
+        [mod(OCII_ERROR_SOCKET)] = /* */
+        "Socket could not be opened, sent to or read from",
+        [mod(OCII_ERROR_NOT_CONFIGURED)] = /* */
+        "Channel has not been initialized with ocii_init",
+        [mod(OCII_ERROR_NO_DEVICE)] = /* */
+        "Device was removed and has not been reconnected"};
 
     if ((error_code = mod(error_code)) < sizeof_arr(error_message))
         return error_message[error_code];
@@ -0,0 +1,929 @@
+/**
+ * OpenCanalystII - Unofficial userspace C driver for the Canalyst-II USB-CAN
+ * analyzer hardware
+ *
+ * DBC code generator, turns a DBC file into a header with per-message pack
+ * and unpack functions whose bit positions are compile-time constants
+ *
+ * Usage: ocii_dbcgen [-x] [-p prefix] input.dbc [output]
+ *
+ *   -x         Emit C++14 (constexpr field templates in a namespace) instead
+ *              of C
+ *   -p prefix  Prefix of the generated identifiers, the DBC file name without
+ *              its extension by default
+ *
+ * The output is written to stdout if no output file is given
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <ocii_dbc.h>
+#include <opencanalystii.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+uint32_t ocii_timeout = 1000U; /* It is necessary to define extern value */
+
+#define GEN_NAME (OCII_DBC_NAME * 2)
+#define GEN_EXPR 256
+
+typedef struct {
+    const ocii_dbc_t *db;
+    FILE *out;
+    const char *source;
+    char prefix[GEN_NAME]; /* Lower case, for functions and types */
+    char macro[GEN_NAME];  /* Upper case, for defines */
+    const char *indent;    /* Of statements in function bodies */
+    int cpp;
+} gen_t;
+
+/**
+ * Where the raw bits of a signal live, in the little endian (le) or the big
+ * endian (be) 64-bit payload word
+ */
+typedef struct {
+    const char *word;
+    unsigned shift;
+    unsigned length;
+    unsigned long long mask;
+    unsigned long long sign;
+} gen_field_t;
+
+/**
+ * Turns DBC names into snake case identifiers, EngineSpeed becomes
+ * engine_speed or ENGINE_SPEED
+ */
+static void gen_case(char *dst, const char *src, size_t size, int upper) {
+    size_t n = 0;
+
+    for (size_t i = 0; src[i] != '\0' && n + 2 < size; i++) {
+        unsigned char c = (unsigned char)src[i];
+
+        if (i > 0 && isupper(c) &&
+            (islower((unsigned char)src[i - 1]) ||
+             isdigit((unsigned char)src[i - 1])))
+            dst[n++] = '_';
+        dst[n++] = isalnum(c) ? (char)(upper ? toupper(c) : tolower(c)) : '_';
+    }
+    dst[n] = '\0';
+}
+
+static gen_field_t gen_field(const ocii_dbc_t *db, uint32_t s) {
+    const ocii_dbc_step_t *step = &db->step[s];
+    const ocii_dbc_signal_t *signal = &db->signal[s];
+    int bytes = step->kind == ocii_dbc_step_u8 ||
+                step->kind == ocii_dbc_step_u16 ||
+                step->kind == ocii_dbc_step_u32;
+
+    return (gen_field_t){.word = step->word ? "be" : "le",
+                         .shift = bytes ? step->shift * 8U : step->shift,
+                         .length = signal->length,
+                         .mask = step->mask,
+                         .sign = step->sign};
+}
+
+static const char *gen_suffix(unsigned long long value) {
+    return value > 0xFFFFFFFFULL ? "ULL" : "U";
+}
+
+/**
+ * Prints the shortest literal that reads back as the same double
+ */
+static void gen_double(char *buf, size_t size, double value) {
+    for (int precision = 1; precision <= 17; precision++) {
+        (void)snprintf(buf, size, "%.*g", precision, value);
+        if (strchr(buf, 'e') != NULL && value < 1e15 && value >= 1e-4)
+            continue;
+        if (strtod(buf, NULL) == value)
+            break;
+    }
+    if (strpbrk(buf, ".eEni") == NULL)
+        (void)strncat(buf, ".0", size - strlen(buf) - 1);
+}
+
+static int gen_scaled(const ocii_dbc_signal_t *signal) {
+    return signal->factor != 1.0 || signal->offset != 0.0;
+}
+
+static const char *gen_type(const ocii_dbc_signal_t *signal) {
+    static const char *types[2][4] = {
+        {"uint8_t", "uint16_t", "uint32_t", "uint64_t"},
+        {"int8_t", "int16_t", "int32_t", "int64_t"}};
+
+    if (signal->value_type == ocii_dbc_float32 && signal->length == 32 &&
+        !gen_scaled(signal))
+        return "float";
+    if (signal->value_type != ocii_dbc_integer || gen_scaled(signal))
+        return "double";
+
+    return types[signal->is_signed != 0][signal->length <= 8    ? 0
+                                         : signal->length <= 16 ? 1
+                                         : signal->length <= 32 ? 2
+                                                                : 3];
+}
+
+/**
+ * Expression of the unsigned raw bits, e.g. ((le >> 24) & 0xFFFU), C++ goes
+ * through the field template of the signal
+ */
+static void gen_raw(const gen_t *gen, char *buf, size_t size,
+                    const gen_field_t *field, const char *name) {
+    if (gen->cpp)
+        (void)snprintf(buf, size, "%s_field::raw(le, be)", name);
+    else if (field->shift == 0 && field->length == 64)
+        (void)snprintf(buf, size, "%s", field->word);
+    else if (field->shift + field->length == 64)
+        (void)snprintf(buf, size, "(%s >> %u)", field->word, field->shift);
+    else if (field->shift == 0)
+        (void)snprintf(buf, size, "(%s & 0x%llX%s)", field->word, field->mask,
+                       gen_suffix(field->mask));
+    else
+        (void)snprintf(buf, size, "((%s >> %u) & 0x%llX%s)", field->word,
+                       field->shift, field->mask, gen_suffix(field->mask));
+}
+
+/**
+ * Expression of the physical value, from the raw bits in raw
+ */
+static void gen_value(const gen_t *gen, char *buf, size_t size,
+                      const ocii_dbc_signal_t *signal, const gen_field_t *field,
+                      const char *raw, const char *name) {
+    char value[GEN_EXPR], factor[32], offset[32];
+    const char *type = gen_type(signal);
+    int floating = signal->value_type != ocii_dbc_integer;
+
+    if (floating && signal->length == 32)
+        (void)snprintf(value, sizeof(value),
+                       gen->cpp ? "detail::f32(static_cast<uint32_t>(%s))"
+                                : "ocii_dbcgen_f32((uint32_t)%s)",
+                       raw);
+    else if (floating)
+        (void)snprintf(value, sizeof(value),
+                       gen->cpp ? "detail::f64(%s)" : "ocii_dbcgen_f64(%s)",
+                       raw);
+    else if (field->sign != 0 && gen->cpp)
+        (void)snprintf(value, sizeof(value), "%s_field::value(le, be)", name);
+    else if (field->sign != 0)
+        (void)snprintf(value, sizeof(value),
+                       "(int64_t)((%s ^ 0x%llX%s) - 0x%llX%s)", raw,
+                       field->sign, gen_suffix(field->sign), field->sign,
+                       gen_suffix(field->sign));
+    else
+        (void)snprintf(value, sizeof(value), "%s", raw);
+
+    if (!gen_scaled(signal)) {
+        if (floating)
+            (void)snprintf(buf, size, "%s", value);
+        else
+            (void)snprintf(buf, size,
+                           gen->cpp ? "static_cast<%s>(%s)" : "(%s)%s", type,
+                           value);
+        return;
+    }
+
+    gen_double(factor, sizeof(factor), signal->factor);
+    gen_double(offset, sizeof(offset), signal->offset < 0 ? -signal->offset
+                                                           : signal->offset);
+    (void)snprintf(buf, size, gen->cpp ? "static_cast<double>(%s)%s%s%s%s"
+                                       : "(double)%s%s%s%s%s",
+                   value, signal->factor != 1.0 ? " * " : "",
+                   signal->factor != 1.0 ? factor : "",
+                   signal->offset == 0.0  ? ""
+                   : signal->offset < 0.0 ? " - "
+                                          : " + ",
+                   signal->offset != 0.0 ? offset : "");
+}
+
+/**
+ * Expression of the unsigned raw bits of a physical value in member
+ */
+static void gen_encode(const gen_t *gen, char *buf, size_t size,
+                       const ocii_dbc_signal_t *signal, const char *member) {
+    char scaled[GEN_EXPR], factor[32], offset[32];
+    int floating = signal->value_type != ocii_dbc_integer;
+
+    if (!gen_scaled(signal))
+        (void)snprintf(scaled, sizeof(scaled), "%s", member);
+    else {
+        gen_double(factor, sizeof(factor), signal->factor);
+        gen_double(offset, sizeof(offset), signal->offset < 0
+                                               ? -signal->offset
+                                               : signal->offset);
+        int group = signal->offset != 0.0 && signal->factor != 1.0;
+
+        (void)snprintf(scaled, sizeof(scaled), "%s%s%s%s%s%s%s",
+                       group ? "(" : "", member,
+                       signal->offset == 0.0  ? ""
+                       : signal->offset < 0.0 ? " + "
+                                              : " - ",
+                       signal->offset != 0.0 ? offset : "", group ? ")" : "",
+                       signal->factor != 1.0 ? " / " : "",
+                       signal->factor != 1.0 ? factor : "");
+    }
+
+    if (floating && signal->length == 32)
+        (void)snprintf(buf, size,
+                       gen->cpp ? "detail::f32_bits(static_cast<float>(%s))"
+                                : "(uint64_t)ocii_dbcgen_f32_bits((float)(%s))",
+                       scaled);
+    else if (floating)
+        (void)snprintf(buf, size,
+                       gen->cpp ? "detail::f64_bits(%s)"
+                                : "ocii_dbcgen_f64_bits(%s)",
+                       scaled);
+    else if (gen_scaled(signal))
+        (void)snprintf(buf, size,
+                       gen->cpp ? "static_cast<uint64_t>(detail::round(%s))"
+                                : "(uint64_t)ocii_dbcgen_round(%s)",
+                       scaled);
+    else
+        (void)snprintf(buf, size,
+                       gen->cpp ? "static_cast<uint64_t>(%s)" : "(uint64_t)%s",
+                       scaled);
+}
+
+/**
+ * Statement that ORs raw bits into their payload word
+ */
+static void gen_put(const gen_t *gen, const gen_field_t *field,
+                    const char *raw, const char *name) {
+    if (gen->cpp)
+        (void)fprintf(gen->out, "%s%s_field::put(le, be, %s);\n", gen->indent,
+                      name, raw);
+    else if (field->length == 64)
+        (void)fprintf(gen->out, "%s%s |= %s;\n", gen->indent, field->word, raw);
+    else if (field->shift == 0)
+        (void)fprintf(gen->out, "%s%s |= %s & 0x%llX%s;\n", gen->indent,
+                      field->word, raw, field->mask, gen_suffix(field->mask));
+    else
+        (void)fprintf(gen->out, "%s%s |= (%s & 0x%llX%s) << %u;\n",
+                      gen->indent, field->word, raw, field->mask,
+                      gen_suffix(field->mask), field->shift);
+}
+
+/**
+ * Acceptance code and mask of the SJA1000 style single filter. Standard IDs
+ * sit in bits 31 to 21, extended IDs in bits 31 to 3, set mask bits are
+ * "don't care". The mask is widened until it covers every given message
+ */
+static void gen_filter(const ocii_dbc_t *db, int only, uint32_t *acc_code,
+                       uint32_t *acc_mask) {
+    uint32_t code = 0, mask = 0;
+    int first = 1;
+
+    for (uint32_t m = 0; m < db->messages; m++) {
+        const ocii_dbc_message_t *message = &db->message[m];
+        uint32_t c, k;
+
+        if (only >= 0 && (uint32_t)only != m)
+            continue;
+
+        if (message->extended) {
+            c = message->can_id << 3;
+            k = 0x00000007U; /* RTR and unused bits */
+        } else {
+            c = message->can_id << 21;
+            k = 0x001FFFFFU; /* RTR and the first two data bytes */
+        }
+
+        if (first) {
+            code = c;
+            mask = k;
+            first = 0;
+        } else {
+            mask |= k | (code ^ c);
+        }
+    }
+
+    *acc_code = code & ~mask;
+    *acc_mask = first ? 0xFFFFFFFFU : mask;
+}
+
+static int gen_big_endian(const ocii_dbc_t *db,
+                          const ocii_dbc_message_t *message) {
+    (void)db;
+    return message->big_endian;
+}
+
+static int gen_little_endian(const ocii_dbc_t *db,
+                             const ocii_dbc_message_t *message) {
+    for (uint32_t s = message->first; s < message->first + message->count; s++)
+        if (!db->step[s].word)
+            return 1;
+
+    return 0;
+}
+
+static int gen_floating(const ocii_dbc_t *db,
+                        const ocii_dbc_message_t *message) {
+    for (uint32_t s = message->first; s < message->first + message->count; s++)
+        if (db->signal[s].value_type != ocii_dbc_integer)
+            return 1;
+
+    return 0;
+}
+
+/**
+ * Emits the signals of one message, the multiplexed ones grouped by their
+ * switch value. decode selects unpacking, otherwise packing is emitted
+ */
+static void gen_signals(const gen_t *gen, const ocii_dbc_message_t *message,
+                        int decode) {
+    const ocii_dbc_t *db = gen->db;
+    const char *target = gen->cpp ? (decode ? "out." : "")
+                                  : (decode ? "out->" : "in->");
+    char name[GEN_NAME], member[GEN_NAME + 8], raw[GEN_EXPR],
+        expr[GEN_EXPR * 2];
+    uint32_t first = message->first, last = first + message->count;
+
+    for (uint32_t s = first; s < last; s++) {
+        const ocii_dbc_signal_t *signal = &db->signal[s];
+        gen_field_t field = gen_field(db, s);
+
+        /**
+         * Plain signals first, then one block per switch value
+         */
+        if (signal->mux_value != OCII_DBC_NOT_MULTIPLEXED)
+            continue;
+
+        gen_case(name, signal->name, sizeof(name), 0);
+        if (decode) {
+            if ((int32_t)(s - first) == message->mux)
+                (void)snprintf(raw, sizeof(raw), "mux");
+            else
+                gen_raw(gen, raw, sizeof(raw), &field, name);
+            gen_value(gen, expr, sizeof(expr), signal, &field, raw, name);
+            (void)fprintf(gen->out, "%s%s%s = %s;\n", gen->indent, target,
+                          name, expr);
+        } else {
+            if ((int32_t)(s - first) == message->mux)
+                (void)snprintf(expr, sizeof(expr), "mux");
+            else {
+                (void)snprintf(member, sizeof(member), "%s%s", target, name);
+                gen_encode(gen, expr, sizeof(expr), signal, member);
+            }
+            gen_put(gen, &field, expr, name);
+        }
+    }
+
+    for (uint32_t s = first; s < last; s++) {
+        int32_t value = db->signal[s].mux_value;
+        int seen = 0;
+
+        if (value == OCII_DBC_NOT_MULTIPLEXED)
+            continue;
+        for (uint32_t t = first; t < s && !seen; t++)
+            seen = db->signal[t].mux_value == value;
+        if (seen)
+            continue;
+
+        (void)fprintf(gen->out, "%sif (mux == %dU) {\n", gen->indent, value);
+        for (uint32_t t = s; t < last; t++) {
+            const ocii_dbc_signal_t *signal = &db->signal[t];
+            gen_field_t field = gen_field(db, t);
+
+            if (signal->mux_value != value)
+                continue;
+
+            gen_case(name, signal->name, sizeof(name), 0);
+            (void)fputs("    ", gen->out);
+            if (decode) {
+                gen_raw(gen, raw, sizeof(raw), &field, name);
+                gen_value(gen, expr, sizeof(expr), signal, &field, raw, name);
+                (void)fprintf(gen->out, "%s%s%s = %s;\n", gen->indent, target,
+                              name, expr);
+            } else {
+                (void)snprintf(member, sizeof(member), "%s%s", target, name);
+                gen_encode(gen, expr, sizeof(expr), signal, member);
+                gen_put(gen, &field, expr, name);
+            }
+        }
+        (void)fprintf(gen->out, "%s}\n", gen->indent);
+    }
+}
+
+/**
+ * Declares the multiplexer value, both sides switch on its raw bits
+ */
+static void gen_mux(const gen_t *gen, const ocii_dbc_message_t *message,
+                    int decode) {
+    const ocii_dbc_signal_t *signal;
+    gen_field_t field;
+    char base[GEN_NAME], name[GEN_NAME + 8], raw[GEN_EXPR], expr[GEN_EXPR];
+
+    if (message->mux < 0)
+        return;
+
+    signal = &gen->db->signal[message->first + (uint32_t)message->mux];
+    field = gen_field(gen->db, message->first + (uint32_t)message->mux);
+    gen_case(base, signal->name, sizeof(base), 0);
+
+    if (decode) {
+        gen_raw(gen, raw, sizeof(raw), &field, base);
+        (void)fprintf(gen->out, "%sconst uint64_t mux = %s;\n", gen->indent,
+                      raw);
+        return;
+    }
+
+    (void)snprintf(name, sizeof(name), "%s%s", gen->cpp ? "" : "in->", base);
+    gen_encode(gen, expr, sizeof(expr), signal, name);
+    (void)fprintf(gen->out, "%sconst uint64_t mux = %s & 0x%llX%s;\n",
+                  gen->indent, expr, field.mask, gen_suffix(field.mask));
+}
+
+static void gen_members(const gen_t *gen, const ocii_dbc_message_t *message) {
+    char name[GEN_NAME];
+
+    for (uint32_t s = message->first; s < message->first + message->count;
+         s++) {
+        const ocii_dbc_signal_t *signal = &gen->db->signal[s];
+
+        gen_case(name, signal->name, sizeof(name), 0);
+        (void)fprintf(gen->out, "    %s %s%s;", gen_type(signal), name,
+                      gen->cpp ? "{}" : "");
+        if (signal->unit[0] != '\0' || signal->mux_value >= 0) {
+            (void)fputs(" /*", gen->out);
+            if (signal->unit[0] != '\0')
+                (void)fprintf(gen->out, " %s", signal->unit);
+            if (signal->mux_value >= 0)
+                (void)fprintf(gen->out, "%s only if %s is %d",
+                              signal->unit[0] != '\0' ? "," : "",
+                              gen->db->signal[message->first +
+                                              (uint32_t)message->mux]
+                                  .name,
+                              signal->mux_value);
+            (void)fputs(" */", gen->out);
+        }
+        (void)fputc('\n', gen->out);
+    }
+}
+
+/**
+ * C++ only, one field template per signal so that shift and mask can be used
+ * in constant expressions
+ */
+static void gen_fields(const gen_t *gen, const ocii_dbc_message_t *message) {
+    char name[GEN_NAME];
+
+    for (uint32_t s = message->first; s < message->first + message->count;
+         s++) {
+        gen_field_t field = gen_field(gen->db, s);
+
+        gen_case(name, gen->db->signal[s].name, sizeof(name), 0);
+        (void)fprintf(gen->out,
+                      "    using %s_field = detail::field<%s, %u, %u, %s>;\n",
+                      name, field.word[0] == 'b' ? "true" : "false",
+                      field.shift, field.length,
+                      field.sign != 0 ? "true" : "false");
+    }
+    if (message->count != 0)
+        (void)fputc('\n', gen->out);
+}
+
+static void gen_c_helpers(const gen_t *gen) {
+    (void)fputs(
+        "#ifndef OCII_DBCGEN_HELPERS\n"
+        "#define OCII_DBCGEN_HELPERS\n"
+        "\n"
+        "typedef struct {\n"
+        "    uint32_t acc_code;\n"
+        "    uint32_t acc_mask;\n"
+        "} ocii_dbcgen_filter_t;\n"
+        "\n"
+        "static inline uint64_t ocii_dbcgen_load_le(const uint8_t *p) {\n"
+        "    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 "
+        "|\n"
+        "           (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 |\n"
+        "           (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 |\n"
+        "           (uint64_t)p[7] << 56;\n"
+        "}\n"
+        "\n"
+        "static inline void ocii_dbcgen_store_le(uint8_t *p, uint64_t v) {\n"
+        "    for (int i = 0; i < 8; i++)\n"
+        "        p[i] = (uint8_t)(v >> (8 * i));\n"
+        "}\n"
+        "\n"
+        "static inline uint64_t ocii_dbcgen_bswap64(uint64_t v) {\n"
+        "    return __builtin_bswap64(v);\n"
+        "}\n"
+        "\n"
+        "static inline int64_t ocii_dbcgen_round(double v) {\n"
+        "    return (int64_t)(v < 0.0 ? v - 0.5 : v + 0.5);\n"
+        "}\n"
+        "\n"
+        "static inline float ocii_dbcgen_f32(uint32_t bits) {\n"
+        "    float value;\n"
+        "\n"
+        "    memcpy(&value, &bits, sizeof(value));\n"
+        "    return value;\n"
+        "}\n"
+        "\n"
+        "static inline uint32_t ocii_dbcgen_f32_bits(float value) {\n"
+        "    uint32_t bits;\n"
+        "\n"
+        "    memcpy(&bits, &value, sizeof(bits));\n"
+        "    return bits;\n"
+        "}\n"
+        "\n"
+        "static inline double ocii_dbcgen_f64(uint64_t bits) {\n"
+        "    double value;\n"
+        "\n"
+        "    memcpy(&value, &bits, sizeof(value));\n"
+        "    return value;\n"
+        "}\n"
+        "\n"
+        "static inline uint64_t ocii_dbcgen_f64_bits(double value) {\n"
+        "    uint64_t bits;\n"
+        "\n"
+        "    memcpy(&bits, &value, sizeof(bits));\n"
+        "    return bits;\n"
+        "}\n"
+        "\n"
+        "#endif /* OCII_DBCGEN_HELPERS */\n",
+        gen->out);
+}
+
+static void gen_c_message(const gen_t *gen, uint32_t m) {
+    const ocii_dbc_message_t *message = &gen->db->message[m];
+    char lower[GEN_NAME], upper[GEN_NAME];
+    int le = gen_little_endian(gen->db, message),
+        be = gen_big_endian(gen->db, message);
+
+    gen_case(lower, message->name, sizeof(lower), 0);
+    gen_case(upper, message->name, sizeof(upper), 1);
+
+    (void)fprintf(gen->out,
+                  "\n/**\n * %s, %s ID 0x%X, %u bytes\n */\n"
+                  "#define %s_%s_ID 0x%XU\n"
+                  "#define %s_%s_EXTENDED %u\n"
+                  "#define %s_%s_DLC %u\n\n",
+                  message->name, message->extended ? "extended" : "standard",
+                  message->can_id, message->dlc, gen->macro, upper,
+                  message->can_id, gen->macro, upper, message->extended,
+                  gen->macro, upper, message->dlc);
+
+    (void)fputs("typedef struct {\n", gen->out);
+    gen_members(gen, message);
+    (void)fprintf(gen->out, "} %s_%s_t;\n\n", gen->prefix, lower);
+
+    /**
+     * Unpack, multiplexed members of other switch values are left untouched
+     */
+    (void)fprintf(gen->out,
+                  "static inline void %s_%s_unpack(const ocii_message_t "
+                  "*frame,\n    %s_%s_t *out) {\n",
+                  gen->prefix, lower, gen->prefix, lower);
+    if (le || be)
+        (void)fprintf(gen->out,
+                      "    const uint64_t %s = ocii_dbcgen_load_le(frame->data);"
+                      "\n",
+                      le ? "le" : "raw");
+    if (be)
+        (void)fprintf(gen->out,
+                      "    const uint64_t be = ocii_dbcgen_bswap64(%s);\n",
+                      le ? "le" : "raw");
+    if (!le && !be)
+        (void)fputs("    (void)frame;\n    (void)out;\n", gen->out);
+    gen_mux(gen, message, 1);
+    if (message->count != 0)
+        (void)fputc('\n', gen->out);
+    gen_signals(gen, message, 1);
+    (void)fputs("}\n\n", gen->out);
+
+    (void)fprintf(gen->out,
+                  "static inline void %s_%s_pack(const %s_%s_t *in,\n"
+                  "    ocii_message_t *frame) {\n"
+                  "    uint64_t le = 0%s;\n",
+                  gen->prefix, lower, gen->prefix, lower, be ? ", be = 0" : "");
+    if (message->count == 0)
+        (void)fputs("    (void)in;\n", gen->out);
+    gen_mux(gen, message, 0);
+    (void)fputc('\n', gen->out);
+    gen_signals(gen, message, 0);
+    (void)fprintf(gen->out,
+                  "\n    frame->can_id = %s_%s_ID;\n"
+                  "    frame->remote = 0;\n"
+                  "    frame->extended = %s_%s_EXTENDED;\n"
+                  "    frame->data_len = %s_%s_DLC;\n"
+                  "    ocii_dbcgen_store_le(frame->data, le%s);\n}\n",
+                  gen->macro, upper, gen->macro, upper, gen->macro, upper,
+                  be ? " | ocii_dbcgen_bswap64(be)" : "");
+}
+
+static void gen_c(const gen_t *gen) {
+    const ocii_dbc_t *db = gen->db;
+    char lower[GEN_NAME];
+    uint32_t code, mask;
+
+    (void)fprintf(gen->out,
+                  "/**\n * Generated by ocii_dbcgen from %s, do not edit\n */\n"
+                  "\n#ifndef %s_dbc_h\n#define %s_dbc_h\n\n"
+                  "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n"
+                  "#include <opencanalystii.h>\n#include <stdint.h>\n"
+                  "#include <string.h>\n\n",
+                  gen->source, gen->prefix, gen->prefix);
+    gen_c_helpers(gen);
+
+    for (uint32_t m = 0; m < db->messages; m++)
+        gen_c_message(gen, m);
+
+    /**
+     * Dispatch by ID, the compiler turns the switch into a jump table or a
+     * binary search
+     */
+    (void)fputs("\n/**\n * Message indexes, as returned by the find function\n"
+                " */\nenum {\n",
+                gen->out);
+    for (uint32_t m = 0; m < db->messages; m++) {
+        gen_case(lower, db->message[m].name, sizeof(lower), 0);
+        (void)fprintf(gen->out, "    %s_%s_index,\n", gen->prefix, lower);
+    }
+    (void)fprintf(gen->out, "    %s_messages\n};\n\n", gen->prefix);
+
+    (void)fprintf(gen->out,
+                  "static inline int %s_find(uint32_t can_id, uint8_t "
+                  "extended) {\n"
+                  "    switch (extended ? can_id | 0x80000000U : can_id) {\n",
+                  gen->prefix);
+    for (uint32_t m = 0; m < db->messages; m++) {
+        gen_case(lower, db->message[m].name, sizeof(lower), 0);
+        (void)fprintf(gen->out, "    case 0x%XU:\n        return %s_%s_index;\n",
+                      db->message[m].can_id |
+                          (db->message[m].extended ? 0x80000000U : 0),
+                      gen->prefix, lower);
+    }
+    (void)fputs("    default:\n        return -1;\n    }\n}\n", gen->out);
+
+    gen_filter(db, -1, &code, &mask);
+    (void)fprintf(gen->out,
+                  "\n/**\n * Acceptance filters for ocii_init in single filter "
+                  "mode (filter = 1), set\n * mask bits are \"don't care\". "
+                  "ACC_CODE and ACC_MASK let every message of\n * the "
+                  "database through, the table holds one exact filter per "
+                  "message. The\n * hardware filter is coarse, frames still "
+                  "need to be checked with the find\n * function\n */\n"
+                  "#define %s_ACC_FILTER 1U\n"
+                  "#define %s_ACC_CODE 0x%08XU\n"
+                  "#define %s_ACC_MASK 0x%08XU\n\n"
+                  "static const ocii_dbcgen_filter_t %s_filter[] = {\n",
+                  gen->macro, gen->macro, code, gen->macro, mask, gen->prefix);
+    for (uint32_t m = 0; m < db->messages; m++) {
+        gen_filter(db, (int)m, &code, &mask);
+        (void)fprintf(gen->out, "    {0x%08XU, 0x%08XU}, /* %s */\n", code,
+                      mask, db->message[m].name);
+    }
+    if (db->messages == 0)
+        (void)fputs("    {0x00000000U, 0xFFFFFFFFU},\n", gen->out);
+    (void)fprintf(gen->out,
+                  "};\n\n#ifdef __cplusplus\n}\n#endif\n\n#endif /* %s_dbc_h "
+                  "*/\n",
+                  gen->prefix);
+}
+
+static void gen_cpp_message(const gen_t *gen, uint32_t m) {
+    const ocii_dbc_t *db = gen->db;
+    const ocii_dbc_message_t *message = &db->message[m];
+    char lower[GEN_NAME];
+    int be = gen_big_endian(db, message);
+    const char *qualifier =
+        gen_floating(db, message) ? "inline" : "constexpr";
+
+    gen_case(lower, message->name, sizeof(lower), 0);
+
+    (void)fprintf(gen->out,
+                  "\n/**\n * %s, %s ID 0x%X, %u bytes\n */\n"
+                  "struct %s {\n"
+                  "    static constexpr uint32_t id = 0x%XU;\n"
+                  "    static constexpr bool extended = %s;\n"
+                  "    static constexpr uint8_t dlc = %u;\n\n",
+                  message->name, message->extended ? "extended" : "standard",
+                  message->can_id, message->dlc, lower, message->can_id,
+                  message->extended ? "true" : "false", message->dlc);
+    gen_fields(gen, message);
+    gen_members(gen, message);
+
+    /**
+     * decode and encode work on the payload words and are constexpr unless
+     * the message carries IEEE 754 signals
+     */
+    (void)fprintf(gen->out,
+                  "\n    static %s %s decode(uint64_t%s, uint64_t%s) {\n"
+                  "        %s out{};\n\n",
+                  qualifier, lower, message->count != 0 ? " le" : "",
+                  message->count != 0 ? " be" : "", lower);
+    gen_mux(gen, message, 1);
+    gen_signals(gen, message, 1);
+    (void)fputs("        return out;\n    }\n", gen->out);
+
+    (void)fprintf(gen->out,
+                  "\n    %s uint64_t encode() const {\n"
+                  "        uint64_t le = 0, be = 0;\n\n",
+                  qualifier);
+    gen_mux(gen, message, 0);
+    gen_signals(gen, message, 0);
+    (void)fprintf(gen->out, "        return le%s;\n    }\n",
+                  be ? " | detail::bswap64(be)" : "");
+
+    (void)fprintf(gen->out,
+                  "\n    static inline %s unpack(const ocii_message_t &frame) {\n"
+                  "        const uint64_t le = detail::load_le(frame.data);\n\n"
+                  "        return decode(le, detail::bswap64(le));\n"
+                  "    }\n\n"
+                  "    inline void pack(ocii_message_t &frame) const {\n"
+                  "        frame.can_id = id;\n"
+                  "        frame.remote = 0;\n"
+                  "        frame.extended = extended;\n"
+                  "        frame.data_len = dlc;\n"
+                  "        detail::store_le(frame.data, encode());\n"
+                  "    }\n};\n",
+                  lower);
+}
+
+static void gen_cpp(const gen_t *gen) {
+    const ocii_dbc_t *db = gen->db;
+    char lower[GEN_NAME];
+    uint32_t code, mask;
+
+    (void)fprintf(
+        gen->out,
+        "/**\n * Generated by ocii_dbcgen from %s, do not edit. Needs C++14\n"
+        " */\n\n#ifndef %s_dbc_hpp\n#define %s_dbc_hpp\n\n"
+        "#include <cstdint>\n#include <cstring>\n#include <opencanalystii.h>\n"
+        "\nnamespace %s {\n\nnamespace detail {\n\n"
+        "constexpr uint64_t load_le(const uint8_t *p) {\n"
+        "    return uint64_t{p[0]} | uint64_t{p[1]} << 8 | uint64_t{p[2]} << 16 "
+        "|\n"
+        "           uint64_t{p[3]} << 24 | uint64_t{p[4]} << 32 |\n"
+        "           uint64_t{p[5]} << 40 | uint64_t{p[6]} << 48 |\n"
+        "           uint64_t{p[7]} << 56;\n}\n\n"
+        "inline void store_le(uint8_t *p, uint64_t v) {\n"
+        "    for (int i = 0; i < 8; i++)\n"
+        "        p[i] = static_cast<uint8_t>(v >> (8 * i));\n}\n\n"
+        "constexpr uint64_t bswap64(uint64_t v) { return "
+        "__builtin_bswap64(v); }\n\n"
+        "constexpr int64_t round(double v) {\n"
+        "    return static_cast<int64_t>(v < 0.0 ? v - 0.5 : v + 0.5);\n}\n\n"
+        "inline float f32(uint32_t bits) {\n    float value;\n\n"
+        "    std::memcpy(&value, &bits, sizeof(value));\n    return value;\n}\n\n"
+        "inline uint32_t f32_bits(float value) {\n    uint32_t bits;\n\n"
+        "    std::memcpy(&bits, &value, sizeof(bits));\n    return bits;\n}\n\n"
+        "inline double f64(uint64_t bits) {\n    double value;\n\n"
+        "    std::memcpy(&value, &bits, sizeof(value));\n    return value;\n}\n\n"
+        "inline uint64_t f64_bits(double value) {\n    uint64_t bits;\n\n"
+        "    std::memcpy(&bits, &value, sizeof(bits));\n    return bits;\n}\n\n"
+        "template <bool BigEndian, unsigned Shift, unsigned Length, bool Signed>\n"
+        "struct field {\n"
+        "    static_assert(Length >= 1 && Shift + Length <= 64, \"bad field\");\n"
+        "\n"
+        "    static constexpr unsigned shift = Shift;\n"
+        "    static constexpr unsigned length = Length;\n"
+        "    static constexpr uint64_t mask = ~uint64_t{0} >> (64 - Length);\n"
+        "    static constexpr uint64_t sign =\n"
+        "        Signed ? uint64_t{1} << (Length - 1) : uint64_t{0};\n\n"
+        "    static constexpr uint64_t raw(uint64_t le, uint64_t be) {\n"
+        "        return ((BigEndian ? be : le) >> Shift) & mask;\n    }\n\n"
+        "    static constexpr int64_t value(uint64_t le, uint64_t be) {\n"
+        "        return static_cast<int64_t>((raw(le, be) ^ sign) - sign);\n"
+        "    }\n\n"
+        "    static constexpr void put(uint64_t &le, uint64_t &be, uint64_t "
+        "bits) {\n"
+        "        (BigEndian ? be : le) |= (bits & mask) << Shift;\n    }\n"
+        "};\n\n"
+        "} // namespace detail\n",
+        gen->source, gen->prefix, gen->prefix, gen->prefix);
+
+    for (uint32_t m = 0; m < db->messages; m++)
+        gen_cpp_message(gen, m);
+
+    /**
+     * Visitor based dispatch, visit is called with the decoded message struct
+     */
+    (void)fputs("\ntemplate <typename Visitor>\n"
+                "inline bool dispatch(const ocii_message_t &frame, Visitor "
+                "&&visit) {\n"
+                "    switch (frame.extended ? frame.can_id | 0x80000000U : "
+                "frame.can_id) {\n",
+                gen->out);
+    for (uint32_t m = 0; m < db->messages; m++) {
+        gen_case(lower, db->message[m].name, sizeof(lower), 0);
+        (void)fprintf(gen->out,
+                      "    case 0x%XU:\n        visit(%s::unpack(frame));\n"
+                      "        return true;\n",
+                      db->message[m].can_id |
+                          (db->message[m].extended ? 0x80000000U : 0),
+                      lower);
+    }
+    (void)fputs("    default:\n        return false;\n    }\n}\n", gen->out);
+
+    gen_filter(db, -1, &code, &mask);
+    (void)fprintf(gen->out,
+                  "\n/**\n * Acceptance filters for ocii_init in single filter "
+                  "mode (filter = 1), see\n * the C output for the details\n"
+                  " */\nstruct filter {\n    uint32_t acc_code;\n"
+                  "    uint32_t acc_mask;\n};\n\n"
+                  "constexpr uint32_t acc_filter = 1U;\n"
+                  "constexpr filter acceptance = {0x%08XU, 0x%08XU};\n\n"
+                  "constexpr filter filters[] = {\n",
+                  code, mask);
+    for (uint32_t m = 0; m < db->messages; m++) {
+        gen_filter(db, (int)m, &code, &mask);
+        (void)fprintf(gen->out, "    {0x%08XU, 0x%08XU}, // %s\n", code, mask,
+                      db->message[m].name);
+    }
+    if (db->messages == 0)
+        (void)fputs("    {0x00000000U, 0xFFFFFFFFU},\n", gen->out);
+    (void)fprintf(gen->out,
+                  "};\n\n} // namespace %s\n\n#endif /* %s_dbc_hpp */\n",
+                  gen->prefix, gen->prefix);
+}
+
+int main(int argc, char *argv[]) {
+    gen_t gen = {0};
+    const char *prefix = NULL, *base;
+    ocii_dbc_t *db = NULL;
+    uint32_t line = 0;
+    int option, error_code, ret = EXIT_FAILURE;
+
+    while ((option = getopt(argc, argv, "xp:")) != -1) {
+        switch (option) {
+        case 'x':
+            gen.cpp = 1;
+            break;
+        case 'p':
+            prefix = optarg;
+            break;
+        default:
+            goto usage;
+        }
+    }
+
+    if (optind >= argc || argc - optind > 2)
+        goto usage;
+
+    gen.source = argv[optind];
+    if ((base = strrchr(gen.source, '/')) != NULL)
+        base++;
+    else
+        base = gen.source;
+
+    gen_case(gen.prefix, prefix != NULL ? prefix : base, sizeof(gen.prefix), 0);
+    if (prefix == NULL && strrchr(base, '.') != NULL &&
+        (size_t)(strrchr(base, '.') - base) < sizeof(gen.prefix))
+        gen.prefix[strrchr(base, '.') - base] = '\0';
+    gen_case(gen.macro, gen.prefix, sizeof(gen.macro), 1);
+    gen.indent = gen.cpp ? "        " : "    ";
+
+    if ((error_code = ocii_dbc_load(gen.source, &db, &line)) !=
+        OCII_ERROR_NO_ERROR) {
+        if (line != 0)
+            (void)fprintf(stderr, "%s:%u: %s\n", gen.source, line,
+                          ocii_error_code_to_string(error_code));
+        else
+            (void)fprintf(stderr, "%s: %s\n", gen.source,
+                          ocii_error_code_to_string(error_code));
+        return EXIT_FAILURE;
+    }
+    gen.db = db;
+
+    gen.out = argc - optind == 2 ? fopen(argv[optind + 1], "w") : stdout;
+    if (gen.out == NULL) {
+        (void)fprintf(stderr, "%s: %s\n", argv[optind + 1],
+                      ocii_error_code_to_string(OCII_ERROR_FILE));
+        goto exit;
+    }
+
+    if (gen.cpp)
+        gen_cpp(&gen);
+    else
+        gen_c(&gen);
+
+    ret = ferror(gen.out) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (gen.out != stdout && fclose(gen.out) != 0)
+        ret = EXIT_FAILURE;
+
+exit:
+    ocii_dbc_free(db);
+    return ret;
+
+usage:
+    (void)fprintf(stderr, "usage: %s [-x] [-p prefix] input.dbc [output]\n",
+                  argv[0]);
+    return EXIT_FAILURE;
+}